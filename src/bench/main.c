@@ -0,0 +1,748 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2014 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * darktable-bench runs the cpu process() of every image operation with its
+ * default parameters on buffers of a few sizes and thread counts, and prints
+ * the throughput. there is no gui and the library lives in memory.
+ *
+ * the input is a synthetic raw, and additionally a real one if --image is
+ * given. every module sees the pixel format it gets in the real pipe: the
+ * mosaic as uint16 or float before demosaic, rgb float after it. for the real
+ * raw, the rgb buffers are made of the mosaic's 2x2 quads, which is not a
+ * demosaic but keeps the noise and the edges of the image.
+ */
+
+#include "common/darktable.h"
+#include "common/film.h"
+#include "common/image.h"
+#include "common/image_cache.h"
+#include "common/interpolation.h"
+#include "common/mipmap_cache.h"
+#include "develop/blend.h"
+#include "develop/develop.h"
+#include "develop/imageop.h"
+#include "develop/pixelpipe.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// a raw source all the input buffers are cut from, in raw units
+typedef struct dt_bench_source_t
+{
+  const char *name;
+  float *mosaic;
+  int width, height;
+  uint32_t filters;
+  float white;
+}
+dt_bench_source_t;
+
+typedef struct dt_bench_options_t
+{
+  gchar **modules;
+  int sizes[16], num_sizes;
+  int threads[16], num_threads;
+  int runs;
+  int blend;
+  int resample;
+}
+dt_bench_options_t;
+
+static void
+usage(const char* progname)
+{
+  fprintf(stderr, "usage: %s [--modules <op,...>] [--sizes <width,...>] [--threads <n,...>] [--runs <n>] [--image <raw file>] [--blend] [--resample] [--core <darktable options>]\n", progname);
+  fprintf(stderr, "\n"
+          "runs the process() function of every image operation (or the given ones) with default\n"
+          "parameters on a synthetic raw, and on the given raw file, for all output widths (3:2 images)\n"
+          "and thread counts. prints MPix/s of output and the speedup over the first thread count.\n"
+          "with --blend, the blend modes and the conditional mask are run instead, plain c against sse2,\n"
+          "single threaded. fails if the results differ by more than rounding.\n"
+          "with --resample, all interpolators are run at a few scales, the direct resampler against the\n"
+          "separable one, with all threads. fails the same way.\n");
+}
+
+static inline int
+FC(const int row, const int col, const unsigned int filters)
+{
+  return filters >> ((((row) << 1 & 14) + ((col) & 1)) << 1) & 3;
+}
+
+// parses a comma separated list of positive numbers, returns their count
+static int
+parse_list(const char *str, int *list, const int max)
+{
+  int num = 0;
+  gchar **tokens = g_strsplit(str, ",", -1);
+  for(gchar **t = tokens; *t && num < max; t++)
+  {
+    const int value = atoi(*t);
+    if(value > 0) list[num++] = value;
+  }
+  g_strfreev(tokens);
+  return num;
+}
+
+// something raw-like: smooth gradients, hard edges, fine texture and shot noise on an rggb mosaic.
+static void
+synthetic_source(dt_bench_source_t *src, const int width, const int height)
+{
+  src->name = "synthetic";
+  src->width = width;
+  src->height = height;
+  src->filters = 0x94949494u;
+  src->white = 16383.0f;
+  src->mosaic = (float *)dt_alloc_align(64, sizeof(float)*width*height);
+  unsigned int seed = 42;
+  for(int j=0; j<height; j++) for(int i=0; i<width; i++)
+    {
+      const float x = i/(float)width, y = j/(float)height;
+      float rgb[3] = { x, y, 0.5f + 0.5f*sinf(20.0f*x*y) };
+      if(((i/37) ^ (j/53)) & 1) rgb[0] = 1.0f - rgb[0];
+      if(((i/3) + (j/3)) & 1) rgb[2] *= 0.8f;
+      const float v = 0.05f + 0.85f*rgb[FC(j, i, src->filters)];
+      const float noise = ((rand_r(&seed) & 0xffff)/65535.0f - 0.5f)*sqrtf(v)*0.05f;
+      src->mosaic[j*width + i] = CLAMP(v + noise, 0.0f, 1.0f)*src->white;
+    }
+}
+
+// the full raw of an imported image, needs a mosaic.
+static int
+raw_source(dt_bench_source_t *src, const dt_mipmap_buffer_t *buf, const dt_image_t *img)
+{
+  if(!img->filters || (img->bpp != sizeof(uint16_t) && img->bpp != sizeof(float))) return 1;
+  src->name = "raw";
+  // cut to even dimensions, so the wrap around in fill_input() keeps the cfa pattern:
+  src->width = buf->width & ~1;
+  src->height = buf->height & ~1;
+  src->filters = img->filters;
+  src->white = 0.0f;
+  src->mosaic = (float *)dt_alloc_align(64, sizeof(float)*src->width*src->height);
+  for(int j=0; j<src->height; j++) for(int i=0; i<src->width; i++)
+    {
+      const size_t k = (size_t)j*buf->width + i;
+      const float v = img->bpp == sizeof(float) ? ((const float *)buf->buf)[k] : ((const uint16_t *)buf->buf)[k];
+      src->mosaic[(size_t)j*src->width + i] = v;
+      src->white = MAX(src->white, v);
+    }
+  if(src->white <= 0.0f) src->white = 1.0f;
+  return 0;
+}
+
+// cuts the centre of the source to the roi, in the layout the module expects. returns non-zero for unknown formats.
+static int
+fill_input(const dt_bench_source_t *src, void *buf, const int bpp, const dt_iop_roi_t *roi)
+{
+  const int ox = ((src->width - roi->width)/2) & ~1, oy = ((src->height - roi->height)/2) & ~1;
+  const int x0 = MAX(ox, 0), y0 = MAX(oy, 0);
+  if(bpp != sizeof(uint16_t) && bpp != sizeof(float) && bpp != 4*sizeof(float)) return 1;
+#ifdef _OPENMP
+  #pragma omp parallel for schedule(static)
+#endif
+  for(int j=0; j<roi->height; j++)
+  {
+    const int sj = (y0 + j) % src->height;
+    const float *row = src->mosaic + (size_t)sj*src->width;
+    for(int i=0; i<roi->width; i++)
+    {
+      const int si = (x0 + i) % src->width;
+      const size_t k = (size_t)j*roi->width + i;
+      if(bpp == sizeof(uint16_t))
+        ((uint16_t *)buf)[k] = CLAMP(row[si], 0.0f, 65535.0f);
+      else if(bpp == sizeof(float))
+        ((float *)buf)[k] = row[si]/src->white;
+      else
+      {
+        // collapse the 2x2 quad around the pixel:
+        float rgb[4] = { 0.0f, 0.0f, 0.0f, 0.0f }, cnt[3] = { 0.0f, 0.0f, 0.0f };
+        const int qj = sj & ~1, qi = si & ~1;
+        for(int jj=qj; jj<qj+2; jj++) for(int ii=qi; ii<qi+2; ii++)
+          {
+            const int c = FC(jj, ii, src->filters) & 3;
+            const int cc = c == 3 ? 1 : c;
+            rgb[cc] += src->mosaic[(size_t)jj*src->width + ii];
+            cnt[cc] += 1.0f;
+          }
+        for(int c=0; c<3; c++) ((float *)buf)[4*k+c] = cnt[c] > 0.0f ? rgb[c]/(cnt[c]*src->white) : 0.0f;
+        ((float *)buf)[4*k+3] = 0.0f;
+      }
+    }
+  }
+  return 0;
+}
+
+static int
+module_selected(const dt_bench_options_t *opt, const dt_iop_module_t *module)
+{
+  if(!opt->modules) return 1;
+  for(gchar **m = opt->modules; *m; m++)
+    if(!strcmp(*m, module->op)) return 1;
+  return 0;
+}
+
+static const char *
+bpp_name(const int bpp)
+{
+  switch(bpp)
+  {
+    case sizeof(uint16_t):
+      return "raw16";
+    case sizeof(float):
+      return "rawf";
+    case 4*sizeof(float):
+      return "rgbf";
+    default:
+      return "?";
+  }
+}
+
+// benchmarks all modules of dev, which has the image of src loaded.
+static void
+bench_source(dt_develop_t *dev, const dt_bench_source_t *src, const dt_bench_options_t *opt)
+{
+  dt_dev_pixelpipe_t pipe;
+  // only the cache is sized by this, we never run the pipe itself:
+  if(!dt_dev_pixelpipe_init_export(&pipe, 16, 16, IMAGEIO_RGB | IMAGEIO_FLOAT))
+  {
+    fprintf(stderr, "[bench] could not init the pixelpipe\n");
+    return;
+  }
+  dt_dev_pixelpipe_set_input(&pipe, dev, NULL, src->width, src->height, 1.0f);
+  // instantiates the pieces with the default parameters:
+  dt_dev_pixelpipe_create_nodes(&pipe, dev);
+
+  // the pixel format passed on by the modules enabled by default:
+  int bpp = (dev->image_storage.flags & DT_IMAGE_RAW) ? dev->image_storage.bpp : 4*sizeof(float);
+
+  GList *modules = dev->iop;
+  GList *pieces = pipe.nodes;
+  for(; modules && pieces; modules = g_list_next(modules), pieces = g_list_next(pieces))
+  {
+    dt_iop_module_t *module = (dt_iop_module_t *)modules->data;
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)pieces->data;
+    const int in_bpp = bpp;
+    const int out_bpp = module->output_bpp(module, &pipe, piece);
+    if(piece->enabled) bpp = out_bpp;
+    if(!module_selected(opt, module)) continue;
+
+    for(int s=0; s<opt->num_sizes; s++)
+    {
+      dt_iop_roi_t roi_out = (dt_iop_roi_t)
+      {
+        0, 0, opt->sizes[s] & ~1, (opt->sizes[s]*2/3) & ~1, 1.0f
+      };
+      dt_iop_roi_t roi_in = roi_out;
+      module->modify_roi_in(module, piece, &roi_out, &roi_in);
+      piece->buf_in = roi_in;
+      piece->buf_out = roi_out;
+
+      void *input = dt_alloc_align(64, (size_t)in_bpp*roi_in.width*roi_in.height);
+      void *output = dt_alloc_align(64, (size_t)out_bpp*roi_out.width*roi_out.height);
+      if(!input || !output || fill_input(src, input, in_bpp, &roi_in))
+      {
+        fprintf(stderr, "[bench] skipping `%s' at %dx%d, input %s\n", module->op, roi_out.width, roi_out.height, bpp_name(in_bpp));
+        free(input);
+        free(output);
+        break;
+      }
+
+      const double mpix = roi_out.width*(double)roi_out.height*1e-6;
+      double base = 0.0;
+      for(int t=0; t<opt->num_threads; t++)
+      {
+#ifdef _OPENMP
+        omp_set_num_threads(opt->threads[t]);
+#endif
+        for(int k=0; k<3; k++) pipe.processed_maximum[k] = 1.0f;
+        // one run to warm up the caches and let modules allocate, then keep the fastest:
+        module->process(module, piece, input, output, &roi_in, &roi_out);
+        double best = INFINITY;
+        for(int r=0; r<opt->runs; r++)
+        {
+          const double start = dt_get_wtime();
+          module->process(module, piece, input, output, &roi_in, &roi_out);
+          best = MIN(best, dt_get_wtime() - start);
+        }
+        const double rate = mpix/MAX(best, 1e-9);
+        if(t == 0) base = rate;
+        printf("%-10s %-18s %-6s %5dx%-5d %3d %10.2f %8.2f\n", src->name, module->op, bpp_name(in_bpp),
+               roi_out.width, roi_out.height, opt->threads[t], rate, rate/base);
+        fflush(stdout);
+      }
+      free(input);
+      free(output);
+    }
+  }
+#ifdef _OPENMP
+  omp_set_num_threads(dt_get_num_threads());
+#endif
+  dt_dev_pixelpipe_cleanup(&pipe);
+}
+
+static const struct
+{
+  unsigned int mode;
+  const char *name;
+}
+blend_modes[] =
+{
+  { DEVELOP_BLEND_NORMAL2, "normal" },
+  { DEVELOP_BLEND_BOUNDED, "normal bounded" },
+  { DEVELOP_BLEND_LIGHTEN, "lighten" },
+  { DEVELOP_BLEND_DARKEN, "darken" },
+  { DEVELOP_BLEND_MULTIPLY, "multiply" },
+  { DEVELOP_BLEND_AVERAGE, "average" },
+  { DEVELOP_BLEND_ADD, "add" },
+  { DEVELOP_BLEND_SUBSTRACT, "substract" },
+  { DEVELOP_BLEND_DIFFERENCE, "difference" },
+  { DEVELOP_BLEND_DIFFERENCE2, "difference2" },
+  { DEVELOP_BLEND_SCREEN, "screen" },
+  { DEVELOP_BLEND_OVERLAY, "overlay" },
+  { DEVELOP_BLEND_SOFTLIGHT, "softlight" },
+  { DEVELOP_BLEND_HARDLIGHT, "hardlight" },
+  { DEVELOP_BLEND_VIVIDLIGHT, "vividlight" },
+  { DEVELOP_BLEND_LINEARLIGHT, "linearlight" },
+  { DEVELOP_BLEND_PINLIGHT, "pinlight" },
+  { DEVELOP_BLEND_LIGHTNESS, "lightness" },
+  { DEVELOP_BLEND_CHROMA, "chroma" },
+  { DEVELOP_BLEND_HUE, "hue" },
+  { DEVELOP_BLEND_COLOR, "color" },
+  { DEVELOP_BLEND_COLORADJUST, "coloradjust" },
+  { DEVELOP_BLEND_INVERSE, "inverse" },
+  { DEVELOP_BLEND_LAB_LIGHTNESS, "Lab lightness" },
+  { DEVELOP_BLEND_LAB_COLOR, "Lab color" },
+};
+
+static inline float
+random_float(unsigned int *seed, const float min, const float max)
+{
+  return min + (max - min)*(rand_r(seed) & 0xffff)/65535.0f;
+}
+
+// largest deviation of res from ref, relative above 1
+static float
+max_error(const float *ref, const float *res, const size_t num)
+{
+  float error = 0.0f;
+  for(size_t k=0; k<num; k++) error = fmaxf(error, fabsf(ref[k] - res[k])/(1.0f + fabsf(ref[k])));
+  return error;
+}
+
+// pixels a bit outside the channel range, so clamping gets tested too
+static void
+blend_fill(dt_iop_colorspace_type_t cst, float *buf, const size_t num, unsigned int *seed)
+{
+  for(size_t k=0; k<num; k+=4)
+  {
+    if(cst == iop_cs_Lab)
+    {
+      buf[k+0] = random_float(seed, -5.0f, 105.0f);
+      buf[k+1] = random_float(seed, -140.0f, 140.0f);
+      buf[k+2] = random_float(seed, -140.0f, 140.0f);
+    }
+    else
+      for(int c=0; c<3; c++) buf[k+c] = random_float(seed, -0.05f, 1.05f);
+    buf[k+3] = random_float(seed, cst == iop_cs_RAW ? -0.05f : 0.0f, cst == iop_cs_RAW ? 1.05f : 1.0f);
+  }
+}
+
+// runs all blend modes and the conditional mask, plain c and sse2, on random pixels. prints MPix/s of both
+// and the largest deviation, returns the number of modes where the sse2 code is off by more than rounding.
+static int
+blend_bench(const int width, const int height, const int runs)
+{
+  // the sse2 code only rounds differently:
+  const float tolerance = 1e-4f;
+  const size_t num = (size_t)4*width*height;
+  float *a = dt_alloc_align(64, num*sizeof(float));
+  float *b = dt_alloc_align(64, num*sizeof(float));
+  float *out[2] = { dt_alloc_align(64, num*sizeof(float)), dt_alloc_align(64, num*sizeof(float)) };
+  float *mask = dt_alloc_align(64, (size_t)width*height*sizeof(float));
+  float *m[2] = { dt_alloc_align(64, (size_t)width*height*sizeof(float)), dt_alloc_align(64, (size_t)width*height*sizeof(float)) };
+  int failed = 0;
+  if(!a || !b || !out[0] || !out[1] || !mask || !m[0] || !m[1])
+  {
+    fprintf(stderr, "[bench] could not allocate buffers\n");
+    failed = 1;
+    goto error;
+  }
+
+  const dt_iop_colorspace_type_t spaces[3] = { iop_cs_Lab, iop_cs_rgb, iop_cs_RAW };
+  const char *space_names[3] = { "Lab", "rgb", "raw" };
+  unsigned int seed = 42;
+
+  printf("%-4s %-16s %4s %12s %12s %8s %10s\n", "# cs", "mode", "flag", "c MPix/s", "sse2 MPix/s", "speedup", "max error");
+  for(int c=0; c<3; c++)
+  {
+    const dt_iop_colorspace_type_t cst = spaces[c];
+    const size_t size = (size_t)(cst == iop_cs_RAW ? 1 : 4)*width*height;
+    blend_fill(cst, a, num, &seed);
+    blend_fill(cst, b, num, &seed);
+    for(size_t k=0; k<(size_t)width*height; k++) mask[k] = random_float(&seed, 0.0f, 1.0f);
+
+    for(int n=0; n<(int)(sizeof(blend_modes)/sizeof(blend_modes[0])); n++)
+      for(int flag=0; flag<=(cst == iop_cs_Lab ? 1 : 0); flag++)
+      {
+        double time[2];
+        for(int v=0; v<2; v++)
+        {
+          time[v] = INFINITY;
+          for(int r=0; r<runs; r++)
+          {
+            memcpy(out[v], b, num*sizeof(float));
+            const double start = dt_get_wtime();
+            dt_develop_blend_rows(blend_modes[n].mode, v, cst, a, out[v], mask, width, height, flag);
+            time[v] = MIN(time[v], dt_get_wtime() - start);
+          }
+        }
+        const float error = max_error(out[0], out[1], size);
+        if(error > tolerance) failed++;
+        printf("%-4s %-16s %4d %12.1f %12.1f %8.2f %10.2g%s\n", space_names[c], blend_modes[n].name, flag,
+               width*height/time[0]*1e-6, width*height/time[1]*1e-6, time[0]/time[1], error,
+               error > tolerance ? " FAILED" : "");
+      }
+
+    if(cst == iop_cs_RAW) continue;
+
+    // conditional blending, all channels with soft edges, one inverted, once more with lch/hsl
+    float parameters[4*DEVELOP_BLENDIF_SIZE];
+    for(int k=0; k<DEVELOP_BLENDIF_SIZE; k++)
+    {
+      parameters[4*k+0] = 0.05f + 0.01f*k;
+      parameters[4*k+1] = 0.25f;
+      parameters[4*k+2] = 0.7f;
+      parameters[4*k+3] = 0.95f - 0.01f*k;
+    }
+    const unsigned int channels = cst == iop_cs_Lab ? DEVELOP_BLENDIF_Lab_MASK : DEVELOP_BLENDIF_RGB_MASK;
+    const unsigned int blendifs[2] = { (channels & 0xff) | (1<<(DEVELOP_BLENDIF_A_in+16)), channels | (1<<(DEVELOP_BLENDIF_A_in+16)) };
+    const unsigned int combines[2] = { DEVELOP_COMBINE_NORM_EXCL, DEVELOP_COMBINE_INV_INCL };
+    for(int n=0; n<2; n++)
+      for(int k=0; k<2; k++)
+      {
+        const unsigned int mask_mode = DEVELOP_MASK_ENABLED | DEVELOP_MASK_CONDITIONAL;
+        double time[2];
+        for(int v=0; v<2; v++)
+        {
+          time[v] = INFINITY;
+          for(int r=0; r<runs; r++)
+          {
+            memcpy(m[v], mask, (size_t)width*height*sizeof(float));
+            const double start = dt_get_wtime();
+            dt_develop_blend_make_mask_rows(v, cst, blendifs[n], parameters, mask_mode, combines[k], 0.8f, a, b, m[v],
+                                            width, height);
+            time[v] = MIN(time[v], dt_get_wtime() - start);
+          }
+        }
+        // the plain c code stops multiplying once the mask is below 1e-6
+        const float error = max_error(m[0], m[1], (size_t)width*height);
+        if(error > tolerance) failed++;
+        printf("%-4s %-16s %4d %12.1f %12.1f %8.2f %10.2g%s\n", space_names[c], n ? "mask lch/hsl" : "mask", k,
+               width*height/time[0]*1e-6, width*height/time[1]*1e-6, time[0]/time[1], error,
+               error > tolerance ? " FAILED" : "");
+      }
+  }
+
+error:
+  free(a);
+  free(b);
+  free(out[0]);
+  free(out[1]);
+  free(mask);
+  free(m[0]);
+  free(m[1]);
+  return failed;
+}
+
+// smooth gradients, hard edges and some noise, rgb
+static void
+resample_fill(float *buf, const int width, const int height)
+{
+  unsigned int seed = 42;
+  for(int j=0; j<height; j++)
+    for(int i=0; i<width; i++)
+    {
+      float *px = buf + (size_t)4*((size_t)j*width + i);
+      const float x = i/(float)width, y = j/(float)height;
+      const float edge = (((i/29) ^ (j/41)) & 1) ? 0.3f : 0.0f;
+      for(int c=0; c<3; c++) px[c] = 0.2f*c + 0.3f*x + 0.2f*y + edge + 0.05f*(rand_r(&seed)/(float)RAND_MAX);
+      px[3] = 0.0f;
+    }
+}
+
+// runs all interpolators at a few scales, with the direct and the separable resampler. prints MPix/s of both,
+// the time to make the plans and the largest deviation, returns the number of cases where the two are off by
+// more than rounding.
+static int
+resample_bench(const int width, const int height, const int runs)
+{
+  // both ways only sum up in a different order
+  const float tolerance = 1e-4f;
+  const float scales[] = { 0.5f, 0.23f, 2.0f };
+  const int nscales = sizeof(scales)/sizeof(scales[0]);
+  const int32_t stride = 4*sizeof(float)*width;
+  float *in = dt_alloc_align(64, (size_t)stride*height);
+  float *out[2] = { dt_alloc_align(64, (size_t)stride*height), dt_alloc_align(64, (size_t)stride*height) };
+  int failed = 0;
+  if(!in || !out[0] || !out[1])
+  {
+    fprintf(stderr, "[bench] could not allocate buffers\n");
+    failed = 1;
+    goto error;
+  }
+  resample_fill(in, width, height);
+
+  printf("%-10s %6s %11s %12s %12s %8s %10s %10s\n", "# itor", "scale", "size", "direct MP/s", "separ. MP/s", "speedup", "plan us", "max error");
+  for(int t=DT_INTERPOLATION_FIRST; t<DT_INTERPOLATION_LAST; t++)
+  {
+    const struct dt_interpolation *itor = dt_interpolation_new(t);
+    for(int n=0; n<nscales; n++)
+    {
+      // upscaling shows the centre, as the darkroom does when zoomed in
+      const float scale = scales[n];
+      const dt_iop_roi_t roi_in = { 0, 0, width, height, 1.0f };
+      dt_iop_roi_t roi_out = { 0, 0, MIN(width, (int)(width*scale)), MIN(height, (int)(height*scale)), scale };
+      roi_out.x = MAX(0, (int)(width*scale) - roi_out.width)/2;
+      roi_out.y = MAX(0, (int)(height*scale) - roi_out.height)/2;
+
+      // with an empty plan cache, what every call paid before plans were cached
+      double cold = INFINITY;
+      for(int r=0; r<runs; r++)
+      {
+        dt_interpolation_cleanup();
+        dt_interpolation_init();
+        const double start = dt_get_wtime();
+        dt_interpolation_resample(itor, out[1], &roi_out, stride, in, &roi_in, stride);
+        cold = MIN(cold, dt_get_wtime() - start);
+      }
+
+      double time[2];
+      for(int v=0; v<2; v++)
+      {
+        time[v] = INFINITY;
+        for(int r=0; r<runs; r++)
+        {
+          const double start = dt_get_wtime();
+          if(v) dt_interpolation_resample(itor, out[v], &roi_out, stride, in, &roi_in, stride);
+          else dt_interpolation_resample_direct(itor, out[v], &roi_out, stride, in, &roi_in, stride);
+          time[v] = MIN(time[v], dt_get_wtime() - start);
+        }
+      }
+
+      float error = 0.0f;
+      for(int j=0; j<roi_out.height; j++)
+        for(int i=0; i<4*roi_out.width; i++)
+        {
+          const size_t k = (size_t)j*4*width + i;
+          error = fmaxf(error, fabsf(out[0][k] - out[1][k]));
+        }
+      if(!(error <= tolerance)) failed++;
+      const double mpix = roi_out.width*(double)roi_out.height*1e-6;
+      printf("%-10s %6.2f %5dx%-5d %12.1f %12.1f %8.2f %10.0f %10.2g%s\n", itor->name, scale, roi_out.width, roi_out.height,
+             mpix/time[0], mpix/time[1], time[0]/time[1], MAX(cold - time[1], 0.0)*1e6, error,
+             error <= tolerance ? "" : " FAILED");
+      fflush(stdout);
+    }
+  }
+
+error:
+  free(in);
+  free(out[0]);
+  free(out[1]);
+  return failed;
+}
+
+int main(int argc, char *arg[])
+{
+  dt_bench_options_t opt;
+  memset(&opt, 0, sizeof(opt));
+  opt.runs = 3;
+  const char *image_filename = NULL;
+
+  int k;
+  for(k=1; k<argc; k++)
+  {
+    if(!strcmp(arg[k], "--help"))
+    {
+      usage(arg[0]);
+      exit(1);
+    }
+    else if(!strcmp(arg[k], "--modules") && k+1 < argc)
+    {
+      k++;
+      opt.modules = g_strsplit(arg[k], ",", -1);
+    }
+    else if(!strcmp(arg[k], "--sizes") && k+1 < argc)
+    {
+      k++;
+      opt.num_sizes = parse_list(arg[k], opt.sizes, 16);
+    }
+    else if(!strcmp(arg[k], "--threads") && k+1 < argc)
+    {
+      k++;
+      opt.num_threads = parse_list(arg[k], opt.threads, 16);
+    }
+    else if(!strcmp(arg[k], "--runs") && k+1 < argc)
+    {
+      k++;
+      opt.runs = MAX(atoi(arg[k]), 1);
+    }
+    else if(!strcmp(arg[k], "--image") && k+1 < argc)
+    {
+      k++;
+      image_filename = arg[k];
+    }
+    else if(!strcmp(arg[k], "--blend"))
+    {
+      opt.blend = 1;
+    }
+    else if(!strcmp(arg[k], "--resample"))
+    {
+      opt.resample = 1;
+    }
+    else if(!strcmp(arg[k], "--core"))
+    {
+      // everything from here on should be passed to the core
+      k++;
+      break;
+    }
+    else
+    {
+      usage(arg[0]);
+      exit(1);
+    }
+  }
+
+  int m_argc = 0;
+  char *m_arg[4 + argc - k];
+  m_arg[m_argc++] = "darktable-bench";
+  m_arg[m_argc++] = "--library";
+  m_arg[m_argc++] = ":memory:";
+  for(; k < argc; k++) m_arg[m_argc++] = arg[k];
+  m_arg[m_argc] = NULL;
+
+  if(dt_init(m_argc, m_arg, 0)) exit(1);
+
+  if(!opt.num_sizes)
+  {
+    const int sizes[] = { 512, 1024, 2048 };
+    for(opt.num_sizes=0; opt.num_sizes<3; opt.num_sizes++) opt.sizes[opt.num_sizes] = sizes[opt.num_sizes];
+  }
+  // modules size their per thread scratch memory for dt_get_num_threads(), we can't go beyond:
+  const int max_threads = dt_get_num_threads();
+  if(!opt.num_threads)
+  {
+    // powers of two, and all cores:
+    for(int t=1; t<max_threads && opt.num_threads<15; t*=2) opt.threads[opt.num_threads++] = t;
+    opt.threads[opt.num_threads++] = max_threads;
+  }
+  int num_threads = 0;
+  for(int t=0; t<opt.num_threads; t++)
+    if(opt.threads[t] <= max_threads) opt.threads[num_threads++] = opt.threads[t];
+    else fprintf(stderr, "[bench] skipping %d threads, there are only %d cores\n", opt.threads[t], max_threads);
+  opt.num_threads = num_threads;
+  if(!opt.num_threads) opt.threads[opt.num_threads++] = 1;
+
+  if(opt.blend)
+  {
+    int failed = 0;
+    for(int s=0; s<opt.num_sizes; s++)
+    {
+      printf("# %dx%d\n", opt.sizes[s], opt.sizes[s]*2/3);
+      failed += blend_bench(opt.sizes[s], opt.sizes[s]*2/3, opt.runs);
+    }
+    dt_cleanup();
+    exit(failed ? 1 : 0);
+  }
+
+  if(opt.resample)
+  {
+    int failed = 0;
+    for(int s=0; s<opt.num_sizes; s++)
+    {
+      printf("# %dx%d\n", opt.sizes[s], opt.sizes[s]*2/3);
+      failed += resample_bench(opt.sizes[s], opt.sizes[s]*2/3, opt.runs);
+    }
+    dt_cleanup();
+    exit(failed ? 1 : 0);
+  }
+
+  printf("%-10s %-18s %-6s %11s %3s %10s %8s\n", "# source", "module", "input", "size", "thr", "MPix/s", "speedup");
+
+  int max_size = 0;
+  for(int s=0; s<opt.num_sizes; s++) max_size = MAX(max_size, opt.sizes[s]);
+
+  // synthetic raw, the modules only see the image struct we make up here:
+  {
+    dt_develop_t dev;
+    dt_dev_init(&dev, 0);
+    dt_bench_source_t src;
+    synthetic_source(&src, (max_size + 64) & ~1, (max_size*2/3 + 64) & ~1);
+    dev.image_storage.width = src.width;
+    dev.image_storage.height = src.height;
+    dev.image_storage.filters = src.filters;
+    dev.image_storage.bpp = sizeof(uint16_t);
+    dev.image_storage.flags |= DT_IMAGE_RAW;
+    dev.iop = dt_iop_load_modules(&dev);
+    bench_source(&dev, &src, &opt);
+    free(src.mosaic);
+    dt_dev_cleanup(&dev);
+  }
+
+  // the real raw goes through the library, so the modules get their defaults for this camera:
+  if(image_filename)
+  {
+    gchar *directory = g_path_get_dirname(image_filename);
+    dt_film_t film;
+    const int filmid = dt_film_new(&film, directory);
+    const uint32_t id = dt_image_import(filmid, image_filename, TRUE);
+    g_free(directory);
+    if(!id)
+    {
+      fprintf(stderr, "[bench] can't open file %s\n", image_filename);
+      dt_cleanup();
+      exit(1);
+    }
+
+    dt_develop_t dev;
+    dt_dev_init(&dev, 0);
+    dt_mipmap_buffer_t buf;
+    dt_mipmap_cache_read_get(darktable.mipmap_cache, &buf, id, DT_MIPMAP_FULL, DT_MIPMAP_BLOCKING);
+    dt_dev_load_image(&dev, id);
+    dt_bench_source_t src;
+    if(!buf.buf || raw_source(&src, &buf, &dev.image_storage))
+      fprintf(stderr, "[bench] %s is not a raw image, skipping it\n", image_filename);
+    else
+    {
+      bench_source(&dev, &src, &opt);
+      free(src.mosaic);
+    }
+    dt_mipmap_cache_read_release(darktable.mipmap_cache, &buf);
+    dt_dev_cleanup(&dev);
+  }
+
+  g_strfreev(opt.modules);
+  dt_cleanup();
+  exit(0);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-space on;
@@ -36,6 +36,7 @@
 #include "common/imageio_module.h"
 #include "common/exif.h"
 #include "common/history.h"
+#include "control/conf.h"
 
 #include <sys/time.h>
 #include <unistd.h>
@@ -47,6 +48,69 @@ static void
 usage(const char* progname)
 {
   fprintf(stderr, "usage: %s <input file> [<xmp file>] <output file> [--width <max width>,--height <max height>,--bpp <bpp>,--hq <0|1|true|false>,--verbose] [--core <darktable options>]\n", progname);
+  fprintf(stderr, "       %s --output <output pattern> [--threads <n>] <input file|directory|->... [<options as above>] [--core <darktable options>]\n", progname);
+  fprintf(stderr, "\n"
+          "the second form exports all given images in one process: the files, the images in the\n"
+          "directories and the files listed on stdin, one per line, for `-'. the output pattern can\n"
+          "use the variables of the export module, like $(FILE_NAME), and its extension selects the\n"
+          "format. xmp sidecar files are applied.\n");
+}
+
+// adds the file, or all supported images in the directory, to the list of inputs
+static GList *
+add_input(GList *inputs, const char *path)
+{
+  if(!g_file_test(path, G_FILE_TEST_IS_DIR))
+    return g_list_append(inputs, g_strdup(path));
+
+  GDir *dir = g_dir_open(path, 0, NULL);
+  if(!dir)
+  {
+    fprintf(stderr, _("error: can't open directory %s"), path);
+    fprintf(stderr, "\n");
+    return inputs;
+  }
+  GList *files = NULL;
+  const gchar *name;
+  while((name = g_dir_read_name(dir)) != NULL)
+  {
+    gchar *filename = g_build_filename(path, name, NULL);
+    if(g_file_test(filename, G_FILE_TEST_IS_REGULAR) && dt_supported_image(name))
+      files = g_list_prepend(files, filename);
+    else
+      g_free(filename);
+  }
+  g_dir_close(dir);
+  return g_list_concat(inputs, g_list_sort(files, (GCompareFunc)g_strcmp0));
+}
+
+// adds the inputs listed on stdin, one per line
+static GList *
+add_inputs_from_stdin(GList *inputs)
+{
+  char line[DT_MAX_PATH_LEN];
+  while(fgets(line, sizeof(line), stdin))
+  {
+    g_strstrip(line);
+    if(line[0]) inputs = add_input(inputs, line);
+  }
+  return inputs;
+}
+
+// imports the image into the film roll of its directory, shared by all images in there
+static int
+import_image(GHashTable *films, const char *filename)
+{
+  gchar *directory = g_path_get_dirname(filename);
+  int filmid = GPOINTER_TO_INT(g_hash_table_lookup(films, directory));
+  if(!filmid)
+  {
+    dt_film_t film;
+    filmid = dt_film_new(&film, directory);
+    g_hash_table_insert(films, directory, GINT_TO_POINTER(filmid));
+  }
+  else g_free(directory);
+  return dt_image_import(filmid, filename, TRUE);
 }
 
 int main(int argc, char *arg[])
@@ -61,14 +125,16 @@ int main(int argc, char *arg[])
   char *image_filename = NULL;
   char *xmp_filename = NULL;
   char *output_filename = NULL;
+  char *output_pattern = NULL;
+  GList *files = NULL;
   int file_counter = 0;
-  int width = 0, height = 0, bpp = 0;
+  int width = 0, height = 0, bpp = 0, threads = 0;
   gboolean verbose = FALSE, high_quality = TRUE;
 
   int k;
   for(k=1; k<argc; k++)
   {
-    if(arg[k][0] == '-')
+    if(arg[k][0] == '-' && arg[k][1] != '\0')
     {
       if(!strcmp(arg[k], "--help"))
       {
@@ -112,6 +178,16 @@ int main(int argc, char *arg[])
         }
         g_free(str);
       }
+      else if(!strcmp(arg[k], "--output") && k+1 < argc)
+      {
+        k++;
+        output_pattern = arg[k];
+      }
+      else if(!strcmp(arg[k], "--threads") && k+1 < argc)
+      {
+        k++;
+        threads = MAX(atoi(arg[k]), 1);
+      }
       else if(!strcmp(arg[k], "-v") || !strcmp(arg[k], "--verbose"))
       {
         verbose = TRUE;
@@ -132,6 +208,7 @@ int main(int argc, char *arg[])
         xmp_filename = arg[k];
       else if(file_counter == 2)
         output_filename = arg[k];
+      files = g_list_append(files, arg[k]);
       file_counter++;
     }
   }
@@ -144,45 +221,93 @@ int main(int argc, char *arg[])
   for(; k < argc; k++) m_arg[m_argc++] = arg[k];
   m_arg[m_argc] = NULL;
 
-  if(file_counter < 2 || file_counter > 3)
+  GList *inputs = NULL;
+  if(output_pattern)
   {
-    usage(arg[0]);
-    exit(1);
+    // batch mode: all file arguments are inputs
+    for(GList *i = files; i; i = g_list_next(i))
+    {
+      if(!strcmp((const char *)i->data, "-"))
+        inputs = add_inputs_from_stdin(inputs);
+      else
+        inputs = add_input(inputs, (const char *)i->data);
+    }
+    if(!inputs)
+    {
+      fprintf(stderr, "%s\n", _("no input images given"));
+      usage(arg[0]);
+      exit(1);
+    }
+    output_filename = output_pattern;
+    xmp_filename = NULL;
   }
-  else if(file_counter == 2)
+  else
   {
-    // no xmp file given
-    output_filename = xmp_filename;
-    xmp_filename = NULL;
+    if(file_counter < 2 || file_counter > 3)
+    {
+      usage(arg[0]);
+      exit(1);
+    }
+    else if(file_counter == 2)
+    {
+      // no xmp file given
+      output_filename = xmp_filename;
+      xmp_filename = NULL;
+    }
+
+    // the output file already exists, so there will be a sequence number added
+    if(g_file_test(output_filename, G_FILE_TEST_EXISTS))
+    {
+      fprintf(stderr, "%s\n", _("output file already exists, it will get renamed"));
+    }
+    inputs = g_list_append(inputs, g_strdup(image_filename));
   }
+  g_list_free(files);
 
-  // the output file already exists, so there will be a sequence number added
-  if(g_file_test(output_filename, G_FILE_TEST_EXISTS))
+  // try to find out the export format from the output_filename
+  char *ext = output_filename + strlen(output_filename);
+  while(ext > output_filename && *ext != '.' && *ext != '/') ext--;
+  if(*ext != '.')
   {
-    fprintf(stderr, "%s\n", _("output file already exists, it will get renamed"));
+    fprintf(stderr, "%s\n", _("error: the output file needs an extension to select the format"));
+    exit(1);
   }
+  *ext = '\0';
+  ext++;
+
+  if(!strcmp(ext, "jpg"))
+    ext = "jpeg";
 
-  // init dt without gui:
+  // init dt without gui, once for all images:
   if(dt_init(m_argc, m_arg, 0)) exit(1);
 
-  dt_film_t film;
-  int id = 0;
-  int filmid = 0;
+  const double start = dt_get_wtime();
 
-  gchar *directory = g_path_get_dirname(image_filename);
-  filmid = dt_film_new(&film, directory);
-  id = dt_image_import(filmid, image_filename, TRUE);
-  if(!id)
+  // import everything up front, so the export threads only work on the library:
+  GList *ids = NULL;
+  int failed = 0;
+  GHashTable *films = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  for(GList *i = inputs; i; i = g_list_next(i))
   {
-    fprintf(stderr, _("error: can't open file %s"), image_filename);
-    fprintf(stderr, "\n");
-    exit(1);
+    const int id = import_image(films, (const char *)i->data);
+    if(!id)
+    {
+      fprintf(stderr, _("error: can't open file %s"), (const char *)i->data);
+      fprintf(stderr, "\n");
+      // a single image that can't be opened is fatal, in batch mode we go on with the others:
+      if(!output_pattern) exit(1);
+      failed++;
+      continue;
+    }
+    ids = g_list_append(ids, GINT_TO_POINTER(id));
   }
-  g_free(directory);
+  g_hash_table_destroy(films);
+  g_list_free_full(inputs, g_free);
 
   // attach xmp, if requested:
   if(xmp_filename)
   {
+    const int id = GPOINTER_TO_INT(ids->data);
     const dt_image_t *cimg = dt_image_cache_read_get(darktable.image_cache, id);
     dt_image_t *image = dt_image_cache_write_get(darktable.image_cache, cimg);
     dt_exif_xmp_read(image, xmp_filename, 1);
@@ -194,26 +319,21 @@ int main(int argc, char *arg[])
   // print the history stack
   if(verbose)
   {
-    gchar *history = dt_history_get_items_as_string(id);
-    if(history)
-      printf("%s\n", history);
-    else
-      printf("[%s]\n", _("empty history stack"));
+    for(GList *i = ids; i; i = g_list_next(i))
+    {
+      gchar *history = dt_history_get_items_as_string(GPOINTER_TO_INT(i->data));
+      if(history)
+        printf("%s\n", history);
+      else
+        printf("[%s]\n", _("empty history stack"));
+      g_free(history);
+    }
   }
 
-  // try to find out the export format from the output_filename
-  char *ext = output_filename + strlen(output_filename);
-  while(ext > output_filename && *ext != '.') ext--;
-  *ext = '\0';
-  ext++;
-
-  if(!strcmp(ext, "jpg"))
-    ext = "jpeg";
-
   // init the export data structures
   dt_imageio_module_format_t *format;
   dt_imageio_module_storage_t *storage;
-  dt_imageio_module_data_t *sdata, *fdata;
+  dt_imageio_module_data_t *sdata;
 
   storage = dt_imageio_get_storage_by_name("disk"); // only exporting to disk makes sense
   if(storage == NULL)
@@ -222,6 +342,7 @@ int main(int argc, char *arg[])
     exit(1);
   }
 
+  // the storage parameters are shared by all threads, the disk module keeps the sequence number in there:
   sdata = storage->get_params(storage);
   if(sdata == NULL)
   {
@@ -241,13 +362,6 @@ int main(int argc, char *arg[])
     exit(1);
   }
 
-  fdata = format->get_params(format);
-  if(fdata == NULL)
-  {
-    fprintf(stderr, "%s\n", _("failed to get parameters from format module, aborting export ..."));
-    exit(1);
-  }
-
   uint32_t w,h,fw,fh,sw,sh;
   fw=fh=sw=sh=0;
   storage->dimension(storage, &sw, &sh);
@@ -259,22 +373,76 @@ int main(int argc, char *arg[])
   if( sh==0 || fh==0) h=sh>fh?sh:fh;
   else h=sh<fh?sh:fh;
 
-  fdata->max_width  = width;
-  fdata->max_height = height;
-  fdata->max_width = (w!=0 && fdata->max_width >w)?w:fdata->max_width;
-  fdata->max_height = (h!=0 && fdata->max_height >h)?h:fdata->max_height;
-  fdata->style[0] = '\0';
-
   //TODO: add a callback to set the bpp without going through the config
 
-  storage->store(storage,sdata, id, format, fdata, 1, 1, high_quality);
+  const int total = g_list_length(ids);
+  const int skipped = failed;
+  int num = 0, exported = 0, no_params = 0;
+  GList *t = ids;
+  // pipelines are kept around for the next image with the same module stack:
+  dt_imageio_export_session_begin();
+#ifdef _OPENMP
+  // as many pipelines in parallel as asked for and as fit into memory:
+  const __attribute__((__unused__)) int num_threads =
+    dt_imageio_export_max_threads(ids, threads ? threads : MAX(1, dt_conf_get_int("parallel_export")));
+  if(verbose && total > 1) printf("exporting %d images with %d threads\n", total, num_threads);
+  #pragma omp parallel num_threads(num_threads) if(num_threads > 1)
+#endif
+  {
+    // every thread needs its own format parameters (one jpeg struct per thread etc):
+    // no exit() in a parallel region: this thread skips the work, the others stop taking images.
+    dt_imageio_module_data_t *fdata = format->get_params(format);
+    if(fdata == NULL)
+    {
+      if(!__sync_fetch_and_add(&no_params, 1))
+        fprintf(stderr, "%s\n", _("failed to get parameters from format module, aborting export ..."));
+    }
+    else
+    {
+      fdata->max_width  = width;
+      fdata->max_height = height;
+      fdata->max_width = (w!=0 && fdata->max_width >w)?w:fdata->max_width;
+      fdata->max_height = (h!=0 && fdata->max_height >h)?h:fdata->max_height;
+      fdata->style[0] = '\0';
+    }
+
+    while(fdata)
+    {
+      int id = 0, n = 0;
+#ifdef _OPENMP
+      #pragma omp critical
+#endif
+      {
+        if(t && !no_params)
+        {
+          id = GPOINTER_TO_INT(t->data);
+          t = g_list_next(t);
+          n = ++num;
+        }
+      }
+      if(!id) break;
+      if(!storage->store(storage, sdata, id, format, fdata, n, total, high_quality))
+        __sync_fetch_and_add(&exported, 1);
+      else
+        __sync_fetch_and_add(&failed, 1);
+    }
+    if(fdata) format->free_params(format, fdata);
+  }
+  dt_imageio_export_session_end();
+
+  if(output_pattern)
+  {
+    const double elapsed = dt_get_wtime() - start;
+    printf("exported %d of %d images in %.1f seconds (%.1f images/minute)\n", exported, total + skipped, elapsed, elapsed > 0.0 ? exported * 60.0 / elapsed : 0.0);
+  }
 
   // cleanup time
   if(storage->finalize_store) storage->finalize_store(storage, sdata);
   storage->free_params(storage, sdata);
-  format->free_params(format, fdata);
+  g_list_free(ids);
 
   dt_cleanup();
+  return (failed || no_params) ? 1 : 0;
 }
 
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
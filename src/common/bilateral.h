@@ -19,6 +19,8 @@
 #ifndef DT_COMMON_BILATERAL_H
 #define DT_COMMON_BILATERAL_H
 
+#include <xmmintrin.h>
+
 #ifdef HAVE_OPENCL
 // function definition on opencl path takes precedence
 #include "common/bilateralcl.h"
@@ -125,43 +127,64 @@ dt_bilateral_splat(
   const int ox = 1;
   const int oy = b->size_x;
   const int oz = b->size_y*b->size_x;
-  // splat into downsampled grid
-#ifdef _OPENMP
-  #pragma omp parallel for default(none) shared(b)
-#endif
+  const float norm = 100.0f/(b->sigma_s*b->sigma_s);
+  // all pixels of an image row splat into the same two rows yi, yi+1 of the grid. so instead of
+  // fighting over grid cells with atomics, threads get all image rows of one yi (a slab) each,
+  // first the even and then the odd ones, so slabs running at the same time never touch.
+  int *slabs = (int *)malloc(2*sizeof(int)*b->size_y);
+  for(int k=0; k<b->size_y; k++)
+  {
+    slabs[2*k] = b->height;
+    slabs[2*k+1] = 0;
+  }
   for(int j=0; j<b->height; j++)
   {
-    int index = 4*j*b->width;
-    for(int i=0; i<b->width; i++)
-    {
-      float x, y, z;
-      const float L = in[index];
-      image_to_grid(b, i, j, L, &x, &y, &z);
-      const int xi = MIN((int)x, b->size_x-2);
-      const int yi = MIN((int)y, b->size_y-2);
-      const int zi = MIN((int)z, b->size_z-2);
-      const float xf = x - xi;
-      const float yf = y - yi;
-      const float zf = z - zi;
-      // nearest neighbour splatting:
-      const int grid_index = xi + b->size_x*(yi + b->size_y*zi);
-      // sum up payload here, doesn't have to be same as edge stopping data
-      // for cross bilateral applications.
-      // also note that this is not clipped (as L->z is), so potentially hdr/out of gamut
-      // should not cause clipping here.
-      for(int k=0; k<8; k++)
-      {
-        const int ii = grid_index + ((k&1)?ox:0) + ((k&2)?oy:0) + ((k&4)?oz:0);
-        const float contrib = ((k&1)?xf:(1.0f-xf)) * ((k&2)?yf:(1.0f-yf)) * ((k&4)?zf:(1.0f-zf))
-                              *100.0f/(b->sigma_s*b->sigma_s);
+    float x, y, z;
+    image_to_grid(b, 0, j, 0.0f, &x, &y, &z);
+    const int yi = MIN((int)y, b->size_y-2);
+    slabs[2*yi] = MIN(slabs[2*yi], j);
+    slabs[2*yi+1] = j+1;
+  }
+  for(int parity=0; parity<2; parity++)
+  {
+    // splat into downsampled grid
 #ifdef _OPENMP
-        #pragma omp atomic
+    #pragma omp parallel for default(none) shared(b, slabs, parity) schedule(dynamic)
 #endif
-        b->buf[ii] += contrib;
+    for(int slab=parity; slab<b->size_y-1; slab+=2)
+    {
+      for(int j=slabs[2*slab]; j<slabs[2*slab+1]; j++)
+      {
+        int index = 4*j*b->width;
+        for(int i=0; i<b->width; i++)
+        {
+          float x, y, z;
+          const float L = in[index];
+          image_to_grid(b, i, j, L, &x, &y, &z);
+          const int xi = MIN((int)x, b->size_x-2);
+          const int yi = MIN((int)y, b->size_y-2);
+          const int zi = MIN((int)z, b->size_z-2);
+          const float xf = x - xi;
+          const float yf = y - yi;
+          const float zf = z - zi;
+          // nearest neighbour splatting:
+          const int grid_index = xi + b->size_x*(yi + b->size_y*zi);
+          // sum up payload here, doesn't have to be same as edge stopping data
+          // for cross bilateral applications.
+          // also note that this is not clipped (as L->z is), so potentially hdr/out of gamut
+          // should not cause clipping here.
+          for(int k=0; k<8; k++)
+          {
+            const int ii = grid_index + ((k&1)?ox:0) + ((k&2)?oy:0) + ((k&4)?oz:0);
+            const float contrib = ((k&1)?xf:(1.0f-xf)) * ((k&2)?yf:(1.0f-yf)) * ((k&4)?zf:(1.0f-zf)) * norm;
+            b->buf[ii] += contrib;
+          }
+          index += 4;
+        }
       }
-      index += 4;
     }
   }
+  free(slabs);
 }
 
 static void
@@ -274,6 +297,36 @@ dt_bilateral_blur(
 }
 
 
+// trilinear lookup, both z layers at once: x neighbours are next to each other in the grid,
+// so each layer is two 64-bit loads.
+static inline float
+grid_lookup(
+  const dt_bilateral_t *const b,
+  const int i,
+  const int j,
+  const float L)
+{
+  float x, y, z;
+  image_to_grid(b, i, j, L, &x, &y, &z);
+  const int xi = MIN((int)x, b->size_x-2);
+  const int yi = MIN((int)y, b->size_y-2);
+  const int zi = MIN((int)z, b->size_z-2);
+  const float xf = x - xi;
+  const float yf = y - yi;
+  const float zf = z - zi;
+  const float *const g0 = b->buf + xi + b->size_x*(yi + b->size_y*zi);
+  const float *const g1 = g0 + b->size_y*b->size_x;
+  const __m128 v0 = _mm_loadh_pi(_mm_loadl_pi(_mm_setzero_ps(), (const __m64 *)g0), (const __m64 *)(g0 + b->size_x));
+  const __m128 v1 = _mm_loadh_pi(_mm_loadl_pi(_mm_setzero_ps(), (const __m64 *)g1), (const __m64 *)(g1 + b->size_x));
+  const __m128 wx = _mm_set_ps(xf, 1.0f-xf, xf, 1.0f-xf);
+  const __m128 wy = _mm_set_ps(yf, yf, 1.0f-yf, 1.0f-yf);
+  __m128 v = _mm_add_ps(_mm_mul_ps(v0, _mm_set1_ps(1.0f-zf)), _mm_mul_ps(v1, _mm_set1_ps(zf)));
+  v = _mm_mul_ps(v, _mm_mul_ps(wx, wy));
+  v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+  v = _mm_add_ss(v, _mm_shuffle_ps(v, v, 1));
+  return _mm_cvtss_f32(v);
+}
+
 void
 dt_bilateral_slice(
   const dt_bilateral_t *const b,
@@ -283,9 +336,6 @@ dt_bilateral_slice(
 {
   // detail: 0 is leave as is, -1 is bilateral filtered, +1 is contrast boost
   const float norm = -detail * b->sigma_r * 0.04f;
-  const int ox = 1;
-  const int oy = b->size_x;
-  const int oz = b->size_y*b->size_x;
 #ifdef _OPENMP
   #pragma omp parallel for default(none) shared(out)
 #endif
@@ -294,26 +344,8 @@ dt_bilateral_slice(
     int index = 4*j*b->width;
     for(int i=0; i<b->width; i++)
     {
-      float x, y, z;
       const float L = in[index];
-      image_to_grid(b, i, j, L, &x, &y, &z);
-      // trilinear lookup:
-      const int xi = MIN((int)x, b->size_x-2);
-      const int yi = MIN((int)y, b->size_y-2);
-      const int zi = MIN((int)z, b->size_z-2);
-      const float xf = x - xi;
-      const float yf = y - yi;
-      const float zf = z - zi;
-      const int gi = xi + b->size_x*(yi + b->size_y*zi);
-      const float Lout = L + norm * (
-                           b->buf[gi]          * (1.0f - xf) * (1.0f - yf) * (1.0f - zf) +
-                           b->buf[gi+ox]       * (       xf) * (1.0f - yf) * (1.0f - zf) +
-                           b->buf[gi+oy]       * (1.0f - xf) * (       yf) * (1.0f - zf) +
-                           b->buf[gi+ox+oy]    * (       xf) * (       yf) * (1.0f - zf) +
-                           b->buf[gi+oz]       * (1.0f - xf) * (1.0f - yf) * (       zf) +
-                           b->buf[gi+ox+oz]    * (       xf) * (1.0f - yf) * (       zf) +
-                           b->buf[gi+oy+oz]    * (1.0f - xf) * (       yf) * (       zf) +
-                           b->buf[gi+ox+oy+oz] * (       xf) * (       yf) * (       zf));
+      const float Lout = L + norm * grid_lookup(b, i, j, L);
       out[index] = MAX(0.0f, Lout);
       // and copy color and mask
       out[index+1] = in[index+1];
@@ -333,9 +365,6 @@ dt_bilateral_slice_to_output(
 {
   // detail: 0 is leave as is, -1 is bilateral filtered, +1 is contrast boost
   const float norm = -detail * b->sigma_r * 0.04f;
-  const int ox = 1;
-  const int oy = b->size_x;
-  const int oz = b->size_y*b->size_x;
 #ifdef _OPENMP
   #pragma omp parallel for default(none) shared(out)
 #endif
@@ -344,26 +373,8 @@ dt_bilateral_slice_to_output(
     int index = 4*j*b->width;
     for(int i=0; i<b->width; i++)
     {
-      float x, y, z;
       const float L = in[index];
-      image_to_grid(b, i, j, L, &x, &y, &z);
-      // trilinear lookup:
-      const int xi = MIN((int)x, b->size_x-2);
-      const int yi = MIN((int)y, b->size_y-2);
-      const int zi = MIN((int)z, b->size_z-2);
-      const float xf = x - xi;
-      const float yf = y - yi;
-      const float zf = z - zi;
-      const int gi = xi + b->size_x*(yi + b->size_y*zi);
-      const float Lout = norm * (
-                           b->buf[gi]          * (1.0f - xf) * (1.0f - yf) * (1.0f - zf) +
-                           b->buf[gi+ox]       * (       xf) * (1.0f - yf) * (1.0f - zf) +
-                           b->buf[gi+oy]       * (1.0f - xf) * (       yf) * (1.0f - zf) +
-                           b->buf[gi+ox+oy]    * (       xf) * (       yf) * (1.0f - zf) +
-                           b->buf[gi+oz]       * (1.0f - xf) * (1.0f - yf) * (       zf) +
-                           b->buf[gi+ox+oz]    * (       xf) * (1.0f - yf) * (       zf) +
-                           b->buf[gi+oy+oz]    * (1.0f - xf) * (       yf) * (       zf) +
-                           b->buf[gi+ox+oy+oz] * (       xf) * (       yf) * (       zf));
+      const float Lout = norm * grid_lookup(b, i, j, L);
       out[index] = MAX(0.0f, out[index] + Lout);
       index += 4;
     }
@@ -53,7 +53,7 @@ typedef struct dt_cache_bucket_t
   int32_t  cost;   // cost associated with this entry (such as byte size)
   uint32_t hash;   // hash of the element
   uint32_t key;    // key of the element
-  // due to alignment, we waste 32 bits here
+  uint32_t used;   // second chance bit, set on every hit instead of moving the bucket in the lru list
   void*    data;   // actual data
 }
 dt_cache_bucket_t;
@@ -150,8 +150,9 @@ remove_key(dt_cache_t *cache,
   key_bucket->hash = DT_CACHE_EMPTY_HASH;
   key_bucket->key  = DT_CACHE_EMPTY_KEY;
 
-  // keep track of cost
+  // keep track of cost and size
   add_cost(cache, -key_bucket->cost);
+  __sync_fetch_and_sub(&cache->size, 1);
 
   if(prev_key_bucket == NULL)
   {
@@ -236,10 +237,12 @@ add_key_to_beginning_of_list(
       dt_cache_bucket_write_lock(free_bucket);
   }
   add_cost(cache, cost);
+  __sync_fetch_and_add(&cache->size, 1);
 
   free_bucket->key  = key;
   free_bucket->hash = hash;
   free_bucket->cost = cost;
+  free_bucket->used = 0;
 
   if(keys_bucket->first_delta == 0)
   {
@@ -275,10 +278,12 @@ add_key_to_end_of_list(
       dt_cache_bucket_write_lock(free_bucket);
   }
   add_cost(cache, cost);
+  __sync_fetch_and_add(&cache->size, 1);
 
   free_bucket->key  = key;
   free_bucket->hash = hash;
   free_bucket->cost = cost;
+  free_bucket->used = 0;
   free_bucket->next_delta = DT_CACHE_NULL_DELTA;
 
   if(last_bucket == NULL)
@@ -372,6 +377,7 @@ dt_cache_init(dt_cache_t *cache, const int32_t capacity, const int32_t num_threa
   cache->table    = (dt_cache_bucket_t  *)dt_alloc_align(64, num_buckets * sizeof(dt_cache_bucket_t));
 
   cache->cost = 0;
+  cache->size = 0;
   cache->cost_quota = cost_quota;
   cache->lru_lock = 0;
   cache->allocate = NULL;
@@ -391,6 +397,7 @@ dt_cache_init(dt_cache_t *cache, const int32_t capacity, const int32_t num_threa
     cache->table[k].hash        = DT_CACHE_EMPTY_HASH;
     cache->table[k].key         = DT_CACHE_EMPTY_KEY;
     cache->table[k].data        = DT_CACHE_EMPTY_DATA;
+    cache->table[k].used        = 0;
     cache->table[k].read        = 0;
     cache->table[k].write       = 0;
     cache->table[k].lru         = -2;
@@ -457,13 +464,7 @@ dt_cache_contains(const dt_cache_t *const cache, const uint32_t key)
 uint32_t
 dt_cache_size(const dt_cache_t *const cache)
 {
-  uint32_t cnt = 0;
-  const uint32_t num = cache->bucket_mask + 1;
-  for(uint32_t k=0; k<num; k++)
-  {
-    if(cache->table[k].hash != DT_CACHE_EMPTY_HASH) cnt++;
-  }
-  return cnt;
+  return cache->size;
 }
 
 #if 0 // not sure we need this diagnostic tool:
@@ -642,10 +643,10 @@ dt_cache_read_testget(
     {
       void *rc = compare_bucket->data;
       int err = dt_cache_bucket_read_testlock(compare_bucket);
+      // only mark as used, dt_cache_gc() will move it to the most recently used end:
+      if(!err) compare_bucket->used = 1;
       dt_cache_unlock(&segment->lock);
       if(err) return NULL;
-      // move this to the  most recently used slot, too:
-      lru_insert_locked(cache, compare_bucket);
       return rc;
     }
     next_delta = compare_bucket->next_delta;
@@ -691,11 +692,11 @@ retry_cache_full:
       {
         void *rc = compare_bucket->data;
         int err = dt_cache_bucket_read_testlock(compare_bucket);
+        // a hit doesn't touch the lru list (and its lock), only gives the bucket a second chance:
+        if(!err) compare_bucket->used = 1;
         dt_cache_unlock(&segment->lock);
         // actually all good, just we couldn't get a lock on the bucket.
         if(err) goto wait;
-        // move this to the  most recently used slot, too:
-        lru_insert_locked(cache, compare_bucket);
         // found and locked:
         return rc;
       }
@@ -871,12 +872,14 @@ dt_cache_remove(dt_cache_t *cache, const uint32_t key)
 #define DT_CACHE_BFL
 #ifdef DT_CACHE_BFL
 // debug helper functions, in case we want a big fat lock for dt_cache_gc():
+// these are called with the lru lock held, but dt_cache_read_get() takes the lru lock while
+// holding a segment lock. so never block on the segment here, just report the key as busy.
 static int
 dt_cache_remove_no_lru_lock(dt_cache_t *cache, const uint32_t key)
 {
   const uint32_t hash = key;
   dt_cache_segment_t *segment = cache->segments + ((hash >> cache->segment_shift) & cache->segment_mask);
-  dt_cache_lock(&segment->lock);
+  if(dt_cache_testlock(&segment->lock)) return 1;
 
   dt_cache_bucket_t *const start_bucket = cache->table + (hash & cache->bucket_mask);
   dt_cache_bucket_t *last_bucket = NULL;
@@ -922,7 +925,7 @@ dt_cache_remove_bucket_no_lru_lock(dt_cache_t *cache, const uint32_t num)
   // dt_cache_remove works on key, not bucket number, so translate that:
   const uint32_t hash = num;
   dt_cache_segment_t *segment = cache->segments + ((hash >> cache->segment_shift) & cache->segment_mask);
-  dt_cache_lock(&segment->lock);
+  if(dt_cache_testlock(&segment->lock)) return 1;
 
   dt_cache_bucket_t *const curr_bucket = cache->table + (hash & cache->bucket_mask);
   const uint32_t key = curr_bucket->key;
@@ -986,6 +989,30 @@ dt_cache_gc(dt_cache_t *cache, const float fill_ratio)
     }
     // fprintf(stderr, "[cache gc] from %u to %u\n", cache->cost, (uint32_t)(0.8*cache->cost_quota));
 
+#ifndef DT_CACHE_BFL
+    dt_cache_lock(&cache->lru_lock);
+#endif
+    // remember where to go on, the bucket will be out of the list after this:
+    const int32_t next = cache->table[curr].mru;
+    if(cache->table[curr].used)
+    {
+      // used since it was last looked at: give it a second chance, i.e. clear the bit
+      // and move it to the most recently used end. this is the only place where hits
+      // are accounted for in the lru list, so the read path never takes the lru lock.
+      cache->table[curr].used = 0;
+      lru_insert(cache, cache->table + curr);
+#ifndef DT_CACHE_BFL
+      dt_cache_unlock(&cache->lru_lock);
+#endif
+      // the old most recently used end:
+      curr = next;
+      i++;
+      continue;
+    }
+#ifndef DT_CACHE_BFL
+    dt_cache_unlock(&cache->lru_lock);
+#endif
+
     // remove it. takes care of lru, cost, user cleanup, and hashtable
     // this could run into keys being concurrently removed, and will not remove these,
     // nor alter the lru list in that case (could be interleaved with the other thread
@@ -994,23 +1021,13 @@ dt_cache_gc(dt_cache_t *cache, const float fill_ratio)
     // in the very unlikely case the bucket in question got just removed,
     // and the lru not cleaned up yet, but another image already occupies that slot...
     // it will be read locked and we go on. very worst case we clean up the wrong image.
+    // if that fails, the entry is in use and we just go on with the next one.
 #ifdef DT_CACHE_BFL
-    const int err = dt_cache_remove_bucket_no_lru_lock(cache, curr);
-#else
-    const int err = dt_cache_remove_bucket(cache, curr);
-#endif
-    if(err)
-    {
-      // fprintf(stderr, "[cache gc] remove failed %d\n", err);
-      // in case we failed, try next entry
-#ifdef DT_CACHE_BFL
-      curr = cache->table[curr].mru;
+    dt_cache_remove_bucket_no_lru_lock(cache, curr);
 #else
-      dt_cache_lock(&cache->lru_lock);
-      curr = cache->table[curr].mru;
-      dt_cache_unlock(&cache->lru_lock);
+    dt_cache_remove_bucket(cache, curr);
 #endif
-    }
+    curr = next;
     i++;
   }
 #ifdef DT_CACHE_BFL
@@ -37,7 +37,10 @@ typedef struct dt_cache_t
   int optimize_cacheline;
   int cost;
   int cost_quota;
+  int size;
   // one fat lru lock, no use locking segments and possibly rolling back changes.
+  // hits don't take it, they only set a bit in the bucket which dt_cache_gc() looks at
+  // (second chance), so it is only held to insert new entries and to clean up.
   uint32_t lru_lock;
 
   // callback functions for cache misses/garbage collection
@@ -98,7 +101,6 @@ int32_t dt_cache_remove(dt_cache_t *cache, const uint32_t key);
 int32_t dt_cache_gc(dt_cache_t *cache, const float fill_ratio);
 
 // returns the number of elements currently stored in the cache.
-// O(N), where N is the total capacity. don't use!
 uint32_t dt_cache_size(const dt_cache_t *const cache);
 
 // returns the maximum capacity of this cache:
@@ -23,6 +23,7 @@
 #include "common/metadata.h"
 #include "common/utility.h"
 #include "common/image.h"
+#include "develop/develop.h"
 
 #include <stdio.h>
 #include <memory.h>
@@ -38,11 +39,77 @@
 /* Stores the collection query, returns 1 if changed.. */
 static int _dt_collection_store (const dt_collection_t *collection, gchar *query);
 
+// needs the ids mutex.
+static void _dt_collection_clear_ids(dt_collection_t *collection)
+{
+  if(collection->ids) g_array_free(collection->ids, TRUE);
+  if(collection->offsets) g_hash_table_destroy(collection->offsets);
+  collection->ids = NULL;
+  collection->offsets = NULL;
+}
+
+static void _dt_collection_drop_ids(dt_collection_t *collection)
+{
+  dt_pthread_mutex_lock(&collection->ids_mutex);
+  _dt_collection_clear_ids(collection);
+  dt_pthread_mutex_unlock(&collection->ids_mutex);
+}
+
+/* images came or went, the query has to run again. */
+static void _dt_collection_changed_callback(gpointer instance, gpointer user_data)
+{
+  _dt_collection_drop_ids((dt_collection_t *)user_data);
+}
+
+static void _dt_collection_imported_callback(gpointer instance, int id, gpointer user_data)
+{
+  _dt_collection_drop_ids((dt_collection_t *)user_data);
+}
+
+/* the history of the image in darkroom changed, it may have become altered or unaltered. */
+static void _dt_collection_history_callback(gpointer instance, gpointer user_data)
+{
+  dt_collection_t *collection = (dt_collection_t *)user_data;
+  if(darktable.develop) dt_collection_image_changed(collection, darktable.develop->image_storage.id);
+}
+
+/* runs the query once, instead of for every page and count the views need. the ids are kept until the
+   query changes or signals say so, see dt_collection_image_changed(). returns with the ids mutex held. */
+static void _dt_collection_lock_ids(const dt_collection_t *collection)
+{
+  dt_collection_t *c = (dt_collection_t *)collection;
+  const gchar *query = dt_collection_get_query(collection);
+  sqlite3 *db = dt_database_get(darktable.db);
+  dt_pthread_mutex_lock(&c->ids_mutex);
+  if(c->ids) return;
+
+  c->ids = g_array_new(FALSE, FALSE, sizeof(int));
+  c->offsets = g_hash_table_new(NULL, NULL);
+  if(!query) return;
+
+  sqlite3_stmt *stmt = NULL;
+  DT_DEBUG_SQLITE3_PREPARE_V2(db, query, -1, &stmt, NULL);
+  if ((collection->params.query_flags&COLLECTION_QUERY_USE_LIMIT) &&
+      !(collection->params.query_flags&COLLECTION_QUERY_USE_ONLY_WHERE_EXT))
+  {
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, 0);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, -1);
+  }
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    const int id = sqlite3_column_int(stmt, 0);
+    g_array_append_val(c->ids, id);
+    g_hash_table_insert(c->offsets, GINT_TO_POINTER(id), GINT_TO_POINTER(c->ids->len));
+  }
+  sqlite3_finalize(stmt);
+}
+
 const dt_collection_t *
 dt_collection_new (const dt_collection_t *clone)
 {
   dt_collection_t *collection = g_malloc (sizeof (dt_collection_t));
   memset (collection,0,sizeof (dt_collection_t));
+  dt_pthread_mutex_init(&collection->ids_mutex, NULL);
 
   /* initialize collection context*/
   if (clone)   /* if clone is provided let's copy it into this context */
@@ -54,7 +121,22 @@ dt_collection_new (const dt_collection_t *clone)
     collection->clone = 1;
   }
   else  /* else we just initialize using the reset */
+  {
     dt_collection_reset (collection);
+    /* the clones of the selection are rebuilt anyways, only the main collection keeps its ids */
+    dt_control_signal_connect(darktable.signals, DT_SIGNAL_FILMROLLS_CHANGED,
+                              G_CALLBACK(_dt_collection_changed_callback), collection);
+    dt_control_signal_connect(darktable.signals, DT_SIGNAL_FILMROLLS_REMOVED,
+                              G_CALLBACK(_dt_collection_changed_callback), collection);
+    dt_control_signal_connect(darktable.signals, DT_SIGNAL_TAG_CHANGED,
+                              G_CALLBACK(_dt_collection_changed_callback), collection);
+    dt_control_signal_connect(darktable.signals, DT_SIGNAL_FILMROLLS_IMPORTED,
+                              G_CALLBACK(_dt_collection_imported_callback), collection);
+    dt_control_signal_connect(darktable.signals, DT_SIGNAL_IMAGE_IMPORT,
+                              G_CALLBACK(_dt_collection_imported_callback), collection);
+    dt_control_signal_connect(darktable.signals, DT_SIGNAL_DEVELOP_HISTORY_CHANGE,
+                              G_CALLBACK(_dt_collection_history_callback), collection);
+  }
 
   return collection;
 }
@@ -66,6 +148,15 @@ dt_collection_free (const dt_collection_t *collection)
     g_free (collection->query);
   if (collection->where_ext)
     g_free (collection->where_ext);
+  if (!collection->clone)
+  {
+    dt_control_signal_disconnect(darktable.signals, G_CALLBACK(_dt_collection_changed_callback), (gpointer)collection);
+    dt_control_signal_disconnect(darktable.signals, G_CALLBACK(_dt_collection_imported_callback), (gpointer)collection);
+    dt_control_signal_disconnect(darktable.signals, G_CALLBACK(_dt_collection_history_callback), (gpointer)collection);
+  }
+  g_free (collection->where);
+  _dt_collection_drop_ids((dt_collection_t *)collection);
+  dt_pthread_mutex_destroy(&((dt_collection_t *)collection)->ids_mutex);
   g_free ((dt_collection_t *)collection);
 }
 
@@ -135,8 +226,13 @@ dt_collection_update (const dt_collection_t *collection)
     sq = dt_collection_get_sort_query(collection);
   }
 
-  /* store the new query */
+  /* store the new query, and the where clause to check single images against */
   query = dt_util_dstrcat(query, "%s %s%s", selq, sq?sq:"", (collection->params.query_flags&COLLECTION_QUERY_USE_LIMIT)?" "LIMIT_QUERY:"");
+  dt_pthread_mutex_lock(&((dt_collection_t *)collection)->ids_mutex);
+  g_free(collection->where);
+  ((dt_collection_t *)collection)->where =
+    (collection->params.query_flags&COLLECTION_QUERY_USE_ONLY_WHERE_EXT) ? NULL : g_strdup(wq);
+  dt_pthread_mutex_unlock(&((dt_collection_t *)collection)->ids_mutex);
   result = _dt_collection_store(collection, query);
 
   /* free memory used */
@@ -346,36 +442,72 @@ _dt_collection_store (const dt_collection_t *collection, gchar *query)
     g_free (collection->query);
 
   ((dt_collection_t *)collection)->query = g_strdup(query);
+  _dt_collection_drop_ids((dt_collection_t *)collection);
 
   return 1;
 }
 
 uint32_t dt_collection_get_count(const dt_collection_t *collection)
 {
-  sqlite3_stmt *stmt = NULL;
-  uint32_t count=1;
-  const gchar *query = dt_collection_get_query(collection);
-  gchar *count_query = NULL;
-
-  gchar *fq = g_strstr_len(query, strlen(query), "from");
-  if ((collection->params.query_flags&COLLECTION_QUERY_USE_ONLY_WHERE_EXT))
-    count_query = dt_util_dstrcat(NULL, "select count(images.id) from images %s", collection->where_ext);
-  else
-    count_query = dt_util_dstrcat(count_query, "select count(id) %s", fq);
+  _dt_collection_lock_ids(collection);
+  const uint32_t count = collection->ids->len;
+  dt_pthread_mutex_unlock(&((dt_collection_t *)collection)->ids_mutex);
+  return count;
+}
 
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), count_query, -1, &stmt, NULL);
-  if ((collection->params.query_flags&COLLECTION_QUERY_USE_LIMIT) &&
-      !(collection->params.query_flags&COLLECTION_QUERY_USE_ONLY_WHERE_EXT))
+void dt_collection_image_changed(const dt_collection_t *collection, const int imgid)
+{
+  dt_collection_t *c = (dt_collection_t *)collection;
+  if(imgid <= 0)
   {
-    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, 0);
-    DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, -1);
+    // a whole selection, one query is cheaper than checking them one by one
+    _dt_collection_drop_ids(c);
+    return;
+  }
+  dt_pthread_mutex_lock(&c->ids_mutex);
+  // nothing to patch, or the order may depend on what changed:
+  if(!c->ids) goto done;
+  if(!c->where || ((c->params.query_flags & COLLECTION_QUERY_USE_SORT) &&
+                   (c->params.sort == DT_COLLECTION_SORT_RATING || c->params.sort == DT_COLLECTION_SORT_COLOR)))
+  {
+    _dt_collection_clear_ids(c);
+    goto done;
   }
 
-  if(sqlite3_step(stmt) == SQLITE_ROW)
-    count = sqlite3_column_int(stmt, 0);
+  gchar *query = g_strdup_printf("select 1 from images where id = ?1 and (%s)", c->where);
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+  const int member = (sqlite3_step(stmt) == SQLITE_ROW);
   sqlite3_finalize(stmt);
-  g_free(count_query);
-  return count;
+  g_free(query);
+
+  const int offset = GPOINTER_TO_INT(g_hash_table_lookup(c->offsets, GINT_TO_POINTER(imgid)));
+  if(member && !offset)
+  {
+    // we don't know where it goes
+    _dt_collection_clear_ids(c);
+  }
+  else if(!member && offset)
+  {
+    g_array_remove_index(c->ids, offset - 1);
+    g_hash_table_remove(c->offsets, GINT_TO_POINTER(imgid));
+    for(int k = offset - 1; k < (int)c->ids->len; k++)
+      g_hash_table_insert(c->offsets, GINT_TO_POINTER(g_array_index(c->ids, int, k)), GINT_TO_POINTER(k + 1));
+  }
+
+done:
+  dt_pthread_mutex_unlock(&c->ids_mutex);
+}
+
+int dt_collection_get_ids(const dt_collection_t *collection, int offset, const int count, int *ids)
+{
+  _dt_collection_lock_ids(collection);
+  offset = MAX(offset, 0);
+  const int num = CLAMP((int)collection->ids->len - offset, 0, count);
+  if(num > 0) memcpy(ids, &g_array_index(collection->ids, int, offset), sizeof(int)*num);
+  dt_pthread_mutex_unlock(&((dt_collection_t *)collection)->ids_mutex);
+  return num;
 }
 
 uint32_t dt_collection_get_selected_count (const dt_collection_t *collection)
@@ -663,35 +795,11 @@ void dt_collection_hint_message(const dt_collection_t *collection)
 
 int dt_collection_image_offset(int imgid)
 {
-  const gchar *qin = dt_collection_get_query (darktable.collection);
-  int offset = 0;
-  sqlite3_stmt *stmt;
-
-  if(qin)
-  {
-    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), qin, -1, &stmt, NULL);
-    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1,  0);
-    DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, -1);
-
-    gboolean found = FALSE;
-
-    while (sqlite3_step (stmt) == SQLITE_ROW)
-    {
-      int id = sqlite3_column_int(stmt, 0);
-      if (imgid == id)
-      {
-        found = TRUE;
-        break;
-      }
-      offset++;
-    }
-
-    if (!found)
-      offset = 0;
-
-    sqlite3_finalize(stmt);
-  }
-  return offset;
+  _dt_collection_lock_ids(darktable.collection);
+  const int offset = GPOINTER_TO_INT(g_hash_table_lookup(darktable.collection->offsets, GINT_TO_POINTER(imgid)));
+  dt_pthread_mutex_unlock(&((dt_collection_t *)darktable.collection)->ids_mutex);
+  // not found is 0, as before
+  return MAX(offset - 1, 0);
 }
 
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
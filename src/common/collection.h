@@ -18,6 +18,7 @@
 #ifndef DT_COLLECTION_H
 #define DT_COLLECTION_H
 
+#include "common/dtpthread.h"
 #include <inttypes.h>
 #include <glib.h>
 
@@ -108,6 +109,13 @@ typedef struct dt_collection_t
   gchar *where_ext;
   dt_collection_params_t params;
   dt_collection_params_t store;
+
+  /* the result of the query, materialized: image ids in order and their offsets (+1) by id.
+     dropped when the query changes or a signal says images came or went, patched when single images change. */
+  dt_pthread_mutex_t ids_mutex;
+  GArray *ids;
+  GHashTable *offsets;
+  gchar *where;  // the where clause of the query, to check single images. NULL if it can't be used alone
 }
 dt_collection_t;
 
@@ -155,6 +163,11 @@ gchar *dt_collection_get_sort_query(const dt_collection_t *collection);
 
 /** get the count of query */
 uint32_t dt_collection_get_count (const dt_collection_t *collection);
+/** something the collection may filter by changed for an image, or the image is new (imgid <= 0: for the
+    selected images). keeps the materialized collection up to date, every writer has to call it. */
+void dt_collection_image_changed(const dt_collection_t *collection, const int imgid);
+/** copies up to count image ids of the collection, starting at offset, to ids. returns the number copied. */
+int dt_collection_get_ids (const dt_collection_t *collection, int offset, const int count, int *ids);
 
 /** get selected image ids order as current selection. */
 GList *dt_collection_get_selected (const dt_collection_t *collection);
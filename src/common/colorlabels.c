@@ -38,6 +38,7 @@ const char *dt_colorlabels_name[] =
 void dt_colorlabels_remove_labels_selection ()
 {
   DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "delete from color_labels where imgid in (select imgid from selected_images)", NULL, NULL, NULL);
+  dt_collection_image_changed(darktable.collection, -1);
 }
 
 void dt_colorlabels_remove_labels (const int imgid)
@@ -47,6 +48,7 @@ void dt_colorlabels_remove_labels (const int imgid)
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
   sqlite3_step(stmt);
   sqlite3_finalize(stmt);
+  dt_collection_image_changed(darktable.collection, imgid);
 }
 
 void dt_colorlabels_set_label (const int imgid, const int color)
@@ -57,6 +59,7 @@ void dt_colorlabels_set_label (const int imgid, const int color)
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, color);
   sqlite3_step(stmt);
   sqlite3_finalize(stmt);
+  dt_collection_image_changed(darktable.collection, imgid);
 }
 
 void dt_colorlabels_remove_label (const int imgid, const int color)
@@ -67,6 +70,7 @@ void dt_colorlabels_remove_label (const int imgid, const int color)
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, color);
   sqlite3_step(stmt);
   sqlite3_finalize(stmt);
+  dt_collection_image_changed(darktable.collection, imgid);
 }
 
 
@@ -94,6 +98,7 @@ void dt_colorlabels_toggle_label_selection (const int color)
   // clean up
   DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "delete from memory.color_labels_temp", NULL, NULL, NULL);
 
+  dt_collection_image_changed(darktable.collection, -1);
   dt_collection_hint_message(darktable.collection);
 }
 
@@ -122,6 +127,7 @@ void dt_colorlabels_toggle_label (const int imgid, const int color)
   }
   sqlite3_finalize(stmt);
 
+  dt_collection_image_changed(darktable.collection, imgid);
   dt_collection_hint_message(darktable.collection);
 }
 
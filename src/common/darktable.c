@@ -33,11 +33,14 @@
 #include "common/image.h"
 #include "common/image_cache.h"
 #include "common/imageio_module.h"
+#include "common/interpolation.h"
 #include "common/mipmap_cache.h"
 #include "common/opencl.h"
 #include "common/points.h"
 #include "develop/imageop.h"
 #include "develop/blend.h"
+#include "develop/masks.h"
+#include "develop/pixelpipe_trace.h"
 #include "libs/lib.h"
 #include "views/view.h"
 #include "views/undo.h"
@@ -104,6 +107,7 @@ static int usage(const char *argv0)
   printf(" [--cachedir <user cache directory>]");
   printf(" [--localedir <locale directory>]");
   printf(" [--conf <key>=<value>]");
+  printf(" [--trace <trace file>]");
   printf("\n");
   return 1;
 }
@@ -383,6 +387,7 @@ int dt_init(int argc, char *argv[], const int init_gui)
   char *tmpdir_from_command = NULL;
   char *configdir_from_command = NULL;
   char *cachedir_from_command = NULL;
+  char *trace_from_command = NULL;
 
   darktable.num_openmp_threads = 1;
 #ifdef _OPENMP
@@ -431,6 +436,10 @@ int dt_init(int argc, char *argv[], const int init_gui)
       {
         cachedir_from_command = argv[++k];
       }
+      else if(!strcmp(argv[k], "--trace") && argc > k+1)
+      {
+        trace_from_command = argv[++k];
+      }
       else if(!strcmp(argv[k], "--localedir"))
       {
         bindtextdomain (GETTEXT_PACKAGE, argv[++k]);
@@ -494,6 +503,7 @@ int dt_init(int argc, char *argv[], const int init_gui)
 #ifdef _OPENMP
   omp_set_num_threads(darktable.num_openmp_threads);
 #endif
+  if(trace_from_command) dt_dev_pixelpipe_trace_init(trace_from_command);
   dt_loc_init_datadir(datadir_from_command);
   dt_loc_init_plugindir(moduledir_from_command);
   if(dt_loc_init_tmp_dir(tmpdir_from_command))
@@ -617,6 +627,7 @@ int dt_init(int argc, char *argv[], const int init_gui)
 
   // FIXME: move there into dt_database_t
   dt_pthread_mutex_init(&(darktable.db_insert), NULL);
+  dt_pthread_mutex_init(&(darktable.db_batch), NULL);
   dt_pthread_mutex_init(&(darktable.plugin_threadsafe), NULL);
   dt_pthread_mutex_init(&(darktable.capabilities_threadsafe), NULL);
   darktable.control = (dt_control_t *)malloc(sizeof(dt_control_t));
@@ -660,6 +671,8 @@ int dt_init(int argc, char *argv[], const int init_gui)
   darktable.blendop = (dt_blendop_t *)malloc(sizeof(dt_blendop_t));
   memset(darktable.blendop, 0, sizeof(dt_blendop_t));
   dt_develop_blend_init(darktable.blendop);
+  dt_masks_cache_init();
+  dt_interpolation_init();
 
   darktable.points = (dt_points_t *)malloc(sizeof(dt_points_t));
   memset(darktable.points, 0, sizeof(dt_points_t));
@@ -802,6 +815,8 @@ void dt_cleanup()
   free(darktable.image_cache);
   dt_mipmap_cache_cleanup(darktable.mipmap_cache);
   free(darktable.mipmap_cache);
+  dt_masks_cache_cleanup();
+  dt_interpolation_cleanup();
   if(init_gui)
   {
     dt_control_cleanup(darktable.control);
@@ -827,11 +842,14 @@ void dt_cleanup()
 
   dt_database_destroy(darktable.db);
 
+  dt_dev_pixelpipe_trace_cleanup();
+
   dt_bauhaus_cleanup();
 
   dt_capabilities_cleanup();
 
   dt_pthread_mutex_destroy(&(darktable.db_insert));
+  dt_pthread_mutex_destroy(&(darktable.db_batch));
   dt_pthread_mutex_destroy(&(darktable.plugin_threadsafe));
   dt_pthread_mutex_destroy(&(darktable.capabilities_threadsafe));
 
@@ -920,6 +938,9 @@ void dt_configure_defaults()
     fprintf(stderr, "[defaults] setting very conservative defaults\n");
     dt_conf_set_int("worker_threads", 1);
     dt_conf_set_int("cache_memory", 200u<<20);
+    dt_conf_set_int("pixelpipe_cache_memory", 64u<<20);
+    dt_conf_set_int("masks_cache_memory", 16u<<20);
+    dt_conf_set_int("darkroom_prefetch_memory", 0);
     dt_conf_set_int("host_memory_limit", 500);
     dt_conf_set_int("singlebuffer_limit", 8);
     dt_conf_set_int("plugins/lighttable/thumbnail_width", 800);
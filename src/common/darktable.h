@@ -192,6 +192,7 @@ typedef struct darktable_t
   struct dt_dbus_t               *dbus;
   struct dt_undo_t               *undo;
   dt_pthread_mutex_t db_insert;
+  dt_pthread_mutex_t db_batch; // held while a batch of writes is grouped in one savepoint
   dt_pthread_mutex_t plugin_threadsafe;
   dt_pthread_mutex_t capabilities_threadsafe;
   char *progname;
@@ -180,6 +180,12 @@ dt_pthread_cond_wait(pthread_cond_t *cond, dt_pthread_mutex_t *mutex)
   return pthread_cond_wait(cond, &(mutex->mutex));
 }
 
+static inline int
+dt_pthread_cond_timedwait(pthread_cond_t *cond, dt_pthread_mutex_t *mutex, const struct timespec *abstime)
+{
+  return pthread_cond_timedwait(cond, &(mutex->mutex), abstime);
+}
+
 #undef TOPN
 #else
 
@@ -190,6 +196,7 @@ dt_pthread_cond_wait(pthread_cond_t *cond, dt_pthread_mutex_t *mutex)
 #define dt_pthread_mutex_trylock pthread_mutex_trylock
 #define dt_pthread_mutex_unlock pthread_mutex_unlock
 #define dt_pthread_cond_wait pthread_cond_wait
+#define dt_pthread_cond_timedwait pthread_cond_timedwait
 
 #endif
 #endif
@@ -761,9 +761,53 @@ int dt_exif_read_from_blob(dt_image_t *img, uint8_t *blob, const int size)
   }
 }
 
+struct dt_exif_handle_t
+{
+  Exiv2::Image::AutoPtr image;
+  std::string path;
+};
+
 /** read the metadata of an image.
  * XMP data trumps IPTC data trumps EXIF data
  */
+static int _exif_read_metadata(dt_image_t *img, Exiv2::Image *image)
+{
+  bool res;
+
+  // EXIF metadata
+  Exiv2::ExifData &exifData = image->exifData();
+  res = dt_exif_read_exif_data(img, exifData);
+
+  // IPTC metadata.
+  Exiv2::IptcData &iptcData = image->iptcData();
+  res = dt_exif_read_iptc_data(img, iptcData) && res;
+
+  // XMP metadata
+  Exiv2::XmpData &xmpData = image->xmpData();
+  res = dt_exif_read_xmp_data(img, xmpData, false, true) && res;
+
+  // Initialize size - don't wait for full raw to be loaded to get this
+  // information. If use_embedded_thumbnail is set, it will take a
+  // change in development history to have this information
+  img->height = image->pixelHeight();
+  img->width = image->pixelWidth();
+
+  return res?0:1;
+}
+
+static int _exif_read_failed(dt_image_t *img, const char *path, Exiv2::AnyError& e)
+{
+  // at least set datetime taken to something useful in case there is no exif data in this file (pfm)
+  struct stat statbuf;
+  stat(path, &statbuf);
+  struct tm result;
+  strftime(img->exif_datetime_taken, 20, "%Y-%m-%d %H:%M:%S", localtime_r(&statbuf.st_mtime, &result));
+
+  std::string s(e.what());
+  std::cerr << "[exiv2] " << path << ": " << s << std::endl;
+  return 1;
+}
+
 int dt_exif_read(dt_image_t *img, const char* path)
 {
   try
@@ -772,42 +816,50 @@ int dt_exif_read(dt_image_t *img, const char* path)
     image = Exiv2::ImageFactory::open(path);
     assert(image.get() != 0);
     image->readMetadata();
-    bool res;
-
-    // EXIF metadata
-    Exiv2::ExifData &exifData = image->exifData();
-    res = dt_exif_read_exif_data(img, exifData);
-
-    // IPTC metadata.
-    Exiv2::IptcData &iptcData = image->iptcData();
-    res = dt_exif_read_iptc_data(img, iptcData) && res;
-
-    // XMP metadata
-    Exiv2::XmpData &xmpData = image->xmpData();
-    res = dt_exif_read_xmp_data(img, xmpData, false, true) && res;
-
-    // Initialize size - don't wait for full raw to be loaded to get this
-    // information. If use_embedded_thumbnail is set, it will take a
-    // change in development history to have this information
-    img->height = image->pixelHeight();
-    img->width = image->pixelWidth();
+    return _exif_read_metadata(img, image.get());
+  }
+  catch (Exiv2::AnyError& e)
+  {
+    return _exif_read_failed(img, path, e);
+  }
+}
 
-    return res?0:1;
+dt_exif_handle_t *dt_exif_open(const char* path)
+{
+  dt_exif_handle_t *handle = new dt_exif_handle_t;
+  try
+  {
+    handle->image = Exiv2::ImageFactory::open(path);
+    assert(handle->image.get() != 0);
+    handle->image->readMetadata();
+    handle->path = path;
+    return handle;
   }
   catch (Exiv2::AnyError& e)
   {
-    // at least set datetime taken to something useful in case there is no exif data in this file (pfm)
-    struct stat statbuf;
-    stat(path, &statbuf);
-    struct tm result;
-    strftime(img->exif_datetime_taken, 20, "%Y-%m-%d %H:%M:%S", localtime_r(&statbuf.st_mtime, &result));
+    // dt_exif_read() will try again and report it
+    delete handle;
+    return NULL;
+  }
+}
 
-    std::string s(e.what());
-    std::cerr << "[exiv2] " << path << ": " << s << std::endl;
-    return 1;
+int dt_exif_read_handle(dt_image_t *img, dt_exif_handle_t *handle)
+{
+  try
+  {
+    return _exif_read_metadata(img, handle->image.get());
+  }
+  catch (Exiv2::AnyError& e)
+  {
+    return _exif_read_failed(img, handle->path.c_str(), e);
   }
 }
 
+void dt_exif_close(dt_exif_handle_t *handle)
+{
+  delete handle;
+}
+
 int dt_exif_write_blob(uint8_t *blob,uint32_t size, const char* path)
 {
   try
@@ -1949,6 +2001,11 @@ int dt_exif_thumbnail(
         y_beg = 0;
         y_end = jpg.height - 1;
       }
+      // decode no larger than needed, the valid area shrinks with it:
+      const int full_height = jpg.height;
+      dt_imageio_jpeg_set_scale(&jpg, width, height);
+      y_beg = y_beg * jpg.height / full_height;
+      y_end = MIN(jpg.height - 1, y_end * jpg.height / full_height);
       uint8_t *tmp = (uint8_t *)malloc(sizeof(uint8_t)*jpg.width*jpg.height*4);
       if(!tmp) return 1;
       if(!dt_imageio_jpeg_decompress(&jpg, tmp))
@@ -1969,12 +2026,22 @@ int dt_exif_thumbnail(
   }
 }
 
+// the xmp toolkit behind exiv2 is not thread safe on its own, and the import parses files in parallel.
+static dt_pthread_mutex_t _exif_xmp_mutex;
+
+static void _exif_xmp_lock(void *data, bool lock)
+{
+  if(lock) dt_pthread_mutex_lock((dt_pthread_mutex_t *)data);
+  else     dt_pthread_mutex_unlock((dt_pthread_mutex_t *)data);
+}
+
 void dt_exif_init()
 {
   // mute exiv2:
   // Exiv2::LogMsg::setLevel(Exiv2::LogMsg::error);
 
-  Exiv2::XmpParser::initialize();
+  dt_pthread_mutex_init(&_exif_xmp_mutex, NULL);
+  Exiv2::XmpParser::initialize(_exif_xmp_lock, &_exif_xmp_mutex);
   // this has te stay with the old url (namespace already propagated outside dt)
   Exiv2::XmpProperties::registerNs("http://darktable.sf.net/", "darktable");
   Exiv2::XmpProperties::registerNs("http://ns.adobe.com/lightroom/1.0/", "lr");
@@ -1983,6 +2050,7 @@ void dt_exif_init()
 void dt_exif_cleanup()
 {
   Exiv2::XmpParser::terminate();
+  dt_pthread_mutex_destroy(&_exif_xmp_mutex);
 }
 
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
@@ -27,9 +27,21 @@ extern "C"
 {
 #endif
 
+  typedef struct dt_exif_handle_t dt_exif_handle_t;
+
   /** read metadata from file with full path name, XMP data trumps IPTC data trumps EXIF data, store to image struct. returns 0 on success. */
   int dt_exif_read(dt_image_t *img, const char* path);
 
+  /** opens the file and parses its metadata, but doesn't store it anywhere yet. this doesn't touch the
+   *  image cache or the database, so it can run in parallel for many files. returns NULL on failure. */
+  dt_exif_handle_t *dt_exif_open(const char* path);
+
+  /** same as dt_exif_read(), from metadata parsed by dt_exif_open(). */
+  int dt_exif_read_handle(dt_image_t *img, dt_exif_handle_t *handle);
+
+  /** frees what dt_exif_open() returned, NULL is fine. */
+  void dt_exif_close(dt_exif_handle_t *handle);
+
   /** read exif data to image struct from given data blob, wherever you got it from. */
   int dt_exif_read_from_blob(dt_image_t *img, uint8_t *blob, const int size);
 
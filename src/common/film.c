@@ -25,6 +25,7 @@
 #include "common/collection.h"
 #include "common/image_cache.h"
 #include "common/debug.h"
+#include "common/exif.h"
 #include "views/view.h"
 
 #include <stdio.h>
@@ -349,6 +350,9 @@ int _film_filename_cmp(gchar *a, gchar *b)
   return g_strcmp0(g_path_get_basename(a), g_path_get_basename(b));
 }
 
+// files imported per transaction, their metadata is read in parallel
+#define DT_FILM_IMPORT_BATCH 64
+
 void dt_film_import1(dt_film_t *film)
 {
   gboolean recursive = dt_conf_get_bool("ui_last/import_recursive");
@@ -375,58 +379,83 @@ void dt_film_import1(dt_film_t *film)
 
   /* loop thru the images and import to current film roll */
   dt_film_t *cfr = film;
+  dt_image_import_stmts_t stmts;
+  memset(&stmts, 0, sizeof(stmts));
   GList *image = g_list_first(images);
-  do
+  while(image)
   {
-    gchar *cdn = g_path_get_dirname((const gchar *)image->data);
-
-    /* check if we need to initialize a new filmroll */
-    if(!cfr || g_strcmp0(cfr->dirname, cdn) != 0)
+    /* parsing the metadata is what takes time, do that for the next batch of files
+       in parallel. the rest touches the database and the image cache, and stays serial. */
+    const gchar *batch[DT_FILM_IMPORT_BATCH];
+    dt_exif_handle_t *exif[DT_FILM_IMPORT_BATCH];
+    int count = 0;
+    for(; image && count < DT_FILM_IMPORT_BATCH; image = g_list_next(image))
+      batch[count++] = (const gchar *)image->data;
+#ifdef _OPENMP
+    #pragma omp parallel for default(none) shared(exif, batch, count) schedule(dynamic)
+#endif
+    for(int k=0; k<count; k++)
+      exif[k] = dt_exif_open(batch[k]);
+
+    /* and write the batch to the library in one transaction, instead of one per statement. the connection
+       is shared, so a savepoint nests into whatever else is going on, and only one batch is open at a time. */
+    dt_pthread_mutex_lock(&darktable.db_batch);
+    DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "savepoint film_import", NULL, NULL, NULL);
+    for(int k=0; k<count; k++)
     {
+      gchar *cdn = g_path_get_dirname(batch[k]);
+      /* check if we need to initialize a new filmroll */
+      if(!cfr || g_strcmp0(cfr->dirname, cdn) != 0)
+      {
 
 #if GLIB_CHECK_VERSION (2, 26, 0)
-      if(cfr && cfr->dir)
-      {
-        /* check if we can find a gpx data file to be auto applied
-           to images in the jsut imported filmroll */
-        g_dir_rewind(cfr->dir);
-        const gchar *dfn = NULL;
-        while ((dfn = g_dir_read_name(cfr->dir)) != NULL)
+        if(cfr && cfr->dir)
         {
-          /* check if we have a gpx to be auto applied to filmroll */
-          if(strcmp(dfn+strlen(dfn)-4,".gpx") == 0 ||
-              strcmp(dfn+strlen(dfn)-4,".GPX") == 0)
+          /* check if we can find a gpx data file to be auto applied
+             to images in the jsut imported filmroll */
+          g_dir_rewind(cfr->dir);
+          const gchar *dfn = NULL;
+          while ((dfn = g_dir_read_name(cfr->dir)) != NULL)
           {
-            gchar *gpx_file = g_build_path (G_DIR_SEPARATOR_S, cfr->dirname, dfn, NULL);
-            dt_control_gpx_apply(gpx_file, cfr->id, dt_conf_get_string("plugins/lighttable/geotagging/tz"));
-            g_free(gpx_file);
+            /* check if we have a gpx to be auto applied to filmroll */
+            if(strcmp(dfn+strlen(dfn)-4,".gpx") == 0 ||
+                strcmp(dfn+strlen(dfn)-4,".GPX") == 0)
+            {
+              gchar *gpx_file = g_build_path (G_DIR_SEPARATOR_S, cfr->dirname, dfn, NULL);
+              dt_control_gpx_apply(gpx_file, cfr->id, dt_conf_get_string("plugins/lighttable/geotagging/tz"));
+              g_free(gpx_file);
+            }
           }
         }
-      }
 #endif
 
-      /* cleanup previously imported filmroll*/
-      if(cfr && cfr!=film)
-      {
-        dt_film_cleanup(cfr);
-        g_free(cfr);
-        cfr = NULL;
-      }
+        /* cleanup previously imported filmroll*/
+        if(cfr && cfr!=film)
+        {
+          dt_film_cleanup(cfr);
+          g_free(cfr);
+          cfr = NULL;
+        }
 
-      /* initialize and create a new film to import to */
-      cfr = g_malloc(sizeof(dt_film_t));
-      dt_film_init(cfr);
-      dt_film_new(cfr, cdn);
-    }
+        /* initialize and create a new film to import to */
+        cfr = g_malloc(sizeof(dt_film_t));
+        dt_film_init(cfr);
+        dt_film_new(cfr, cdn);
+      }
 
-    /* import image */
-    dt_image_import(cfr->id, (const gchar *)image->data, FALSE);
+      g_free(cdn);
 
-    fraction+=1.0/total;
-    dt_control_backgroundjobs_progress(darktable.control, jid, fraction);
+      /* import image */
+      dt_image_import_with_exif(cfr->id, batch[k], FALSE, exif[k], &stmts);
+      dt_exif_close(exif[k]);
 
+      fraction+=1.0/total;
+      dt_control_backgroundjobs_progress(darktable.control, jid, fraction);
+    }
+    DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "release film_import", NULL, NULL, NULL);
+    dt_pthread_mutex_unlock(&darktable.db_batch);
   }
-  while( (image = g_list_next(image)) != NULL);
+  dt_image_import_stmts_cleanup(&stmts);
 
   // only redraw at the end, to not spam the cpu with exposure events
   dt_control_queue_redraw_center();
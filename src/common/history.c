@@ -20,6 +20,7 @@
 #include "common/darktable.h"
 #include "develop/develop.h"
 #include "control/control.h"
+#include "common/collection.h"
 #include "common/debug.h"
 #include "common/exif.h"
 #include "common/history.h"
@@ -87,6 +88,9 @@ void dt_history_delete_on_image(int32_t imgid)
 
   /* remove darktable|style|* tags */
   dt_tag_detach_by_string("darktable|style%", imgid);
+
+  /* it might not be altered anymore */
+  dt_collection_image_changed(darktable.collection, imgid);
 }
 
 void
@@ -131,6 +135,7 @@ dt_history_load_and_apply_on_selection (gchar *filename)
     }
   }
   sqlite3_finalize(stmt);
+  dt_collection_image_changed(darktable.collection, -1);
   return res;
 }
 
@@ -237,6 +242,9 @@ dt_history_copy_and_paste_on_image (int32_t imgid, int32_t dest_imgid, gboolean
 
   dt_mipmap_cache_remove(darktable.mipmap_cache, dest_imgid);
 
+  /* it might be altered now */
+  dt_collection_image_changed(darktable.collection, dest_imgid);
+
   return 0;
 }
 
@@ -382,6 +382,8 @@ int32_t dt_image_duplicate(const int32_t imgid)
     DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, newid);
     sqlite3_step(stmt);
     sqlite3_finalize(stmt);
+    // show the new duplicate, wherever it belongs in the collection:
+    dt_collection_image_changed(darktable.collection, newid);
     if(darktable.gui && darktable.gui->grouping)
     {
       const dt_image_t *img = dt_image_cache_read_get(darktable.image_cache, newid);
@@ -452,6 +454,7 @@ void dt_image_remove(const int32_t imgid)
   sqlite3_finalize(stmt);
   // also clear all thumbnails in mipmap_cache.
   dt_mipmap_cache_remove(darktable.mipmap_cache, imgid);
+  dt_collection_image_changed(darktable.collection, imgid);
 }
 
 int dt_image_altered(const uint32_t imgid)
@@ -483,6 +486,42 @@ int dt_image_altered(const uint32_t imgid)
 
 
 uint32_t dt_image_import(const int32_t film_id, const char *filename, gboolean override_ignore_jpegs)
+{
+  return dt_image_import_with_exif(film_id, filename, override_ignore_jpegs, NULL, NULL);
+}
+
+// returns a statement for sql, ready to bind. if kept is given, it is prepared only the first time.
+static sqlite3_stmt *_image_import_stmt(sqlite3_stmt **kept, const char *sql)
+{
+  sqlite3_stmt *stmt = NULL;
+  if(kept && *kept) return *kept;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), sql, -1, &stmt, NULL);
+  if(kept) *kept = stmt;
+  return stmt;
+}
+
+// done with a statement from _image_import_stmt(), kept ones are only reset.
+static void _image_import_stmt_done(sqlite3_stmt **kept, sqlite3_stmt *stmt)
+{
+  if(!kept)
+  {
+    sqlite3_finalize(stmt);
+    return;
+  }
+  sqlite3_reset(stmt);
+  sqlite3_clear_bindings(stmt);
+}
+
+void dt_image_import_stmts_cleanup(dt_image_import_stmts_t *stmts)
+{
+  sqlite3_finalize(stmts->select_id);
+  sqlite3_finalize(stmts->insert);
+  sqlite3_finalize(stmts->set_group);
+  memset(stmts, 0, sizeof(dt_image_import_stmts_t));
+}
+
+uint32_t dt_image_import_with_exif(const int32_t film_id, const char *filename, gboolean override_ignore_jpegs,
+                                   dt_exif_handle_t *exif, dt_image_import_stmts_t *stmts)
 {
   if(!g_file_test(filename, G_FILE_TEST_IS_REGULAR))
     return 0;
@@ -518,16 +557,17 @@ uint32_t dt_image_import(const int32_t film_id, const char *filename, gboolean o
   gchar *imgfname;
   imgfname = g_path_get_basename((const gchar*)filename);
   sqlite3_stmt *stmt;
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "select id from images where film_id = ?1 and filename = ?2",
-                              -1, &stmt, NULL);
+  sqlite3_stmt **select_id = stmts ? &stmts->select_id : NULL;
+  sqlite3_stmt **insert = stmts ? &stmts->insert : NULL;
+  sqlite3_stmt **set_group = stmts ? &stmts->set_group : NULL;
+  stmt = _image_import_stmt(select_id, "select id from images where film_id = ?1 and filename = ?2");
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, film_id);
   DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 2, imgfname, strlen(imgfname), SQLITE_STATIC);
   if(sqlite3_step(stmt) == SQLITE_ROW)
   {
     id = sqlite3_column_int(stmt, 0);
+    _image_import_stmt_done(select_id, stmt);
     g_free(imgfname);
-    sqlite3_finalize(stmt);
     g_free(ext);
     const dt_image_t *cimg = dt_image_cache_read_get(darktable.image_cache, id);
     dt_image_t *img = dt_image_cache_write_get(darktable.image_cache, cimg);
@@ -536,7 +576,7 @@ uint32_t dt_image_import(const int32_t film_id, const char *filename, gboolean o
     dt_image_cache_read_release(darktable.image_cache, img);
     return id;
   }
-  sqlite3_finalize(stmt);
+  _image_import_stmt_done(select_id, stmt);
 
   // also need to set the no-legacy bit, to make sure we get the right presets (new ones)
   uint32_t flags = dt_conf_get_int("ui_last/import_initial_rating");
@@ -547,26 +587,22 @@ uint32_t dt_image_import(const int32_t film_id, const char *filename, gboolean o
   }
   flags |= DT_IMAGE_NO_LEGACY_PRESETS;
   // insert dummy image entry in database
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "insert into images (id, film_id, filename, caption, description, "
-                              "license, sha1sum, flags) values (null, ?1, ?2, '', '', '', '', ?3)",
-                              -1, &stmt, NULL);
+  stmt = _image_import_stmt(insert, "insert into images (id, film_id, filename, caption, description, "
+                                    "license, sha1sum, flags) values (null, ?1, ?2, '', '', '', '', ?3)");
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, film_id);
   DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 2, imgfname, strlen(imgfname),
                              SQLITE_TRANSIENT);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 3, flags);
   rc = sqlite3_step(stmt);
   if (rc != SQLITE_DONE) fprintf(stderr, "sqlite3 error %d\n", rc);
-  sqlite3_finalize(stmt);
+  _image_import_stmt_done(insert, stmt);
 
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "select id from images where film_id = ?1 and filename = ?2",
-                              -1, &stmt, NULL);
+  stmt = _image_import_stmt(select_id, "select id from images where film_id = ?1 and filename = ?2");
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, film_id);
   DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 2, imgfname, strlen(imgfname),
                              SQLITE_STATIC);
   if(sqlite3_step(stmt) == SQLITE_ROW) id = sqlite3_column_int(stmt, 0);
-  sqlite3_finalize(stmt);
+  _image_import_stmt_done(select_id, stmt);
 
   // Try to find out if this should be grouped already.
   gchar *basename = g_strdup(imgfname);
@@ -636,11 +672,11 @@ uint32_t dt_image_import(const int32_t film_id, const char *filename, gboolean o
     else                                 group_id = id;
   }
   sqlite3_finalize(stmt);
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "update images set group_id = ?1 where id = ?2", -1, &stmt, NULL);
+  stmt = _image_import_stmt(set_group, "update images set group_id = ?1 where id = ?2");
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, group_id);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, id);
   sqlite3_step(stmt);
-  sqlite3_finalize(stmt);
+  _image_import_stmt_done(set_group, stmt);
 
   // printf("[image_import] importing `%s' to img id %d\n", imgfname, id);
 
@@ -650,7 +686,8 @@ uint32_t dt_image_import(const int32_t film_id, const char *filename, gboolean o
   img->group_id = group_id;
 
   // read dttags and exif for database queries!
-  (void) dt_exif_read(img, filename);
+  if(exif) (void) dt_exif_read_handle(img, exif);
+  else      (void) dt_exif_read(img, filename);
   char dtfilename[DT_MAX_PATH_LEN];
   g_strlcpy(dtfilename, filename, DT_MAX_PATH_LEN);
   dt_image_path_append_version(id, dtfilename, DT_MAX_PATH_LEN);
@@ -838,6 +875,7 @@ int32_t dt_image_move(const int32_t imgid, const int32_t filmid)
         // write through to db, but not to xmp
         dt_image_cache_write_release(darktable.image_cache, img, DT_IMAGE_CACHE_RELAXED);
         dt_image_cache_read_release(darktable.image_cache, img);
+        dt_collection_image_changed(darktable.collection, id);
         dup_list = g_list_delete_link(dup_list, dup_list);
       }
       g_list_free(dup_list);
@@ -974,6 +1012,7 @@ int32_t dt_image_copy(const int32_t imgid, const int32_t filmid)
 
         // write xmp file
         dt_image_write_sidecar_file(newid);
+        dt_collection_image_changed(darktable.collection, newid);
       }
     }
     else
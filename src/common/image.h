@@ -139,6 +139,20 @@ void dt_image_path_append_version(int imgid, char *pathname, const int len);
 void dt_image_print_exif(const dt_image_t *img, char *line, int len);
 /** imports a new image from raw/etc file and adds it to the data base and image cache. */
 uint32_t dt_image_import(const int32_t film_id, const char *filename, gboolean override_ignore_jpegs);
+/** statements which dt_image_import_with_exif() prepares once and reuses over a batch of imports. zero it before the first use. */
+typedef struct dt_image_import_stmts_t
+{
+  struct sqlite3_stmt *select_id;
+  struct sqlite3_stmt *insert;
+  struct sqlite3_stmt *set_group;
+}
+dt_image_import_stmts_t;
+/** same, with the metadata already parsed by dt_exif_open() (or NULL). the caller still owns exif.
+ * stmts may be NULL, otherwise the statements in there are reused. */
+uint32_t dt_image_import_with_exif(const int32_t film_id, const char *filename, gboolean override_ignore_jpegs,
+                                   struct dt_exif_handle_t *exif, dt_image_import_stmts_t *stmts);
+/** finalizes the statements kept for a batch of imports. */
+void dt_image_import_stmts_cleanup(dt_image_import_stmts_t *stmts);
 /** removes the given image from the database. */
 void dt_image_remove(const int32_t imgid);
 /** duplicates the given image in the database. */
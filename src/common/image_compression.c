@@ -17,10 +17,20 @@
 */
 #include "common/image_compression.h"
 
+#include <float.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
 #include <string.h>
+#include <emmintrin.h>
+
+// no glib here, so src/tests/dxt.c builds without it.
+#ifndef CLAMP
+#define CLAMP(x, low, high) (((x) > (high)) ? (high) : (((x) < (low)) ? (low) : (x)))
+#endif
+#ifndef MIN
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+#endif
 
 typedef union
 {
@@ -150,6 +160,248 @@ void dt_image_compress(const float *in, uint8_t *out, const int32_t width, const
   }
 }
 
+// =================================================
+//   DXT1 block codec for 8-bit thumbnails
+// =================================================
+
+// expands a 565 colour to 8 bits per channel, the same way squish does it.
+static inline void
+_dxt1_unpack_565(const int v, int c[3])
+{
+  const int r = (v >> 11) & 0x1f, g = (v >> 5) & 0x3f, b = v & 0x1f;
+  c[0] = (r << 3) | (r >> 2);
+  c[1] = (g << 2) | (g >> 4);
+  c[2] = (b << 3) | (b >> 2);
+}
+
+static inline int
+_dxt1_pack_565(const float c[3])
+{
+  const int r = CLAMP((int)(c[0]*(31.0f/255.0f) + 0.5f), 0, 31);
+  const int g = CLAMP((int)(c[1]*(63.0f/255.0f) + 0.5f), 0, 63);
+  const int b = CLAMP((int)(c[2]*(31.0f/255.0f) + 0.5f), 0, 31);
+  return (r << 11) | (g << 5) | b;
+}
+
+// the four colours of a block as 4 bytes per pixel: c0, c1 and the two interpolated ones.
+static inline __m128i
+_dxt1_palette(const uint8_t *const block)
+{
+  const int a = block[0] | (block[1] << 8);
+  const int b = block[2] | (block[3] << 8);
+  int ca[3], cb[3];
+  _dxt1_unpack_565(a, ca);
+  _dxt1_unpack_565(b, cb);
+  // 16-bit lanes: c0 in the low, c1 in the high half, and swapped:
+  const __m128i c = _mm_setr_epi16(ca[0], ca[1], ca[2], 255, cb[0], cb[1], cb[2], 255);
+  const __m128i s = _mm_shuffle_epi32(c, _MM_SHUFFLE(1, 0, 3, 2));
+  __m128i mid;
+  if(a <= b)
+  {
+    // three colour mode: (c0+c1)/2 and transparent black
+    mid = _mm_srli_epi16(_mm_add_epi16(c, s), 1);
+    mid = _mm_unpacklo_epi64(mid, _mm_setzero_si128());
+  }
+  else
+  {
+    // (2c0+c1)/3 and (c0+2c1)/3. x*21846 >> 16 is exactly x/3 for x < 768.
+    mid = _mm_mulhi_epu16(_mm_add_epi16(_mm_add_epi16(c, c), s), _mm_set1_epi16(21846));
+  }
+  return _mm_packus_epi16(c, mid);
+}
+
+void dt_image_dxt1_uncompress_8(const uint8_t *in, uint8_t *out, const int32_t width, const int32_t height)
+{
+  const int32_t bw = (width + 3)/4;
+#ifdef _OPENMP
+  #pragma omp parallel for schedule(static)
+#endif
+  for(int j=0; j<height; j+=4)
+  {
+    const uint8_t *block = in + 8*bw*(j/4);
+    for(int i=0; i<width; i+=4, block+=8)
+    {
+      uint32_t palette[4] __attribute__((aligned(16)));
+      _mm_store_si128((__m128i *)palette, _dxt1_palette(block));
+      if(i + 4 <= width && j + 4 <= height)
+      {
+        // whole block, one row of four pixels per index byte:
+        for(int r=0; r<4; r++)
+        {
+          const int idx = block[4+r];
+          const __m128i row = _mm_setr_epi32(palette[idx & 3], palette[(idx >> 2) & 3],
+                                             palette[(idx >> 4) & 3], palette[idx >> 6]);
+          _mm_storeu_si128((__m128i *)(out + 4*(i + (size_t)width*(j + r))), row);
+        }
+      }
+      else
+      {
+        for(int r=0; r<4 && j+r<height; r++)
+          for(int c=0; c<4 && i+c<width; c++)
+            memcpy(out + 4*(i + c + (size_t)width*(j + r)), palette + ((block[4+r] >> (2*c)) & 3), 4);
+      }
+    }
+  }
+}
+
+// picks the closest of the four palette colours for every pixel. returns the index bits.
+static inline uint32_t
+_dxt1_indices(const float px[16][3], const int p[4][3])
+{
+  uint32_t bits = 0;
+  for(int k=0; k<16; k++)
+  {
+    int best = 0;
+    float dmin = FLT_MAX;
+    for(int q=0; q<4; q++)
+    {
+      const float d0 = px[k][0] - p[q][0], d1 = px[k][1] - p[q][1], d2 = px[k][2] - p[q][2];
+      const float d = d0*d0 + d1*d1 + d2*d2;
+      if(d < dmin)
+      {
+        dmin = d;
+        best = q;
+      }
+    }
+    bits |= best << (2*k);
+  }
+  return bits;
+}
+
+// encodes both endpoints, and the indices fitting them best. returns the index bits.
+static inline uint32_t
+_dxt1_encode(const float px[16][3], const float e0[3], const float e1[3], int *a, int *b)
+{
+  *a = _dxt1_pack_565(e0);
+  *b = _dxt1_pack_565(e1);
+  // four colour mode needs a > b:
+  if(*a < *b)
+  {
+    const int t = *a;
+    *a = *b;
+    *b = t;
+  }
+  if(*a == *b) return 0; // one colour, index 0 is exactly c0 in three colour mode.
+  int p[4][3];
+  _dxt1_unpack_565(*a, p[0]);
+  _dxt1_unpack_565(*b, p[1]);
+  for(int c=0; c<3; c++)
+  {
+    p[2][c] = (2*p[0][c] + p[1][c])/3;
+    p[3][c] = (p[0][c] + 2*p[1][c])/3;
+  }
+  return _dxt1_indices(px, p);
+}
+
+static void
+_dxt1_compress_block(const float px[16][3], uint8_t *block, const int refine)
+{
+  // principal axis of the colours in the block, by power iteration on the covariance:
+  float mean[3] = {0.0f}, cov[6] = {0.0f};
+  float mn[3] = {255.0f, 255.0f, 255.0f}, mx[3] = {0.0f};
+  for(int k=0; k<16; k++) for(int c=0; c<3; c++)
+    {
+      mean[c] += px[k][c]*(1.0f/16.0f);
+      mn[c] = fminf(mn[c], px[k][c]);
+      mx[c] = fmaxf(mx[c], px[k][c]);
+    }
+  for(int k=0; k<16; k++)
+  {
+    const float d[3] = { px[k][0] - mean[0], px[k][1] - mean[1], px[k][2] - mean[2] };
+    cov[0] += d[0]*d[0]; cov[1] += d[0]*d[1]; cov[2] += d[0]*d[2];
+    cov[3] += d[1]*d[1]; cov[4] += d[1]*d[2]; cov[5] += d[2]*d[2];
+  }
+  float axis[3] = { mx[0] - mn[0], mx[1] - mn[1], mx[2] - mn[2] };
+  for(int it=0; it<4; it++)
+  {
+    const float v[3] = { cov[0]*axis[0] + cov[1]*axis[1] + cov[2]*axis[2],
+                         cov[1]*axis[0] + cov[3]*axis[1] + cov[4]*axis[2],
+                         cov[2]*axis[0] + cov[4]*axis[1] + cov[5]*axis[2] };
+    const float n = fmaxf(fabsf(v[0]), fmaxf(fabsf(v[1]), fabsf(v[2])));
+    if(n < 1e-6f) break;
+    for(int c=0; c<3; c++) axis[c] = v[c]/n;
+  }
+
+  // the extreme colours along that axis are the first guess for the endpoints:
+  float e0[3] = { px[0][0], px[0][1], px[0][2] }, e1[3] = { px[0][0], px[0][1], px[0][2] };
+  float dmin = FLT_MAX, dmax = -FLT_MAX;
+  for(int k=0; k<16; k++)
+  {
+    const float d = px[k][0]*axis[0] + px[k][1]*axis[1] + px[k][2]*axis[2];
+    if(d < dmin)
+    {
+      dmin = d;
+      for(int c=0; c<3; c++) e1[c] = px[k][c];
+    }
+    if(d > dmax)
+    {
+      dmax = d;
+      for(int c=0; c<3; c++) e0[c] = px[k][c];
+    }
+  }
+
+  int a, b;
+  uint32_t bits = _dxt1_encode(px, e0, e1, &a, &b);
+
+  // least squares fit of the endpoints to the chosen indices, which usually lowers the error a bit:
+  for(int it=0; it<refine && a != b; it++)
+  {
+    static const float w0[4] = { 1.0f, 0.0f, 2.0f/3.0f, 1.0f/3.0f };
+    float aa = 0.0f, ab = 0.0f, bb = 0.0f, ax[3] = {0.0f}, bx[3] = {0.0f};
+    for(int k=0; k<16; k++)
+    {
+      const float wa = w0[(bits >> (2*k)) & 3], wb = 1.0f - wa;
+      aa += wa*wa;
+      ab += wa*wb;
+      bb += wb*wb;
+      for(int c=0; c<3; c++)
+      {
+        ax[c] += wa*px[k][c];
+        bx[c] += wb*px[k][c];
+      }
+    }
+    const float det = aa*bb - ab*ab;
+    if(fabsf(det) < 1e-6f) break;
+    float f0[3], f1[3];
+    for(int c=0; c<3; c++)
+    {
+      f0[c] = CLAMP((bb*ax[c] - ab*bx[c])/det, 0.0f, 255.0f);
+      f1[c] = CLAMP((aa*bx[c] - ab*ax[c])/det, 0.0f, 255.0f);
+    }
+    bits = _dxt1_encode(px, f0, f1, &a, &b);
+  }
+
+  block[0] = a & 0xff;
+  block[1] = a >> 8;
+  block[2] = b & 0xff;
+  block[3] = b >> 8;
+  for(int r=0; r<4; r++) block[4+r] = (bits >> (8*r)) & 0xff;
+}
+
+void dt_image_dxt1_compress_8(const uint8_t *in, uint8_t *out, const int32_t width, const int32_t height, const int refine)
+{
+  const int32_t bw = (width + 3)/4;
+#ifdef _OPENMP
+  #pragma omp parallel for schedule(static)
+#endif
+  for(int j=0; j<height; j+=4)
+  {
+    uint8_t *block = out + 8*bw*(j/4);
+    for(int i=0; i<width; i+=4, block+=8)
+    {
+      // pixels outside the image repeat the border:
+      float px[16][3];
+      for(int k=0; k<16; k++)
+      {
+        const int ii = MIN(i + (k & 3), width - 1), jj = MIN(j + (k >> 2), height - 1);
+        const uint8_t *p = in + 4*(ii + (size_t)width*jj);
+        for(int c=0; c<3; c++) px[k][c] = p[c];
+      }
+      _dxt1_compress_block(px, block, refine);
+    }
+  }
+}
+
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
 // kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-space on;
@@ -16,12 +16,20 @@
     along with darktable.  If not, see <http://www.gnu.org/licenses/>.
 */
 #ifndef DT_IMAGE_COMPRESSION
+#define DT_IMAGE_COMPRESSION
 #include <inttypes.h>
 
 /** K. Roimela, T. Aarnio and J. Itäranta. High Dynamic Range Texture Compression. Proceedings of SIGGRAPH 2006. */
 void dt_image_compress(const float *in, uint8_t *out, const int32_t width, const int32_t height);
 void dt_image_uncompress(const uint8_t *in, float *out, const int32_t width, const int32_t height);
 
+/** DXT1 for 8-bit thumbnails: 4 bytes per pixel in, 8 bytes per 4x4 block out, blocks in rows of (width+3)/4.
+  * refine is the number of least squares passes over the endpoints, 0 is fastest. */
+void dt_image_dxt1_compress_8(const uint8_t *in, uint8_t *out, const int32_t width, const int32_t height, const int refine);
+/** decodes to 4 bytes per pixel with a stride of 4*width, as a cairo RGB24 surface wants it.
+  * the pixels are identical to what squish decodes from the same blocks. */
+void dt_image_dxt1_uncompress_8(const uint8_t *in, uint8_t *out, const int32_t width, const int32_t height);
+
 #endif
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
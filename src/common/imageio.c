@@ -45,10 +45,12 @@
 #include "develop/develop.h"
 #include "develop/imageop.h"
 #include "develop/blend.h"
+#include "develop/tiling.h"
 #include "iop/colorout.h"
 #include "libraw/libraw.h"
 
 #include <inttypes.h>
+#include <sqlite3.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -500,6 +502,315 @@ void dt_imageio_to_fractional(float in, uint32_t *num, uint32_t *den)
   }
 }
 
+// a pixelpipe which outlives a single export, together with the develop struct owning the modules
+// its nodes point to. consecutive images with the same module stack keep the nodes and cache lines.
+typedef struct dt_imageio_export_pipe_t
+{
+  dt_develop_t *dev;
+  dt_dev_pixelpipe_t pipe;
+  int32_t thumbnail;
+  int32_t levels;
+}
+dt_imageio_export_pipe_t;
+
+// returns 1 if the nodes of the pipe have been created for the same module instances as found in dev.
+static int _export_pipe_matches(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev)
+{
+  GList *nodes = pipe->nodes;
+  GList *modules = dev->iop;
+  while(nodes && modules)
+  {
+    const dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)nodes->data;
+    const dt_iop_module_t *module = (dt_iop_module_t *)modules->data;
+    if(piece->module->so != module->so || piece->module->multi_priority != module->multi_priority) return 0;
+    nodes = g_list_next(nodes);
+    modules = g_list_next(modules);
+  }
+  return !nodes && !modules;
+}
+
+// takes an idle pipe from the pool, preferring one with a matching module stack.
+// returns NULL if no export session is running or no suitable pipe is idle.
+static dt_imageio_export_pipe_t *_export_pipe_acquire(dt_develop_t *dev, const int thumbnail, const int levels)
+{
+  dt_imageio_t *iio = darktable.imageio;
+  dt_imageio_export_pipe_t *ep = NULL;
+  dt_pthread_mutex_lock(&iio->export_mutex);
+  GList *candidate = NULL;
+  for(GList *it = iio->export_pipes; it; it = g_list_next(it))
+  {
+    dt_imageio_export_pipe_t *p = (dt_imageio_export_pipe_t *)it->data;
+    if(p->thumbnail != thumbnail || p->levels != levels) continue;
+    if(!candidate) candidate = it;
+    if(p->dev && _export_pipe_matches(&p->pipe, dev))
+    {
+      candidate = it;
+      break;
+    }
+  }
+  if(candidate)
+  {
+    ep = (dt_imageio_export_pipe_t *)candidate->data;
+    iio->export_pipes = g_list_delete_link(iio->export_pipes, candidate);
+  }
+  dt_pthread_mutex_unlock(&iio->export_mutex);
+  return ep;
+}
+
+// hands dev over to the pipe. if the previous image used the same module stack, the nodes
+// (and whatever init_pipe allocated for them) are kept and only pointed to the new modules.
+static void _export_pipe_attach(dt_imageio_export_pipe_t *ep, dt_develop_t *dev)
+{
+  dt_dev_pixelpipe_t *pipe = &ep->pipe;
+  if(ep->dev && _export_pipe_matches(pipe, dev))
+  {
+    dt_pthread_mutex_lock(&pipe->busy_mutex);
+    GList *modules = dev->iop;
+    for(GList *nodes = pipe->nodes; nodes; nodes = g_list_next(nodes))
+    {
+      dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)nodes->data;
+      piece->module  = (dt_iop_module_t *)modules->data;
+      piece->iscale  = pipe->iscale;
+      piece->iwidth  = pipe->iwidth;
+      piece->iheight = pipe->iheight;
+      piece->process_cl_ready = 0;
+      modules = g_list_next(modules);
+    }
+    dt_pthread_mutex_unlock(&pipe->busy_mutex);
+  }
+  else
+  {
+    // nodes have to be cleaned up while the modules they were created for are still alive:
+    if(ep->dev) dt_dev_pixelpipe_cleanup_nodes(pipe);
+    dt_dev_pixelpipe_create_nodes(pipe, dev);
+  }
+  if(ep->dev)
+  {
+    dt_dev_cleanup(ep->dev);
+    free(ep->dev);
+  }
+  ep->dev = dev;
+  // keep the buffers, but don't hand out pixels of the previous image:
+  dt_dev_pixelpipe_cache_flush(&pipe->cache);
+}
+
+static void _export_pipe_destroy(dt_imageio_export_pipe_t *ep)
+{
+  dt_dev_pixelpipe_cleanup(&ep->pipe);
+  if(ep->dev)
+  {
+    dt_dev_cleanup(ep->dev);
+    free(ep->dev);
+  }
+  free(ep);
+}
+
+// returns the pipe to the pool while an export session is running, destroys it otherwise.
+static void _export_pipe_release(dt_imageio_export_pipe_t *ep)
+{
+  dt_imageio_t *iio = darktable.imageio;
+  dt_pthread_mutex_lock(&iio->export_mutex);
+  if(iio->export_sessions > 0)
+  {
+    iio->export_pipes = g_list_prepend(iio->export_pipes, ep);
+    ep = NULL;
+  }
+  dt_pthread_mutex_unlock(&iio->export_mutex);
+  if(ep) _export_pipe_destroy(ep);
+}
+
+void dt_imageio_export_session_begin()
+{
+  dt_imageio_t *iio = darktable.imageio;
+  dt_pthread_mutex_lock(&iio->export_mutex);
+  iio->export_sessions++;
+  dt_pthread_mutex_unlock(&iio->export_mutex);
+}
+
+void dt_imageio_export_session_end()
+{
+  dt_imageio_t *iio = darktable.imageio;
+  GList *pipes = NULL;
+  dt_pthread_mutex_lock(&iio->export_mutex);
+  if(--iio->export_sessions <= 0)
+  {
+    iio->export_sessions = 0;
+    pipes = iio->export_pipes;
+    iio->export_pipes = NULL;
+  }
+  dt_pthread_mutex_unlock(&iio->export_mutex);
+  while(pipes)
+  {
+    _export_pipe_destroy((dt_imageio_export_pipe_t *)pipes->data);
+    pipes = g_list_delete_link(pipes, pipes);
+  }
+}
+
+int dt_imageio_export_max_threads(const GList *imgids, const int requested)
+{
+  // every thread holds the full input buffer, the pipe cache lines and the processing buffers
+  // of the largest image in flight. don't start more threads than fit the host memory limit.
+  size_t max_width = 0, max_height = 0;
+  for(const GList *i = imgids; i; i = g_list_next(i))
+  {
+    const dt_image_t *image = dt_image_cache_read_get(darktable.image_cache, (int32_t)(long int)i->data);
+    if(!image) continue;
+    if((size_t)image->width * image->height > max_width * max_height)
+    {
+      max_width  = image->width;
+      max_height = image->height;
+    }
+    dt_image_cache_read_release(darktable.image_cache, image);
+  }
+  int max_threads = MAX(1, requested);
+  while(max_threads > 1 && !dt_tiling_piece_fits_host_memory(max_width, max_height, 4*sizeof(float), 5.0f*max_threads, 0))
+    max_threads--;
+  return max_threads;
+}
+
+// thumbnails can be processed from the downscaled float buffer, as long as it has the pixels the thumbnail needs.
+// if the history changes the geometry, the export switches to the full buffer, see _pipe_changes_geometry().
+static int _thumbnail_from_mipf(const uint32_t imgid, const dt_imageio_module_data_t *format_params)
+{
+  if(dt_conf_get_bool("plugins/lighttable/low_quality_thumbnails")) return 1;
+  const dt_mipmap_cache_one_t *mipf = &darktable.mipmap_cache->mip[DT_MIPMAP_F];
+  return format_params->max_width <= mipf->max_width && format_params->max_height <= mipf->max_height;
+}
+
+// does any enabled module crop, rotate, distort or add borders? the pieces' buffer sizes have to be
+// set by dt_dev_pixelpipe_get_dimensions() before.
+static int _pipe_changes_geometry(dt_dev_pixelpipe_t *pipe)
+{
+  for(const GList *nodes = pipe->nodes; nodes; nodes = g_list_next(nodes))
+  {
+    const dt_dev_pixelpipe_iop_t *piece = (const dt_dev_pixelpipe_iop_t *)nodes->data;
+    if(!piece->enabled) continue;
+    if(piece->buf_in.x != piece->buf_out.x || piece->buf_in.y != piece->buf_out.y ||
+       piece->buf_in.width != piece->buf_out.width || piece->buf_in.height != piece->buf_out.height)
+      return 1;
+  }
+  return 0;
+}
+
+// huge images are exported in horizontal stripes, if the format can write them that way and all modules
+// can run on parts of the image (the ones which allow tiling can). memory then depends on the stripe size only.
+static int _export_stripes_wanted(dt_dev_pixelpipe_t *pipe, dt_imageio_module_format_t *format, const int width, const int height)
+{
+  if(!format->write_image_rows) return 0;
+  if(!dt_conf_get_bool("plugins/lighttable/export/stripes") &&
+     dt_tiling_piece_fits_host_memory(width, height, 4*sizeof(float), 3.0f, 0)) return 0;
+  for(GList *nodes = pipe->nodes; nodes; nodes = g_list_next(nodes))
+  {
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)nodes->data;
+    if(!piece->enabled || !strcmp(piece->module->op, "gamma")) continue;
+    if(!(piece->module->flags() & (IOP_FLAGS_ALLOW_TILING | IOP_FLAGS_POINT_TO_POINT))) return 0;
+  }
+  return 1;
+}
+
+static int _export_stripes(
+  dt_dev_pixelpipe_t         *pipe,
+  dt_develop_t               *dev,
+  const uint32_t              imgid,
+  const char                 *filename,
+  dt_imageio_module_format_t *format,
+  dt_imageio_module_data_t   *format_params,
+  const int32_t               ignore_exif,
+  const int32_t               display_byteorder,
+  const int                   sRGB,
+  const int                   width,
+  const int                   height,
+  const double                scale,
+  const int                   bpp)
+{
+  const dt_iop_roi_t roi = { 0, 0, width, height, scale };
+  const int overlap = dt_dev_pixelpipe_tiling_overlap(pipe, dev, &roi);
+  // ~64MB of floats per stripe, but not less than a tiff strip:
+  const int rows = MIN(height, MAX(64, (int)((64 << 20) / (4*sizeof(float)*width))));
+  const size_t outsize = (size_t)width*rows*4*MAX(1, bpp/8);
+  uint8_t *outbuf = (uint8_t *)dt_alloc_align(64, outsize);
+  if(!outbuf) return 1;
+
+  // the pipe cache lines have been sized for the full image, they only need to hold a stripe now:
+  dt_dev_pixelpipe_cache_trim(&pipe->cache, (size_t)width*(rows + 2*overlap)*4*sizeof(float));
+
+  format_params->width  = width;
+  format_params->height = height;
+  if(format->write_image_begin(format_params, filename, imgid))
+  {
+    free(outbuf);
+    return 1;
+  }
+  dt_print(DT_DEBUG_DEV, "[export] writing %dx%d in stripes of %d rows, %d rows overlap\n", width, height, rows, overlap);
+
+  int res = 0;
+  for(int y=0; y<height && !res; y+=rows)
+  {
+    const int h = MIN(rows, height - y);
+    const int top = MIN(y, overlap);
+    const int bottom = MIN(height - y - h, overlap);
+    if(bpp == 8)
+      res = dt_dev_pixelpipe_process(pipe, dev, 0, y - top, width, h + top + bottom, scale);
+    else
+      res = dt_dev_pixelpipe_process_no_gamma(pipe, dev, 0, y - top, width, h + top + bottom, scale);
+    if(res) break;
+
+    // convert the rows we're after, the overlap is only there for the neighbourhood of the stripe:
+    int npixels = width*h;
+    if(bpp == 8)
+    {
+      // flip byte order, unless asked not to:
+      const uint8_t *in8 = pipe->backbuf + (size_t)4*width*top;
+      int r = display_byteorder ? 0 : 2;
+#ifdef _OPENMP
+      #pragma omp parallel for default(none) shared(outbuf, in8, r, npixels) schedule(static)
+#endif
+      for(int k=0; k<npixels; k++)
+      {
+        outbuf[4*k+0] = in8[4*k+r];
+        outbuf[4*k+1] = in8[4*k+1];
+        outbuf[4*k+2] = in8[4*k+2-r];
+        outbuf[4*k+3] = in8[4*k+3];
+      }
+    }
+    else if(bpp == 16)
+    {
+      // uint16_t per color channel
+      const float *inf = (const float *)pipe->backbuf + (size_t)4*width*top;
+      uint16_t *buf16 = (uint16_t *)outbuf;
+#ifdef _OPENMP
+      #pragma omp parallel for default(none) shared(buf16, inf, npixels) schedule(static)
+#endif
+      for(int k=0; k<npixels; k++)
+        for(int i=0; i<3; i++) buf16[4*k+i] = CLAMP(inf[4*k+i]*0x10000, 0, 0xffff);
+    }
+    else
+    {
+      memcpy(outbuf, (const float *)pipe->backbuf + (size_t)4*width*top, sizeof(float)*4*npixels);
+    }
+    res = format->write_image_rows(format_params, outbuf, h);
+  }
+
+  if(!ignore_exif)
+  {
+    int length;
+    uint8_t exif_profile[65535]; // C++ alloc'ed buffer is uncool, so we waste some bits here.
+    char pathname[1024];
+    gboolean from_cache = TRUE;
+    dt_image_full_path(imgid, pathname, 1024, &from_cache);
+    // last param is dng mode, it's false here
+    length = dt_exif_read_blob(exif_profile, pathname, imgid, sRGB, width, height, 0);
+
+    res |= format->write_image_end(format_params, exif_profile, length);
+  }
+  else
+  {
+    res |= format->write_image_end(format_params, NULL, 0);
+  }
+  free(outbuf);
+  return res;
+}
+
 int dt_imageio_export(
   const uint32_t              imgid,
   const char                 *filename,
@@ -527,15 +838,16 @@ int dt_imageio_export_with_flags(
   const int32_t               thumbnail_export,
   const char                 *filter)
 {
-  dt_develop_t dev;
-  dt_dev_init(&dev, 0);
+  dt_develop_t *dev = (dt_develop_t *)malloc(sizeof(dt_develop_t));
+  dt_dev_init(dev, 0);
   dt_mipmap_buffer_t buf;
-  if(thumbnail_export && dt_conf_get_bool("plugins/lighttable/low_quality_thumbnails"))
+  const int from_mipf = thumbnail_export && _thumbnail_from_mipf(imgid, format_params);
+  if(from_mipf)
     dt_mipmap_cache_read_get(darktable.mipmap_cache, &buf, imgid, DT_MIPMAP_F, DT_MIPMAP_BLOCKING);
   else
     dt_mipmap_cache_read_get(darktable.mipmap_cache, &buf, imgid, DT_MIPMAP_FULL, DT_MIPMAP_BLOCKING);
-  dt_dev_load_image(&dev, imgid);
-  const dt_image_t *img = &dev.image_storage;
+  dt_dev_load_image(dev, imgid);
+  const dt_image_t *img = &dev->image_storage;
   const int wd = img->width;
   const int ht = img->height;
 
@@ -543,21 +855,34 @@ int dt_imageio_export_with_flags(
 
   dt_times_t start;
   dt_get_times(&start);
-  dt_dev_pixelpipe_t pipe;
-  res = thumbnail_export ? dt_dev_pixelpipe_init_thumbnail(&pipe, wd, ht) : dt_dev_pixelpipe_init_export(&pipe, wd, ht, format->levels(format_params));
-  if(!res)
+  const int levels = thumbnail_export ? 0 : format->levels(format_params);
+  dt_imageio_export_pipe_t *ep = _export_pipe_acquire(dev, thumbnail_export, levels);
+  if(!ep)
   {
-    dt_control_log(_("failed to allocate memory for export, please lower the threads used for export or buy more memory."));
-    dt_dev_cleanup(&dev);
-    dt_mipmap_cache_read_release(darktable.mipmap_cache, &buf);
-    return 1;
+    ep = (dt_imageio_export_pipe_t *)malloc(sizeof(dt_imageio_export_pipe_t));
+    ep->dev = NULL;
+    ep->thumbnail = thumbnail_export;
+    ep->levels = levels;
+    res = thumbnail_export ? dt_dev_pixelpipe_init_thumbnail(&ep->pipe, wd, ht) : dt_dev_pixelpipe_init_export(&ep->pipe, wd, ht, levels);
+    if(!res)
+    {
+      dt_control_log(_("failed to allocate memory for export, please lower the threads used for export or buy more memory."));
+      free(ep);
+      dt_dev_cleanup(dev);
+      free(dev);
+      dt_mipmap_cache_read_release(darktable.mipmap_cache, &buf);
+      return 1;
+    }
   }
+  dt_dev_pixelpipe_t *pipe = &ep->pipe;
 
   if(!buf.buf)
   {
     dt_control_log(_("image `%s' is not available!"), img->filename);
     dt_mipmap_cache_read_release(darktable.mipmap_cache, &buf);
-    dt_dev_cleanup(&dev);
+    _export_pipe_release(ep);
+    dt_dev_cleanup(dev);
+    free(dev);
     return 1;
   }
 
@@ -566,13 +891,15 @@ int dt_imageio_export_with_flags(
   {
     GList *stls;
 
-    GList *modules = dev.iop;
+    GList *modules = dev->iop;
     dt_iop_module_t *m = NULL;
 
     if ((stls=dt_styles_get_item_list(format_params->style, TRUE, -1)) == 0)
     {
       dt_control_log(_("cannot find the style '%s' to apply during export."), format_params->style);
-      dt_dev_cleanup(&dev);
+      _export_pipe_release(ep);
+      dt_dev_cleanup(dev);
+      free(dev);
       dt_mipmap_cache_read_release(darktable.mipmap_cache, &buf);
       return 1;
     }
@@ -582,7 +909,7 @@ int dt_imageio_export_with_flags(
     {
       dt_style_item_t *s = (dt_style_item_t *) stls->data;
 
-      modules = dev.iop;
+      modules = dev->iop;
       while (modules)
       {
         m = (dt_iop_module_t *)modules->data;
@@ -598,8 +925,8 @@ int dt_imageio_export_with_flags(
           h->multi_priority = 1;
           strcpy(h->multi_name, "");
 
-          dev.history_end++;
-          dev.history = g_list_append(dev.history, h);
+          dev->history_end++;
+          dev->history = g_list_append(dev->history, h);
           break;
         }
         modules = g_list_next(modules);
@@ -608,16 +935,38 @@ int dt_imageio_export_with_flags(
     }
   }
 
-  dt_dev_pixelpipe_set_input(&pipe, &dev, (float *)buf.buf, buf.width, buf.height, 1.0);
-  dt_dev_pixelpipe_create_nodes(&pipe, &dev);
-  dt_dev_pixelpipe_synch_all(&pipe, &dev);
-  dt_dev_pixelpipe_get_dimensions(&pipe, &dev, pipe.iwidth, pipe.iheight, &pipe.processed_width, &pipe.processed_height);
+  dt_dev_pixelpipe_set_input(pipe, dev, (float *)buf.buf, buf.width, buf.height, 1.0);
+  // the pipe now owns dev, and the modules its nodes point to:
+  _export_pipe_attach(ep, dev);
+  dt_dev_pixelpipe_synch_all(pipe, dev);
+  dt_dev_pixelpipe_get_dimensions(pipe, dev, pipe->iwidth, pipe->iheight, &pipe->processed_width, &pipe->processed_height);
+  if(from_mipf && !dt_conf_get_bool("plugins/lighttable/low_quality_thumbnails") && _pipe_changes_geometry(pipe))
+  {
+    // what is left of the downscaled buffer after cropping may be smaller than the thumbnail:
+    dt_mipmap_cache_read_release(darktable.mipmap_cache, &buf);
+    dt_mipmap_cache_read_get(darktable.mipmap_cache, &buf, imgid, DT_MIPMAP_FULL, DT_MIPMAP_BLOCKING);
+    if(!buf.buf)
+    {
+      dt_control_log(_("image `%s' is not available!"), img->filename);
+      _export_pipe_release(ep);
+      dt_mipmap_cache_read_release(darktable.mipmap_cache, &buf);
+      return 1;
+    }
+    dt_dev_pixelpipe_set_input(pipe, dev, (float *)buf.buf, buf.width, buf.height, 1.0);
+    for(GList *nodes = pipe->nodes; nodes; nodes = g_list_next(nodes))
+    {
+      dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)nodes->data;
+      piece->iwidth  = pipe->iwidth;
+      piece->iheight = pipe->iheight;
+    }
+    dt_dev_pixelpipe_get_dimensions(pipe, dev, pipe->iwidth, pipe->iheight, &pipe->processed_width, &pipe->processed_height);
+  }
   if(filter)
   {
     if(!strncmp(filter, "pre:", 4))
-      dt_dev_pixelpipe_disable_after(&pipe, filter+4);
+      dt_dev_pixelpipe_disable_after(pipe, filter+4);
     if(!strncmp(filter, "post:", 5))
-      dt_dev_pixelpipe_disable_before(&pipe, filter+5);
+      dt_dev_pixelpipe_disable_before(pipe, filter+5);
   }
   dt_show_times(&start, "[export] creating pixelpipe", NULL);
 
@@ -630,7 +979,7 @@ int dt_imageio_export_with_flags(
   }
   else if(!overprofile || !strcmp(overprofile, "image"))
   {
-    GList *modules = dev.iop;
+    GList *modules = dev->iop;
     dt_iop_module_t *colorout = NULL;
     while (modules)
     {
@@ -651,30 +1000,43 @@ int dt_imageio_export_with_flags(
   g_free(overprofile);
 
   // get only once at the beginning, in case the user changes it on the way:
-  const gboolean high_quality_processing = ((format_params->max_width  == 0 || format_params->max_width  >= pipe.processed_width ) &&
-      (format_params->max_height == 0 || format_params->max_height >= pipe.processed_height)) ? FALSE :
+  const gboolean high_quality_processing = ((format_params->max_width  == 0 || format_params->max_width  >= pipe->processed_width ) &&
+      (format_params->max_height == 0 || format_params->max_height >= pipe->processed_height)) ? FALSE :
       high_quality;
   const int width  = high_quality_processing ? 0 : format_params->max_width;
   const int height = high_quality_processing ? 0 : format_params->max_height;
-  const double scalex = width  > 0 ? fminf(width /(double)pipe.processed_width,  1.0) : 1.0;
-  const double scaley = height > 0 ? fminf(height/(double)pipe.processed_height, 1.0) : 1.0;
+  const double scalex = width  > 0 ? fminf(width /(double)pipe->processed_width,  1.0) : 1.0;
+  const double scaley = height > 0 ? fminf(height/(double)pipe->processed_height, 1.0) : 1.0;
   const double scale = fminf(scalex, scaley);
-  int processed_width  = scale*pipe.processed_width  + .5f;
-  int processed_height = scale*pipe.processed_height + .5f;
+  int processed_width  = scale*pipe->processed_width  + .5f;
+  int processed_height = scale*pipe->processed_height + .5f;
   const int bpp = format->bpp(format_params);
 
+  if(!thumbnail_export && !high_quality_processing &&
+     _export_stripes_wanted(pipe, format, processed_width, processed_height))
+  {
+    dt_get_times(&start);
+    res = _export_stripes(pipe, dev, imgid, filename, format, format_params, ignore_exif, display_byteorder,
+                          sRGB, processed_width, processed_height, scale, bpp);
+    dt_show_times(&start, "[dev_process_export] pixel pipeline processing in stripes", NULL);
+    _export_pipe_release(ep);
+    dt_mipmap_cache_read_release(darktable.mipmap_cache, &buf);
+    dt_control_signal_raise(darktable.signals,DT_SIGNAL_IMAGE_EXPORT_TMPFILE,imgid,filename);
+    return res;
+  }
+
   // downsampling done last, if high quality processing was requested:
-  uint8_t *outbuf = pipe.backbuf;
+  uint8_t *outbuf = pipe->backbuf;
   uint8_t *moutbuf = NULL; // keep track of alloc'ed memory
   dt_get_times(&start);
   if(high_quality_processing)
   {
-    dt_dev_pixelpipe_process_no_gamma(&pipe, &dev, 0, 0, processed_width, processed_height, scale);
-    const double scalex = format_params->max_width  > 0 ? fminf(format_params->max_width /(double)pipe.processed_width,  1.0) : 1.0;
-    const double scaley = format_params->max_height > 0 ? fminf(format_params->max_height/(double)pipe.processed_height, 1.0) : 1.0;
+    dt_dev_pixelpipe_process_no_gamma(pipe, dev, 0, 0, processed_width, processed_height, scale);
+    const double scalex = format_params->max_width  > 0 ? fminf(format_params->max_width /(double)pipe->processed_width,  1.0) : 1.0;
+    const double scaley = format_params->max_height > 0 ? fminf(format_params->max_height/(double)pipe->processed_height, 1.0) : 1.0;
     const double scale = fminf(scalex, scaley);
-    processed_width  = scale*pipe.processed_width  + .5f;
-    processed_height = scale*pipe.processed_height + .5f;
+    processed_width  = scale*pipe->processed_width  + .5f;
+    processed_height = scale*pipe->processed_height + .5f;
     moutbuf = (uint8_t *)dt_alloc_align(64, sizeof(float)*processed_width*processed_height*4);
     outbuf = moutbuf;
     // now downscale into the new buffer:
@@ -682,20 +1044,20 @@ int dt_imageio_export_with_flags(
     roi_in.x = roi_in.y = roi_out.x = roi_out.y = 0;
     roi_in.scale = 1.0;
     roi_out.scale = scale;
-    roi_in.width = pipe.processed_width;
-    roi_in.height = pipe.processed_height;
+    roi_in.width = pipe->processed_width;
+    roi_in.height = pipe->processed_height;
     roi_out.width = processed_width;
     roi_out.height = processed_height;
-    dt_iop_clip_and_zoom((float *)outbuf, (float *)pipe.backbuf, &roi_out, &roi_in, processed_width, pipe.processed_width);
+    dt_iop_clip_and_zoom((float *)outbuf, (float *)pipe->backbuf, &roi_out, &roi_in, processed_width, pipe->processed_width);
   }
   else
   {
     // do the processing (8-bit with special treatment, to make sure we can use openmp further down):
     if(bpp == 8)
-      dt_dev_pixelpipe_process(&pipe, &dev, 0, 0, processed_width, processed_height, scale);
+      dt_dev_pixelpipe_process(pipe, dev, 0, 0, processed_width, processed_height, scale);
     else
-      dt_dev_pixelpipe_process_no_gamma(&pipe, &dev, 0, 0, processed_width, processed_height, scale);
-    outbuf = pipe.backbuf;
+      dt_dev_pixelpipe_process_no_gamma(pipe, dev, 0, 0, processed_width, processed_height, scale);
+    outbuf = pipe->backbuf;
   }
   dt_show_times(&start, thumbnail_export ? "[dev_process_thumbnail] pixel pipeline processing" : "[dev_process_export] pixel pipeline processing", NULL);
 
@@ -719,7 +1081,7 @@ int dt_imageio_export_with_flags(
     }
     else
     {
-      uint8_t *const buf8 = pipe.backbuf;
+      uint8_t *const buf8 = pipe->backbuf;
 #ifdef _OPENMP
       #pragma omp parallel for default(none) shared(processed_width, processed_height) schedule(static)
 #endif
@@ -766,8 +1128,7 @@ int dt_imageio_export_with_flags(
     res = format->write_image (format_params, filename, outbuf, NULL, 0, imgid);
   }
 
-  dt_dev_pixelpipe_cleanup(&pipe);
-  dt_dev_cleanup(&dev);
+  _export_pipe_release(ep);
   dt_mipmap_cache_read_release(darktable.mipmap_cache, &buf);
   free(moutbuf);
 
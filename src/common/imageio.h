@@ -72,6 +72,13 @@ dt_imageio_export_with_flags(
   const int32_t                      thumbnail_export,
   const char                        *filter);
 
+/** while a session is open, exports keep their pixelpipes around for the next image.
+  * sessions nest, the pipes are freed when the last one ends. */
+void dt_imageio_export_session_begin();
+void dt_imageio_export_session_end();
+/** number of images out of the given list that can be exported in parallel, at most requested. */
+int dt_imageio_export_max_threads(const GList *imgids, const int requested);
+
 int dt_imageio_write_pos(int i, int j, int wd, int ht, float fwd, float fht, int orientation);
 
 // general, efficient buffer flipping function using memcopies
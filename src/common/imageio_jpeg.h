@@ -44,6 +44,10 @@ dt_imageio_jpeg_t;
 
 /** reads the header and fills width/height in jpg struct. */
 int dt_imageio_jpeg_decompress_header(const void *in, size_t length, dt_imageio_jpeg_t *jpg);
+/** lets libjpeg decode at 1/2, 1/4 or 1/8 size (that's almost free in the dct), as long as the image still
+ *  covers a width x height box, in either orientation. call after reading the header, width/height in jpg are
+ *  updated to the size the image will be decoded at. */
+void dt_imageio_jpeg_set_scale(dt_imageio_jpeg_t *jpg, const int width, const int height);
 /** reads the whole image to the out buffer, which has to be large enough. */
 int dt_imageio_jpeg_decompress(dt_imageio_jpeg_t *jpg, uint8_t *out);
 /** compresses in to out buffer with given quality (0..100). out buffer must be large enough. returns actual data length. */
@@ -95,6 +95,15 @@ dt_imageio_load_module_format (dt_imageio_module_format_t *module, const char *l
   if(!g_module_symbol(module->module, "flags",                        (gpointer)&(module->flags)))                        module->flags = _default_format_flags;
   if(!g_module_symbol(module->module, "levels",                       (gpointer)&(module->levels)))                       module->levels = _default_format_levels;
   if(!g_module_symbol(module->module, "read_image",                   (gpointer)&(module->read_image)))                   module->read_image = NULL;
+  if(!g_module_symbol(module->module, "write_image_begin",            (gpointer)&(module->write_image_begin)) ||
+     !g_module_symbol(module->module, "write_image_rows",             (gpointer)&(module->write_image_rows)) ||
+     !g_module_symbol(module->module, "write_image_end",              (gpointer)&(module->write_image_end)))
+  {
+    // stripe wise writing needs all three of them
+    module->write_image_begin = NULL;
+    module->write_image_rows = NULL;
+    module->write_image_end = NULL;
+  }
 
 #ifdef USE_LUA
   {
@@ -262,6 +271,9 @@ dt_imageio_init (dt_imageio_t *iio)
 {
   iio->plugins_format  = NULL;
   iio->plugins_storage = NULL;
+  dt_pthread_mutex_init(&iio->export_mutex, NULL);
+  iio->export_pipes = NULL;
+  iio->export_sessions = 0;
 
   dt_imageio_load_modules_format (iio);
   dt_imageio_load_modules_storage(iio);
@@ -270,6 +282,10 @@ dt_imageio_init (dt_imageio_t *iio)
 void
 dt_imageio_cleanup (dt_imageio_t *iio)
 {
+  // drop pipes of sessions which have not been closed:
+  iio->export_sessions = 1;
+  dt_imageio_export_session_end();
+  dt_pthread_mutex_destroy(&iio->export_mutex);
   while(iio->plugins_format)
   {
     dt_imageio_module_format_t *module = (dt_imageio_module_format_t *)(iio->plugins_format->data);
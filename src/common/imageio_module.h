@@ -100,6 +100,12 @@ typedef struct dt_imageio_module_format_t
   int (*bpp)(dt_imageio_module_data_t *data);
   /* write to file, with exif if not NULL, and icc profile if supported. */
   int (*write_image)(dt_imageio_module_data_t *data, const char *filename, const void *in, void *exif, int exif_len, int imgid);
+  /* optional: write the image in horizontal stripes, top to bottom, so that it never has to be in memory at once.
+   * begin opens the file for data->width x data->height, rows gets the next rows in the same layout as write_image,
+   * and end finishes the file and adds exif if not NULL. all return != 0 on fail. */
+  int (*write_image_begin)(dt_imageio_module_data_t *data, const char *filename, int imgid);
+  int (*write_image_rows)(dt_imageio_module_data_t *data, const void *in, int rows);
+  int (*write_image_end)(dt_imageio_module_data_t *data, void *exif, int exif_len);
   /* flag that describes the available precision/levels of output format. mainly used for dithering. */
   int (*levels)(dt_imageio_module_data_t *data);
 
@@ -163,6 +169,11 @@ typedef struct dt_imageio_t
 {
   GList *plugins_format;
   GList *plugins_storage;
+
+  // idle export pipelines, kept between images while an export session is open:
+  dt_pthread_mutex_t export_mutex;
+  GList *export_pipes;
+  int32_t export_sessions;
 }
 dt_imageio_t;
 
@@ -26,6 +26,9 @@
 #include <inttypes.h>
 #include <glib.h>
 #include <assert.h>
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
 
 /** Border extrapolation modes */
 enum border_mode
@@ -1268,83 +1271,249 @@ prepare_resampling_plan(
   return 0;
 }
 
-void
-dt_interpolation_resample(
+/* --------------------------------------------------------------------------
+ * Resampling plan cache
+ * ------------------------------------------------------------------------*/
+
+/** A resampling plan for one axis, as made by prepare_resampling_plan(),
+ * together with what it was made for. Plans are read only once made, so the
+ * cached ones are shared by all threads and pipes. */
+typedef struct dt_interpolation_plan_t
+{
+  const struct dt_interpolation* itor;
+  int in, in_x0, out, out_x0;
+  float scale;
+
+  int* length;
+  float* kernel;
+  int* index;
+  int* meta;
+  int first, last; /**< range of input samples the plan reads */
+
+  int users; /**< < 0 for plans not in the cache, freed after use */
+  uint64_t used;
+} dt_interpolation_plan_t;
+
+#define DT_INTERPOLATION_PLANS 16
+
+static struct
+{
+  dt_pthread_mutex_t lock;
+  int inited;
+  dt_interpolation_plan_t* plans[DT_INTERPOLATION_PLANS];
+  uint64_t stamp, hits, misses;
+} _plans = { .inited = 0 };
+
+static void
+plan_free(
+  dt_interpolation_plan_t* plan)
+{
+  if (!plan)
+  {
+    return;
+  }
+  // the length array holds all the memory, see prepare_resampling_plan()
+  free(plan->length);
+  free(plan);
+}
+
+static dt_interpolation_plan_t*
+plan_new(
   const struct dt_interpolation* itor,
-  float *out,
-  const dt_iop_roi_t* const roi_out,
-  const int32_t out_stride,
-  const float* const in,
-  const dt_iop_roi_t* const roi_in,
-  const int32_t in_stride)
+  const int in,
+  const int in_x0,
+  const int out,
+  const int out_x0,
+  const float scale)
 {
-  int* hindex = NULL;
-  int* hlength = NULL;
-  float* hkernel = NULL;
-  int* vindex = NULL;
-  int* vlength = NULL;
-  float* vkernel = NULL;
-  int* vmeta = NULL;
+  if (out <= 0)
+  {
+    return NULL;
+  }
+  dt_interpolation_plan_t* plan = (dt_interpolation_plan_t*)calloc(1, sizeof(dt_interpolation_plan_t));
+  if (!plan)
+  {
+    return NULL;
+  }
+  plan->itor = itor;
+  plan->in = in;
+  plan->in_x0 = in_x0;
+  plan->out = out;
+  plan->out_x0 = out_x0;
+  plan->scale = scale;
+  plan->users = -1;
+
+  int r = prepare_resampling_plan(itor, in, in_x0, out, out_x0, scale, &plan->length, &plan->kernel, &plan->index, &plan->meta);
+  if (r || !plan->length)
+  {
+    plan_free(plan);
+    return NULL;
+  }
 
-  int r;
+  // Range of input samples, the separable resampler buffers only those
+  const int nindex = plan->meta[3*(out-1) + 2] + plan->length[out-1];
+  plan->first = in;
+  plan->last = -1;
+  for (int i=0; i<nindex; i++)
+  {
+    plan->first = MIN(plan->first, plan->index[i]);
+    plan->last = MAX(plan->last, plan->index[i]);
+  }
+  if (plan->last < plan->first)
+  {
+    plan->first = plan->last = 0;
+  }
+  return plan;
+}
 
-  debug_info(
-    "resampling %p (%dx%d@%dx%d scale %f) -> %p (%dx%d@%dx%d scale %f)\n",
-    in,
-    roi_in->width, roi_in->height, roi_in->x, roi_in->y, roi_in->scale,
-    out,
-    roi_out->width, roi_out->height, roi_out->x, roi_out->y, roi_out->scale);
+void
+dt_interpolation_init()
+{
+  dt_pthread_mutex_init(&_plans.lock, NULL);
+  memset(_plans.plans, 0, sizeof(_plans.plans));
+  _plans.stamp = _plans.hits = _plans.misses = 0;
+  _plans.inited = 1;
+}
 
-  // Fast code path for 1:1 copy, only cropping area can change
-  if (roi_out->scale == 1.f)
+void
+dt_interpolation_cleanup()
+{
+  if (!_plans.inited)
   {
-    const int x0 = roi_out->x*4*sizeof(float);
-    const int l = roi_out->width*4*sizeof(float);
-#if DEBUG_RESAMPLING_TIMING
-    int64_t ts_resampling = getts();
-#endif
-#ifdef _OPENMP
-    #pragma omp parallel for default(none) shared(out)
-#endif
-    for (int y=0; y<roi_out->height; y++)
+    return;
+  }
+  dt_print(DT_DEBUG_PERF, "[interpolation] resampling plans: %"PRIu64" hits, %"PRIu64" misses\n", _plans.hits, _plans.misses);
+  for (int k=0; k<DT_INTERPOLATION_PLANS; k++)
+  {
+    plan_free(_plans.plans[k]);
+    _plans.plans[k] = NULL;
+  }
+  _plans.inited = 0;
+  dt_pthread_mutex_destroy(&_plans.lock);
+}
+
+static inline int
+plan_matches(
+  const dt_interpolation_plan_t* plan,
+  const struct dt_interpolation* itor,
+  const int in,
+  const int in_x0,
+  const int out,
+  const int out_x0,
+  const float scale)
+{
+  return plan && plan->itor == itor && plan->in == in && plan->in_x0 == in_x0
+         && plan->out == out && plan->out_x0 == out_x0 && plan->scale == scale;
+}
+
+/** Gets a plan from the cache, or makes one and puts it there. Release it
+ * with plan_release() */
+static dt_interpolation_plan_t*
+plan_get(
+  const struct dt_interpolation* itor,
+  const int in,
+  const int in_x0,
+  const int out,
+  const int out_x0,
+  const float scale)
+{
+  if (!_plans.inited)
+  {
+    return plan_new(itor, in, in_x0, out, out_x0, scale);
+  }
+
+  dt_pthread_mutex_lock(&_plans.lock);
+  for (int k=0; k<DT_INTERPOLATION_PLANS; k++)
+  {
+    dt_interpolation_plan_t* plan = _plans.plans[k];
+    if (plan_matches(plan, itor, in, in_x0, out, out_x0, scale))
     {
-      float* i = (float*)((char*)in + in_stride*(y + roi_out->y) + x0);
-      float* o = (float*)((char*)out + out_stride*y);
-      memcpy(o, i, l);
+      plan->users++;
+      plan->used = ++_plans.stamp;
+      _plans.hits++;
+      dt_pthread_mutex_unlock(&_plans.lock);
+      return plan;
     }
-#if DEBUG_RESAMPLING_TIMING
-    ts_resampling = getts() - ts_resampling;
-    fprintf(stderr, "resampling %p plan:0us resampling:%"PRId64"us\n", in, ts_resampling);
-#endif
-    // All done, so easy case
-    return;
   }
+  _plans.misses++;
+  dt_pthread_mutex_unlock(&_plans.lock);
 
-  // Generic non 1:1 case... much more complicated :D
-#if DEBUG_RESAMPLING_TIMING
-  int64_t ts_plan = getts();
-#endif
+  // Don't keep others waiting while computing the kernels
+  dt_interpolation_plan_t* plan = plan_new(itor, in, in_x0, out, out_x0, scale);
+  if (!plan)
+  {
+    return NULL;
+  }
 
-  // Prepare resampling plans once and for all
-  r = prepare_resampling_plan(itor, roi_in->width, roi_in->x, roi_out->width, roi_out->x, roi_out->scale, &hlength, &hkernel, &hindex, NULL);
-  if (r)
+  dt_pthread_mutex_lock(&_plans.lock);
+  // Replace an empty slot or the least recently used plan nobody is using
+  int victim = -1;
+  for (int k=0; k<DT_INTERPOLATION_PLANS; k++)
   {
-    goto exit;
+    dt_interpolation_plan_t* other = _plans.plans[k];
+    if (!other)
+    {
+      victim = k;
+      break;
+    }
+    if (other->users == 0 && (victim < 0 || other->used < _plans.plans[victim]->used))
+    {
+      victim = k;
+    }
   }
+  if (victim >= 0)
+  {
+    plan_free(_plans.plans[victim]);
+    _plans.plans[victim] = plan;
+    plan->users = 1;
+    plan->used = ++_plans.stamp;
+  }
+  dt_pthread_mutex_unlock(&_plans.lock);
+  return plan;
+}
 
-  r = prepare_resampling_plan(itor, roi_in->height, roi_in->y, roi_out->height, roi_out->y, roi_out->scale, &vlength, &vkernel, &vindex, &vmeta);
-  if (r)
+static void
+plan_release(
+  dt_interpolation_plan_t* plan)
+{
+  if (!plan)
   {
-    goto exit;
+    return;
+  }
+  if (plan->users < 0)
+  {
+    plan_free(plan);
+    return;
   }
+  dt_pthread_mutex_lock(&_plans.lock);
+  plan->users--;
+  dt_pthread_mutex_unlock(&_plans.lock);
+}
 
-#if DEBUG_RESAMPLING_TIMING
-  ts_plan = getts() - ts_plan;
-#endif
+/* --------------------------------------------------------------------------
+ * Resampling passes
+ * ------------------------------------------------------------------------*/
 
-#if DEBUG_RESAMPLING_TIMING
-  int64_t ts_resampling = getts();
-#endif
+/** Direct resampler: for each output pixel, filters all contributing input
+ * lines horizontally and sums them up vertically. Needs no extra memory,
+ * costs vertical*horizontal taps per output pixel. */
+static void
+resample_direct(
+  float* out,
+  const dt_iop_roi_t* const roi_out,
+  const int32_t out_stride,
+  const float* const in,
+  const int32_t in_stride,
+  const dt_interpolation_plan_t* hplan,
+  const dt_interpolation_plan_t* vplan)
+{
+  const int* hindex = hplan->index;
+  const int* hlength = hplan->length;
+  const float* hkernel = hplan->kernel;
+  const int* vindex = vplan->index;
+  const int* vlength = vplan->length;
+  const float* vkernel = vplan->kernel;
+  const int* vmeta = vplan->meta;
 
   // Process each output line
 #ifdef _OPENMP
@@ -1421,6 +1590,203 @@ dt_interpolation_resample(
   }
 
   _mm_sfence();
+}
+
+/** Vertical pass: blends the contributing input lines into one line of
+ * n floats. row must be aligned for the widest vectors used */
+static inline void
+resample_vertical(
+  float* row,
+  const float** lines,
+  const float* kernel,
+  const int length,
+  const int n)
+{
+  int i = 0;
+#ifdef __AVX__
+  // Two pixels a time, input lines are only guaranteed to be sse aligned
+  for (; i+8<=n; i+=8)
+  {
+    __m256 acc = _mm256_setzero_ps();
+    for (int k=0; k<length; k++)
+    {
+      acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_loadu_ps(lines[k] + i), _mm256_set1_ps(kernel[k])));
+    }
+    _mm256_store_ps(row + i, acc);
+  }
+#endif
+  for (; i<n; i+=4)
+  {
+    __m128 acc = _mm_setzero_ps();
+    for (int k=0; k<length; k++)
+    {
+      acc = _mm_add_ps(acc, _mm_mul_ps(_mm_load_ps(lines[k] + i), _mm_set1_ps(kernel[k])));
+    }
+    _mm_store_ps(row + i, acc);
+  }
+}
+
+/** Horizontal pass: filters the line made by the vertical pass into one
+ * output line. Indexes are relative to the first sample of the plan */
+static inline void
+resample_horizontal(
+  float* out,
+  const float* row,
+  const dt_interpolation_plan_t* plan)
+{
+  int kidx = 0;
+  for (int ox=0; ox<plan->out; ox++)
+  {
+    const int l = plan->length[ox];
+    const int* index = plan->index + kidx;
+    const float* kernel = plan->kernel + kidx;
+    int k = 0;
+#ifdef __AVX__
+    // Two taps a time, neighbouring taps mostly read neighbouring pixels
+    __m256 acc2 = _mm256_setzero_ps();
+    for (; k+2<=l; k+=2)
+    {
+      const int i0 = index[k] - plan->first;
+      const int i1 = index[k+1] - plan->first;
+      const __m256 px = (i1 == i0 + 1)
+                        ? _mm256_loadu_ps(row + 4*i0)
+                        : _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_load_ps(row + 4*i0)), _mm_load_ps(row + 4*i1), 1);
+      const __m256 tap = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(kernel[k])), _mm_set1_ps(kernel[k+1]), 1);
+      acc2 = _mm256_add_ps(acc2, _mm256_mul_ps(px, tap));
+    }
+    __m128 acc = _mm_add_ps(_mm256_castps256_ps128(acc2), _mm256_extractf128_ps(acc2, 1));
+#else
+    __m128 acc = _mm_setzero_ps();
+#endif
+    for (; k<l; k++)
+    {
+      acc = _mm_add_ps(acc, _mm_mul_ps(_mm_load_ps(row + 4*(index[k] - plan->first)), _mm_set1_ps(kernel[k])));
+    }
+    _mm_stream_ps(out + 4*ox, acc);
+    kidx += l;
+  }
+}
+
+/** Separable resampler: first blends the contributing input lines into one,
+ * then filters that one horizontally. Costs vertical taps per input sample
+ * of the plan plus horizontal taps per output pixel, and one line of
+ * temporary memory per thread. */
+static int
+resample_separable(
+  float* out,
+  const dt_iop_roi_t* const roi_out,
+  const int32_t out_stride,
+  const float* const in,
+  const int32_t in_stride,
+  const dt_interpolation_plan_t* hplan,
+  const dt_interpolation_plan_t* vplan)
+{
+  // Pad lines to full avx vectors, so every thread's line stays aligned
+  const int width = hplan->last - hplan->first + 1;
+  const size_t row_stride = (size_t)4*((width + 1) & ~1);
+  float* rows = (float*)dt_alloc_align(64, sizeof(float)*row_stride*dt_get_num_threads());
+  if (!rows)
+  {
+    return 1;
+  }
+#ifdef _OPENMP
+  #pragma omp parallel for default(none) shared(out, rows, hplan, vplan) schedule(static)
+#endif
+  for (int oy=0; oy<roi_out->height; oy++)
+  {
+    float* row = rows + row_stride*dt_get_thread_num();
+    const int vl = vplan->length[oy];
+    const int vkidx = vplan->meta[3*oy + 1];
+    const int viidx = vplan->meta[3*oy + 2];
+
+    // Input lines contributing to this output line, cut to the plan's columns
+    const float* lines[MAX(vl, 1)];
+    for (int k=0; k<vl; k++)
+    {
+      lines[k] = (const float*)((const char*)in + (size_t)in_stride*vplan->index[viidx + k]) + 4*hplan->first;
+    }
+
+    resample_vertical(row, lines, vplan->kernel + vkidx, vl, 4*width);
+    resample_horizontal((float*)((char*)out + (size_t)oy*out_stride), row, hplan);
+  }
+
+  _mm_sfence();
+  free(rows);
+  return 0;
+}
+
+static void
+resample(
+  const struct dt_interpolation* itor,
+  float *out,
+  const dt_iop_roi_t* const roi_out,
+  const int32_t out_stride,
+  const float* const in,
+  const dt_iop_roi_t* const roi_in,
+  const int32_t in_stride,
+  const int direct)
+{
+  dt_interpolation_plan_t* hplan = NULL;
+  dt_interpolation_plan_t* vplan = NULL;
+
+  debug_info(
+    "resampling %p (%dx%d@%dx%d scale %f) -> %p (%dx%d@%dx%d scale %f)\n",
+    in,
+    roi_in->width, roi_in->height, roi_in->x, roi_in->y, roi_in->scale,
+    out,
+    roi_out->width, roi_out->height, roi_out->x, roi_out->y, roi_out->scale);
+
+  // Fast code path for 1:1 copy, only cropping area can change
+  if (roi_out->scale == 1.f)
+  {
+    const int x0 = roi_out->x*4*sizeof(float);
+    const int l = roi_out->width*4*sizeof(float);
+#if DEBUG_RESAMPLING_TIMING
+    int64_t ts_resampling = getts();
+#endif
+#ifdef _OPENMP
+    #pragma omp parallel for default(none) shared(out)
+#endif
+    for (int y=0; y<roi_out->height; y++)
+    {
+      float* i = (float*)((char*)in + in_stride*(y + roi_out->y) + x0);
+      float* o = (float*)((char*)out + out_stride*y);
+      memcpy(o, i, l);
+    }
+#if DEBUG_RESAMPLING_TIMING
+    ts_resampling = getts() - ts_resampling;
+    fprintf(stderr, "resampling %p plan:0us resampling:%"PRId64"us\n", in, ts_resampling);
+#endif
+    // All done, so easy case
+    return;
+  }
+
+  // Generic non 1:1 case... much more complicated :D
+#if DEBUG_RESAMPLING_TIMING
+  int64_t ts_plan = getts();
+#endif
+
+  // Get the resampling plans, zooming and panning keeps asking for the same ones
+  hplan = plan_get(itor, roi_in->width, roi_in->x, roi_out->width, roi_out->x, roi_out->scale);
+  vplan = plan_get(itor, roi_in->height, roi_in->y, roi_out->height, roi_out->y, roi_out->scale);
+  if (!hplan || !vplan)
+  {
+    goto exit;
+  }
+
+#if DEBUG_RESAMPLING_TIMING
+  ts_plan = getts() - ts_plan;
+#endif
+
+#if DEBUG_RESAMPLING_TIMING
+  int64_t ts_resampling = getts();
+#endif
+
+  // Out of memory for the temporary lines? The direct way needs none.
+  if (direct || resample_separable(out, roi_out, out_stride, in, in_stride, hplan, vplan))
+  {
+    resample_direct(out, roi_out, out_stride, in, in_stride, hplan, vplan);
+  }
 
 #if DEBUG_RESAMPLING_TIMING
   ts_resampling = getts() - ts_resampling;
@@ -1428,12 +1794,36 @@ dt_interpolation_resample(
 #endif
 
 exit:
-  /* Free the resampling plans. It's nasty to optimize allocs like that, but
-   * it simplifies the code :-D. The length array is in fact the only memory
-   * allocated. */
-  free(hlength);
-  free(vlength);
+  plan_release(hplan);
+  plan_release(vplan);
+}
+
+void
+dt_interpolation_resample(
+  const struct dt_interpolation* itor,
+  float *out,
+  const dt_iop_roi_t* const roi_out,
+  const int32_t out_stride,
+  const float* const in,
+  const dt_iop_roi_t* const roi_in,
+  const int32_t in_stride)
+{
+  resample(itor, out, roi_out, out_stride, in, roi_in, in_stride, 0);
+}
+
+void
+dt_interpolation_resample_direct(
+  const struct dt_interpolation* itor,
+  float *out,
+  const dt_iop_roi_t* const roi_out,
+  const int32_t out_stride,
+  const float* const in,
+  const dt_iop_roi_t* const roi_in,
+  const int32_t in_stride)
+{
+  resample(itor, out, roi_out, out_stride, in, roi_in, in_stride, 1);
 }
+
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
 // kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-space on;
@@ -33,7 +33,7 @@ enum dt_interpolation_type
   DT_INTERPOLATION_LANCZOS3, /**< Lanczos interpolation (with 3 lobes) */
   DT_INTERPOLATION_LAST, /**< Helper for easy iteration on interpolators */
   DT_INTERPOLATION_DEFAULT=DT_INTERPOLATION_BILINEAR,
-  DT_INTERPOLATION_USERPREF /**< can be specified so that user setting is chosen */
+  DT_INTERPOLATION_USERPREF=DT_INTERPOLATION_LAST+1 /**< can be specified so that user setting is chosen */
 };
 
 /** Interpolation function */
@@ -152,6 +152,27 @@ dt_interpolation_resample(
   const dt_iop_roi_t* const roi_in,
   const int32_t in_stride);
 
+/** Sets up the cache of resampling plans shared by all resampling calls */
+void
+dt_interpolation_init();
+
+/** Frees the cached resampling plans */
+void
+dt_interpolation_cleanup();
+
+/** Same as dt_interpolation_resample(), but always filters every output
+ * pixel in both directions at once instead of in two passes. Slower, for
+ * comparison in benchmarks */
+void
+dt_interpolation_resample_direct(
+  const struct dt_interpolation* itor,
+  float *out,
+  const dt_iop_roi_t* const roi_out,
+  const int32_t out_stride,
+  const float* const in,
+  const dt_iop_roi_t* const roi_in,
+  const int32_t in_stride);
+
 #endif /* INTERPOLATION_H */
 
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
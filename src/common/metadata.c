@@ -17,6 +17,7 @@
 */
 
 #include "common/metadata.h"
+#include "common/collection.h"
 #include "common/debug.h"
 
 #include <stdlib.h>
@@ -391,6 +392,8 @@ void dt_metadata_set(int id, const char* key, const char* value)
     dt_metadata_set_xmp(id, key, value);
   else if(strncmp(key, "Exif.", 5) == 0)
     dt_metadata_set_exif(id, key, value);
+  // the collection might filter by it:
+  dt_collection_image_changed(darktable.collection, id);
 }
 
 GList* dt_metadata_get(int id, const char* key, uint32_t* count)
@@ -422,6 +425,7 @@ void dt_metadata_clear(int id)
     sqlite3_step(stmt);
     sqlite3_finalize(stmt);
   }
+  dt_collection_image_changed(darktable.collection, id);
 }
 
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
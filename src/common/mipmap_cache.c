@@ -22,13 +22,11 @@
 #include "common/imageio.h"
 #include "common/imageio_module.h"
 #include "common/imageio_jpeg.h"
+#include "common/image_compression.h"
 #include "common/mipmap_cache.h"
 #include "control/conf.h"
 #include "control/jobs.h"
 #include "libraw/libraw.h"
-#ifdef HAVE_SQUISH
-#include "squish/csquish.h"
-#endif
 
 #include <assert.h>
 #include <string.h>
@@ -42,8 +40,6 @@
 #include <errno.h>
 #include <xmmintrin.h>
 
-#define DT_MIPMAP_CACHE_FILE_MAGIC 0xD71337
-#define DT_MIPMAP_CACHE_FILE_VERSION 22
 #define DT_MIPMAP_CACHE_DEFAULT_FILE_NAME "mipmaps"
 
 #define DT_MIPMAP_BUFFER_DSC_FLAG_GENERATE (1<<0)
@@ -152,63 +148,6 @@ get_size(const uint32_t key)
   return (dt_mipmap_size_t)(key >> 29);
 }
 
-typedef struct _iterate_data_t
-{
-  FILE *f;
-  uint8_t *blob;
-  int compression_type;
-  dt_mipmap_size_t mip;
-}
-_iterate_data_t;
-
-static int
-_write_buffer(const uint32_t key, const void *data, void *user_data)
-{
-  if(!data) return 1;
-  struct dt_mipmap_buffer_dsc* dsc = (struct dt_mipmap_buffer_dsc*)data;
-  // too small to write. no error, but don't write.
-  if(dsc->width <= 8 && dsc->height <= 8) return 0;
-
-  _iterate_data_t *d = (_iterate_data_t *)user_data;
-  int written = fwrite(&(d->mip), sizeof(dt_mipmap_size_t), 1, d->f);
-  if(written != 1) return 1;
-  written = fwrite(&key, sizeof(uint32_t), 1, d->f);
-  if(written != 1) return 1;
-
-  if(d->compression_type)
-  {
-    // write buffer size, wd, ht and the full blob, as it is in memory.
-    const int32_t length = compressed_buffer_size(d->compression_type, dsc->width, dsc->height);
-    written = fwrite(&length, sizeof(int32_t), 1, d->f);
-    if(written != 1) return 1;
-    written = fwrite(&dsc->width, sizeof(int32_t), 1, d->f);
-    if(written != 1) return 1;
-    written = fwrite(&dsc->height, sizeof(int32_t), 1, d->f);
-    if(written != 1) return 1;
-    written = fwrite(dsc+1, sizeof(uint8_t), length, d->f);
-    if(written != length) return 1;
-  }
-  else
-  {
-    dt_mipmap_buffer_t buf;
-    buf.width  = dsc->width;
-    buf.height = dsc->height;
-    buf.imgid  = get_imgid(key);
-    buf.size   = get_size(key);
-    // skip to next 8-byte alignment, for sse buffers.
-    buf.buf    = (uint8_t *)(dsc+1);
-
-    const int cache_quality = dt_conf_get_int("database_cache_quality");
-    const int32_t length = dt_imageio_jpeg_compress(buf.buf, d->blob, buf.width, buf.height, MIN(100, MAX(10, cache_quality)));
-    written = fwrite(&length, sizeof(int32_t), 1, d->f);
-    if(written != 1) return 1;
-    written = fwrite(d->blob, sizeof(uint8_t), length, d->f);
-    if(written != length) return 1;
-  }
-
-  return 0;
-}
-
 static int
 dt_mipmap_cache_get_filename(
   gchar* mipmapfilename, size_t size)
@@ -254,217 +193,31 @@ exit:
   return r;
 }
 
-static int
-dt_mipmap_cache_serialize(dt_mipmap_cache_t *cache)
-{
-  gchar dbfilename[DT_MAX_PATH_LEN];
-  if (dt_mipmap_cache_get_filename(dbfilename, sizeof(dbfilename)))
-  {
-    fprintf(stderr, "[mipmap_cache] could not retrieve cache filename; not serializing\n");
-    return 1;
-  }
-  if (!strcmp(dbfilename, ":memory:"))
-  {
-    // fprintf(stderr, "[mipmap_cache] library is in memory; not serializing\n");
-    return 0;
-  }
-
-  // only store smallest thumbs.
-  const dt_mipmap_size_t mip = DT_MIPMAP_2;
-
-  _iterate_data_t d;
-  d.f = NULL;
-  d.blob = (uint8_t *)malloc(cache->mip[mip].buffer_size);
-  int written = 0;
-  FILE *f = fopen(dbfilename, "wb");
-  if(!f) goto write_error;
-  d.f = f;
-  // fprintf(stderr, "[mipmap_cache] serializing to `%s'\n", dbfilename);
-
-  // write version info:
-  const int32_t magic = DT_MIPMAP_CACHE_FILE_MAGIC + DT_MIPMAP_CACHE_FILE_VERSION;
-  written = fwrite(&magic, sizeof(int32_t), 1, f);
-  if(written != 1) goto write_error;
-
-  // store compression type
-  written = fwrite(&cache->compression_type, sizeof(int32_t), 1, f);
-  if(written != 1) goto write_error;
-
-  for(int i=0; i<=mip; i++)
-  {
-    // print max sizes for this cache
-    written = fwrite(&cache->mip[i].max_width, sizeof(int32_t), 1, f);
-    if(written != 1) goto write_error;
-    written = fwrite(&cache->mip[i].max_height, sizeof(int32_t), 1, f);
-    if(written != 1) goto write_error;
-  }
-
-  for(int i=0; i<=mip; i++)
-  {
-    d.mip = (dt_mipmap_size_t)i;
-    d.compression_type = cache->compression_type;
-    if(dt_cache_for_all(&cache->mip[i].cache, _write_buffer, &d)) goto write_error;
-  }
-
-  free(d.blob);
-  fclose(f);
-  return 0;
-
-write_error:
-  fprintf(stderr, "[mipmap_cache] serialization to `%s' failed!\n", dbfilename);
-  if(f) fclose(f);
-  free(d.blob);
-  return 1;
-}
-
-static int
-dt_mipmap_cache_deserialize(dt_mipmap_cache_t *cache)
+// opens the on-disk thumbnail store belonging to the current library.
+static void
+_init_store(dt_mipmap_cache_t *cache)
 {
-  int32_t rd = 0;
-  const dt_mipmap_size_t mip = DT_MIPMAP_2;
-  uint8_t *blob = NULL;
-  int file_width[mip+1], file_height[mip+1];
-
-  gchar dbfilename[DT_MAX_PATH_LEN];
-  if (dt_mipmap_cache_get_filename(dbfilename, sizeof(dbfilename)))
+  gchar filename[DT_MAX_PATH_LEN];
+  if(dt_mipmap_cache_get_filename(filename, sizeof(filename)))
   {
-    fprintf(stderr, "[mipmap_cache] could not retrieve cache filename; not deserializing\n");
-    return 1;
-  }
-  if (!strcmp(dbfilename, ":memory:"))
-  {
-    // fprintf(stderr, "[mipmap_cache] library is in memory; not deserializing\n");
-    return 0;
-  }
-
-  FILE *f = fopen(dbfilename, "rb");
-  if(!f)
-  {
-    if (errno == ENOENT)
-    {
-      fprintf(stderr, "[mipmap_cache] cache is empty, file `%s' doesn't exist\n", dbfilename);
-    }
-    else
-    {
-      fprintf(stderr, "[mipmap_cache] failed to open the cache from `%s'\n", dbfilename);
-    }
-    goto read_finalize;
-  }
-
-  // read version info:
-  const int32_t magic = DT_MIPMAP_CACHE_FILE_MAGIC + DT_MIPMAP_CACHE_FILE_VERSION;
-  int32_t magic_file = 0;
-  rd = fread(&magic_file, sizeof(int32_t), 1, f);
-  if(rd != 1) goto read_error;
-  if(magic_file != magic)
-  {
-    if(magic_file > DT_MIPMAP_CACHE_FILE_MAGIC && magic_file < magic)
-      fprintf(stderr, "[mipmap_cache] cache version too old, dropping `%s' cache\n", dbfilename);
-    else
-      fprintf(stderr, "[mipmap_cache] invalid cache file, dropping `%s' cache\n", dbfilename);
-    goto read_finalize;
-  }
-
-  // also read compression type and yell out on missmatch.
-  int32_t compression = -1;
-  rd = fread(&compression, sizeof(int32_t), 1, f);
-  if(rd != 1) goto read_error;
-  if(compression != cache->compression_type)
-  {
-    fprintf(stderr, "[mipmap_cache] cache is %s, but settings say we should use %s, dropping `%s' cache\n",
-            compression == 0 ? "uncompressed" : (compression == 1 ? "low quality compressed" : "high quality compressed"),
-            cache->compression_type == 0 ? "no compression" : (cache->compression_type == 1 ? "low quality compression" : "high quality compression"),
-            dbfilename);
-    goto read_finalize;
-  }
-
-  for (int i=0; i<=mip; i++)
-  {
-    rd = fread(&file_width[i], sizeof(int32_t), 1, f);
-    if(rd != 1) goto read_error;
-    rd = fread(&file_height[i], sizeof(int32_t), 1, f);
-    if(rd != 1) goto read_error;
-    if(file_width[i]  != cache->mip[i].max_width ||
-        file_height[i] != cache->mip[i].max_height)
-    {
-      fprintf(stderr, "[mipmap_cache] cache settings changed, dropping `%s' cache\n", dbfilename);
-      goto read_finalize;
-    }
+    fprintf(stderr, "[mipmap_cache] could not retrieve cache filename; thumbnails will not be kept on disk\n");
+    dt_mipmap_store_init(&cache->store, NULL);
+    return;
   }
-
-  if(cache->compression_type) blob = NULL;
-  else blob = malloc(sizeof(uint32_t)*file_width[mip]*file_height[mip]);
-
-  while(!feof(f))
+  if(!strcmp(filename, ":memory:"))
   {
-    int level = 0;
-    rd = fread(&level, sizeof(int), 1, f);
-    if (level > mip) break;
-
-    int32_t key = 0;
-    rd = fread(&key, sizeof(int32_t), 1, f);
-    if(rd != 1) break; // first value is break only, goes to eof.
-    int32_t length = 0;
-    rd = fread(&length, sizeof(int32_t), 1, f);
-    if(rd != 1) goto read_error;
-
-    uint8_t *data = (uint8_t *)dt_cache_read_get(&cache->mip[level].cache, key);
-    struct dt_mipmap_buffer_dsc* dsc = (struct dt_mipmap_buffer_dsc*)data;
-    if(dsc->flags & DT_MIPMAP_BUFFER_DSC_FLAG_GENERATE)
-    {
-      if(cache->compression_type)
-      {
-        int32_t wd, ht;
-        rd = fread(&wd, sizeof(int32_t), 1, f);
-        if(rd != 1) goto read_error;
-        rd = fread(&ht, sizeof(int32_t), 1, f);
-        if(rd != 1) goto read_error;
-        dsc->width = wd;
-        dsc->height = ht;
-        if(length != compressed_buffer_size(cache->compression_type, wd, ht)) goto read_error;
-        // directly read from disk into cache:
-        rd = fread(data + sizeof(*dsc), 1, length, f);
-        if(rd != length) goto read_error;
-      }
-      else
-      {
-        // jpg too large?
-        if(length > sizeof(uint32_t)*file_width[mip]*file_height[mip]) goto read_error;
-        rd = fread(blob, sizeof(uint8_t), length, f);
-        if(rd != length) goto read_error;
-        // no compression, the image is still compressed on disk, as jpg
-        dt_imageio_jpeg_t jpg;
-        if(dt_imageio_jpeg_decompress_header(blob, length, &jpg) ||
-            (jpg.width > file_width[level] || jpg.height > file_height[level]) ||
-            dt_imageio_jpeg_decompress(&jpg, data+sizeof(*dsc)))
-        {
-          fprintf(stderr, "[mipmap_cache] failed to decompress thumbnail for image %d!\n", get_imgid(key));
-        }
-        dsc->width = jpg.width;
-        dsc->height = jpg.height;
-      }
-      dsc->flags &= ~DT_MIPMAP_BUFFER_DSC_FLAG_GENERATE;
-      // these come write locked in case idata[3] == 1, so release that!
-      dt_cache_write_release(&cache->mip[level].cache, key);
-    }
-    dt_cache_read_release(&cache->mip[level].cache, key);
+    dt_mipmap_store_init(&cache->store, NULL);
+    return;
   }
-
-  fclose(f);
-  free(blob);
-  return 0;
-
-read_error:
-  fprintf(stderr, "[mipmap_cache] failed to recover the cache from `%s'\n", dbfilename);
-read_finalize:
-  if(f) fclose(f);
-  free(blob);
-  g_unlink(dbfilename);
-  return 1;
+  // the monolithic cache file of earlier versions has been superseded by the store:
+  if(g_file_test(filename, G_FILE_TEST_IS_REGULAR)) g_unlink(filename);
+  dt_mipmap_store_init(&cache->store, filename);
 }
 
 static void _init_f(float   *buf, uint32_t *width, uint32_t *height, const uint32_t imgid);
 static void _init_8(uint8_t *buf, uint32_t *width, uint32_t *height, const uint32_t imgid, const dt_mipmap_size_t size);
+static void _init_smaller(dt_mipmap_cache_t *cache, const uint32_t imgid, const dt_mipmap_size_t mip,
+                          const uint8_t *in, const uint32_t width, const uint32_t height, const uint64_t hash, const int fresh);
 
 static int32_t
 scratchmem_allocate(void *data, const uint32_t key, int32_t *cost, void **buf)
@@ -750,12 +503,22 @@ void dt_mipmap_cache_init(dt_mipmap_cache_t *cache)
   cache->mip[DT_MIPMAP_F].size = DT_MIPMAP_F;
   cache->mip[DT_MIPMAP_F].buf = NULL;
 
-  dt_mipmap_cache_deserialize(cache);
+  // nothing is read here, thumbnails are fetched from disk when they are requested:
+  _init_store(cache);
+
+  dt_pthread_mutex_init(&cache->prefetch_mutex, NULL);
+  cache->prefetch_wanted = g_hash_table_new(g_direct_hash, g_direct_equal);
+  cache->prefetch_done = g_hash_table_new(g_direct_hash, g_direct_equal);
+  cache->stats_prefetch_queued = cache->stats_prefetch_cached = cache->stats_prefetch_dropped = 0;
+  cache->stats_prefetch_loaded = cache->stats_prefetch_hits = 0;
 }
 
 void dt_mipmap_cache_cleanup(dt_mipmap_cache_t *cache)
 {
-  dt_mipmap_cache_serialize(cache);
+  g_hash_table_destroy(cache->prefetch_wanted);
+  g_hash_table_destroy(cache->prefetch_done);
+  dt_pthread_mutex_destroy(&cache->prefetch_mutex);
+  dt_mipmap_store_cleanup(&cache->store);
   for(int k=0; k<DT_MIPMAP_F; k++)
   {
     dt_cache_cleanup(&cache->mip[k].cache);
@@ -817,6 +580,10 @@ void dt_mipmap_cache_print(dt_mipmap_cache_t *cache)
         100.0*cache->mip[k].stats_standin/(float)sum_standins,
         100.0*cache->mip[k].stats_fetches/(float)sum_fetches,
         100.0*cache->mip[k].stats_requests/(float)sum);
+  printf("[mipmap_cache] prefetch: %ld queued, %ld loaded, %ld already cached, %ld dropped as stale, %ld shown later (%.2f%% of loaded)\n",
+         cache->stats_prefetch_queued, cache->stats_prefetch_loaded, cache->stats_prefetch_cached,
+         cache->stats_prefetch_dropped, cache->stats_prefetch_hits,
+         100.0*cache->stats_prefetch_hits/(float)MAX(1, cache->stats_prefetch_loaded));
   printf("\n\n");
   // very verbose stats about locks/users
   //dt_cache_print(&cache->mip[DT_MIPMAP_3].cache);
@@ -943,27 +710,39 @@ dt_mipmap_cache_read_get(
         else
         {
           // 8-bit thumbs, possibly need to be compressed:
+          uint8_t *out = (uint8_t *)(dsc+1);
+          const int key = dt_control_get_threadid();
           if(cache->compression_type)
           {
             // get per-thread temporary storage without malloc from a separate cache:
-            const int key = dt_control_get_threadid();
             // const void *cbuf =
             dt_cache_read_get(&cache->scratchmem.cache, key);
-            uint8_t *scratchmem = (uint8_t *)dt_cache_write_get(&cache->scratchmem.cache, key);
-            _init_8(scratchmem, &dsc->width, &dsc->height, imgid, mip);
+            out = (uint8_t *)dt_cache_write_get(&cache->scratchmem.cache, key);
+          }
+          // thumbnails of earlier sessions are still on disk, unless the history changed:
+          const uint64_t hash = dt_mipmap_store_hash(imgid);
+          int fresh = 0;
+          if(dt_mipmap_store_read(&cache->store, imgid, mip, hash, cache->mip[mip].max_width, cache->mip[mip].max_height,
+                                  out, &dsc->width, &dsc->height))
+          {
+            _init_8(out, &dsc->width, &dsc->height, imgid, mip);
+            dt_mipmap_store_write(&cache->store, imgid, mip, hash, cache->mip[mip].max_width, cache->mip[mip].max_height,
+                                  out, dsc->width, dsc->height);
+            fresh = 1;
+          }
+          // one decode is enough for all zoom levels of the lighttable:
+          _init_smaller(cache, imgid, mip, out, dsc->width, dsc->height, hash, fresh);
+          if(cache->compression_type)
+          {
             buf->width  = dsc->width;
             buf->height = dsc->height;
             buf->imgid  = imgid;
             buf->size   = mip;
             buf->buf = (uint8_t *)(dsc+1);
-            dt_mipmap_cache_compress(buf, scratchmem);
+            dt_mipmap_cache_compress(buf, out);
             dt_cache_write_release(&cache->scratchmem.cache, key);
             dt_cache_read_release(&cache->scratchmem.cache, key);
           }
-          else
-          {
-            _init_8((uint8_t *)(dsc+1), &dsc->width, &dsc->height, imgid, mip);
-          }
         }
         dsc->flags &= ~DT_MIPMAP_BUFFER_DSC_FLAG_GENERATE;
         // drop the write lock
@@ -998,6 +777,14 @@ dt_mipmap_cache_read_get(
       if(buf->buf && buf->width > 0 && buf->height > 0)
       {
         if(mip != k) __sync_fetch_and_add (&(cache->mip[k].stats_standin), 1);
+        else if(k < DT_MIPMAP_F)
+        {
+          // did the prefetcher see this coming?
+          dt_pthread_mutex_lock(&cache->prefetch_mutex);
+          if(g_hash_table_remove(cache->prefetch_done, GUINT_TO_POINTER(get_key(imgid, k))))
+            cache->stats_prefetch_hits++;
+          dt_pthread_mutex_unlock(&cache->prefetch_mutex);
+        }
         return;
       }
       // didn't succeed the first time? prefetch for later!
@@ -1017,6 +804,55 @@ dt_mipmap_cache_read_get(
   }
 }
 
+void dt_mipmap_cache_prefetch_begin(dt_mipmap_cache_t *cache)
+{
+  dt_pthread_mutex_lock(&cache->prefetch_mutex);
+  g_hash_table_remove_all(cache->prefetch_wanted);
+  // only to measure hits, don't let it grow without bounds while nobody looks:
+  if(g_hash_table_size(cache->prefetch_done) > 4096) g_hash_table_remove_all(cache->prefetch_done);
+  dt_pthread_mutex_unlock(&cache->prefetch_mutex);
+}
+
+void dt_mipmap_cache_prefetch(dt_mipmap_cache_t *cache, const uint32_t imgid, const dt_mipmap_size_t mip)
+{
+  if(mip >= DT_MIPMAP_F || mip < DT_MIPMAP_0) return;
+  dt_pthread_mutex_lock(&cache->prefetch_mutex);
+  g_hash_table_insert(cache->prefetch_wanted, GUINT_TO_POINTER(get_key(imgid, mip)), GINT_TO_POINTER(1));
+  cache->stats_prefetch_queued++;
+  dt_pthread_mutex_unlock(&cache->prefetch_mutex);
+  // queue order is importance, requests still waiting from an earlier round
+  // are dropped when it's their turn, or revived if they're still wanted:
+  dt_job_t j;
+  dt_image_prefetch_job_init(&j, imgid, mip);
+  if(dt_control_revive_job(darktable.control, &j) < 0)
+    dt_control_add_job(darktable.control, &j);
+}
+
+void dt_mipmap_cache_prefetch_load(dt_mipmap_cache_t *cache, const uint32_t imgid, const dt_mipmap_size_t mip)
+{
+  const uint32_t key = get_key(imgid, mip);
+  dt_pthread_mutex_lock(&cache->prefetch_mutex);
+  const int wanted = g_hash_table_remove(cache->prefetch_wanted, GUINT_TO_POINTER(key));
+  if(!wanted) cache->stats_prefetch_dropped++;
+  dt_pthread_mutex_unlock(&cache->prefetch_mutex);
+  if(!wanted) return;
+
+  dt_mipmap_buffer_t buf;
+  dt_mipmap_cache_read_get(cache, &buf, imgid, mip, DT_MIPMAP_TESTLOCK);
+  const int cached = (buf.buf != NULL);
+  if(!cached) dt_mipmap_cache_read_get(cache, &buf, imgid, mip, DT_MIPMAP_BLOCKING);
+  if(buf.buf) dt_mipmap_cache_read_release(cache, &buf);
+
+  dt_pthread_mutex_lock(&cache->prefetch_mutex);
+  if(cached) cache->stats_prefetch_cached++;
+  else
+  {
+    cache->stats_prefetch_loaded++;
+    g_hash_table_insert(cache->prefetch_done, GUINT_TO_POINTER(key), GINT_TO_POINTER(1));
+  }
+  dt_pthread_mutex_unlock(&cache->prefetch_mutex);
+}
+
 void
 dt_mipmap_cache_write_get(
   dt_mipmap_cache_t *cache,
@@ -1102,6 +938,8 @@ dt_mipmap_cache_remove(
     const uint32_t key = get_key(imgid, k);
     dt_cache_remove(&cache->mip[k].cache, key);
   }
+  // and don't bring them back from disk:
+  dt_mipmap_store_remove(&cache->store, imgid);
 }
 
 static void
@@ -1266,6 +1104,7 @@ _init_8(
       dt_imageio_jpeg_t jpg;
       if(!dt_imageio_jpeg_read_header(filename, &jpg))
       {
+        dt_imageio_jpeg_set_scale(&jpg, wd, ht);
         uint8_t *tmp = (uint8_t *)malloc(sizeof(uint8_t)*jpg.width*jpg.height*4);
         if(!dt_imageio_jpeg_read(&jpg, tmp))
         {
@@ -1296,6 +1135,7 @@ _init_8(
         // JPEG: decode (directly rescaled to mip4)
         dt_imageio_jpeg_t jpg;
         if(dt_imageio_jpeg_decompress_header(image->data, image->data_size, &jpg)) goto libraw_fail;
+        dt_imageio_jpeg_set_scale(&jpg, wd, ht);
         uint8_t *tmp = (uint8_t *)malloc(sizeof(uint8_t)*jpg.width*jpg.height*4);
         if(dt_imageio_jpeg_decompress(&jpg, tmp))
         {
@@ -1354,10 +1194,72 @@ libraw_fail:
     return;
   }
 
-  // TODO: various speed optimizations:
-  // TODO: also init all smaller mips!
-  // TODO: use mipf, but:
-  // TODO: if output is cropped, don't use mipf!
+  // smaller mips are filled by _init_smaller(), and the export uses mipf unless the history changes the geometry.
+}
+
+// fills the smaller levels which aren't cached yet by downscaling the thumbnail just produced
+// for level mip (4 bytes per pixel, uncompressed). the smaller ones of a fresh thumbnail go to the
+// disk store, for a thumbnail from disk only those the store doesn't have yet.
+static void
+_init_smaller(
+  dt_mipmap_cache_t      *cache,
+  const uint32_t          imgid,
+  const dt_mipmap_size_t  mip,
+  const uint8_t          *in,
+  const uint32_t          width,
+  const uint32_t          height,
+  const uint64_t          hash,
+  const int               fresh)
+{
+  // don't spread skulls:
+  if(width <= 8 && height <= 8) return;
+  uint8_t *scratchmem = NULL;
+  int filled = 0;
+  for(int k=mip-1; k>=DT_MIPMAP_0; k--)
+  {
+    const uint32_t key = get_key(imgid, k);
+    // already there, no need to wait for it:
+    if(dt_cache_read_testget(&cache->mip[k].cache, key))
+    {
+      dt_cache_read_release(&cache->mip[k].cache, key);
+      continue;
+    }
+    struct dt_mipmap_buffer_dsc* dsc = (struct dt_mipmap_buffer_dsc*)dt_cache_read_get(&cache->mip[k].cache, key);
+    if(dsc->flags & DT_MIPMAP_BUFFER_DSC_FLAG_GENERATE)
+    {
+      // we're write locked, as requested by the alloc callback.
+      if(cache->compression_type && !scratchmem) scratchmem = dt_mipmap_cache_alloc_scratchmem(cache);
+      uint8_t *out = cache->compression_type ? scratchmem : (uint8_t *)(dsc+1);
+      const uint32_t wd = cache->mip[k].max_width, ht = cache->mip[k].max_height;
+      if(width <= wd && height <= ht)
+      {
+        // small image, fits all levels as it is:
+        memcpy(out, in, sizeof(uint32_t)*width*height);
+        dsc->width  = width;
+        dsc->height = height;
+      }
+      else dt_iop_flip_and_zoom_8(in, width, height, out, wd, ht, 0, &dsc->width, &dsc->height);
+      if(fresh || !dt_mipmap_store_has(&cache->store, imgid, k, hash, wd, ht))
+        dt_mipmap_store_write(&cache->store, imgid, k, hash, wd, ht, out, dsc->width, dsc->height);
+      if(cache->compression_type)
+      {
+        dt_mipmap_buffer_t buf;
+        buf.width  = dsc->width;
+        buf.height = dsc->height;
+        buf.imgid  = imgid;
+        buf.size   = k;
+        buf.buf    = (uint8_t *)(dsc+1);
+        dt_mipmap_cache_compress(&buf, out);
+      }
+      dsc->flags &= ~DT_MIPMAP_BUFFER_DSC_FLAG_GENERATE;
+      dt_cache_write_release(&cache->mip[k].cache, key);
+      filled++;
+    }
+    dt_cache_read_release(&cache->mip[k].cache, key);
+  }
+  free(scratchmem);
+  /* raise signal that these mipmaps have been flushed to cache, too */
+  if(filled) dt_control_signal_raise(darktable.signals, DT_SIGNAL_DEVELOP_MIPMAP_UPDATED);
 }
 
 // compression stuff: alloc a buffer if needed
@@ -1385,14 +1287,12 @@ dt_mipmap_cache_decompress(
   const dt_mipmap_buffer_t *buf,
   uint8_t *scratchmem)
 {
-#ifdef HAVE_SQUISH
   if(darktable.mipmap_cache->compression_type && buf->width > 8 && buf->height > 8)
   {
-    squish_decompress_image(scratchmem, buf->width, buf->height, buf->buf, squish_dxt1);
+    dt_image_dxt1_uncompress_8(buf->buf, scratchmem, buf->width, buf->height);
     return scratchmem;
   }
   else
-#endif
   {
     return buf->buf;
   }
@@ -1406,16 +1306,13 @@ dt_mipmap_cache_compress(
   dt_mipmap_buffer_t *buf,
   uint8_t *const scratchmem)
 {
-#ifdef HAVE_SQUISH
   // only do something if compression is on, don't compress skulls:
   if(darktable.mipmap_cache->compression_type && buf->width > 8 && buf->height > 8)
   {
-    int flags = squish_dxt1;
-    // low quality:
-    if(darktable.mipmap_cache->compression_type == 1) flags |= squish_colour_range_fit;
-    squish_compress_image(scratchmem, buf->width, buf->height, buf->buf, squish_dxt1);
+    // high quality refines the block endpoints, low quality takes the first guess:
+    const int refine = darktable.mipmap_cache->compression_type == 2 ? 2 : 0;
+    dt_image_dxt1_compress_8(scratchmem, buf->buf, buf->width, buf->height, refine);
   }
-#endif
 }
 
 
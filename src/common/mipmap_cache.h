@@ -19,7 +19,11 @@
 #define DT_MIPMAP_CACHE_H
 
 #include "common/cache.h"
+#include "common/dtpthread.h"
 #include "common/image.h"
+#include "common/mipmap_store.h"
+
+#include <glib.h>
 
 
 // sizes stored in the mipmap cache.
@@ -110,6 +114,18 @@ typedef struct dt_mipmap_cache_t
   int compression_type; // 0 - none, 1 - low quality, 2 - slow
   // per-thread cache of uncompressed buffers, in case compression is requested.
   dt_mipmap_cache_one_t scratchmem;
+  // thumbnails of all 8-bit levels are kept on disk across sessions:
+  dt_mipmap_store_t store;
+
+  // speculative prefetching ahead of the lighttable, see dt_mipmap_cache_prefetch().
+  dt_pthread_mutex_t prefetch_mutex;
+  GHashTable *prefetch_wanted;        // keys requested in the latest round
+  GHashTable *prefetch_done;          // keys loaded speculatively, and not asked for since
+  long int stats_prefetch_queued;     // speculative requests
+  long int stats_prefetch_cached;     // ..which were in the cache already when their turn came
+  long int stats_prefetch_dropped;    // ..which nobody wanted anymore when their turn came
+  long int stats_prefetch_loaded;     // ..which had to be loaded
+  long int stats_prefetch_hits;       // best effort requests served by a speculatively loaded thumbnail
 }
 dt_mipmap_cache_t;
 
@@ -139,6 +155,14 @@ dt_mipmap_cache_read_get(
   const dt_mipmap_size_t mip,
   const dt_mipmap_get_flags_t flags);
 
+// speculative prefetching: start a new round, forgetting all requests of the previous
+// one which didn't get their turn yet. then add the thumbnails most likely needed next
+// first. they are loaded in the background, after everything that is actually visible.
+void dt_mipmap_cache_prefetch_begin(dt_mipmap_cache_t *cache);
+void dt_mipmap_cache_prefetch(dt_mipmap_cache_t *cache, const uint32_t imgid, const dt_mipmap_size_t mip);
+// called by the background job, loads the thumbnail unless it's stale.
+void dt_mipmap_cache_prefetch_load(dt_mipmap_cache_t *cache, const uint32_t imgid, const dt_mipmap_size_t mip);
+
 // lock it for writing. this is always blocking.
 // requires you already hold a read lock.
 void
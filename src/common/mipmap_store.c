@@ -0,0 +1,483 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2014 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/darktable.h"
+#include "common/debug.h"
+#include "common/imageio_jpeg.h"
+#include "common/mipmap_cache.h"
+#include "common/mipmap_store.h"
+#include "control/conf.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sqlite3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
+
+#define DT_MIPMAP_STORE_MAGIC 0xD71338
+#define DT_MIPMAP_STORE_VERSION 1
+// the data file is mapped in steps of this size, so appending doesn't remap every time:
+#define DT_MIPMAP_STORE_MAP_STEP (64u<<20)
+// don't bother compacting less garbage than this:
+#define DT_MIPMAP_STORE_MIN_GARBAGE (16u<<20)
+
+// both files start with this:
+typedef struct dt_mipmap_store_header_t
+{
+  int32_t magic;
+  int32_t version;
+}
+dt_mipmap_store_header_t;
+
+// precedes every jpeg blob in the data file
+typedef struct dt_mipmap_store_record_t
+{
+  uint32_t key;
+  uint32_t length;
+  uint64_t hash;
+  uint32_t width, height;
+  uint32_t max_width, max_height; // size of the mip level the thumbnail was produced for
+}
+__attribute__((packed)) dt_mipmap_store_record_t;
+
+// the index file is an array of these. later entries supersede earlier ones.
+typedef struct dt_mipmap_store_entry_t
+{
+  uint32_t key;
+  uint32_t length;                // of the jpeg blob, 0 marks a removed thumbnail
+  uint64_t hash;
+  uint64_t offset;                // of the record in the data file
+}
+__attribute__((packed)) dt_mipmap_store_entry_t;
+
+typedef struct dt_mipmap_store_map_t
+{
+  uint8_t *addr;
+  size_t size;
+}
+dt_mipmap_store_map_t;
+
+static inline uint32_t
+_key(const uint32_t imgid, const int mip)
+{
+  // imgid can't be >= 2^29, same as in the mipmap cache. never 0, as imgid > 0.
+  return (((uint32_t)mip) << 29) | imgid;
+}
+
+static inline uint64_t
+_record_size(const uint32_t length)
+{
+  return sizeof(dt_mipmap_store_record_t) + length;
+}
+
+// makes sure the file starts with a valid header, truncates it otherwise. returns the file size or -1.
+static off_t
+_check_header(const int fd)
+{
+  const dt_mipmap_store_header_t header = { DT_MIPMAP_STORE_MAGIC, DT_MIPMAP_STORE_VERSION };
+  dt_mipmap_store_header_t file_header = { 0, 0 };
+  struct stat st;
+  if(fstat(fd, &st)) return -1;
+  if(st.st_size >= (off_t)sizeof(header) &&
+     pread(fd, &file_header, sizeof(file_header), 0) == sizeof(file_header) &&
+     file_header.magic == header.magic && file_header.version == header.version)
+    return st.st_size;
+
+  if(st.st_size > 0) fprintf(stderr, "[mipmap_store] dropping thumbnail store of an old version\n");
+  if(ftruncate(fd, 0)) return -1;
+  if(pwrite(fd, &header, sizeof(header), 0) != sizeof(header)) return -1;
+  return sizeof(header);
+}
+
+static void
+_close(dt_mipmap_store_t *store)
+{
+  if(store->map) munmap(store->map, store->map_size);
+  store->map = NULL;
+  store->map_size = 0;
+  while(store->old_maps)
+  {
+    dt_mipmap_store_map_t *m = (dt_mipmap_store_map_t *)store->old_maps->data;
+    munmap(m->addr, m->size);
+    free(m);
+    store->old_maps = g_list_delete_link(store->old_maps, store->old_maps);
+  }
+  if(store->data_fd >= 0) close(store->data_fd);
+  if(store->index_fd >= 0) close(store->index_fd);
+  store->data_fd = store->index_fd = -1;
+  if(store->index) g_hash_table_destroy(store->index);
+  store->index = NULL;
+  store->loaded = 0;
+}
+
+void
+dt_mipmap_store_init(dt_mipmap_store_t *store, const char *basename)
+{
+  dt_pthread_mutex_init(&store->lock, NULL);
+  store->data_fd = store->index_fd = -1;
+  store->loaded = 0;
+  store->index = NULL;
+  store->data_end = store->index_end = 0;
+  store->garbage = 0;
+  store->map = NULL;
+  store->map_size = 0;
+  store->old_maps = NULL;
+  if(!basename) return;
+
+  snprintf(store->data_filename, sizeof(store->data_filename), "%s.data", basename);
+  snprintf(store->index_filename, sizeof(store->index_filename), "%s.index", basename);
+  store->data_fd  = open(store->data_filename,  O_RDWR | O_CREAT, 0644);
+  store->index_fd = open(store->index_filename, O_RDWR | O_CREAT, 0644);
+  const off_t data_size  = store->data_fd  >= 0 ? _check_header(store->data_fd)  : -1;
+  const off_t index_size = store->index_fd >= 0 ? _check_header(store->index_fd) : -1;
+  if(data_size < 0 || index_size < 0)
+  {
+    fprintf(stderr, "[mipmap_store] could not open `%s', thumbnails will not be kept on disk\n", store->data_filename);
+    _close(store);
+    return;
+  }
+  // the index itself is only read when the first thumbnail is requested.
+  store->data_end  = data_size;
+  store->index_end = index_size;
+}
+
+// remembers the entry, accounting for the record it supersedes. called with the lock held.
+static void
+_insert(dt_mipmap_store_t *store, const dt_mipmap_store_entry_t *entry)
+{
+  const gpointer key = GUINT_TO_POINTER(entry->key);
+  const dt_mipmap_store_entry_t *old = (const dt_mipmap_store_entry_t *)g_hash_table_lookup(store->index, key);
+  if(old) store->garbage += _record_size(old->length);
+  if(entry->length == 0)
+  {
+    g_hash_table_remove(store->index, key);
+    return;
+  }
+  dt_mipmap_store_entry_t *e = (dt_mipmap_store_entry_t *)malloc(sizeof(dt_mipmap_store_entry_t));
+  *e = *entry;
+  g_hash_table_insert(store->index, key, e);
+}
+
+// reads the index file. called with the lock held.
+static void
+_load_index(dt_mipmap_store_t *store)
+{
+  store->loaded = 1;
+  store->index = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, free);
+
+  const size_t header = sizeof(dt_mipmap_store_header_t);
+  const size_t count = (store->index_end - header) / sizeof(dt_mipmap_store_entry_t);
+  if(header + count * sizeof(dt_mipmap_store_entry_t) != store->index_end)
+  {
+    // a crash while appending left half an entry behind:
+    store->index_end = header + count * sizeof(dt_mipmap_store_entry_t);
+    if(ftruncate(store->index_fd, store->index_end)) {}
+  }
+  if(!count) return;
+
+  dt_mipmap_store_entry_t *entries = (dt_mipmap_store_entry_t *)malloc(count * sizeof(dt_mipmap_store_entry_t));
+  if(!entries) return;
+  const ssize_t size = count * sizeof(dt_mipmap_store_entry_t);
+  if(pread(store->index_fd, entries, size, header) == size)
+  {
+    for(size_t k = 0; k < count; k++)
+    {
+      // records are written before their index entry, but better be safe:
+      if(entries[k].length && entries[k].offset + _record_size(entries[k].length) > store->data_end) continue;
+      _insert(store, entries + k);
+    }
+  }
+  free(entries);
+  dt_print(DT_DEBUG_CACHE, "[mipmap_store] %u thumbnails on disk, %.2f MB of %.2f MB garbage\n",
+           g_hash_table_size(store->index), store->garbage/(1024.0*1024.0), store->data_end/(1024.0*1024.0));
+}
+
+// makes sure the data file is mapped up to the given offset. called with the lock held.
+static int
+_map(dt_mipmap_store_t *store, const uint64_t end)
+{
+  if(end <= store->map_size) return 0;
+  // map beyond the end of the file, so appended records can be read without remapping:
+  const size_t size = ((end + DT_MIPMAP_STORE_MAP_STEP - 1) / DT_MIPMAP_STORE_MAP_STEP + 1) * (size_t)DT_MIPMAP_STORE_MAP_STEP;
+  uint8_t *map = (uint8_t *)mmap(NULL, size, PROT_READ, MAP_SHARED, store->data_fd, 0);
+  if(map == MAP_FAILED) return 1;
+  if(store->map)
+  {
+    // other threads might still decode from the old mapping, keep it until cleanup.
+    dt_mipmap_store_map_t *m = (dt_mipmap_store_map_t *)malloc(sizeof(dt_mipmap_store_map_t));
+    m->addr = store->map;
+    m->size = store->map_size;
+    store->old_maps = g_list_prepend(store->old_maps, m);
+  }
+  store->map = map;
+  store->map_size = size;
+  return 0;
+}
+
+uint64_t
+dt_mipmap_store_hash(const uint32_t imgid)
+{
+  uint64_t hash = 5381;
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "select operation, op_params, enabled, blendop_params, multi_priority, multi_name "
+                              "from history where imgid = ?1 order by num", -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    for(int k = 0; k < 6; k++)
+    {
+      const uint8_t *blob = (const uint8_t *)sqlite3_column_blob(stmt, k);
+      const int bytes = sqlite3_column_bytes(stmt, k);
+      for(int i = 0; i < bytes; i++) hash = ((hash << 5) + hash) ^ blob[i];
+    }
+  }
+  sqlite3_finalize(stmt);
+  // unaltered images might show the embedded thumbnail:
+  hash = ((hash << 5) + hash) ^ dt_conf_get_bool("never_use_embedded_thumb");
+  return hash;
+}
+
+int
+dt_mipmap_store_read(
+  dt_mipmap_store_t *store,
+  const uint32_t imgid,
+  const int mip,
+  const uint64_t hash,
+  const uint32_t max_width,
+  const uint32_t max_height,
+  uint8_t *out,
+  uint32_t *width,
+  uint32_t *height)
+{
+  if(store->data_fd < 0) return 1;
+  const uint32_t key = _key(imgid, mip);
+  const uint8_t *data = NULL;
+  uint32_t length = 0;
+
+  dt_pthread_mutex_lock(&store->lock);
+  if(!store->loaded) _load_index(store);
+  const dt_mipmap_store_entry_t *entry = (const dt_mipmap_store_entry_t *)g_hash_table_lookup(store->index, GUINT_TO_POINTER(key));
+  if(entry && entry->hash == hash && !_map(store, entry->offset + _record_size(entry->length)))
+  {
+    data = store->map + entry->offset;
+    length = entry->length;
+  }
+  dt_pthread_mutex_unlock(&store->lock);
+  if(!data) return 1;
+
+  // records are never overwritten and mappings stay valid until cleanup, so decode without the lock:
+  dt_mipmap_store_record_t record;
+  memcpy(&record, data, sizeof(record));
+  if(record.key != key || record.hash != hash || record.length != length) return 1;
+  // produced for a different thumbnail size:
+  if(record.max_width != max_width || record.max_height != max_height) return 1;
+  if(record.width > max_width || record.height > max_height) return 1;
+
+  dt_imageio_jpeg_t jpg;
+  if(dt_imageio_jpeg_decompress_header(data + sizeof(record), record.length, &jpg) ||
+     jpg.width != record.width || jpg.height != record.height ||
+     dt_imageio_jpeg_decompress(&jpg, out))
+  {
+    fprintf(stderr, "[mipmap_store] failed to decompress thumbnail for image %u!\n", imgid);
+    return 1;
+  }
+  *width  = record.width;
+  *height = record.height;
+  return 0;
+}
+
+int
+dt_mipmap_store_has(
+  dt_mipmap_store_t *store,
+  const uint32_t imgid,
+  const int mip,
+  const uint64_t hash,
+  const uint32_t max_width,
+  const uint32_t max_height)
+{
+  if(store->data_fd < 0) return 0;
+  const uint32_t key = _key(imgid, mip);
+  int found = 0;
+  dt_pthread_mutex_lock(&store->lock);
+  if(!store->loaded) _load_index(store);
+  const dt_mipmap_store_entry_t *entry = (const dt_mipmap_store_entry_t *)g_hash_table_lookup(store->index, GUINT_TO_POINTER(key));
+  if(entry && entry->length && entry->hash == hash && !_map(store, entry->offset + _record_size(entry->length)))
+  {
+    // same checks as the read, short of decoding the jpeg:
+    dt_mipmap_store_record_t record;
+    memcpy(&record, store->map + entry->offset, sizeof(record));
+    found = record.key == key && record.hash == hash && record.length == entry->length &&
+            record.max_width == max_width && record.max_height == max_height;
+  }
+  dt_pthread_mutex_unlock(&store->lock);
+  return found;
+}
+
+// appends an index entry and updates the table. called with the lock held.
+static int
+_append_entry(dt_mipmap_store_t *store, const dt_mipmap_store_entry_t *entry)
+{
+  if(pwrite(store->index_fd, entry, sizeof(*entry), store->index_end) != sizeof(*entry)) return 1;
+  store->index_end += sizeof(*entry);
+  _insert(store, entry);
+  return 0;
+}
+
+void
+dt_mipmap_store_write(
+  dt_mipmap_store_t *store,
+  const uint32_t imgid,
+  const int mip,
+  const uint64_t hash,
+  const uint32_t max_width,
+  const uint32_t max_height,
+  const uint8_t *in,
+  const uint32_t width,
+  const uint32_t height)
+{
+  if(store->data_fd < 0) return;
+  // skulls and failed thumbnails are not worth keeping:
+  if(width <= 8 && height <= 8) return;
+
+  uint8_t *blob = (uint8_t *)malloc(sizeof(dt_mipmap_store_record_t) + 4*sizeof(uint8_t)*width*height);
+  if(!blob) return;
+  const int quality = MIN(100, MAX(10, dt_conf_get_int("database_cache_quality")));
+  const int length = dt_imageio_jpeg_compress(in, blob + sizeof(dt_mipmap_store_record_t), width, height, quality);
+  // 1 means failure (or a really good compressor)
+  if(length <= 1)
+  {
+    free(blob);
+    return;
+  }
+  dt_mipmap_store_record_t record;
+  record.key = _key(imgid, mip);
+  record.length = length;
+  record.hash = hash;
+  record.width = width;
+  record.height = height;
+  record.max_width = max_width;
+  record.max_height = max_height;
+  memcpy(blob, &record, sizeof(record));
+
+  dt_pthread_mutex_lock(&store->lock);
+  if(!store->loaded) _load_index(store);
+  dt_mipmap_store_entry_t entry;
+  entry.key = record.key;
+  entry.length = record.length;
+  entry.hash = hash;
+  entry.offset = store->data_end;
+  const ssize_t size = _record_size(length);
+  // data goes first, an index entry never points to a record which isn't there:
+  if(pwrite(store->data_fd, blob, size, store->data_end) == size)
+  {
+    store->data_end += size;
+    if(_append_entry(store, &entry))
+      fprintf(stderr, "[mipmap_store] failed to write to `%s': %s\n", store->index_filename, strerror(errno));
+  }
+  else
+    fprintf(stderr, "[mipmap_store] failed to write to `%s': %s\n", store->data_filename, strerror(errno));
+  dt_pthread_mutex_unlock(&store->lock);
+  free(blob);
+}
+
+void
+dt_mipmap_store_remove(dt_mipmap_store_t *store, const uint32_t imgid)
+{
+  if(store->data_fd < 0) return;
+  dt_pthread_mutex_lock(&store->lock);
+  if(!store->loaded) _load_index(store);
+  for(int k=DT_MIPMAP_0; k<DT_MIPMAP_F; k++)
+  {
+    const uint32_t key = _key(imgid, k);
+    if(!g_hash_table_lookup(store->index, GUINT_TO_POINTER(key))) continue;
+    dt_mipmap_store_entry_t entry = { key, 0, 0, 0 };
+    (void)_append_entry(store, &entry);
+  }
+  dt_pthread_mutex_unlock(&store->lock);
+}
+
+// rewrites the live records into fresh files. called on shutdown only, no readers are around.
+static void
+_compact(dt_mipmap_store_t *store)
+{
+  char data_tmp[1040], index_tmp[1040];
+  snprintf(data_tmp, sizeof(data_tmp), "%s.tmp", store->data_filename);
+  snprintf(index_tmp, sizeof(index_tmp), "%s.tmp", store->index_filename);
+  if(_map(store, store->data_end)) return;
+
+  FILE *fd = fopen(data_tmp, "wb");
+  FILE *fi = fopen(index_tmp, "wb");
+  int err = !fd || !fi;
+  const dt_mipmap_store_header_t header = { DT_MIPMAP_STORE_MAGIC, DT_MIPMAP_STORE_VERSION };
+  if(!err) err = fwrite(&header, sizeof(header), 1, fd) != 1 || fwrite(&header, sizeof(header), 1, fi) != 1;
+  uint64_t offset = sizeof(header);
+
+  GHashTableIter it;
+  gpointer key, value;
+  g_hash_table_iter_init(&it, store->index);
+  while(!err && g_hash_table_iter_next(&it, &key, &value))
+  {
+    dt_mipmap_store_entry_t entry = *(dt_mipmap_store_entry_t *)value;
+    const size_t size = _record_size(entry.length);
+    err = fwrite(store->map + entry.offset, 1, size, fd) != size;
+    entry.offset = offset;
+    offset += size;
+    if(!err) err = fwrite(&entry, sizeof(entry), 1, fi) != 1;
+  }
+  if(fd && fclose(fd)) err = 1;
+  if(fi && fclose(fi)) err = 1;
+  if(err || g_rename(data_tmp, store->data_filename))
+  {
+    // nothing replaced yet, the old files are still consistent:
+    fprintf(stderr, "[mipmap_store] failed to compact `%s'\n", store->data_filename);
+    g_unlink(data_tmp);
+    g_unlink(index_tmp);
+    return;
+  }
+  if(g_rename(index_tmp, store->index_filename))
+  {
+    // the old index doesn't match the new data file, start over next time:
+    fprintf(stderr, "[mipmap_store] failed to compact `%s', dropping thumbnails\n", store->index_filename);
+    g_unlink(index_tmp);
+    g_unlink(store->index_filename);
+    return;
+  }
+  dt_print(DT_DEBUG_CACHE, "[mipmap_store] compacted thumbnails from %.2f MB to %.2f MB\n",
+           store->data_end/(1024.0*1024.0), offset/(1024.0*1024.0));
+}
+
+void
+dt_mipmap_store_cleanup(dt_mipmap_store_t *store)
+{
+  if(store->data_fd >= 0 && store->loaded &&
+     store->garbage > DT_MIPMAP_STORE_MIN_GARBAGE && 2*store->garbage > store->data_end)
+    _compact(store);
+  _close(store);
+  dt_pthread_mutex_destroy(&store->lock);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-space on;
@@ -0,0 +1,83 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2014 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DT_COMMON_MIPMAP_STORE_H
+#define DT_COMMON_MIPMAP_STORE_H
+
+#include "common/dtpthread.h"
+#include <glib.h>
+#include <inttypes.h>
+#include <stddef.h>
+
+/**
+ * persistent on-disk store for the 8-bit thumbnails of the mipmap cache.
+ *
+ * thumbnails are appended to a data file as jpeg records as soon as they
+ * have been produced, and a small index file records where they went. the
+ * index is keyed by imgid and mip level and remembers the hash of the
+ * history a thumbnail was produced with, so edited images miss.
+ *
+ * nothing is read at startup: the index is loaded on the first lookup and
+ * records are read through a read-only mapping of the data file. superseded
+ * records are dropped by compacting the files on shutdown.
+ */
+typedef struct dt_mipmap_store_t
+{
+  dt_pthread_mutex_t lock;
+  char data_filename[1024];
+  char index_filename[1024];
+  int data_fd;              // -1 if the store is disabled
+  int index_fd;
+  int loaded;               // index has been read
+  GHashTable *index;        // key -> dt_mipmap_store_entry_t
+  uint64_t data_end;        // append position in the data file
+  uint64_t index_end;       // append position in the index file
+  uint64_t garbage;         // bytes held by superseded records
+  uint8_t *map;             // read-only mapping of the data file
+  size_t map_size;
+  GList *old_maps;          // outgrown mappings, readers might still use them
+}
+dt_mipmap_store_t;
+
+/** opens (or creates) the store next to the given base filename. pass NULL to disable it. */
+void dt_mipmap_store_init(dt_mipmap_store_t *store, const char *basename);
+/** closes the files, compacting them first if most of the data file is garbage. */
+void dt_mipmap_store_cleanup(dt_mipmap_store_t *store);
+
+/** hash of everything the thumbnail of this image depends on, to be passed to read and write. */
+uint64_t dt_mipmap_store_hash(const uint32_t imgid);
+
+/** decodes the stored thumbnail into out (4 bytes per pixel, up to max_width x max_height).
+  * returns non-zero and leaves width/height alone if there is no matching thumbnail. */
+int dt_mipmap_store_read(dt_mipmap_store_t *store, const uint32_t imgid, const int mip, const uint64_t hash,
+                         const uint32_t max_width, const uint32_t max_height,
+                         uint8_t *out, uint32_t *width, uint32_t *height);
+/** returns non-zero if a thumbnail of the image and size with this hash is stored, without decoding it. */
+int dt_mipmap_store_has(dt_mipmap_store_t *store, const uint32_t imgid, const int mip, const uint64_t hash,
+                        const uint32_t max_width, const uint32_t max_height);
+/** appends a freshly produced thumbnail, superseding any earlier one of the same image and size. */
+void dt_mipmap_store_write(dt_mipmap_store_t *store, const uint32_t imgid, const int mip, const uint64_t hash,
+                           const uint32_t max_width, const uint32_t max_height,
+                           const uint8_t *in, const uint32_t width, const uint32_t height);
+/** forgets all thumbnails of the image. */
+void dt_mipmap_store_remove(dt_mipmap_store_t *store, const uint32_t imgid);
+
+#endif
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-space on;
@@ -35,6 +35,7 @@ void dt_ratings_apply_to_image (int imgid, int rating)
   dt_image_cache_write_release(darktable.image_cache, image, DT_IMAGE_CACHE_SAFE);
   dt_image_cache_read_release(darktable.image_cache, image);
 
+  dt_collection_image_changed(darktable.collection, imgid);
   dt_collection_hint_message(darktable.collection);
 }
 
@@ -19,6 +19,7 @@
 #include "common/darktable.h"
 #include "develop/develop.h"
 #include "control/control.h"
+#include "common/collection.h"
 #include "common/history.h"
 #include "common/imageio.h"
 #include "common/image_cache.h"
@@ -441,6 +442,9 @@ dt_styles_apply_to_image(const char *name,gboolean duplicate, int32_t imgid)
     sqlite3_step (stmt);
     sqlite3_finalize (stmt);
 
+    /* it might be altered now */
+    dt_collection_image_changed(darktable.collection, newimgid);
+
     /* add tag */
     guint tagid=0;
     gchar ntag[512]= {0};
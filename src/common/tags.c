@@ -19,6 +19,7 @@
 
 #include "common/darktable.h"
 #include "common/tags.h"
+#include "common/collection.h"
 #include "common/debug.h"
 #include "control/conf.h"
 #include "control/control.h"
@@ -236,6 +237,7 @@ void dt_tag_attach(guint tagid,gint imgid)
     sqlite3_step(stmt);
     sqlite3_finalize(stmt);
   }
+  dt_collection_image_changed(darktable.collection, imgid);
 }
 
 void dt_tag_attach_list(GList *tags,gint imgid)
@@ -320,6 +322,7 @@ void dt_tag_detach(guint tagid,gint imgid)
     sqlite3_step(stmt);
     sqlite3_finalize(stmt);
   }
+  dt_collection_image_changed(darktable.collection, imgid);
 }
 
 void dt_tag_detach_by_string(const char *name, gint imgid)
@@ -330,6 +333,7 @@ void dt_tag_detach_by_string(const char *name, gint imgid)
              "tags WHERE name LIKE '%s') AND imgid = %d;", name, imgid);
   DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), query,
                         NULL, NULL, NULL);
+  dt_collection_image_changed(darktable.collection, imgid);
 }
 
 
@@ -56,15 +56,46 @@
 #include <glib/gstdio.h>
 #include <gdk/gdkkeysyms.h>
 
-/* the queue can have scheduled jobs but all
-    the workers is sleeping, so this kicks the workers
-    on timed interval.
+/* delayed background jobs are handed over to the
+    reserved background worker by this thread, once
+    they are due.
 */
-static void * _control_worker_kicker(void *ptr);
+static void * _control_scheduler(void *ptr);
+
+/* a job waiting in one of the worker queues. the list node is
+    embedded, so it can be moved around without reallocation. */
+typedef struct _control_queued_job_t
+{
+  dt_job_t job;
+  GList link;
+  int32_t owner;  // index of the queue this job is in, -1 if it has been taken out
+}
+_control_queued_job_t;
 
 /* redraw mutex to synchronize redraws */
 static dt_pthread_mutex_t _control_gdk_lock_threads_mutex;
 
+/* jobs are considered equal if they'd do the same thing,
+    independent of their state or time stamps. */
+static guint _control_job_hash(gconstpointer key)
+{
+  const dt_job_t *j = (const dt_job_t *)key;
+  // bernstein hash (djb2) over what the job does:
+  guint hash = 5381 ^ (guint)(size_t)j->execute;
+  const char *str = (const char *)j->param;
+  for(size_t i=0; i<sizeof(j->param); i++) hash = ((hash << 5) + hash) ^ str[i];
+  return hash;
+}
+
+static gboolean _control_job_equal(gconstpointer a, gconstpointer b)
+{
+  const dt_job_t *ja = (const dt_job_t *)a, *jb = (const dt_job_t *)b;
+  return ja->execute == jb->execute &&
+         ja->state_changed_cb == jb->state_changed_cb &&
+         ja->user_data == jb->user_data &&
+         !memcmp(ja->param, jb->param, sizeof(ja->param));
+}
+
 void dt_ctl_settings_default(dt_control_t *c)
 {
   dt_conf_set_string ("database", "library.db");
@@ -484,6 +515,8 @@ void dt_control_init(dt_control_t *s)
     dt_ctl_settings_default(s);
 
   pthread_cond_init(&s->cond, NULL);
+  pthread_cond_init(&s->cond_res, NULL);
+  pthread_cond_init(&s->cond_scheduled, NULL);
   dt_pthread_mutex_init(&s->cond_mutex, NULL);
   dt_pthread_mutex_init(&s->queue_mutex, NULL);
   dt_pthread_mutex_init(&s->run_mutex, NULL);
@@ -492,14 +525,24 @@ void dt_control_init(dt_control_t *s)
   // start threads
   s->num_threads = CLAMP(dt_conf_get_int ("worker_threads"), 1, 8);
   s->thread = (pthread_t *)malloc(sizeof(pthread_t)*s->num_threads);
+  s->queues = (dt_control_queue_t *)malloc(sizeof(dt_control_queue_t)*s->num_threads);
+  for(int k=0; k<s->num_threads; k++)
+  {
+    dt_pthread_mutex_init(&s->queues[k].mutex, NULL);
+    for(int p=0; p<DT_JOB_PRIORITY_COUNT; p++) g_queue_init(&s->queues[k].jobs[p]);
+  }
+  s->num_queued = 0;
+  s->next_queue = 0;
+  s->queued = g_hash_table_new(_control_job_hash, _control_job_equal);
+  s->scheduled = NULL;
   dt_pthread_mutex_lock(&s->run_mutex);
   s->running = 1;
   dt_pthread_mutex_unlock(&s->run_mutex);
   for(int k=0; k<s->num_threads; k++)
     pthread_create(&s->thread[k], NULL, dt_control_work, s);
 
-  /* create queue kicker thread */
-  pthread_create(&s->kick_on_workers_thread, NULL, _control_worker_kicker, s);
+  /* create thread for delayed jobs */
+  pthread_create(&s->scheduler_thread, NULL, _control_scheduler, s);
 
   for(int k=0; k<DT_CTL_WORKER_RESERVED; k++)
   {
@@ -834,14 +877,16 @@ void dt_control_shutdown(dt_control_t *s)
   dt_pthread_mutex_lock(&s->run_mutex);
   s->running = 0;
   dt_pthread_mutex_unlock(&s->run_mutex);
-  dt_pthread_mutex_unlock(&s->cond_mutex);
   pthread_cond_broadcast(&s->cond);
+  pthread_cond_broadcast(&s->cond_res);
+  pthread_cond_broadcast(&s->cond_scheduled);
+  dt_pthread_mutex_unlock(&s->cond_mutex);
 
   /* cancel background job if any */
   dt_control_job_cancel(&s->job_res[DT_CTL_WORKER_7]);
 
-  /* first wait for kick_on_workers_thread */
-  pthread_join(s->kick_on_workers_thread, NULL);
+  /* first wait for the scheduler thread */
+  pthread_join(s->scheduler_thread, NULL);
 
   // gdk_threads_leave();
   int k;
@@ -866,6 +911,20 @@ void dt_control_cleanup(dt_control_t *s)
   // vacuum TODO: optional?
   // DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "PRAGMA incremental_vacuum(0)", NULL, NULL, NULL);
   // DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "vacuum", NULL, NULL, NULL);
+  /* free jobs which never got to run */
+  for(int k=0; k<s->num_threads; k++)
+  {
+    for(int p=0; p<DT_JOB_PRIORITY_COUNT; p++)
+    {
+      GList *link;
+      while((link = g_queue_pop_head_link(&s->queues[k].jobs[p])))
+        g_free(link->data);
+    }
+    dt_pthread_mutex_destroy(&s->queues[k].mutex);
+  }
+  free(s->queues);
+  g_list_free_full(s->scheduled, g_free);
+  g_hash_table_destroy(s->queued);
   dt_pthread_mutex_destroy(&s->queue_mutex);
   dt_pthread_mutex_destroy(&s->cond_mutex);
   dt_pthread_mutex_destroy(&s->log_mutex);
@@ -893,6 +952,11 @@ void dt_control_job_init(dt_job_t *j, const char *msg, ...)
   dt_pthread_mutex_init (&j->wait_mutex,NULL);
 }
 
+void dt_control_job_set_priority(dt_job_t *j, dt_job_priority_t priority)
+{
+  j->priority = CLAMP(priority, 0, DT_JOB_PRIORITY_COUNT-1);
+}
+
 void dt_control_job_set_state_callback(dt_job_t *j,dt_job_state_change_callback cb,void *user_data)
 {
   j->state_changed_cb = cb;
@@ -974,69 +1038,62 @@ int32_t dt_control_run_job_res(dt_control_t *s, int32_t res)
 
   }
   dt_pthread_mutex_unlock (&j->wait_mutex);
+
+  /* the scheduler waits for the background worker to be idle */
+  if(res == DT_CTL_WORKER_7)
+  {
+    dt_pthread_mutex_lock(&s->cond_mutex);
+    pthread_cond_signal(&s->cond_scheduled);
+    dt_pthread_mutex_unlock(&s->cond_mutex);
+  }
   return 0;
 }
 
 
-int32_t dt_control_run_job(dt_control_t *s)
+/* take the most urgent job: first look into our own queue, then try to
+    steal from the other workers. */
+static _control_queued_job_t *_control_take_job(dt_control_t *s, const int32_t threadid)
 {
-  dt_job_t *j=NULL,*bj=NULL;
-  dt_pthread_mutex_lock(&s->queue_mutex);
-
-  /* check if queue is empty */
-  if(g_list_length(s->queue) == 0)
+  for(int p=0; p<DT_JOB_PRIORITY_COUNT; p++)
   {
-    dt_pthread_mutex_unlock(&s->queue_mutex);
-    return -1;
-  }
-
-  /* go thru the queue and find one normal job and a background job
-      that is up for execution.*/
-  time_t ts_now = time(NULL);
-  GList *jobitem=g_list_first(s->queue);
-  if(jobitem)
-    do
+    for(int k=0; k<s->num_threads; k++)
     {
-      dt_job_t *tj = jobitem->data;
-
-      /* check if it's a scheduled job and is waiting to be executed */
-      if(!bj && (tj->ts_execute > tj->ts_added) && tj->ts_execute <= ts_now)
-        bj = tj;
-      else if ((tj->ts_execute < tj->ts_added) && !j)
-        j = tj;
-
-      /* if we got a normal job, and a background job, we are finished */
-      if(bj && j) break;
-
+      dt_control_queue_t *q = s->queues + (threadid + k) % s->num_threads;
+      dt_pthread_mutex_lock(&q->mutex);
+      GList *link = g_queue_pop_head_link(&q->jobs[p]);
+      if(link) ((_control_queued_job_t *)link->data)->owner = -1;
+      dt_pthread_mutex_unlock(&q->mutex);
+      if(link) return (_control_queued_job_t *)link->data;
     }
-    while ((jobitem = g_list_next(jobitem)));
+  }
+  return NULL;
+}
 
-  /* remove the found jobs from queue */
-  if (bj)
-    s->queue = g_list_remove(s->queue, bj);
+int32_t dt_control_run_job(dt_control_t *s)
+{
+  const int32_t threadid = dt_control_get_threadid();
+  _control_queued_job_t *qj = _control_take_job(s, threadid % s->num_threads);
 
-  if (j)
-    s->queue = g_list_remove(s->queue, j);
+  /* don't continue if we don't have have a job to execute */
+  if(!qj)
+    return -1;
 
-  /* unlock the queue */
+  dt_pthread_mutex_lock(&s->cond_mutex);
+  s->num_queued--;
+  dt_pthread_mutex_unlock(&s->cond_mutex);
+
+  dt_pthread_mutex_lock(&s->queue_mutex);
+  g_hash_table_remove(s->queued, &qj->job);
   dt_pthread_mutex_unlock(&s->queue_mutex);
 
-  /* push background job on reserved background worker */
-  if(bj)
-  {
-    dt_control_add_job_res(s,bj,DT_CTL_WORKER_7);
-    g_free (bj);
-  }
-  /* don't continue if we don't have have a job to execute */
-  if(!j)
-    return -1;
+  dt_job_t *j = &qj->job;
 
   /* change state to running */
   dt_pthread_mutex_lock (&j->wait_mutex);
   if (dt_control_job_get_state (j) == DT_JOB_STATE_QUEUED)
   {
     dt_print(DT_DEBUG_CONTROL, "[run_job+] %02d %f ",
-             DT_CTL_WORKER_RESERVED+dt_control_get_threadid(), dt_get_wtime());
+             DT_CTL_WORKER_RESERVED+threadid, dt_get_wtime());
     dt_control_job_print(j);
     dt_print(DT_DEBUG_CONTROL, "\n");
 
@@ -1048,16 +1105,14 @@ int32_t dt_control_run_job(dt_control_t *s)
     _control_job_set_state (j,DT_JOB_STATE_FINISHED);
 
     dt_print(DT_DEBUG_CONTROL, "[run_job-] %02d %f ",
-             DT_CTL_WORKER_RESERVED+dt_control_get_threadid(), dt_get_wtime());
+             DT_CTL_WORKER_RESERVED+threadid, dt_get_wtime());
     dt_control_job_print(j);
     dt_print(DT_DEBUG_CONTROL, "\n");
-
-    /* free job */
-    dt_pthread_mutex_unlock (&j->wait_mutex);
-    g_free(j);
-    j = NULL;
   }
-  if(j) dt_pthread_mutex_unlock (&j->wait_mutex);
+  dt_pthread_mutex_unlock (&j->wait_mutex);
+
+  /* free job, also if it has been cancelled while waiting */
+  g_free(qj);
 
   return 0;
 }
@@ -1074,14 +1129,14 @@ int32_t dt_control_add_job_res(dt_control_t *s, dt_job_t *job, int32_t res)
   s->new_res[res] = 1;
   dt_pthread_mutex_unlock(&s->queue_mutex);
   dt_pthread_mutex_lock(&s->cond_mutex);
-  pthread_cond_broadcast(&s->cond);
+  pthread_cond_broadcast(&s->cond_res);
   dt_pthread_mutex_unlock(&s->cond_mutex);
   return 0;
 }
 
-/* Background jobs will be timestamped and added to queue
-    the queue will then check ts and detect if its background job
-    and place it on the job_res if its available...
+/* Background jobs will be timestamped and kept in a separate list,
+    the scheduler thread will then hand them over to the reserved
+    background worker once they are due.
 */
 int32_t dt_control_add_background_job(dt_control_t *s, dt_job_t *job, time_t delay)
 {
@@ -1099,49 +1154,59 @@ int32_t dt_control_add_job(dt_control_t *s, dt_job_t *job)
   if (job->ts_added == 0)
     job->ts_added = time(NULL);
 
+  /* allocate storage for the job */
+  _control_queued_job_t *qj = g_malloc(sizeof(_control_queued_job_t));
+  memcpy(&qj->job, job, sizeof(dt_job_t));
+  qj->job.priority = CLAMP(qj->job.priority, 0, DT_JOB_PRIORITY_COUNT-1);
+  qj->link.data = qj;
+  qj->link.next = qj->link.prev = NULL;
+  qj->owner = -1;
+
   dt_pthread_mutex_lock(&s->queue_mutex);
 
   /* check if equivalent job exist in queue, and discard job
       if duplicate found .*/
-  GList *jobitem = g_list_first(s->queue);
-  if(jobitem)
-    do
-    {
-      if(!memcmp(job, jobitem->data, sizeof(dt_job_t)))
-      {
-        dt_print(DT_DEBUG_CONTROL, "[add_job] found job already in queue\n");
-        _control_job_set_state (job,DT_JOB_STATE_DISCARDED);
-        dt_pthread_mutex_unlock(&s->queue_mutex);
-        return -1;
-      }
-    }
-    while((jobitem=g_list_next(jobitem)));
+  if(g_hash_table_lookup(s->queued, job))
+  {
+    dt_print(DT_DEBUG_CONTROL, "[add_job] found job already in queue\n");
+    _control_job_set_state (job,DT_JOB_STATE_DISCARDED);
+    dt_pthread_mutex_unlock(&s->queue_mutex);
+    g_free(qj);
+    return -1;
+  }
 
-  dt_print(DT_DEBUG_CONTROL, "[add_job] %d ", g_list_length(s->queue));
+  dt_print(DT_DEBUG_CONTROL, "[add_job] %d ", g_hash_table_size(s->queued));
   dt_control_job_print(job);
   dt_print(DT_DEBUG_CONTROL, "\n");
 
-  /* add job to queue if not full, otherwise discard the job */
-  if( g_list_length(s->queue) < DT_CONTROL_MAX_JOBS)
-  {
-    /* allocate storage for the job, and set job state */
-    dt_job_t *thejob = g_malloc(sizeof(dt_job_t));
-    memcpy(thejob,job,sizeof(dt_job_t));
-    _control_job_set_state (thejob,DT_JOB_STATE_QUEUED);
-    s->queue = g_list_append(s->queue, thejob);
-    dt_pthread_mutex_unlock(&s->queue_mutex);
-  }
-  else
+  g_hash_table_insert(s->queued, &qj->job, qj);
+  _control_job_set_state (&qj->job,DT_JOB_STATE_QUEUED);
+
+  /* delayed jobs wait for the scheduler thread */
+  if(job->ts_execute > job->ts_added)
   {
-    dt_print(DT_DEBUG_CONTROL, "[add_job] too many jobs in queue!\n");
-    _control_job_set_state (job,DT_JOB_STATE_DISCARDED);
+    s->scheduled = g_list_append(s->scheduled, qj);
     dt_pthread_mutex_unlock(&s->queue_mutex);
-    return -1;
+    dt_pthread_mutex_lock(&s->cond_mutex);
+    pthread_cond_signal(&s->cond_scheduled);
+    dt_pthread_mutex_unlock(&s->cond_mutex);
+    return 0;
   }
+  dt_pthread_mutex_unlock(&s->queue_mutex);
+
+  /* workers push to their own queue, everybody else distributes round robin */
+  int32_t k = dt_control_get_threadid();
+  if(k >= s->num_threads) k = __sync_fetch_and_add(&s->next_queue, 1) % s->num_threads;
+  dt_control_queue_t *q = s->queues + k;
+  dt_pthread_mutex_lock(&q->mutex);
+  qj->owner = k;
+  g_queue_push_tail_link(&q->jobs[qj->job.priority], &qj->link);
+  dt_pthread_mutex_unlock(&q->mutex);
 
-  // notify workers
+  // notify one idle worker, it will steal the job if it's not in its own queue
   dt_pthread_mutex_lock(&s->cond_mutex);
-  pthread_cond_broadcast(&s->cond);
+  s->num_queued++;
+  pthread_cond_signal(&s->cond);
   dt_pthread_mutex_unlock(&s->cond_mutex);
   return 0;
 }
@@ -1154,29 +1219,30 @@ int32_t dt_control_revive_job(dt_control_t *s, dt_job_t *job)
   dt_control_job_print(job);
   dt_print(DT_DEBUG_CONTROL, "\n");
 
-  /* find equivalent job and move it to top of the stack */
-  GList *jobitem = g_list_first(s->queue);
-  if (jobitem)
-    do
+  /* find equivalent job and move it to the front of its queue.
+      the job can't be freed while we hold the queue_mutex, as
+      the worker taking it needs that to remove it from s->queued. */
+  _control_queued_job_t *qj = g_hash_table_lookup(s->queued, job);
+  if(qj)
+  {
+    found_j = 1;
+    const int32_t k = qj->owner;
+    if(k >= 0)
     {
-      if(!memcmp(job, jobitem->data, sizeof(dt_job_t)))
+      dt_control_queue_t *q = s->queues + k;
+      dt_pthread_mutex_lock(&q->mutex);
+      // it might have been taken in the meantime
+      if(qj->owner == k)
       {
-        s->queue = g_list_remove_link(s->queue, jobitem);
-        s->queue = g_list_insert(s->queue, jobitem->data, 0);
-        g_free(jobitem);
-        found_j = 1;
-        break;
+        g_queue_unlink(&q->jobs[qj->job.priority], &qj->link);
+        g_queue_push_head_link(&q->jobs[qj->job.priority], &qj->link);
       }
+      dt_pthread_mutex_unlock(&q->mutex);
     }
-    while((jobitem=g_list_next(jobitem)));
+  }
 
   /* unlock the queue */
   dt_pthread_mutex_unlock(&s->queue_mutex);
-
-  /* notify workers */
-  dt_pthread_mutex_lock(&s->cond_mutex);
-  pthread_cond_broadcast(&s->cond);
-  dt_pthread_mutex_unlock(&s->cond_mutex);
   return found_j;
 }
 
@@ -1210,7 +1276,11 @@ void *dt_control_work_res(void *ptr)
       int old;
       pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &old);
       dt_pthread_mutex_lock(&s->cond_mutex);
-      dt_pthread_cond_wait(&s->cond, &s->cond_mutex);
+      dt_pthread_mutex_lock(&s->queue_mutex);
+      int new_job = s->new_res[threadid];
+      dt_pthread_mutex_unlock(&s->queue_mutex);
+      if(!new_job && dt_control_running())
+        dt_pthread_cond_wait(&s->cond_res, &s->cond_mutex);
       dt_pthread_mutex_unlock(&s->cond_mutex);
       pthread_setcancelstate(old, NULL);
     }
@@ -1218,14 +1288,61 @@ void *dt_control_work_res(void *ptr)
   return NULL;
 }
 
-void * _control_worker_kicker(void *ptr)
+void * _control_scheduler(void *ptr)
 {
   dt_control_t *s = (dt_control_t *)ptr;
   while(dt_control_running())
   {
-    sleep(2);
+    /* the reserved background worker holds one job only, hand over the first due one once it is idle,
+       and find out when the next one will be */
+    const time_t ts_now = time(NULL);
+    time_t ts_next = 0;
+    _control_queued_job_t *due = NULL;
+    dt_pthread_mutex_lock(&s->queue_mutex);
+    const int idle = !s->new_res[DT_CTL_WORKER_7] &&
+                     dt_control_job_get_state(&s->job_res[DT_CTL_WORKER_7]) != DT_JOB_STATE_RUNNING;
+    GList *jobitem = s->scheduled;
+    while(jobitem)
+    {
+      GList *next = g_list_next(jobitem);
+      _control_queued_job_t *qj = (_control_queued_job_t *)jobitem->data;
+      if(qj->job.ts_execute <= ts_now)
+      {
+        if(idle && !due)
+        {
+          s->scheduled = g_list_delete_link(s->scheduled, jobitem);
+          g_hash_table_remove(s->queued, &qj->job);
+          due = qj;
+        }
+        else // look again when the worker is done, or in a second in case we missed that
+          ts_next = ts_now + 1;
+      }
+      else if(!ts_next || qj->job.ts_execute < ts_next)
+        ts_next = qj->job.ts_execute;
+      jobitem = next;
+    }
+    dt_pthread_mutex_unlock(&s->queue_mutex);
+
+    /* push background job on reserved background worker */
+    if(due)
+    {
+      dt_control_add_job_res(s, &due->job, DT_CTL_WORKER_7);
+      g_free(due);
+      continue;
+    }
+
+    /* sleep until the next job is due, or a new one comes in */
     dt_pthread_mutex_lock(&s->cond_mutex);
-    pthread_cond_broadcast(&s->cond);
+    if(dt_control_running())
+    {
+      if(ts_next)
+      {
+        struct timespec ts = { ts_next, 0 };
+        dt_pthread_cond_timedwait(&s->cond_scheduled, &s->cond_mutex, &ts);
+      }
+      else
+        dt_pthread_cond_wait(&s->cond_scheduled, &s->cond_mutex);
+    }
     dt_pthread_mutex_unlock(&s->cond_mutex);
   }
   return NULL;
@@ -1245,7 +1362,8 @@ void *dt_control_work(void *ptr)
     {
       // wait for a new job.
       dt_pthread_mutex_lock(&s->cond_mutex);
-      dt_pthread_cond_wait(&s->cond, &s->cond_mutex);
+      if(!s->num_queued && dt_control_running())
+        dt_pthread_cond_wait(&s->cond, &s->cond_mutex);
       dt_pthread_mutex_unlock(&s->cond_mutex);
     }
   }
@@ -33,7 +33,6 @@
 #include "libs/lib.h"
 // #include "control/job.def"
 
-#define DT_CONTROL_MAX_JOBS 30
 #define DT_CONTROL_JOB_DEBUG
 #define DT_CONTROL_DESCRIPTION_LEN 256
 // reserved workers
@@ -148,6 +147,17 @@ typedef void (*dt_job_state_change_callback)(struct dt_job_t*,int state);
 #define DT_JOB_STATE_FINISHED		3
 #define DT_JOB_STATE_CANCELLED		4
 #define DT_JOB_STATE_DISCARDED		5
+
+/** scheduling class of a job. workers always pick the most urgent class first. */
+typedef enum dt_job_priority_t
+{
+  DT_JOB_PRIORITY_INTERACTIVE = 0, // the user waits for this (gui actions, darkroom), the default
+  DT_JOB_PRIORITY_THUMBNAIL   = 1, // thumbnail generation and prefetching
+  DT_JOB_PRIORITY_BATCH       = 2, // long running bulk work, such as exports and imports
+  DT_JOB_PRIORITY_COUNT       = 3
+}
+dt_job_priority_t;
+
 typedef struct dt_job_t
 {
   int32_t (*execute) (struct dt_job_t *job);
@@ -163,6 +173,7 @@ typedef struct dt_job_t
   dt_pthread_mutex_t wait_mutex;
 
   int32_t state;
+  dt_job_priority_t priority;
   dt_job_state_change_callback state_changed_cb;
   void *user_data;
 
@@ -175,6 +186,8 @@ dt_job_t;
 
 /** initializes a job */
 void dt_control_job_init(dt_job_t *j, const char *msg, ...);
+/** sets the scheduling class of a job, before it is added. */
+void dt_control_job_set_priority(dt_job_t *j, dt_job_priority_t priority);
 /** setup a state callback for job. */
 void dt_control_job_set_state_callback(dt_job_t *j,dt_job_state_change_callback cb,void *user_data);
 void dt_control_job_print(dt_job_t *j);
@@ -195,6 +208,14 @@ typedef struct dt_control_accels_t
 
 } dt_control_accels_t;
 
+/** per worker job deque, idle workers steal from the other ones. */
+typedef struct dt_control_queue_t
+{
+  dt_pthread_mutex_t mutex;
+  GQueue jobs[DT_JOB_PRIORITY_COUNT];
+}
+dt_control_queue_t;
+
 #define DT_CTL_LOG_SIZE 10
 #define DT_CTL_LOG_MSG_SIZE 200
 #define DT_CTL_LOG_TIMEOUT 20000
@@ -252,10 +273,14 @@ typedef struct dt_control_t
   // job management
   int32_t running;
   dt_pthread_mutex_t queue_mutex, cond_mutex, run_mutex;
-  pthread_cond_t cond;
+  pthread_cond_t cond, cond_res, cond_scheduled;
   int32_t num_threads;
-  pthread_t *thread,kick_on_workers_thread;
-  GList *queue;
+  pthread_t *thread,scheduler_thread;
+  dt_control_queue_t *queues;   // one per worker thread
+  int32_t num_queued;           // jobs waiting in the queues, protected by cond_mutex
+  uint32_t next_queue;          // round robin for jobs added from outside the worker threads
+  GHashTable *queued;           // all waiting jobs for duplicate detection, protected by queue_mutex
+  GList *scheduled;             // delayed background jobs, protected by queue_mutex
   dt_job_t job_res[DT_CTL_WORKER_RESERVED];
   uint8_t new_res[DT_CTL_WORKER_RESERVED];
   pthread_t thread_res[DT_CTL_WORKER_RESERVED];
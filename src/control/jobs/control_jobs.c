@@ -1050,17 +1050,23 @@ static int32_t dt_control_export_job_run(dt_job_t *job)
   const dt_control_t *control = darktable.control;
 
   double fraction=0;
+  int exported = 0;
+  const double start = dt_get_wtime();
+  // keep pipelines alive between images, consecutive images with the same module stack reuse them:
+  dt_imageio_export_session_begin();
 #ifdef _OPENMP
   // limit this to num threads = num full buffers - 1 (keep one for darkroom mode)
   // use min of user request and mipmap cache entries
   const int full_entries = dt_conf_get_int ("parallel_export");
+  const int max_threads = dt_imageio_export_max_threads(t, MIN(full_entries, 8));
   // GCC won't accept that this variable is used in a macro, considers
   // it set but not used, which makes for instance Fedora break.
-  const __attribute__((__unused__)) int num_threads = MAX(1, MIN(full_entries, 8));
+  const __attribute__((__unused__)) int num_threads = max_threads;
+  dt_print(DT_DEBUG_PERF, "[export] using %d threads for %d images\n", num_threads, total);
 #if !defined(__SUNOS__) && !defined(__NetBSD__)
-  #pragma omp parallel default(none) private(imgid) shared(control, fraction, w, h, stderr, mformat, mstorage, t, sdata, job, jid, darktable, settings) num_threads(num_threads) if(num_threads > 1)
+  #pragma omp parallel default(none) private(imgid) shared(control, fraction, exported, w, h, stderr, mformat, mstorage, t, sdata, job, jid, darktable, settings) num_threads(num_threads) if(num_threads > 1)
 #else
-  #pragma omp parallel private(imgid) shared(control, fraction, w, h, mformat, mstorage, t, sdata, job, jid, darktable, settings) num_threads(num_threads) if(num_threads > 1)
+  #pragma omp parallel private(imgid) shared(control, fraction, exported, w, h, mformat, mstorage, t, sdata, job, jid, darktable, settings) num_threads(num_threads) if(num_threads > 1)
 #endif
   {
 #endif
@@ -1091,6 +1097,8 @@ static int32_t dt_control_export_job_run(dt_job_t *job)
           imgid = (long int)t->data;
           t = g_list_delete_link(t, t);
           num = total - g_list_length(t);
+          // decode the next image in the background while this one is processed:
+          if(t) dt_mipmap_cache_read_get(darktable.mipmap_cache, NULL, (long int)t->data, DT_MIPMAP_FULL, DT_MIPMAP_PREFETCH);
         }
       }
       // remove 'changed' tag from image
@@ -1114,7 +1122,8 @@ static int32_t dt_control_export_job_run(dt_job_t *job)
         else
         {
           dt_image_cache_read_release(darktable.image_cache, image);
-          mstorage->store(mstorage,sdata, imgid, mformat, fdata, num, total, settings->high_quality);
+          if(!mstorage->store(mstorage,sdata, imgid, mformat, fdata, num, total, settings->high_quality))
+            __sync_fetch_and_add(&exported, 1);
         }
       }
 #ifdef _OPENMP
@@ -1139,6 +1148,14 @@ static int32_t dt_control_export_job_run(dt_job_t *job)
 #ifdef _OPENMP
   }
 #endif
+  dt_imageio_export_session_end();
+  const double elapsed = dt_get_wtime() - start;
+  if(exported > 0 && elapsed > 0.0)
+  {
+    dt_control_log(ngettext("exported %d image in %.1f s (%.1f images/min)", "exported %d images in %.1f s (%.1f images/min)", exported),
+                   exported, elapsed, 60.0 * exported / elapsed);
+    dt_print(DT_DEBUG_PERF, "[export] %d images in %.3f s, %.2f images/min\n", exported, elapsed, 60.0 * exported / elapsed);
+  }
   g_free(t1->data);
   return 0;
 }
@@ -1149,6 +1166,7 @@ void dt_control_export(GList *imgid_list,int max_width, int max_height, int form
   dt_job_t job;
   dt_control_job_init(&job, "export");
   job.execute = &dt_control_export_job_run;
+  dt_control_job_set_priority(&job, DT_JOB_PRIORITY_BATCH);
   dt_control_image_enumerator_t *t = (dt_control_image_enumerator_t *)job.param;
   t->index = imgid_list;
   dt_control_export_t *data = (dt_control_export_t*)malloc(sizeof(dt_control_export_t));
@@ -49,6 +49,21 @@ void dt_dev_process_image_job_init(dt_job_t *job, dt_develop_t *dev)
   t->dev = dev;
 }
 
+int32_t dt_dev_prefetch_job_run(dt_job_t *job)
+{
+  dt_dev_process_t *t = (dt_dev_process_t *)job->param;
+  dt_dev_prefetch_job(t->dev);
+  return 0;
+}
+
+void dt_dev_prefetch_job_init(dt_job_t *job, dt_develop_t *dev)
+{
+  dt_control_job_init(job, "develop prefetch");
+  job->execute = &dt_dev_prefetch_job_run;
+  dt_dev_process_t *t = (dt_dev_process_t *)job->param;
+  t->dev = dev;
+}
+
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
 // kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-space on;
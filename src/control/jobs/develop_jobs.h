@@ -37,6 +37,10 @@ void dt_dev_process_preview_job_init(dt_job_t *job, dt_develop_t *dev);
 int32_t dt_dev_process_image_job_run(dt_job_t *job);
 void dt_dev_process_image_job_init(dt_job_t *job, dt_develop_t *dev);
 
+/** pre-develop the filmstrip neighbours */
+int32_t dt_dev_prefetch_job_run(dt_job_t *job);
+void dt_dev_prefetch_job_init(dt_job_t *job, dt_develop_t *dev);
+
 void dt_dev_export_init(dt_job_t *job);
 
 #endif
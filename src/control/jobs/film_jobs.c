@@ -24,6 +24,7 @@ void dt_film_import1_init(dt_job_t *job, dt_film_t *film)
 {
   dt_control_job_init(job, "cache load raw images for preview");
   job->execute = &dt_film_import1_run;
+  dt_control_job_set_priority(job, DT_JOB_PRIORITY_BATCH);
   dt_film_import1_t *t = (dt_film_import1_t *)job->param;
   t->film = film;
   dt_pthread_mutex_lock(&film->images_mutex);
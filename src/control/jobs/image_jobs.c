@@ -24,15 +24,35 @@ void dt_image_load_job_init(dt_job_t *job, int32_t id, dt_mipmap_size_t mip)
 {
   dt_control_job_init(job, "load image %d mip %d", id, mip);
   job->execute = &dt_image_load_job_run;
+  dt_control_job_set_priority(job, DT_JOB_PRIORITY_THUMBNAIL);
   dt_image_load_t *t = (dt_image_load_t *)job->param;
   t->imgid = id;
   t->mip = mip;
+  t->speculative = 0;
+}
+
+void dt_image_prefetch_job_init(dt_job_t *job, int32_t id, dt_mipmap_size_t mip)
+{
+  dt_control_job_init(job, "prefetch image %d mip %d", id, mip);
+  job->execute = &dt_image_load_job_run;
+  // after all thumbnails which are actually on screen:
+  dt_control_job_set_priority(job, DT_JOB_PRIORITY_BATCH);
+  dt_image_load_t *t = (dt_image_load_t *)job->param;
+  t->imgid = id;
+  t->mip = mip;
+  t->speculative = 1;
 }
 
 int32_t dt_image_load_job_run(dt_job_t *job)
 {
   dt_image_load_t *t = (dt_image_load_t *)job->param;
 
+  if(t->speculative)
+  {
+    dt_mipmap_cache_prefetch_load(darktable.mipmap_cache, t->imgid, t->mip);
+    return 0;
+  }
+
   // hook back into mipmap_cache:
   dt_mipmap_buffer_t buf;
   dt_mipmap_cache_read_get(
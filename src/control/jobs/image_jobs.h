@@ -27,11 +27,13 @@ typedef struct dt_image_load_t
 {
   int32_t imgid;
   dt_mipmap_size_t mip;
+  int32_t speculative;    // only a guess that it will be needed, see dt_mipmap_cache_prefetch()
 }
 dt_image_load_t;
 
 int32_t dt_image_load_job_run(dt_job_t *job);
 void dt_image_load_job_init(dt_job_t *job, int32_t imgid, dt_mipmap_size_t mip);
+void dt_image_prefetch_job_init(dt_job_t *job, int32_t imgid, dt_mipmap_size_t mip);
 
 
 #endif
@@ -23,6 +23,9 @@
 #include "common/gaussian.h"
 #include "blend.h"
 
+#include <xmmintrin.h>
+#include <emmintrin.h>
+
 #define CLAMP_RANGE(x,y,z)      (CLAMP(x,y,z))
 
 typedef void (_blend_row_func)(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag);
@@ -1742,82 +1745,765 @@ static void _blend_Lab_color(dt_iop_colorspace_type_t cst,const float *a, float
 }
 
 
+/* sse2 versions of the blend operators above. one pixel fits one register, so
+   all channels are done at once, the per channel formulas (L vs. a and b in
+   Lab) are picked with lane masks. raw is done four mosaic pixels at a time
+   with one opacity, exactly like the plain c code. the modes that go through
+   hsl or lch in rgb and Lab have no sse2 version and keep using the plain c. */
 
-void dt_develop_blend_process (struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece, void *i, void *o, const struct dt_iop_roi_t *roi_in, const struct dt_iop_roi_t *roi_out)
+typedef struct _blend_sse_t
 {
-  int ch = piece->colors;
-  _blend_row_func *blend = NULL;
-  dt_develop_blend_params_t *d = (dt_develop_blend_params_t *)piece->blendop_data;
+  __m128 scale, rescale;      // from the colorspace to the blend range (divided by, as the c code) and back
+  __m128 min, max;            // channel range, after scaling
+  __m128 offset, lmax;        // fabs(min) and max + fabs(min)
+  __m128 sum;                 // fabs(min + max)
+  __m128 L;                   // the L lane in Lab
+  __m128 alpha;               // the lane which gets the opacity, none for raw
+  int lab;
+}
+_blend_sse_t;
 
-  const unsigned int blend_mode = d->blend_mode;
-  const unsigned int mask_mode = d->mask_mode;
-  const unsigned int xoffs = roi_out->x - roi_in->x;
-  const unsigned int yoffs = roi_out->y - roi_in->y;
+static inline void _blend_sse_init(_blend_sse_t *s, dt_iop_colorspace_type_t cst)
+{
+  float min[4] = {0}, max[4] = {0};
+  _blend_colorspace_channel_range(cst, min, max);
+  s->min = _mm_loadu_ps(min);
+  s->max = _mm_loadu_ps(max);
+  s->offset = _mm_andnot_ps(_mm_set1_ps(-0.0f), s->min);
+  s->lmax = _mm_add_ps(s->max, s->offset);
+  s->sum = _mm_andnot_ps(_mm_set1_ps(-0.0f), _mm_add_ps(s->min, s->max));
+  s->lab = (cst == iop_cs_Lab);
+  s->scale = s->lab ? _mm_set_ps(1.0f, 128.0f, 128.0f, 100.0f) : _mm_set1_ps(1.0f);
+  s->rescale = s->lab ? _mm_set_ps(1.0f, 128.0f, 128.0f, 100.0f) : _mm_set1_ps(1.0f);
+  s->L = _mm_castsi128_ps(_mm_set_epi32(0, 0, 0, -1));
+  s->alpha = (cst != iop_cs_RAW) ? _mm_castsi128_ps(_mm_set_epi32(-1, 0, 0, 0)) : _mm_setzero_ps();
+}
 
-  /* check if blend is disabled */
-  if (!d || !(mask_mode & DEVELOP_MASK_ENABLED)) return;
+static inline __m128 _sse_clamp(const __m128 x, const __m128 min, const __m128 max)
+{
+  return _mm_min_ps(_mm_max_ps(x, min), max);
+}
 
-  /* we can only handle blending if roi_out and roi_in have the same scale and
-     if roi_out fits into the area given by roi_in */
-  if (roi_out->scale != roi_in->scale || xoffs < 0 || yoffs < 0 
-      || ((xoffs > 0 || yoffs > 0) && (roi_out->width + xoffs > roi_in->width || roi_out->height + yoffs > roi_in->height)))
+static inline __m128 _sse_select(const __m128 mask, const __m128 x, const __m128 y)
+{
+  return _mm_or_ps(_mm_and_ps(mask, x), _mm_andnot_ps(mask, y));
+}
+
+static inline __m128 _sse_abs(const __m128 x)
+{
+  return _mm_andnot_ps(_mm_set1_ps(-0.0f), x);
+}
+
+static inline __m128 _sse_lerp(const __m128 a, const __m128 b, const __m128 opacity)
+{
+  return _mm_add_ps(_mm_mul_ps(a, _mm_sub_ps(_mm_set1_ps(1.0f), opacity)), _mm_mul_ps(b, opacity));
+}
+
+/* copies the L lane into all others */
+static inline __m128 _sse_L(const __m128 x)
+{
+  return _mm_shuffle_ps(x, x, _MM_SHUFFLE(0, 0, 0, 0));
+}
+
+static inline __m128 _blend_sse_load(const _blend_sse_t *s, const float *p)
+{
+  return _mm_div_ps(_mm_loadu_ps(p), s->scale);
+}
+
+/* L from the first, a and b from the second argument */
+static inline __m128 _blend_sse_Lab(const _blend_sse_t *s, const __m128 L, const __m128 ab)
+{
+  return _sse_select(s->L, L, ab);
+}
+
+static inline void _blend_sse_store(const _blend_sse_t *s, float *p, const __m128 x, const __m128 opacity)
+{
+  _mm_storeu_ps(p, _sse_select(s->alpha, opacity, _mm_mul_ps(x, s->rescale)));
+}
+
+/* a and b (mixed into sum) follow the change in lightness, as done by most of the Lab modes */
+static inline __m128 _blend_sse_ab_ratio(const _blend_sse_t *s, const __m128 ta, const __m128 sum, const __m128 L,
+                                         const __m128 opacity)
+{
+  const __m128 ratio = _mm_div_ps(_sse_L(L), _mm_max_ps(_sse_L(ta), _mm_set1_ps(0.01f)));
+  return _sse_clamp(_sse_lerp(ta, _mm_mul_ps(sum, ratio), opacity), s->min, s->max);
+}
+
+/* normal blend with clamping */
+static void _blend_normal_bounded_sse2(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
+{
+  _blend_sse_t s;
+  _blend_sse_init(&s, cst);
+
+  for(int i=0, j=0; j<stride; i++, j+=4)
   {
-    //printf("%s: scale %f/%f %d\n", self->op, roi_out->scale, roi_in->scale, roi_out->scale == roi_in->scale);
-    //printf("xoffs %d, yoffs %d, out %d, %d, in %d, %d\n", xoffs, yoffs, roi_out->width, roi_out->height, roi_in->width, roi_in->height);
-    dt_control_log(_("skipped blending in module '%s': roi's do not match"), self->op);
+    const __m128 opacity = _mm_set1_ps(mask[i]);
+    const __m128 ta = _blend_sse_load(&s, a+j);
+    const __m128 tb = _blend_sse_load(&s, b+j);
+    __m128 t = _sse_clamp(_sse_lerp(ta, tb, opacity), s.min, s.max);
+    if(s.lab && flag) t = _blend_sse_Lab(&s, t, ta);
+    _blend_sse_store(&s, b+j, t, opacity);
+  }
+}
+
+/* normal blend without any clamping */
+static void _blend_normal_unbounded_sse2(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
+{
+  _blend_sse_t s;
+  _blend_sse_init(&s, cst);
+
+  for(int i=0, j=0; j<stride; i++, j+=4)
+  {
+    const __m128 opacity = _mm_set1_ps(mask[i]);
+    const __m128 ta = _blend_sse_load(&s, a+j);
+    const __m128 tb = _blend_sse_load(&s, b+j);
+    __m128 t = _sse_lerp(ta, tb, opacity);
+    if(s.lab && flag) t = _blend_sse_Lab(&s, t, ta);
+    _blend_sse_store(&s, b+j, t, opacity);
+  }
+}
+
+/* lighten and darken, both move a and b by the change in lightness */
+static inline __m128 _blend_sse_chroma_follow(const _blend_sse_t *s, const __m128 ta, const __m128 tb, const __m128 L)
+{
+  const __m128 d = _sse_abs(_mm_sub_ps(_sse_L(tb), _sse_L(L)));
+  return _sse_clamp(_mm_add_ps(_mm_mul_ps(ta, _mm_sub_ps(_mm_set1_ps(1.0f), d)),
+                               _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), _mm_add_ps(ta, tb)), d)), s->min, s->max);
+}
+
+/* lighten */
+static void _blend_lighten_sse2(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
+{
+  _blend_sse_t s;
+  _blend_sse_init(&s, cst);
+
+  for(int i=0, j=0; j<stride; i++, j+=4)
+  {
+    const __m128 opacity = _mm_set1_ps(mask[i]);
+    const __m128 ta = _blend_sse_load(&s, a+j);
+    const __m128 tb = _blend_sse_load(&s, b+j);
+    __m128 t = _sse_clamp(_sse_lerp(ta, _mm_max_ps(ta, tb), opacity), s.min, s.max);
+    if(s.lab) t = _blend_sse_Lab(&s, t, flag ? ta : _blend_sse_chroma_follow(&s, ta, tb, t));
+    _blend_sse_store(&s, b+j, t, opacity);
+  }
+}
+
+/* darken */
+static void _blend_darken_sse2(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
+{
+  _blend_sse_t s;
+  _blend_sse_init(&s, cst);
+
+  for(int i=0, j=0; j<stride; i++, j+=4)
+  {
+    const __m128 opacity = _mm_set1_ps(mask[i]);
+    const __m128 ta = _blend_sse_load(&s, a+j);
+    const __m128 tb = _blend_sse_load(&s, b+j);
+    __m128 t = _sse_clamp(_sse_lerp(ta, _mm_min_ps(ta, tb), opacity), s.min, s.max);
+    if(s.lab) t = _blend_sse_Lab(&s, t, flag ? ta : _blend_sse_chroma_follow(&s, ta, tb, t));
+    _blend_sse_store(&s, b+j, t, opacity);
+  }
+}
+
+/* multiply */
+static void _blend_multiply_sse2(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
+{
+  _blend_sse_t s;
+  _blend_sse_init(&s, cst);
+  const __m128 zero = _mm_setzero_ps();
+
+  for(int i=0, j=0; j<stride; i++, j+=4)
+  {
+    const __m128 opacity = _mm_set1_ps(mask[i]);
+    const __m128 ta = _blend_sse_load(&s, a+j);
+    const __m128 tb = _blend_sse_load(&s, b+j);
+    __m128 t;
+    if(s.lab)
+    {
+      const __m128 la = _sse_clamp(_mm_add_ps(ta, s.offset), zero, s.lmax);
+      const __m128 lb = _sse_clamp(_mm_add_ps(tb, s.offset), zero, s.lmax);
+      t = _mm_sub_ps(_sse_clamp(_sse_lerp(la, _mm_mul_ps(la, lb), opacity), s.min, s.max), s.offset);
+      t = _blend_sse_Lab(&s, t, flag ? ta : _blend_sse_ab_ratio(&s, ta, _mm_add_ps(ta, tb), t, opacity));
+    }
+    else
+      t = _sse_clamp(_sse_lerp(ta, _mm_mul_ps(ta, tb), opacity), s.min, s.max);
+    _blend_sse_store(&s, b+j, t, opacity);
+  }
+}
+
+/* average */
+static void _blend_average_sse2(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
+{
+  _blend_sse_t s;
+  _blend_sse_init(&s, cst);
+
+  for(int i=0, j=0; j<stride; i++, j+=4)
+  {
+    const __m128 opacity = _mm_set1_ps(mask[i]);
+    const __m128 ta = _blend_sse_load(&s, a+j);
+    const __m128 tb = _blend_sse_load(&s, b+j);
+    __m128 t = _sse_clamp(_sse_lerp(ta, _mm_mul_ps(_mm_add_ps(ta, tb), _mm_set1_ps(0.5f)), opacity), s.min, s.max);
+    if(s.lab && flag) t = _blend_sse_Lab(&s, t, ta);
+    _blend_sse_store(&s, b+j, t, opacity);
+  }
+}
+
+/* add */
+static void _blend_add_sse2(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
+{
+  _blend_sse_t s;
+  _blend_sse_init(&s, cst);
+
+  for(int i=0, j=0; j<stride; i++, j+=4)
+  {
+    const __m128 opacity = _mm_set1_ps(mask[i]);
+    const __m128 ta = _blend_sse_load(&s, a+j);
+    const __m128 tb = _blend_sse_load(&s, b+j);
+    __m128 t = _sse_clamp(_sse_lerp(ta, _mm_add_ps(ta, tb), opacity), s.min, s.max);
+    if(s.lab && flag) t = _blend_sse_Lab(&s, t, ta);
+    _blend_sse_store(&s, b+j, t, opacity);
+  }
+}
+
+/* substract */
+static void _blend_substract_sse2(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
+{
+  _blend_sse_t s;
+  _blend_sse_init(&s, cst);
+
+  for(int i=0, j=0; j<stride; i++, j+=4)
+  {
+    const __m128 opacity = _mm_set1_ps(mask[i]);
+    const __m128 ta = _blend_sse_load(&s, a+j);
+    const __m128 tb = _blend_sse_load(&s, b+j);
+    __m128 t = _sse_clamp(_sse_lerp(ta, _mm_sub_ps(_mm_add_ps(tb, ta), s.sum), opacity), s.min, s.max);
+    if(s.lab && flag) t = _blend_sse_Lab(&s, t, ta);
+    _blend_sse_store(&s, b+j, t, opacity);
+  }
+}
+
+/* difference (deprecated) */
+static void _blend_difference_sse2(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
+{
+  _blend_sse_t s;
+  _blend_sse_init(&s, cst);
+  const __m128 zero = _mm_setzero_ps();
+
+  for(int i=0, j=0; j<stride; i++, j+=4)
+  {
+    const __m128 opacity = _mm_set1_ps(mask[i]);
+    const __m128 ta = _blend_sse_load(&s, a+j);
+    const __m128 tb = _blend_sse_load(&s, b+j);
+    __m128 la = _mm_add_ps(ta, s.offset);
+    __m128 lb = _mm_add_ps(tb, s.offset);
+    // only Lab clamps the input
+    if(s.lab)
+    {
+      la = _sse_clamp(la, zero, s.lmax);
+      lb = _sse_clamp(lb, zero, s.lmax);
+    }
+    __m128 t = _mm_sub_ps(_sse_clamp(_sse_lerp(la, _sse_abs(_mm_sub_ps(la, lb)), opacity), zero, s.lmax), s.offset);
+    if(s.lab && flag) t = _blend_sse_Lab(&s, t, ta);
+    _blend_sse_store(&s, b+j, t, opacity);
+  }
+}
+
+/* difference 2 (new) */
+static void _blend_difference2_sse2(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
+{
+  _blend_sse_t s;
+  _blend_sse_init(&s, cst);
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 range = _sse_abs(_mm_sub_ps(s.max, s.min));
+
+  for(int i=0, j=0; j<stride; i++, j+=4)
+  {
+    const __m128 opacity = _mm_set1_ps(mask[i]);
+    const __m128 ta = _blend_sse_load(&s, a+j);
+    const __m128 tb = _blend_sse_load(&s, b+j);
+    __m128 t;
+    if(s.lab)
+    {
+      // lightness is the largest difference of all three channels
+      const __m128 d = _mm_div_ps(_sse_abs(_mm_sub_ps(ta, tb)), range);
+      const __m128 dmax = _mm_max_ps(_sse_L(d), _mm_max_ps(_mm_shuffle_ps(d, d, _MM_SHUFFLE(1, 1, 1, 1)),
+                                                           _mm_shuffle_ps(d, d, _MM_SHUFFLE(2, 2, 2, 2))));
+      t = _sse_clamp(_sse_lerp(ta, dmax, opacity), s.min, s.max);
+      t = _blend_sse_Lab(&s, t, flag ? ta : zero);
+    }
+    else
+    {
+      const __m128 la = _mm_add_ps(ta, s.offset);
+      const __m128 lb = _mm_add_ps(tb, s.offset);
+      t = _mm_sub_ps(_sse_clamp(_sse_lerp(la, _sse_abs(_mm_sub_ps(la, lb)), opacity), zero, s.lmax), s.offset);
+    }
+    _blend_sse_store(&s, b+j, t, opacity);
+  }
+}
+
+/* screen */
+static void _blend_screen_sse2(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
+{
+  _blend_sse_t s;
+  _blend_sse_init(&s, cst);
+  const __m128 zero = _mm_setzero_ps();
+
+  for(int i=0, j=0; j<stride; i++, j+=4)
+  {
+    const __m128 opacity = _mm_set1_ps(mask[i]);
+    const __m128 ta = _blend_sse_load(&s, a+j);
+    const __m128 tb = _blend_sse_load(&s, b+j);
+    const __m128 la = _sse_clamp(_mm_add_ps(ta, s.offset), zero, s.lmax);
+    const __m128 lb = _sse_clamp(_mm_add_ps(tb, s.offset), zero, s.lmax);
+    const __m128 screen = _mm_sub_ps(s.lmax, _mm_mul_ps(_mm_sub_ps(s.lmax, la), _mm_sub_ps(s.lmax, lb)));
+    __m128 t = _mm_sub_ps(_sse_clamp(_sse_lerp(la, screen, opacity), zero, s.lmax), s.offset);
+    if(s.lab)
+      t = _blend_sse_Lab(&s, t, flag ? ta : _blend_sse_ab_ratio(&s, ta, _mm_mul_ps(_mm_set1_ps(0.5f), _mm_add_ps(ta, tb)),
+                                                              t, opacity));
+    _blend_sse_store(&s, b+j, t, opacity);
+  }
+}
+
+/* the light modes below mix with the squared opacity, in Lab a and b follow the lightness */
+static inline __m128 _blend_sse_light(const _blend_sse_t *s, const __m128 ta, const __m128 tb, const __m128 la,
+                                      const __m128 mixed, const __m128 opacity2, const int flag)
+{
+  const __m128 t = _mm_sub_ps(_sse_clamp(_sse_lerp(la, mixed, opacity2), _mm_setzero_ps(), s->lmax), s->offset);
+  if(!s->lab) return t;
+  return _blend_sse_Lab(s, t, flag ? ta : _blend_sse_ab_ratio(s, ta, _mm_add_ps(ta, tb), t, opacity2));
+}
+
+/* overlay */
+static void _blend_overlay_sse2(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
+{
+  _blend_sse_t s;
+  _blend_sse_init(&s, cst);
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 halfmax = _mm_mul_ps(s.lmax, _mm_set1_ps(0.5f));
+  const __m128 doublemax = _mm_mul_ps(s.lmax, _mm_set1_ps(2.0f));
+
+  for(int i=0, j=0; j<stride; i++, j+=4)
+  {
+    const __m128 opacity = _mm_set1_ps(mask[i]);
+    const __m128 opacity2 = _mm_mul_ps(opacity, opacity);
+    const __m128 ta = _blend_sse_load(&s, a+j);
+    const __m128 tb = _blend_sse_load(&s, b+j);
+    const __m128 la = _sse_clamp(_mm_add_ps(ta, s.offset), zero, s.lmax);
+    const __m128 lb = _sse_clamp(_mm_add_ps(tb, s.offset), zero, s.lmax);
+    const __m128 high = _mm_sub_ps(s.lmax, _mm_mul_ps(_mm_sub_ps(s.lmax, _mm_mul_ps(doublemax, _mm_sub_ps(la, halfmax))),
+                                                      _mm_sub_ps(s.lmax, lb)));
+    const __m128 low = _mm_mul_ps(_mm_mul_ps(doublemax, la), lb);
+    const __m128 mixed = _sse_select(_mm_cmpgt_ps(la, halfmax), high, low);
+    _blend_sse_store(&s, b+j, _blend_sse_light(&s, ta, tb, la, mixed, opacity2, flag), opacity);
+  }
+}
+
+/* softlight */
+static void _blend_softlight_sse2(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
+{
+  _blend_sse_t s;
+  _blend_sse_init(&s, cst);
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 halfmax = _mm_mul_ps(s.lmax, _mm_set1_ps(0.5f));
+
+  for(int i=0, j=0; j<stride; i++, j+=4)
+  {
+    const __m128 opacity = _mm_set1_ps(mask[i]);
+    const __m128 opacity2 = _mm_mul_ps(opacity, opacity);
+    const __m128 ta = _blend_sse_load(&s, a+j);
+    const __m128 tb = _blend_sse_load(&s, b+j);
+    const __m128 la = _sse_clamp(_mm_add_ps(ta, s.offset), zero, s.lmax);
+    const __m128 lb = _sse_clamp(_mm_add_ps(tb, s.offset), zero, s.lmax);
+    const __m128 high = _mm_sub_ps(s.lmax, _mm_mul_ps(_mm_sub_ps(s.lmax, la), _mm_sub_ps(s.lmax, _mm_sub_ps(lb, halfmax))));
+    const __m128 low = _mm_mul_ps(la, _mm_add_ps(lb, halfmax));
+    const __m128 mixed = _sse_select(_mm_cmpgt_ps(lb, halfmax), high, low);
+    _blend_sse_store(&s, b+j, _blend_sse_light(&s, ta, tb, la, mixed, opacity2, flag), opacity);
+  }
+}
+
+/* hardlight */
+static void _blend_hardlight_sse2(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
+{
+  _blend_sse_t s;
+  _blend_sse_init(&s, cst);
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 halfmax = _mm_mul_ps(s.lmax, _mm_set1_ps(0.5f));
+  const __m128 doublemax = _mm_mul_ps(s.lmax, _mm_set1_ps(2.0f));
+
+  for(int i=0, j=0; j<stride; i++, j+=4)
+  {
+    const __m128 opacity = _mm_set1_ps(mask[i]);
+    const __m128 opacity2 = _mm_mul_ps(opacity, opacity);
+    const __m128 ta = _blend_sse_load(&s, a+j);
+    const __m128 tb = _blend_sse_load(&s, b+j);
+    const __m128 la = _sse_clamp(_mm_add_ps(ta, s.offset), zero, s.lmax);
+    const __m128 lb = _sse_clamp(_mm_add_ps(tb, s.offset), zero, s.lmax);
+    const __m128 high = _mm_sub_ps(s.lmax, _mm_mul_ps(_mm_sub_ps(s.lmax, _mm_mul_ps(doublemax, _mm_sub_ps(la, halfmax))),
+                                                      _mm_sub_ps(s.lmax, lb)));
+    const __m128 low = _mm_mul_ps(_mm_mul_ps(doublemax, la), lb);
+    const __m128 mixed = _sse_select(_mm_cmpgt_ps(lb, halfmax), high, low);
+    _blend_sse_store(&s, b+j, _blend_sse_light(&s, ta, tb, la, mixed, opacity2, flag), opacity);
+  }
+}
+
+/* vividlight */
+static void _blend_vividlight_sse2(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
+{
+  _blend_sse_t s;
+  _blend_sse_init(&s, cst);
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 halfmax = _mm_mul_ps(s.lmax, _mm_set1_ps(0.5f));
+  const __m128 doublemax = _mm_mul_ps(s.lmax, _mm_set1_ps(2.0f));
+
+  for(int i=0, j=0; j<stride; i++, j+=4)
+  {
+    const __m128 opacity = _mm_set1_ps(mask[i]);
+    const __m128 opacity2 = _mm_mul_ps(opacity, opacity);
+    const __m128 ta = _blend_sse_load(&s, a+j);
+    const __m128 tb = _blend_sse_load(&s, b+j);
+    const __m128 la = _sse_clamp(_mm_add_ps(ta, s.offset), zero, s.lmax);
+    const __m128 lb = _sse_clamp(_mm_add_ps(tb, s.offset), zero, s.lmax);
+    // the divisions by zero end up in lanes which are not selected
+    const __m128 high = _sse_select(_mm_cmpge_ps(lb, s.lmax), s.lmax,
+                                    _mm_div_ps(la, _mm_mul_ps(doublemax, _mm_sub_ps(s.lmax, lb))));
+    const __m128 low = _sse_select(_mm_cmple_ps(lb, zero), zero,
+                                   _mm_sub_ps(s.lmax, _mm_div_ps(_mm_sub_ps(s.lmax, la), _mm_mul_ps(doublemax, lb))));
+    const __m128 mixed = _sse_select(_mm_cmpgt_ps(lb, halfmax), high, low);
+    _blend_sse_store(&s, b+j, _blend_sse_light(&s, ta, tb, la, mixed, opacity2, flag), opacity);
+  }
+}
+
+/* linearlight */
+static void _blend_linearlight_sse2(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
+{
+  _blend_sse_t s;
+  _blend_sse_init(&s, cst);
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 doublemax = _mm_mul_ps(s.lmax, _mm_set1_ps(2.0f));
+
+  for(int i=0, j=0; j<stride; i++, j+=4)
+  {
+    const __m128 opacity = _mm_set1_ps(mask[i]);
+    const __m128 opacity2 = _mm_mul_ps(opacity, opacity);
+    const __m128 ta = _blend_sse_load(&s, a+j);
+    const __m128 tb = _blend_sse_load(&s, b+j);
+    const __m128 la = _sse_clamp(_mm_add_ps(ta, s.offset), zero, s.lmax);
+    const __m128 lb = _sse_clamp(_mm_add_ps(tb, s.offset), zero, s.lmax);
+    const __m128 mixed = _mm_sub_ps(_mm_add_ps(la, _mm_mul_ps(doublemax, lb)), s.lmax);
+    _blend_sse_store(&s, b+j, _blend_sse_light(&s, ta, tb, la, mixed, opacity2, flag), opacity);
+  }
+}
+
+/* pinlight */
+static void _blend_pinlight_sse2(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
+{
+  _blend_sse_t s;
+  _blend_sse_init(&s, cst);
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 halfmax = _mm_mul_ps(s.lmax, _mm_set1_ps(0.5f));
+  const __m128 doublemax = _mm_mul_ps(s.lmax, _mm_set1_ps(2.0f));
+
+  for(int i=0, j=0; j<stride; i++, j+=4)
+  {
+    const __m128 opacity = _mm_set1_ps(mask[i]);
+    const __m128 opacity2 = _mm_mul_ps(opacity, opacity);
+    const __m128 ta = _blend_sse_load(&s, a+j);
+    const __m128 tb = _blend_sse_load(&s, b+j);
+    const __m128 la = _sse_clamp(_mm_add_ps(ta, s.offset), zero, s.lmax);
+    const __m128 lb = _sse_clamp(_mm_add_ps(tb, s.offset), zero, s.lmax);
+    const __m128 high = _mm_max_ps(la, _mm_mul_ps(doublemax, _mm_sub_ps(lb, halfmax)));
+    const __m128 low = _mm_min_ps(la, _mm_mul_ps(doublemax, lb));
+    const __m128 mixed = _sse_select(_mm_cmpgt_ps(lb, halfmax), high, low);
+    __m128 t = _mm_sub_ps(_sse_clamp(_sse_lerp(la, mixed, opacity2), zero, s.lmax), s.offset);
+    // a and b stay, regardless of the flag
+    if(s.lab) t = _blend_sse_Lab(&s, t, _sse_clamp(ta, s.min, s.max));
+    _blend_sse_store(&s, b+j, t, opacity);
+  }
+}
+
+/* lightness blend, rgb needs hsl and stays with the plain c version */
+static void _blend_lightness_sse2(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
+{
+  if(cst == iop_cs_rgb)
+  {
+    _blend_lightness(cst, a, b, mask, stride, flag);
     return;
   }
 
-  /* select the blend operator */
+  _blend_sse_t s;
+  _blend_sse_init(&s, cst);
+
+  for(int i=0, j=0; j<stride; i++, j+=4)
+  {
+    const __m128 opacity = _mm_set1_ps(mask[i]);
+    const __m128 ta = _blend_sse_load(&s, a+j);
+    const __m128 tb = _blend_sse_load(&s, b+j);
+    __m128 t = _sse_clamp(ta, s.min, s.max);    // noop for raw
+    if(s.lab) t = _blend_sse_Lab(&s, _sse_clamp(_sse_lerp(ta, tb, opacity), s.min, s.max), t);
+    _blend_sse_store(&s, b+j, t, opacity);
+  }
+}
+
+/* inverse blend */
+static void _blend_inverse_sse2(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
+{
+  _blend_sse_t s;
+  _blend_sse_init(&s, cst);
+
+  for(int i=0, j=0; j<stride; i++, j+=4)
+  {
+    const __m128 opacity = _mm_set1_ps(1.0f - mask[i]);
+    const __m128 ta = _blend_sse_load(&s, a+j);
+    const __m128 tb = _blend_sse_load(&s, b+j);
+    __m128 t = _sse_clamp(_sse_lerp(ta, tb, opacity), s.min, s.max);
+    if(s.lab && flag) t = _blend_sse_Lab(&s, t, ta);
+    _blend_sse_store(&s, b+j, t, opacity);
+  }
+}
+
+/* blend only lightness in Lab color space without any clamping (a noop for other color spaces) */
+static void _blend_Lab_lightness_sse2(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
+{
+  _blend_sse_t s;
+  _blend_sse_init(&s, cst);
+
+  for(int i=0, j=0; j<stride; i++, j+=4)
+  {
+    const __m128 opacity = _mm_set1_ps(mask[i]);
+    const __m128 ta = _blend_sse_load(&s, a+j);
+    const __m128 tb = _blend_sse_load(&s, b+j);
+    __m128 t = ta;
+    if(s.lab) t = _blend_sse_Lab(&s, _sse_lerp(ta, tb, opacity), ta);
+    _blend_sse_store(&s, b+j, t, opacity);
+  }
+}
+
+/* blend only color in Lab color space without any clamping (a noop for other color spaces) */
+static void _blend_Lab_color_sse2(dt_iop_colorspace_type_t cst,const float *a, float *b, const float *mask, int stride, int flag)
+{
+  _blend_sse_t s;
+  _blend_sse_init(&s, cst);
+
+  for(int i=0, j=0; j<stride; i++, j+=4)
+  {
+    const __m128 opacity = _mm_set1_ps(mask[i]);
+    const __m128 ta = _blend_sse_load(&s, a+j);
+    const __m128 tb = _blend_sse_load(&s, b+j);
+    __m128 t = ta;
+    if(s.lab && !flag) t = _blend_sse_Lab(&s, ta, _sse_lerp(ta, tb, opacity));
+    _blend_sse_store(&s, b+j, t, opacity);
+  }
+}
+
+
+/* the blendif parameters transposed to one register per group of four channels,
+   so all channels of a group get their factor at once. */
+typedef struct _blendif_sse_t
+{
+  __m128 p0[4], p1[4], p2[4], p3[4];
+  __m128 rise[4], fall[4];    // reciprocal width of the ramps
+  __m128 flip[4];             // channels which need 1 - factor: inverted xor included
+  __m128 active[4];           // channels with a slider not spanning the whole range
+  __m128 fixed[4];            // factors of the other channels, 1 if not used in this colorspace
+  int groups;                 // 4 if lch or hsl is needed, 2 otherwise
+  int conditional;
+  float constant;             // the result when not conditional
+}
+_blendif_sse_t;
+
+static _blendif_sse_t _blendif_sse_init(dt_iop_colorspace_type_t cst, const unsigned int blendif, const float *parameters,
+                                        const unsigned int mask_mode, const unsigned int mask_combine)
+{
+  _blendif_sse_t sse;
+  _blendif_sse_t *s = &sse;
+  const int incl = (mask_combine & DEVELOP_COMBINE_INCL) ? 1 : 0;
+  unsigned int channel_mask = 0;
+  if(cst == iop_cs_Lab) channel_mask = DEVELOP_BLENDIF_Lab_MASK;
+  else if(cst == iop_cs_rgb) channel_mask = DEVELOP_BLENDIF_RGB_MASK;
+
+  s->conditional = (mask_mode & DEVELOP_MASK_CONDITIONAL) && channel_mask;
+  s->constant = incl ? 0.0f : 1.0f;
+  s->groups = (blendif & 0x7f00) ? 4 : 2;
+
+  for(int g=0; g<4; g++)
+  {
+    float p[4][4], rise[4], fall[4], fixed[4];
+    int flip[4], active[4];
+    for(int k=0; k<4; k++)
+    {
+      const int ch = 4*g + k;
+      for(int n=0; n<4; n++) p[n][k] = parameters[4*ch+n];
+      rise[k] = 1.0f/fmax(0.01f, p[1][k] - p[0][k]);
+      fall[k] = 1.0f/fmax(0.01f, p[3][k] - p[2][k]);
+      flip[k] = ((blendif & (1<<(ch+16))) ? 1 : 0) ^ incl;
+      active[k] = (channel_mask & (1<<ch)) && (blendif & (1<<ch));
+      if(!(channel_mask & (1<<ch))) fixed[k] = 1.0f;
+      else fixed[k] = !(blendif & (1<<(ch+16))) == !incl ? 1.0f : 0.0f;
+    }
+    s->p0[g] = _mm_loadu_ps(p[0]);
+    s->p1[g] = _mm_loadu_ps(p[1]);
+    s->p2[g] = _mm_loadu_ps(p[2]);
+    s->p3[g] = _mm_loadu_ps(p[3]);
+    s->rise[g] = _mm_loadu_ps(rise);
+    s->fall[g] = _mm_loadu_ps(fall);
+    s->flip[g] = _mm_castsi128_ps(_mm_set_epi32(-flip[3], -flip[2], -flip[1], -flip[0]));
+    s->active[g] = _mm_castsi128_ps(_mm_set_epi32(-active[3], -active[2], -active[1], -active[0]));
+    s->fixed[g] = _mm_loadu_ps(fixed);
+  }
+  return sse;
+}
+
+static inline __m128 _blendif_sse_factor(const _blendif_sse_t *s, const int g, const __m128 x)
+{
+  const __m128 one = _mm_set1_ps(1.0f);
+  const __m128 rise = _mm_mul_ps(_mm_sub_ps(x, s->p0[g]), s->rise[g]);
+  const __m128 fall = _mm_sub_ps(one, _mm_mul_ps(_mm_sub_ps(x, s->p2[g]), s->fall[g]));
+  __m128 f = _mm_and_ps(_mm_and_ps(_mm_cmpgt_ps(x, s->p2[g]), _mm_cmplt_ps(x, s->p3[g])), fall);
+  f = _sse_select(_mm_and_ps(_mm_cmpgt_ps(x, s->p0[g]), _mm_cmplt_ps(x, s->p1[g])), rise, f);
+  f = _sse_select(_mm_and_ps(_mm_cmpge_ps(x, s->p1[g]), _mm_cmple_ps(x, s->p2[g])), one, f);
+  f = _sse_select(s->flip[g], _mm_sub_ps(one, f), f);
+  return _sse_select(s->active[g], f, s->fixed[g]);
+}
+
+/* same as _blendif_factor() */
+static inline float _blendif_sse(const _blendif_sse_t *s, dt_iop_colorspace_type_t cst, const float *input,
+                                 const float *output, const unsigned int mask_combine)
+{
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 one = _mm_set1_ps(1.0f);
+  __m128 scaled[4];
+
+  if(cst == iop_cs_Lab)
+  {
+    const __m128 scale = _mm_set_ps(0.0f, 1.0f/256.0f, 1.0f/256.0f, 1.0f/100.0f);
+    const __m128 offset = _mm_set_ps(0.0f, 0.5f, 0.5f, 0.0f);
+    scaled[0] = _sse_clamp(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(input), scale), offset), zero, one);
+    scaled[1] = _sse_clamp(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(output), scale), offset), zero, one);
+    if(s->groups == 4)
+    {
+      float LCH_input[3];
+      float LCH_output[3];
+      _Lab_2_LCH(input, LCH_input);
+      _Lab_2_LCH(output, LCH_output);
+      scaled[2] = _sse_clamp(_mm_set_ps(0.0f, 0.0f, LCH_input[2], LCH_input[1] / (128.0f*sqrtf(2.0f))), zero, one);
+      scaled[3] = _sse_clamp(_mm_set_ps(0.0f, 0.0f, LCH_output[2], LCH_output[1] / (128.0f*sqrtf(2.0f))), zero, one);
+    }
+  }
+  else
+  {
+    scaled[0] = _sse_clamp(_mm_set_ps(input[2], input[1], input[0],
+                                      0.3f*input[0] + 0.59f*input[1] + 0.11f*input[2]), zero, one);
+    scaled[1] = _sse_clamp(_mm_set_ps(output[2], output[1], output[0],
+                                      0.3f*output[0] + 0.59f*output[1] + 0.11f*output[2]), zero, one);
+    if(s->groups == 4)
+    {
+      float HSL_input[3];
+      float HSL_output[3];
+      _RGB_2_HSL(input, HSL_input);
+      _RGB_2_HSL(output, HSL_output);
+      scaled[2] = _sse_clamp(_mm_set_ps(0.0f, HSL_input[2], HSL_input[1], HSL_input[0]), zero, one);
+      scaled[3] = _sse_clamp(_mm_set_ps(0.0f, HSL_output[2], HSL_output[1], HSL_output[0]), zero, one);
+    }
+  }
+
+  __m128 r = _mm_mul_ps(_blendif_sse_factor(s, 0, scaled[0]), _blendif_sse_factor(s, 1, scaled[1]));
+  if(s->groups == 4)
+    r = _mm_mul_ps(r, _mm_mul_ps(_blendif_sse_factor(s, 2, scaled[2]), _blendif_sse_factor(s, 3, scaled[3])));
+  else // lch or hsl channels with sliders spanning the whole range still count
+    r = _mm_mul_ps(r, _mm_mul_ps(s->fixed[2], s->fixed[3]));
+  r = _mm_mul_ps(r, _mm_shuffle_ps(r, r, _MM_SHUFFLE(2, 3, 0, 1)));
+  r = _mm_mul_ps(r, _mm_shuffle_ps(r, r, _MM_SHUFFLE(1, 0, 3, 2)));
+  const float result = _mm_cvtss_f32(r);
+
+  return (mask_combine & DEVELOP_COMBINE_INCL) ? 1.0f - result : result;
+}
+
+/* generate blend mask */
+static void _blend_make_mask_sse2(const _blendif_sse_t *s, dt_iop_colorspace_type_t cst, const unsigned int mask_combine,
+                                  const float gopacity, const float *a, const float *b, float *mask, int stride)
+{
+  for(int i=0, j=0; j<stride; i++, j+=4)
+  {
+    float form = mask[i];
+    float conditional = s->conditional ? _blendif_sse(s, cst, &a[j], &b[j], mask_combine) : s->constant;
+    float opacity = (mask_combine & DEVELOP_COMBINE_INCL) ? 1.0f - (1.0f - form) * (1.0f - conditional) : form * conditional ;
+    opacity = (mask_combine & DEVELOP_COMBINE_INV) ? 1.0f - opacity : opacity;
+    mask[i] = opacity*gopacity;
+  }
+}
+
+
+/* the blend operator for a mode. there is no sse2 version of the modes which go through hsl or lch. */
+static _blend_row_func *_blend_select(const unsigned int blend_mode, const int sse2)
+{
+  _blend_row_func *blend = NULL;
+  _blend_row_func *blend_sse2 = NULL;
+
   switch (blend_mode)
   {
     case DEVELOP_BLEND_LIGHTEN:
       blend = _blend_lighten;
+      blend_sse2 = _blend_lighten_sse2;
       break;
     case DEVELOP_BLEND_DARKEN:
       blend = _blend_darken;
+      blend_sse2 = _blend_darken_sse2;
       break;
     case DEVELOP_BLEND_MULTIPLY:
       blend = _blend_multiply;
+      blend_sse2 = _blend_multiply_sse2;
       break;
     case DEVELOP_BLEND_AVERAGE:
       blend = _blend_average;
+      blend_sse2 = _blend_average_sse2;
       break;
     case DEVELOP_BLEND_ADD:
       blend = _blend_add;
+      blend_sse2 = _blend_add_sse2;
       break;
     case DEVELOP_BLEND_SUBSTRACT:
       blend = _blend_substract;
+      blend_sse2 = _blend_substract_sse2;
       break;
     case DEVELOP_BLEND_DIFFERENCE:
       blend = _blend_difference;
+      blend_sse2 = _blend_difference_sse2;
       break;
     case DEVELOP_BLEND_DIFFERENCE2:
       blend = _blend_difference2;
+      blend_sse2 = _blend_difference2_sse2;
       break;
     case DEVELOP_BLEND_SCREEN:
       blend = _blend_screen;
+      blend_sse2 = _blend_screen_sse2;
       break;
     case DEVELOP_BLEND_OVERLAY:
       blend = _blend_overlay;
+      blend_sse2 = _blend_overlay_sse2;
       break;
     case DEVELOP_BLEND_SOFTLIGHT:
       blend = _blend_softlight;
+      blend_sse2 = _blend_softlight_sse2;
       break;
     case DEVELOP_BLEND_HARDLIGHT:
       blend = _blend_hardlight;
+      blend_sse2 = _blend_hardlight_sse2;
       break;
     case DEVELOP_BLEND_VIVIDLIGHT:
       blend = _blend_vividlight;
+      blend_sse2 = _blend_vividlight_sse2;
       break;
     case DEVELOP_BLEND_LINEARLIGHT:
       blend = _blend_linearlight;
+      blend_sse2 = _blend_linearlight_sse2;
       break;
     case DEVELOP_BLEND_PINLIGHT:
       blend = _blend_pinlight;
+      blend_sse2 = _blend_pinlight_sse2;
       break;
     case DEVELOP_BLEND_LIGHTNESS:
       blend = _blend_lightness;
+      blend_sse2 = _blend_lightness_sse2;
       break;
     case DEVELOP_BLEND_CHROMA:
       blend = _blend_chroma;
@@ -1830,19 +2516,23 @@ void dt_develop_blend_process (struct dt_iop_module_t *self, struct dt_dev_pixel
       break;
     case DEVELOP_BLEND_INVERSE:
       blend = _blend_inverse;
+      blend_sse2 = _blend_inverse_sse2;
       break;
     case DEVELOP_BLEND_NORMAL:
     case DEVELOP_BLEND_BOUNDED:
       blend = _blend_normal_bounded;
+      blend_sse2 = _blend_normal_bounded_sse2;
       break;
     case DEVELOP_BLEND_COLORADJUST:
       blend = _blend_coloradjust;
       break;
     case DEVELOP_BLEND_LAB_LIGHTNESS:
       blend = _blend_Lab_lightness;
+      blend_sse2 = _blend_Lab_lightness_sse2;
       break;
     case DEVELOP_BLEND_LAB_COLOR:
       blend = _blend_Lab_color;
+      blend_sse2 = _blend_Lab_color_sse2;
       break;
 
       /* fallback to normal blend */
@@ -1850,9 +2540,42 @@ void dt_develop_blend_process (struct dt_iop_module_t *self, struct dt_dev_pixel
     case DEVELOP_BLEND_UNBOUNDED:
     default:
       blend = _blend_normal_unbounded;
+      blend_sse2 = _blend_normal_unbounded_sse2;
       break;
   }
 
+  return (sse2 && blend_sse2) ? blend_sse2 : blend;
+}
+
+
+void dt_develop_blend_process (struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece, void *i, void *o, const struct dt_iop_roi_t *roi_in, const struct dt_iop_roi_t *roi_out)
+{
+  int ch = piece->colors;
+  _blend_row_func *blend = NULL;
+  dt_develop_blend_params_t *d = (dt_develop_blend_params_t *)piece->blendop_data;
+
+  const unsigned int blend_mode = d->blend_mode;
+  const unsigned int mask_mode = d->mask_mode;
+  const unsigned int xoffs = roi_out->x - roi_in->x;
+  const unsigned int yoffs = roi_out->y - roi_in->y;
+
+  /* check if blend is disabled */
+  if (!d || !(mask_mode & DEVELOP_MASK_ENABLED)) return;
+
+  /* we can only handle blending if roi_out and roi_in have the same scale and
+     if roi_out fits into the area given by roi_in */
+  if (roi_out->scale != roi_in->scale || xoffs < 0 || yoffs < 0 
+      || ((xoffs > 0 || yoffs > 0) && (roi_out->width + xoffs > roi_in->width || roi_out->height + yoffs > roi_in->height)))
+  {
+    //printf("%s: scale %f/%f %d\n", self->op, roi_out->scale, roi_in->scale, roi_out->scale == roi_in->scale);
+    //printf("xoffs %d, yoffs %d, out %d, %d, in %d, %d\n", xoffs, yoffs, roi_out->width, roi_out->height, roi_in->width, roi_in->height);
+    dt_control_log(_("skipped blending in module '%s': roi's do not match"), self->op);
+    return;
+  }
+
+  /* select the blend operator */
+  blend = _blend_select(blend_mode, 1);
+
   /* allocate space for blend mask */
   float *mask = dt_alloc_align(64, roi_out->width*roi_out->height*sizeof(float));
   if(!mask)
@@ -1925,6 +2648,7 @@ void dt_develop_blend_process (struct dt_iop_module_t *self, struct dt_dev_pixel
     /* only true if mask_display was set by an _earlier_ module */
     const int mask_display = piece->pipe->mask_display;
     const int iwidth = roi_in->width;
+    const _blendif_sse_t blendif = _blendif_sse_init(cst, d->blendif, d->blendif_parameters, d->mask_mode, d->mask_combine);
 
 #ifdef _OPENMP
 #if !defined(__SUNOS__) && !defined(__NetBSD__)
@@ -1941,7 +2665,7 @@ void dt_develop_blend_process (struct dt_iop_module_t *self, struct dt_dev_pixel
       float *in = (float *)i + iindex;
       float *out = (float *)o + oindex;
       float *m = (float *)mask + y * roi_out->width;
-      _blend_make_mask(cst, d->blendif, d->blendif_parameters, d->mask_mode, d->mask_combine, opacity, in, out, m, stride);
+      _blend_make_mask_sse2(&blendif, cst, d->mask_combine, opacity, in, out, m, stride);
     }
 
     if(maskblur)
@@ -2024,6 +2748,32 @@ void dt_develop_blend_process (struct dt_iop_module_t *self, struct dt_dev_pixel
 }
 
 
+void dt_develop_blend_rows(const unsigned int blend_mode, const int sse2, dt_iop_colorspace_type_t cst, const float *a,
+                           float *b, const float *mask, const int width, const int height, const int flag)
+{
+  _blend_row_func *blend = _blend_select(blend_mode, sse2);
+  const int stride = (cst == iop_cs_RAW ? 1 : 4)*width;
+  for(int y=0; y<height; y++)
+    blend(cst, a + (size_t)y*stride, b + (size_t)y*stride, mask + (size_t)y*width, stride, flag);
+}
+
+void dt_develop_blend_make_mask_rows(const int sse2, dt_iop_colorspace_type_t cst, const unsigned int blendif,
+                                     const float *parameters, const unsigned int mask_mode, const unsigned int mask_combine,
+                                     const float opacity, const float *a, const float *b, float *mask,
+                                     const int width, const int height)
+{
+  const _blendif_sse_t s = _blendif_sse_init(cst, blendif, parameters, mask_mode, mask_combine);
+  const int stride = (cst == iop_cs_RAW ? 1 : 4)*width;
+  for(int y=0; y<height; y++)
+  {
+    const float *in = a + (size_t)y*stride, *out = b + (size_t)y*stride;
+    float *m = mask + (size_t)y*width;
+    if(sse2) _blend_make_mask_sse2(&s, cst, mask_combine, opacity, in, out, m, stride);
+    else _blend_make_mask(cst, blendif, parameters, mask_mode, mask_combine, opacity, in, out, m, stride);
+  }
+}
+
+
 #ifdef HAVE_OPENCL
 int
 dt_develop_blend_process_cl (struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece, cl_mem dev_in, cl_mem dev_out, const struct dt_iop_roi_t *roi_in, const struct dt_iop_roi_t *roi_out)
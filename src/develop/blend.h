@@ -379,6 +379,16 @@ void dt_develop_blend_init(dt_blendop_t *gd);
 /** apply blend */
 void dt_develop_blend_process (struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece, void *i, void *o, const struct dt_iop_roi_t *roi_in, const struct dt_iop_roi_t *roi_out);
 
+/** blends a into b row by row with the plain c or the sse2 code of blend_mode, single threaded, for benchmarks. */
+void dt_develop_blend_rows(const unsigned int blend_mode, const int sse2, dt_iop_colorspace_type_t cst, const float *a,
+                           float *b, const float *mask, const int width, const int height, const int flag);
+
+/** the same for the conditional mask, which is multiplied into mask. */
+void dt_develop_blend_make_mask_rows(const int sse2, dt_iop_colorspace_type_t cst, const unsigned int blendif,
+                                     const float *parameters, const unsigned int mask_mode, const unsigned int mask_combine,
+                                     const float opacity, const float *a, const float *b, float *mask,
+                                     const int width, const int height);
+
 /** get blend version */
 int dt_develop_blend_version (void);
 
@@ -43,6 +43,7 @@
 #define DT_DEV_AVERAGE_DELAY_START            250
 #define DT_DEV_PREVIEW_AVERAGE_DELAY_START     50
 #define DT_DEV_AVERAGE_DELAY_COUNT              5
+#define DT_DEV_PAN_MIN_STRIP                   32
 
 
 const gchar* dt_dev_histogram_type_names[DT_DEV_HISTOGRAM_N] = { "logarithmic", "linear", "waveform" };
@@ -101,6 +102,9 @@ void dt_dev_init(dt_develop_t *dev, int32_t gui_attached)
     dev->histogram_max = -1;
     dev->histogram_pre_tonecurve_max = -1;
     dev->histogram_pre_levels_max = -1;
+
+    dt_pthread_mutex_init(&dev->prefetch.mutex, NULL);
+    for(int k=0; k<2; k++) dev->prefetch.imgid[k] = dev->prefetch.done[k].imgid = -1;
   }
 
   dev->iop_instance = 0;
@@ -147,15 +151,29 @@ void dt_dev_cleanup(dt_develop_t *dev)
   free(dev->histogram);
   free(dev->histogram_pre_tonecurve);
   free(dev->histogram_pre_levels);
+  if(dev->gui_attached)
+  {
+    for(int k=0; k<2; k++) free(dev->prefetch.done[k].buf);
+    dt_pthread_mutex_destroy(&dev->prefetch.mutex);
+  }
 
   dt_conf_set_int("darkroom/ui/overexposed/colorscheme", dev->overexposed.colorscheme);
   dt_conf_set_int("darkroom/ui/overexposed/lower", dev->overexposed.lower);
   dt_conf_set_int("darkroom/ui/overexposed/upper", dev->overexposed.upper);
 }
 
+// the darkroom wants the cpu, let the neighbour being pre-developed wait.
+static void _dev_prefetch_pause(dt_develop_t *dev)
+{
+  dt_pthread_mutex_lock(&dev->prefetch.mutex);
+  if(dev->prefetch.running) dev->prefetch.running->gui_leaving = 1;
+  dt_pthread_mutex_unlock(&dev->prefetch.mutex);
+}
+
 void dt_dev_process_image(dt_develop_t *dev)
 {
   if(!dev->gui_attached || dev->pipe->processing) return;
+  _dev_prefetch_pause(dev);
   dt_job_t job;
   dt_dev_process_image_job_init(&job, dev);
   int err = dt_control_add_job_res(darktable.control, &job, DT_CTL_WORKER_2);
@@ -165,6 +183,7 @@ void dt_dev_process_image(dt_develop_t *dev)
 void dt_dev_process_preview(dt_develop_t *dev)
 {
   if(!dev->gui_attached) return;
+  _dev_prefetch_pause(dev);
   dt_job_t job;
   dt_dev_process_preview_job_init(&job, dev);
   int err = dt_control_add_job_res(darktable.control, &job, DT_CTL_WORKER_3);
@@ -261,6 +280,152 @@ restart:
   dt_mipmap_cache_read_release(darktable.mipmap_cache, &buf);
 }
 
+// region of the image shown by the darkroom at the current zoom, in dev->pipe output coordinates.
+static float _dev_image_roi(dt_develop_t *dev, int32_t *x, int32_t *y, int32_t *wd, int32_t *ht)
+{
+  dt_dev_zoom_t zoom;
+  float zoom_x, zoom_y;
+  DT_CTL_GET_GLOBAL(zoom, dev_zoom);
+  DT_CTL_GET_GLOBAL(zoom_x, dev_zoom_x);
+  DT_CTL_GET_GLOBAL(zoom_y, dev_zoom_y);
+
+  const float scale = dt_dev_get_zoom_scale(dev, zoom, 1.0f, 0);
+  *wd = MIN(MIN(dev->width,  dev->pipe->processed_width *scale), darktable.thumbnail_width);
+  *ht = MIN(MIN(dev->height, dev->pipe->processed_height*scale), darktable.thumbnail_height);
+  *x = MAX(0, scale*dev->pipe->processed_width *(.5+zoom_x)-*wd/2);
+  *y = MAX(0, scale*dev->pipe->processed_height*(.5+zoom_y)-*ht/2);
+  return scale;
+}
+
+// puts an 8-bit output for roi into the pipe cache, where the last module will look for it.
+static void _dev_seed_output(dt_develop_t *dev, const dt_iop_roi_t *roi, const uint64_t hash, const uint8_t *output)
+{
+  void *buf = NULL;
+  dt_pthread_mutex_lock(&dev->pipe->busy_mutex);
+  dt_dev_pixelpipe_cache_get(&dev->pipe->cache, hash, 4*sizeof(float)*roi->width*roi->height, &buf);
+  memcpy(buf, output, (size_t)4*roi->width*roi->height);
+  dt_pthread_mutex_unlock(&dev->pipe->busy_mutex);
+}
+
+// if the image we just switched to was pre-developed at exactly this roi and history, use that.
+static void _dev_prefetch_seed(dt_develop_t *dev, const dt_iop_roi_t *roi)
+{
+  const int32_t imgid = dev->image_storage.id;
+  const uint64_t hash = dt_dev_pixelpipe_cache_hash(imgid, roi, dev->pipe, g_list_length(dev->iop));
+  dt_pthread_mutex_lock(&dev->prefetch.mutex);
+  for(int k=0; k<2; k++)
+  {
+    if(!dev->prefetch.done[k].buf || dev->prefetch.done[k].imgid != imgid || dev->prefetch.done[k].hash != hash ||
+       dev->prefetch.done[k].width != roi->width || dev->prefetch.done[k].height != roi->height) continue;
+    _dev_seed_output(dev, roi, hash, dev->prefetch.done[k].buf);
+    dt_print(DT_DEBUG_DEV, "[dev_prefetch] image %d was developed in advance\n", imgid);
+    break;
+  }
+  dt_pthread_mutex_unlock(&dev->prefetch.mutex);
+}
+
+// processes the strip of the new roi at x, y relative to it, and copies the output into buf. the strip is
+// enlarged by margin on all sides, like tiling.c does, so the modules see the same context as for the whole roi.
+static int _dev_pan_strip(dt_develop_t *dev, const dt_iop_roi_t *roi, uint8_t *buf, int x, int y, int wd, int ht,
+                          const int margin)
+{
+  if(wd <= 0 || ht <= 0) return 0;
+  // very thin strips aren't worth a pipe run of their own, take some of the old part along:
+  wd = MIN(MAX(wd, DT_DEV_PAN_MIN_STRIP), roi->width);
+  ht = MIN(MAX(ht, DT_DEV_PAN_MIN_STRIP), roi->height);
+  x = CLAMP(x, 0, roi->width - wd);
+  y = CLAMP(y, 0, roi->height - ht);
+  // keep the edges on the same bayer parity as the ones of roi (demosaic aligns its input, flip may swap sides),
+  // and inside the image:
+  const int width = dev->pipe->processed_width * roi->scale, height = dev->pipe->processed_height * roi->scale;
+  int x0 = MAX(x - margin, -roi->x + (roi->x & 1)), y0 = MAX(y - margin, -roi->y + (roi->y & 1));
+  int x1 = MIN(x + wd + margin, width - roi->x), y1 = MIN(y + ht + margin, height - roi->y);
+  x0 += x0 & 1;
+  y0 += y0 & 1;
+  x1 -= (x1 - roi->width) & 1;
+  y1 -= (y1 - roi->height) & 1;
+  x0 = MIN(x0, x);
+  y0 = MIN(y0, y);
+  x1 = MAX(x1, x + wd);
+  y1 = MAX(y1, y + ht);
+  if(dt_dev_pixelpipe_process(dev->pipe, dev, roi->x + x0, roi->y + y0, x1 - x0, y1 - y0, roi->scale)) return 1;
+  for(int j=0; j<ht; j++)
+    memcpy(buf + (size_t)4*((size_t)(y + j)*roi->width + x),
+           dev->pipe->backbuf + (size_t)4*((size_t)(y - y0 + j)*(x1 - x0) + x - x0), (size_t)4*wd);
+  return 0;
+}
+
+// after panning, only process the newly exposed strips and take the rest from the last output, if that is still
+// valid for the current history. the pipe will find the result in its cache then.
+// returns non-zero if processing was interrupted.
+static int _dev_pan(dt_develop_t *dev, const dt_iop_roi_t *roi)
+{
+  dt_dev_pixelpipe_t *pipe = dev->pipe;
+  const dt_iop_roi_t old = pipe->backbuf_roi;
+  const int dx = roi->x - old.x, dy = roi->y - old.y;
+  if(old.scale != roi->scale || old.width != roi->width || old.height != roi->height || (!dx && !dy)) return 0;
+  if(abs(dx) >= roi->width || abs(dy) >= roi->height) return 0;
+  // the color picker has to see the whole thing:
+  if(dev->gui_module && dev->gui_module->request_color_pick) return 0;
+  // not worth it if most of it is new:
+  const size_t area = (size_t)roi->width*roi->height;
+  if(area - (size_t)(roi->width - abs(dx))*(roi->height - abs(dy)) > area/2) return 0;
+
+  // all modules have to produce the same pixels no matter how the image is cut, given the context they ask for
+  // in tiling_callback(). the last one only converts to 8 bits. some compute statistics over their roi or round
+  // their roi when scaling, so modules have to say so. masks may be blurred, which isn't local either.
+  for(GList *pieces = pipe->nodes; pieces && g_list_next(pieces); pieces = g_list_next(pieces))
+  {
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)pieces->data;
+    if(!piece->enabled) continue;
+    if(!(piece->module->flags() & IOP_FLAGS_POINT_TO_POINT) && !(piece->roi_invariant && roi->scale == 1.0f)) return 0;
+    const dt_develop_blend_params_t *d = (const dt_develop_blend_params_t *)piece->blendop_data;
+    if(d && (d->mask_mode & DEVELOP_MASK_ENABLED)) return 0;
+  }
+
+  // the last output, for the current history?
+  const int pos = g_list_length(dev->iop);
+  const uint64_t hash = dt_dev_pixelpipe_cache_hash(pipe->image.id, roi, pipe, pos);
+  const uint64_t old_hash = dt_dev_pixelpipe_cache_hash(pipe->image.id, &old, pipe, pos);
+  uint8_t *buf = (uint8_t *)malloc(4*area);
+  if(!buf) return 0;
+  int found = 0;
+  dt_pthread_mutex_lock(&pipe->busy_mutex);
+  if(dt_dev_pixelpipe_cache_available(&pipe->cache, old_hash))
+  {
+    void *old_buf = NULL;
+    dt_dev_pixelpipe_cache_get(&pipe->cache, old_hash, 4*sizeof(float)*old.width*old.height, &old_buf);
+    // copy the overlap, the strips will overwrite the rest:
+    const int x0 = MAX(0, -dx), x1 = MIN(roi->width, roi->width - dx);
+    const int y0 = MAX(0, -dy), y1 = MIN(roi->height, roi->height - dy);
+    for(int j=y0; j<y1; j++)
+      memcpy(buf + (size_t)4*((size_t)j*roi->width + x0), (uint8_t *)old_buf + (size_t)4*((size_t)(j + dy)*old.width + x0 + dx),
+             (size_t)4*(x1 - x0));
+    found = 1;
+  }
+  dt_pthread_mutex_unlock(&pipe->busy_mutex);
+  if(!found)
+  {
+    free(buf);
+    return 0;
+  }
+
+  // the rows which came in at the top or bottom, then the columns on the left or right of the rest:
+  const int rows = abs(dy), cols = abs(dx);
+  const int margin = dt_dev_pixelpipe_tiling_overlap(pipe, dev, roi);
+  if(_dev_pan_strip(dev, roi, buf, 0, dy > 0 ? roi->height - rows : 0, roi->width, rows, margin) ||
+     _dev_pan_strip(dev, roi, buf, dx > 0 ? roi->width - cols : 0, dy > 0 ? 0 : rows, cols, roi->height - rows, margin))
+  {
+    free(buf);
+    return 1;
+  }
+  _dev_seed_output(dev, roi, hash, buf);
+  free(buf);
+  dt_print(DT_DEBUG_DEV, "[dev_process_image] panned by %d %d, reused %d%% of the image\n", dx, dy,
+           (int)(100*(roi->width - cols)*(size_t)(roi->height - rows)/area));
+  return 0;
+}
+
 void dt_dev_process_image_job(dt_develop_t *dev)
 {
   dt_pthread_mutex_lock(&dev->pipe_mutex);
@@ -310,9 +475,8 @@ void dt_dev_process_image_job(dt_develop_t *dev)
     dev->pipe->changed |= DT_DEV_PIPE_SYNCH;
   }
 
-  dt_dev_zoom_t zoom;
-  float zoom_x, zoom_y, scale;
-  int x, y;
+  float scale;
+  int32_t x, y;
 
   // adjust pipeline according to changed flag set by {add,pop}_history_item.
 restart:
@@ -327,18 +491,15 @@ restart:
   // this locks dev->history_mutex.
   dt_dev_pixelpipe_change(dev->pipe, dev);
   // determine scale according to new dimensions
-  DT_CTL_GET_GLOBAL(zoom, dev_zoom);
-  DT_CTL_GET_GLOBAL(zoom_x, dev_zoom_x);
-  DT_CTL_GET_GLOBAL(zoom_y, dev_zoom_y);
+  scale = _dev_image_roi(dev, &x, &y, &dev->capwidth, &dev->capheight);
 
-  scale = dt_dev_get_zoom_scale(dev, zoom, 1.0f, 0);
-  dev->capwidth  = MIN(MIN(dev->width,  dev->pipe->processed_width *scale), darktable.thumbnail_width);
-  dev->capheight = MIN(MIN(dev->height, dev->pipe->processed_height*scale), darktable.thumbnail_height);
-  x = MAX(0, scale*dev->pipe->processed_width *(.5+zoom_x)-dev->capwidth/2);
-  y = MAX(0, scale*dev->pipe->processed_height*(.5+zoom_y)-dev->capheight/2);
+  const dt_iop_roi_t roi = { x, y, dev->capwidth, dev->capheight, scale };
+  if(dev->image_loading && dev->gui_attached)
+    _dev_prefetch_seed(dev, &roi);
 
   dt_get_times(&start);
-  if(dt_dev_pixelpipe_process(dev->pipe, dev, x, y, dev->capwidth, dev->capheight, scale))
+  if((!dev->image_loading && dev->gui_attached && _dev_pan(dev, &roi)) ||
+     dt_dev_pixelpipe_process(dev->pipe, dev, x, y, dev->capwidth, dev->capheight, scale))
   {
     // interrupted because image changed?
     if(dev->image_force_reload)
@@ -369,6 +530,195 @@ restart:
   dt_pthread_mutex_unlock(&dev->pipe_mutex);
 }
 
+void dt_dev_prefetch(dt_develop_t *dev, const int32_t next, const int32_t prev)
+{
+  if(!dev->gui_attached) return;
+  const int enabled = dt_conf_get_int64("darkroom_prefetch_memory") > 0;
+  dt_pthread_mutex_lock(&dev->prefetch.mutex);
+  dev->prefetch.generation++;
+  dev->prefetch.imgid[0] = enabled ? next : -1;
+  dev->prefetch.imgid[1] = enabled ? prev : -1;
+  if(dev->prefetch.running) dev->prefetch.running->gui_leaving = 1;
+  // results for images which are not around the current one anymore are of no use:
+  for(int k=0; k<2; k++)
+  {
+    const int32_t imgid = dev->prefetch.done[k].imgid;
+    if(imgid == dev->image_storage.id || imgid == dev->prefetch.imgid[0] || imgid == dev->prefetch.imgid[1]) continue;
+    free(dev->prefetch.done[k].buf);
+    dev->prefetch.done[k].buf = NULL;
+    dev->prefetch.done[k].imgid = -1;
+  }
+  const int wanted = dev->prefetch.imgid[0] >= 0 || dev->prefetch.imgid[1] >= 0;
+  dt_pthread_mutex_unlock(&dev->prefetch.mutex);
+  if(!wanted) return;
+
+  dt_job_t job;
+  dt_dev_prefetch_job_init(&job, dev);
+  int err = dt_control_add_job_res(darktable.control, &job, DT_CTL_WORKER_6);
+  if(err) fprintf(stderr, "[dev_prefetch] job queue exceeded!\n");
+}
+
+// we are low priority: wait until the darkroom is done with the current image.
+// returns non-zero if the user moved on in the meantime.
+static int _dev_prefetch_wait(dt_develop_t *dev, const uint32_t generation)
+{
+  while(dt_control_running())
+  {
+    dt_pthread_mutex_lock(&dev->prefetch.mutex);
+    const int abandoned = dev->prefetch.generation != generation;
+    dt_pthread_mutex_unlock(&dev->prefetch.mutex);
+    if(abandoned) return 1;
+    if(!dev->image_dirty && !dev->preview_dirty && !dev->image_loading && !dev->preview_loading) return 0;
+    g_usleep(50000);
+  }
+  return 1;
+}
+
+// loads and develops one neighbour the way dt_dev_process_image_job() would show it.
+// returns non-zero if abandoned.
+static int _dev_prefetch_image(dt_develop_t *dev, const int32_t imgid, const uint32_t generation, int64_t *budget)
+{
+  // what will this cost: the full buffer in the mipmap cache, the pipe cache and the result.
+  const dt_image_t *img = dt_image_cache_read_get(darktable.image_cache, imgid);
+  if(!img) return 0;
+  size_t pixels = (size_t)img->width*img->height;
+  const size_t bpp = img->bpp ? img->bpp : ((img->flags & DT_IMAGE_RAW) ? sizeof(uint16_t) : 4*sizeof(float));
+  dt_image_cache_read_release(darktable.image_cache, img);
+  // never loaded before, most likely it's from the same camera:
+  if(!pixels) pixels = (size_t)dev->image_storage.width*dev->image_storage.height;
+  const size_t bufsize = (size_t)4*sizeof(float)*darktable.thumbnail_width*darktable.thumbnail_height;
+  const int64_t cost = pixels*bpp + 2*bufsize + bufsize/4;
+  if(cost > *budget)
+  {
+    dt_print(DT_DEBUG_DEV, "[dev_prefetch] image %d does not fit into the memory budget\n", imgid);
+    return 0;
+  }
+  *budget -= cost;
+
+  if(_dev_prefetch_wait(dev, generation)) return 1;
+
+  dt_times_t start;
+  dt_get_times(&start);
+  dt_mipmap_buffer_t buf;
+  dt_mipmap_cache_read_get(darktable.mipmap_cache, &buf, imgid, DT_MIPMAP_FULL, DT_MIPMAP_BLOCKING);
+  if(!buf.buf)
+  {
+    dt_mipmap_cache_read_release(darktable.mipmap_cache, &buf);
+    return 0;
+  }
+  // the preview pipe starts from mip f, which is cheap to create while the full buffer is there:
+  dt_mipmap_buffer_t fbuf;
+  dt_mipmap_cache_read_get(darktable.mipmap_cache, &fbuf, imgid, DT_MIPMAP_F, DT_MIPMAP_BLOCKING);
+  dt_mipmap_cache_read_release(darktable.mipmap_cache, &fbuf);
+
+  int abandoned = 0, done = 0;
+  dt_develop_t *tmp = (dt_develop_t *)malloc(sizeof(dt_develop_t));
+  dt_dev_init(tmp, 0);
+  dt_dev_load_image(tmp, imgid);
+  // same window as the darkroom, so the roi comes out the same:
+  tmp->width  = dev->width;
+  tmp->height = dev->height;
+  tmp->pipe = (dt_dev_pixelpipe_t *)malloc(sizeof(dt_dev_pixelpipe_t));
+  if(!dt_dev_pixelpipe_init_cached(tmp->pipe, bufsize, 2))
+  {
+    free(tmp->pipe);
+    tmp->pipe = NULL;
+    goto cleanup;
+  }
+  tmp->pipe->type = DT_DEV_PIXELPIPE_FULL;
+  dt_dev_pixelpipe_set_input(tmp->pipe, tmp, (float *)buf.buf, buf.width, buf.height, 1.0);
+  dt_dev_pixelpipe_create_nodes(tmp->pipe, tmp);
+  dt_dev_pixelpipe_synch_all(tmp->pipe, tmp);
+  dt_dev_pixelpipe_get_dimensions(tmp->pipe, tmp, tmp->pipe->iwidth, tmp->pipe->iheight,
+                                  &tmp->pipe->processed_width, &tmp->pipe->processed_height);
+
+  int32_t x, y, wd, ht;
+  const float scale = _dev_image_roi(tmp, &x, &y, &wd, &ht);
+  if(wd <= 0 || ht <= 0) goto cleanup;
+  const dt_iop_roi_t roi = { x, y, wd, ht, scale };
+  const uint64_t hash = dt_dev_pixelpipe_cache_hash(imgid, &roi, tmp->pipe, g_list_length(tmp->iop));
+
+  dt_pthread_mutex_lock(&dev->prefetch.mutex);
+  abandoned = dev->prefetch.generation != generation;
+  // maybe we have it already, when going back and forth:
+  for(int k=0; k<2; k++)
+    if(dev->prefetch.done[k].buf && dev->prefetch.done[k].imgid == imgid && dev->prefetch.done[k].hash == hash &&
+       dev->prefetch.done[k].width == wd && dev->prefetch.done[k].height == ht) done = 1;
+  if(!abandoned && !done) dev->prefetch.running = tmp;
+  dt_pthread_mutex_unlock(&dev->prefetch.mutex);
+  if(abandoned || done) goto cleanup;
+
+  while(dt_dev_pixelpipe_process(tmp->pipe, tmp, x, y, wd, ht, scale))
+  {
+    // failed for good, or interrupted on purpose?
+    dt_pthread_mutex_lock(&dev->prefetch.mutex);
+    const int paused = tmp->gui_leaving;
+    dt_pthread_mutex_unlock(&dev->prefetch.mutex);
+    if(!paused) goto cleanup;
+    // the darkroom needed the cpu, or the user moved on.
+    if(_dev_prefetch_wait(dev, generation))
+    {
+      abandoned = 1;
+      goto cleanup;
+    }
+    dt_pthread_mutex_lock(&dev->prefetch.mutex);
+    tmp->gui_leaving = 0;
+    dt_pthread_mutex_unlock(&dev->prefetch.mutex);
+  }
+
+  dt_pthread_mutex_lock(&dev->prefetch.mutex);
+  if(dev->prefetch.generation == generation)
+  {
+    // replace the result for the same image, or one nobody is interested in anymore:
+    int slot = -1;
+    for(int k=0; k<2 && slot<0; k++)
+      if(dev->prefetch.done[k].imgid == imgid) slot = k;
+    for(int k=0; k<2 && slot<0; k++)
+      if(dev->prefetch.done[k].imgid != dev->prefetch.imgid[0] && dev->prefetch.done[k].imgid != dev->prefetch.imgid[1]) slot = k;
+    if(slot < 0) slot = 0;
+    free(dev->prefetch.done[slot].buf);
+    dev->prefetch.done[slot].buf = (uint8_t *)malloc((size_t)4*wd*ht);
+    if(dev->prefetch.done[slot].buf)
+    {
+      memcpy(dev->prefetch.done[slot].buf, tmp->pipe->backbuf, (size_t)4*wd*ht);
+      dev->prefetch.done[slot].imgid = imgid;
+      dev->prefetch.done[slot].hash = hash;
+      dev->prefetch.done[slot].width = wd;
+      dev->prefetch.done[slot].height = ht;
+    }
+    else dev->prefetch.done[slot].imgid = -1;
+  }
+  dt_pthread_mutex_unlock(&dev->prefetch.mutex);
+  dt_show_times(&start, "[dev_prefetch]", "to develop image %d in advance", imgid);
+
+cleanup:
+  dt_pthread_mutex_lock(&dev->prefetch.mutex);
+  if(dev->prefetch.running == tmp) dev->prefetch.running = NULL;
+  dt_pthread_mutex_unlock(&dev->prefetch.mutex);
+  dt_dev_cleanup(tmp);
+  free(tmp);
+  dt_mipmap_cache_read_release(darktable.mipmap_cache, &buf);
+  return abandoned;
+}
+
+void dt_dev_prefetch_job(dt_develop_t *dev)
+{
+  dt_pthread_mutex_lock(&dev->prefetch.mutex);
+  const uint32_t generation = dev->prefetch.generation;
+  const int32_t imgid[2] = { dev->prefetch.imgid[0], dev->prefetch.imgid[1] };
+  dt_pthread_mutex_unlock(&dev->prefetch.mutex);
+
+  // the full buffers stay in the mipmap cache, which only holds a few of them. never push out
+  // the one the darkroom is working on, so on small setups only the next image is prepared.
+  const int slots = MIN(2, darktable.mipmap_cache->mip[DT_MIPMAP_FULL].cache.cost_quota - 1);
+  int64_t budget = dt_conf_get_int64("darkroom_prefetch_memory");
+  for(int k=0; k<slots; k++)
+  {
+    if(imgid[k] < 0) continue;
+    if(_dev_prefetch_image(dev, imgid[k], generation, &budget)) break;
+  }
+}
+
 void dt_dev_reload_image(dt_develop_t *dev, const uint32_t imgid)
 {
   const dt_image_t *image = dt_image_cache_read_get(darktable.image_cache, imgid);
@@ -385,7 +735,8 @@ float dt_dev_get_zoom_scale(dt_develop_t *dev, dt_dev_zoom_t zoom, int closeup_f
 
   const float w = preview ? dev->preview_pipe->processed_width  : dev->pipe->processed_width;
   const float h = preview ? dev->preview_pipe->processed_height : dev->pipe->processed_height;
-  const float ps = dev->pipe->backbuf_width ?
+  // only touch the preview pipe if asked for it, background develops don't have one:
+  const float ps = !preview ? 1.0f : dev->pipe->backbuf_width ?
                    dev->pipe->processed_width/(float)dev->preview_pipe->processed_width :
                    dev->preview_pipe->iscale / dev->preview_downsampling;
 
@@ -419,6 +770,17 @@ void dt_dev_load_image(dt_develop_t *dev, const uint32_t imgid)
     dev->pipe->processed_width  = 0;
     dev->pipe->processed_height = 0;
   }
+  if(dev->gui_attached)
+  {
+    // pick up a changed cache budget, the cache shrinks to it lazily:
+    const size_t memory = MAX(0, dt_conf_get_int64("pixelpipe_cache_memory"));
+    dt_pthread_mutex_lock(&dev->pipe->busy_mutex);
+    dt_dev_pixelpipe_cache_set_memory(&dev->pipe->cache, memory);
+    dt_pthread_mutex_unlock(&dev->pipe->busy_mutex);
+    dt_pthread_mutex_lock(&dev->preview_pipe->busy_mutex);
+    dt_dev_pixelpipe_cache_set_memory(&dev->preview_pipe->cache, memory);
+    dt_pthread_mutex_unlock(&dev->preview_pipe->busy_mutex);
+  }
   dev->image_loading = 1;
   dev->preview_loading = 1;
   dev->first_load = 1;
@@ -1471,6 +1833,33 @@ int dt_dev_distort_backtransform_plus(dt_develop_t *dev, dt_dev_pixelpipe_t *pip
   return 1;
 }
 
+uint64_t dt_dev_distort_hash_plus(dt_develop_t *dev, dt_dev_pixelpipe_t *pipe, int pmin, int pmax)
+{
+  uint64_t hash = 5381;
+  GList *modules = g_list_first(dev->iop);
+  GList *pieces = g_list_first(pipe->nodes);
+  while (modules)
+  {
+    if (!pieces) return 0;
+    dt_iop_module_t *module = (dt_iop_module_t *) (modules->data);
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *) (pieces->data);
+    if ((module->enabled || piece->enabled) && module->priority <= pmax && module->priority >= pmin
+        && dt_iop_is_distorting(module))
+    {
+      // the params (piece->hash), and the buffer sizes the transforms scale with
+      const int32_t geom[6] = { module->priority, piece->enabled,
+                                piece->buf_in.width, piece->buf_in.height, piece->buf_out.width, piece->buf_out.height };
+      const char *str = (const char *)geom;
+      for(int i=0; i<sizeof(geom); i++) hash = ((hash << 5) + hash) ^ str[i];
+      str = (const char *)&piece->hash;
+      for(int i=0; i<sizeof(uint64_t); i++) hash = ((hash << 5) + hash) ^ str[i];
+    }
+    modules = g_list_next(modules);
+    pieces = g_list_next(pieces);
+  }
+  return hash;
+}
+
 dt_dev_pixelpipe_iop_t *dt_dev_distort_get_iop_pipe(dt_develop_t *dev, struct dt_dev_pixelpipe_t *pipe, struct dt_iop_module_t *module)
 {
   GList *pieces = g_list_last(pipe->nodes);
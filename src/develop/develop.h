@@ -180,6 +180,24 @@ typedef struct dt_develop_t
     float upper;
   }
   overexposed;
+
+  // speculative processing of the filmstrip neighbours in the background, see dt_dev_prefetch().
+  struct
+  {
+    dt_pthread_mutex_t mutex;
+    uint32_t generation;            // bumped on every navigation, abandons older rounds
+    int32_t imgid[2];               // next and previous image, -1 if none
+    struct dt_develop_t *running;   // develop of the neighbour being processed right now
+    struct
+    {
+      int32_t imgid;
+      uint64_t hash;                // pixelpipe cache hash of the complete stack and roi
+      int32_t width, height;
+      uint8_t *buf;                 // 8-bit output of the full pipe
+    }
+    done[2];
+  }
+  prefetch;
 }
 dt_develop_t;
 
@@ -191,6 +209,10 @@ void dt_dev_process_preview_job(dt_develop_t *dev);
 // launch jobs above
 void dt_dev_process_image(dt_develop_t *dev);
 void dt_dev_process_preview(dt_develop_t *dev);
+/** loads the full buffers of the given neighbours of the current image and runs the full pipe on them
+  * at the current zoom, while the darkroom is idle. pass -1 to abandon. */
+void dt_dev_prefetch(dt_develop_t *dev, const int32_t next, const int32_t prev);
+void dt_dev_prefetch_job(dt_develop_t *dev);
 
 void dt_dev_load_image(dt_develop_t *dev, const uint32_t imgid);
 void dt_dev_reload_image(dt_develop_t *dev, const uint32_t imgid);
@@ -289,6 +311,8 @@ int dt_dev_distort_transform_plus(dt_develop_t *dev, struct dt_dev_pixelpipe_t *
 int dt_dev_distort_backtransform_plus(dt_develop_t *dev, struct dt_dev_pixelpipe_t *pipe, int pmin, int pmax, float *points, int points_count);
 /** get the iop_pixelpipe instance corresponding to the iop in the given pipe */
 struct dt_dev_pixelpipe_iop_t *dt_dev_distort_get_iop_pipe(dt_develop_t *dev, struct dt_dev_pixelpipe_t *pipe, struct dt_iop_module_t *module);
+/** hash of everything the transforms between pmin and pmax depend on, changes whenever their result would */
+uint64_t dt_dev_distort_hash_plus(dt_develop_t *dev, struct dt_dev_pixelpipe_t *pipe, int pmin, int pmax);
 
 /*
  * distort functions
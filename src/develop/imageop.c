@@ -1231,6 +1231,11 @@ gboolean dt_iop_is_hidden(dt_iop_module_t *module)
   return is_hidden;
 }
 
+gboolean dt_iop_is_distorting(dt_iop_module_t *module)
+{
+  return module->distort_transform != default_distort_transform;
+}
+
 static void _iop_gui_update_header(dt_iop_module_t *module)
 {
   /* get the enable button spacer and button */
@@ -1612,8 +1617,9 @@ void dt_iop_commit_params(dt_iop_module_t *module, dt_iop_params_t *params, dt_d
     /* and we add masks */
     dt_masks_group_get_hash_buffer(grp,str+pos);
 
-    // assume process_cl is ready, commit_params can overwrite this.
+    // assume process_cl is ready and the module keeps what its flags say, commit_params can overwrite this.
     if(module->process_cl) piece->process_cl_ready = 1;
+    piece->roi_invariant = (module->flags() & IOP_FLAGS_ROI_INVARIANT) != 0;
     module->commit_params(module, params, pipe, piece);
     for(int i=0; i<length; i++) hash = ((hash << 5) + hash) ^ str[i];
     piece->hash = hash;
@@ -2130,6 +2136,20 @@ int dt_iop_breakpoint(struct dt_develop_t *dev, struct dt_dev_pixelpipe_t *pipe)
   return 0;
 }
 
+int dt_iop_cancelled(const dt_dev_pixelpipe_iop_t *piece)
+{
+  // the same conditions as dt_iop_breakpoint() and the pipe, but without yielding.
+  // all of these stay set until the pipe is restarted.
+  const dt_dev_pixelpipe_t *pipe = piece->pipe;
+  const dt_develop_t *dev = piece->module->dev;
+  if(pipe->shutdown || dev->gui_leaving) return 1;
+  if(pipe == dev->pipe && dev->image_force_reload) return 1;
+  if(pipe == dev->preview_pipe && dev->preview_loading) return 1;
+  // the preview pipe always processes the whole image, zooming doesn't matter there:
+  const int changed = pipe == dev->preview_pipe ? (pipe->changed & ~DT_DEV_PIPE_ZOOMED) : pipe->changed;
+  return changed != DT_DEV_PIPE_UNCHANGED;
+}
+
 void dt_iop_nap(int32_t usec)
 {
   if(usec <= 0) return;
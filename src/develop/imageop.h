@@ -64,6 +64,8 @@ struct dt_develop_tiling_t;
 #define IOP_FLAGS_PREVIEW_NON_OPENCL  256                       // Preview pixelpipe of this module must not run on GPU but always on CPU
 #define IOP_FLAGS_NO_HISTORY_STACK    512                       // This iop will never show up in the history stack
 #define IOP_FLAGS_NO_MASKS  1024    // The module doesn't support masks (used with SUPPORT_BLENDING)
+#define IOP_FLAGS_POINT_TO_POINT     2048                      // Output pixels only depend on the input pixel at the same place, may run fused with its neighbours
+#define IOP_FLAGS_ROI_INVARIANT      4096                      // At 1:1, output pixels only depend on the input within the tiling overlap around them, not on where the roi is cut
 /** status of a module*/
 typedef enum dt_iop_module_state_t
 {
@@ -343,6 +345,8 @@ void dt_iop_cleanup_module(dt_iop_module_t *module);
 void dt_iop_init_pipe(struct dt_iop_module_t *module, struct dt_dev_pixelpipe_t *pipe, struct dt_dev_pixelpipe_iop_t *piece);
 /** checks if iop do have an ui */
 gboolean dt_iop_is_hidden(dt_iop_module_t *module);
+/** returns true if the module moves pixels around, i.e. brings its own distort_transform(). */
+gboolean dt_iop_is_distorting(dt_iop_module_t *module);
 /** cleans up gui of module and of blendops */
 void dt_iop_gui_cleanup_module(dt_iop_module_t *module);
 /** updates the gui params and the enabled switch. */
@@ -376,6 +380,10 @@ int  dt_iop_load_preset_interpolated_iso(dt_iop_module_t *module, const dt_image
 
 /** let plugins have breakpoints: */
 int dt_iop_breakpoint(struct dt_develop_t *dev, struct dt_dev_pixelpipe_t *pipe);
+/** cheap checkpoint for long loops in process() and for the tiling driver: non-zero if this run of the
+ *  pipe became obsolete. the pipe starts over then and throws away whatever the module leaves in its output,
+ *  so it can just return. */
+int dt_iop_cancelled(const struct dt_dev_pixelpipe_iop_t *piece);
 
 /** allow plugins to relinquish CPU and go to sleep for some time */
 void dt_iop_nap(int32_t usec);
@@ -290,7 +290,181 @@ int dt_masks_get_source_area(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *pi
   return 0;
 }
 
-int dt_masks_get_mask(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, dt_masks_form_t *form, float **buffer, int *width, int *height, int *posx, int *posy)
+/*
+ * rasterized forms are kept in a cache shared by all modules and pipes, so the
+ * same drawn mask is only computed once for the preview and the full pipe, and
+ * a group where only one form changed only re-rasterizes that form.
+ * the key covers the form itself (for groups: all members, their states and
+ * opacities), the region of interest and everything in the pipe the
+ * back-transform of the form depends on.
+ */
+typedef struct dt_masks_cache_entry_t
+{
+  uint64_t key;
+  float *buffer;
+  size_t size;
+  int width, height, posx, posy;
+  uint64_t used;
+}
+dt_masks_cache_entry_t;
+
+static struct
+{
+  dt_pthread_mutex_t lock;
+  GHashTable *entries;
+  size_t memory, max_memory;
+  uint64_t stamp, hits, misses;
+}
+_masks_cache = { .entries = NULL };
+
+static void _masks_cache_entry_free(gpointer data)
+{
+  dt_masks_cache_entry_t *entry = (dt_masks_cache_entry_t *)data;
+  free(entry->buffer);
+  free(entry);
+}
+
+void dt_masks_cache_init()
+{
+  dt_pthread_mutex_init(&_masks_cache.lock, NULL);
+  _masks_cache.entries = g_hash_table_new_full(g_int64_hash, g_int64_equal, NULL, _masks_cache_entry_free);
+  _masks_cache.memory = 0;
+  _masks_cache.max_memory = MAX(0, dt_conf_get_int64("masks_cache_memory"));
+  _masks_cache.stamp = _masks_cache.hits = _masks_cache.misses = 0;
+}
+
+void dt_masks_cache_cleanup()
+{
+  if(!_masks_cache.entries) return;
+  dt_print(DT_DEBUG_MASKS, "[masks] cache: %"PRIu64" hits, %"PRIu64" misses\n", _masks_cache.hits, _masks_cache.misses);
+  g_hash_table_destroy(_masks_cache.entries);
+  _masks_cache.entries = NULL;
+  dt_pthread_mutex_destroy(&_masks_cache.lock);
+}
+
+static uint64_t _masks_cache_hash(uint64_t hash, const void *data, const size_t size)
+{
+  const char *str = (const char *)data;
+  for(int i=0; i<size; i++) hash = ((hash << 5) + hash) ^ str[i];
+  return hash;
+}
+
+static uint64_t _masks_cache_form_hash(dt_develop_t *dev, dt_masks_form_t *form, uint64_t hash)
+{
+  if (form->type & DT_MASKS_GROUP)
+  {
+    // dt_masks_group_get_hash_buffer() looks members up in darktable.develop, we need them from dev:
+    hash = _masks_cache_hash(hash, &form->type, sizeof(dt_masks_type_t));
+    hash = _masks_cache_hash(hash, &form->formid, sizeof(int));
+    GList *fpts = g_list_first(form->points);
+    while(fpts)
+    {
+      dt_masks_point_group_t *fpt = (dt_masks_point_group_t *) fpts->data;
+      dt_masks_form_t *sel = dt_masks_get_from_id(dev,fpt->formid);
+      if (sel)
+      {
+        hash = _masks_cache_hash(hash, &fpt->state, sizeof(int));
+        hash = _masks_cache_hash(hash, &fpt->opacity, sizeof(float));
+        hash = _masks_cache_form_hash(dev, sel, hash);
+      }
+      fpts = g_list_next(fpts);
+    }
+    return hash;
+  }
+  const int length = dt_masks_group_get_hash_buffer_length(form);
+  char *str = malloc(length);
+  dt_masks_group_get_hash_buffer(form, str);
+  hash = _masks_cache_hash(hash, str, length);
+  free(str);
+  return hash;
+}
+
+static uint64_t _masks_cache_key(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, dt_masks_form_t *form, const dt_iop_roi_t *roi)
+{
+  uint64_t hash = _masks_cache_form_hash(module->dev, form, 5381);
+  const int32_t pipe[3] = { piece->pipe->image.id, piece->pipe->iwidth, piece->pipe->iheight };
+  hash = _masks_cache_hash(hash, pipe, sizeof(pipe));
+  // whole forms (dt_masks_get_mask) depend on the input scale, the others on the roi:
+  if(roi) hash = _masks_cache_hash(hash, roi, sizeof(dt_iop_roi_t));
+  else hash = _masks_cache_hash(hash, &piece->iscale, sizeof(float));
+  const uint64_t distort = dt_dev_distort_hash_plus(module->dev, piece->pipe, 0, module->priority);
+  return _masks_cache_hash(hash, &distort, sizeof(uint64_t));
+}
+
+/** hands out a copy of the cached mask, callers own and modify their buffers. */
+static int _masks_cache_get(const uint64_t key, float **buffer, int *width, int *height, int *posx, int *posy)
+{
+  if(!_masks_cache.entries || !_masks_cache.max_memory) return 0;
+  int found = 0;
+  dt_pthread_mutex_lock(&_masks_cache.lock);
+  dt_masks_cache_entry_t *entry = (dt_masks_cache_entry_t *)g_hash_table_lookup(_masks_cache.entries, &key);
+  if(entry && (*buffer = malloc(entry->size)))
+  {
+    memcpy(*buffer, entry->buffer, entry->size);
+    if(width) *width = entry->width;
+    if(height) *height = entry->height;
+    if(posx) *posx = entry->posx;
+    if(posy) *posy = entry->posy;
+    entry->used = ++_masks_cache.stamp;
+    _masks_cache.hits++;
+    found = 1;
+  }
+  else _masks_cache.misses++;
+  dt_pthread_mutex_unlock(&_masks_cache.lock);
+  return found;
+}
+
+static void _masks_cache_put(const uint64_t key, const float *buffer, const int width, const int height, const int posx, const int posy)
+{
+  const size_t size = sizeof(float)*width*height;
+  if(!_masks_cache.entries || size == 0 || size > _masks_cache.max_memory) return;
+  dt_masks_cache_entry_t *entry = (dt_masks_cache_entry_t *)malloc(sizeof(dt_masks_cache_entry_t));
+  if(!entry) return;
+  entry->buffer = (float *)malloc(size);
+  if(!entry->buffer)
+  {
+    free(entry);
+    return;
+  }
+  memcpy(entry->buffer, buffer, size);
+  entry->key = key;
+  entry->size = size;
+  entry->width = width;
+  entry->height = height;
+  entry->posx = posx;
+  entry->posy = posy;
+
+  dt_pthread_mutex_lock(&_masks_cache.lock);
+  // another pipe might have been faster:
+  if(g_hash_table_lookup(_masks_cache.entries, &key))
+  {
+    dt_pthread_mutex_unlock(&_masks_cache.lock);
+    _masks_cache_entry_free(entry);
+    return;
+  }
+  // drop the least recently used masks until the new one fits. there are only a few of them:
+  while(_masks_cache.memory + size > _masks_cache.max_memory)
+  {
+    GHashTableIter it;
+    gpointer value;
+    dt_masks_cache_entry_t *lru = NULL;
+    g_hash_table_iter_init(&it, _masks_cache.entries);
+    while(g_hash_table_iter_next(&it, NULL, &value))
+    {
+      dt_masks_cache_entry_t *e = (dt_masks_cache_entry_t *)value;
+      if(!lru || e->used < lru->used) lru = e;
+    }
+    if(!lru) break;
+    _masks_cache.memory -= lru->size;
+    g_hash_table_remove(_masks_cache.entries, &lru->key);
+  }
+  entry->used = ++_masks_cache.stamp;
+  _masks_cache.memory += size;
+  g_hash_table_insert(_masks_cache.entries, &entry->key, entry);
+  dt_pthread_mutex_unlock(&_masks_cache.lock);
+}
+
+static int _masks_get_mask(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, dt_masks_form_t *form, float **buffer, int *width, int *height, int *posx, int *posy)
 {
   if (form->type & DT_MASKS_CIRCLE)
   {
@@ -319,7 +493,7 @@ int dt_masks_get_mask(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, dt
   return 0;
 }
 
-int dt_masks_get_mask_roi(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, dt_masks_form_t *form, const dt_iop_roi_t *roi, float **buffer)
+static int _masks_get_mask_roi(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, dt_masks_form_t *form, const dt_iop_roi_t *roi, float **buffer)
 {
   if (form->type & DT_MASKS_CIRCLE)
   {
@@ -348,6 +522,24 @@ int dt_masks_get_mask_roi(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece
   return 0;
 }
 
+int dt_masks_get_mask(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, dt_masks_form_t *form, float **buffer, int *width, int *height, int *posx, int *posy)
+{
+  const uint64_t key = _masks_cache_key(module,piece,form,NULL);
+  if(_masks_cache_get(key,buffer,width,height,posx,posy)) return 1;
+  const int ok = _masks_get_mask(module,piece,form,buffer,width,height,posx,posy);
+  if(ok) _masks_cache_put(key,*buffer,*width,*height,*posx,*posy);
+  return ok;
+}
+
+int dt_masks_get_mask_roi(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, dt_masks_form_t *form, const dt_iop_roi_t *roi, float **buffer)
+{
+  const uint64_t key = _masks_cache_key(module,piece,form,roi);
+  if(_masks_cache_get(key,buffer,NULL,NULL,NULL,NULL)) return 1;
+  const int ok = _masks_get_mask_roi(module,piece,form,roi,buffer);
+  if(ok) _masks_cache_put(key,*buffer,roi->width,roi->height,roi->x,roi->y);
+  return ok;
+}
+
 dt_masks_form_t *dt_masks_create(dt_masks_type_t type)
 {
   dt_masks_form_t *form = (dt_masks_form_t *)malloc(sizeof(dt_masks_form_t));
@@ -20,6 +20,8 @@
 #include "develop/pixelpipe_hb.h"
 #include "libs/lib.h"
 #include <stdlib.h>
+#include <float.h>
+#include <math.h>
 
 
 // TODO: make cache global (needs to be thread safe then)
@@ -33,11 +35,13 @@
 
 int dt_dev_pixelpipe_cache_init(dt_dev_pixelpipe_cache_t *cache, int entries, int size)
 {
-  cache->entries = entries;
+  cache->entries = cache->min_entries = cache->max_entries = entries;
+  cache->memory = cache->max_memory = 0;
   cache->data = (void **)malloc(sizeof(void *)*entries);
   cache->size = (size_t *)malloc(sizeof(size_t)*entries);
   cache->hash = (uint64_t *)malloc(sizeof(uint64_t)*entries);
-  cache->used = (int32_t *)malloc(sizeof(int32_t)*entries);
+  cache->used = (int64_t *)malloc(sizeof(int64_t)*entries);
+  cache->cost = (float *)malloc(sizeof(float)*entries);
   memset(cache->data,0,sizeof(void *)*entries);
   for(int k=0; k<entries; k++)
   {
@@ -45,12 +49,20 @@ int dt_dev_pixelpipe_cache_init(dt_dev_pixelpipe_cache_t *cache, int entries, in
     if(!cache->data[k])
       goto alloc_memory_fail;
     cache->size[k] = size;
+    cache->memory += size;
 #ifdef _DEBUG
     memset(cache->data[k], 0x5d, size);
 #endif
     cache->hash[k] = -1;
     cache->used[k] = 0;
+    cache->cost[k] = 0.0f;
   }
+  cache->lookup = g_hash_table_new(g_int64_hash, g_int64_equal);
+  cache->stats = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, free);
+  cache->last = -1;
+  cache->pinned = NULL;
+  cache->pinned_mutex = NULL;
+  cache->tick = 0;
   cache->queries = cache->misses = 0;
   return 1;
 
@@ -65,6 +77,7 @@ alloc_memory_fail:
   free(cache->size);
   free(cache->hash);
   free(cache->used);
+  free(cache->cost);
 
   return 0;
 
@@ -77,6 +90,43 @@ void dt_dev_pixelpipe_cache_cleanup(dt_dev_pixelpipe_cache_t *cache)
   free(cache->hash);
   free(cache->used);
   free(cache->size);
+  free(cache->cost);
+  g_hash_table_destroy(cache->lookup);
+  g_hash_table_destroy(cache->stats);
+}
+
+void dt_dev_pixelpipe_cache_set_memory(dt_dev_pixelpipe_cache_t *cache, size_t max_memory)
+{
+  const int32_t max_entries = MAX(cache->entries, DT_DEV_PIXELPIPE_CACHE_MAX_ENTRIES);
+  if(max_entries > cache->max_entries)
+  {
+    // the lookup table points into the hash array, so rebuild it after moving that around.
+    g_hash_table_remove_all(cache->lookup);
+    cache->data = (void **)realloc(cache->data, sizeof(void *)*max_entries);
+    cache->size = (size_t *)realloc(cache->size, sizeof(size_t)*max_entries);
+    cache->hash = (uint64_t *)realloc(cache->hash, sizeof(uint64_t)*max_entries);
+    cache->used = (int64_t *)realloc(cache->used, sizeof(int64_t)*max_entries);
+    cache->cost = (float *)realloc(cache->cost, sizeof(float)*max_entries);
+    for(int k=cache->entries; k<max_entries; k++)
+    {
+      cache->data[k] = NULL;
+      cache->size[k] = 0;
+      cache->hash[k] = -1;
+      cache->used[k] = 0;
+      cache->cost[k] = 0.0f;
+    }
+    for(int k=0; k<cache->entries; k++)
+      if(cache->hash[k] != (uint64_t)-1)
+        g_hash_table_insert(cache->lookup, cache->hash + k, GINT_TO_POINTER(k+1));
+    cache->max_entries = max_entries;
+  }
+  cache->max_memory = max_memory;
+}
+
+void dt_dev_pixelpipe_cache_pin(dt_dev_pixelpipe_cache_t *cache, void **buf, dt_pthread_mutex_t *mutex)
+{
+  cache->pinned = buf;
+  cache->pinned_mutex = mutex;
 }
 
 uint64_t dt_dev_pixelpipe_cache_hash(int imgid, const dt_iop_roi_t *roi, dt_dev_pixelpipe_t *pipe, int module)
@@ -114,11 +164,112 @@ uint64_t dt_dev_pixelpipe_cache_hash(int imgid, const dt_iop_roi_t *roi, dt_dev_
   return hash;
 }
 
+static inline int _cache_find(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash)
+{
+  return GPOINTER_TO_INT(g_hash_table_lookup(cache->lookup, &hash)) - 1;
+}
+
+static inline void _cache_set_hash(dt_dev_pixelpipe_cache_t *cache, const int k, const uint64_t hash)
+{
+  if(cache->hash[k] != (uint64_t)-1) g_hash_table_remove(cache->lookup, cache->hash + k);
+  cache->hash[k] = hash;
+  if(hash != (uint64_t)-1) g_hash_table_insert(cache->lookup, cache->hash + k, GINT_TO_POINTER(k+1));
+}
+
+// the larger, the more likely this line is to be evicted. invalid lines go first,
+// then old ones. a line which took long to compute survives proportionally longer
+// (logarithmically, so a one second module is kept about ten times as long as a trivial one).
+static inline float _cache_score(const dt_dev_pixelpipe_cache_t *cache, const int k)
+{
+  if(cache->hash[k] == (uint64_t)-1) return FLT_MAX;
+  const float age = cache->tick - cache->used[k];
+  return age / (1.0f + log2f(1.0f + 1000.0f*cache->cost[k]));
+}
+
+// needs the pinned_mutex, if there is one.
+static int _cache_victim(const dt_dev_pixelpipe_cache_t *cache, const int keep)
+{
+  const void *pinned = cache->pinned ? *cache->pinned : NULL;
+  int victim = -1;
+  float max = -FLT_MAX;
+  for(int k=0; k<cache->entries; k++)
+  {
+    if(k == cache->last || k == keep || !cache->data[k] || cache->data[k] == pinned) continue;
+    const float score = _cache_score(cache, k);
+    if(score > max)
+    {
+      max = score;
+      victim = k;
+    }
+  }
+  return victim;
+}
+
+static void _cache_free_line(dt_dev_pixelpipe_cache_t *cache, const int k)
+{
+  _cache_set_hash(cache, k, -1);
+  free(cache->data[k]);
+  cache->memory -= cache->size[k];
+  cache->data[k] = NULL;
+  cache->size[k] = 0;
+  cache->cost[k] = 0.0f;
+}
+
+// free lines until we're back within the memory budget, but never the last line handed out, the pinned one or the one
+// we're about to return. needs the pinned_mutex, if there is one.
+static void _cache_shrink(dt_dev_pixelpipe_cache_t *cache, const int keep)
+{
+  if(!cache->max_memory) return;
+  int lines = 0;
+  for(int k=0; k<cache->entries; k++) if(cache->data[k]) lines++;
+  while(cache->memory > cache->max_memory && lines > cache->min_entries)
+  {
+    const int victim = _cache_victim(cache, keep);
+    // important lines (the backbuffer, the input of the focused module) are never dropped.
+    if(victim < 0 || _cache_score(cache, victim) < 0.0f) break;
+    _cache_free_line(cache, victim);
+    lines--;
+  }
+}
+
+// find a cache line to hold a new buffer of the given size. needs the pinned_mutex, if there is one.
+static int _cache_get_line(dt_dev_pixelpipe_cache_t *cache, const size_t size)
+{
+  const void *pinned = cache->pinned ? *cache->pinned : NULL;
+  // invalid lines which are large enough don't cost anything:
+  for(int k=0; k<cache->entries; k++)
+    if(k != cache->last && cache->data[k] && cache->data[k] != pinned && cache->hash[k] == (uint64_t)-1
+       && cache->size[k] >= size)
+      return k;
+
+  // grow if the budget allows:
+  if(cache->max_memory && cache->memory + size <= cache->max_memory)
+  {
+    for(int k=0; k<cache->max_entries; k++)
+    {
+      if(cache->data[k]) continue;
+      cache->entries = MAX(cache->entries, k+1);
+      return k;
+    }
+  }
+
+  // evict
+  const int victim = _cache_victim(cache, -1);
+  if(victim >= 0) return victim;
+
+  // everything else is in use, exceed the budget rather than overwriting the input of the current module.
+  for(int k=0; k<cache->max_entries; k++)
+  {
+    if(cache->data[k]) continue;
+    cache->entries = MAX(cache->entries, k+1);
+    return k;
+  }
+  return cache->last == 0 ? 1 : 0;
+}
+
 int dt_dev_pixelpipe_cache_available(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash)
 {
-  // search for hash in cache
-  for(int32_t k=0; k<cache->entries; k++) if(cache->hash[k] == hash) return 1;
-  return 0;
+  return _cache_find(cache, hash) >= 0;
 }
 
 int dt_dev_pixelpipe_cache_get_important(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash, const size_t size, void **data)
@@ -134,51 +285,75 @@ int dt_dev_pixelpipe_cache_get(dt_dev_pixelpipe_cache_t *cache, const uint64_t h
 int dt_dev_pixelpipe_cache_get_weighted(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash, const size_t size, void **data, int weight)
 {
   cache->queries ++;
+  cache->tick ++;
   *data = NULL;
-  int max_used = -1, max = 0;
-  size_t sz = 0;
-  for(int k=0; k<cache->entries; k++)
+
+  int k = _cache_find(cache, hash);
+  if(k >= 0 && cache->size[k] >= size)
   {
-    // search for hash in cache
-    if(cache->used[k] > max_used)
-    {
-      max_used = cache->used[k];
-      max = k;
-    }
-    cache->used[k]++; // age all entries
-    if(cache->hash[k] == hash)
-    {
-      *data = cache->data[k];
-      sz = cache->size[k];
-      cache->used[k] = weight; // this is the MRU entry
-    }
+    *data = cache->data[k];
+    cache->used[k] = cache->tick - weight; // this is the MRU entry
+    cache->last = k;
+    return 0;
   }
 
-  if(!*data || sz < size)
+  // the backbuf may be displayed by another thread while we free lines:
+  if(cache->pinned_mutex) dt_pthread_mutex_lock(cache->pinned_mutex);
+
+  // a line with this hash but too small a buffer will be replaced, it's useless anyways.
+  if(k >= 0 && cache->pinned && cache->data[k] == *cache->pinned)
   {
-    // kill LRU entry
-    // printf("[pixelpipe_cache_get] hash not found, returning slot %d/%d age %d\n", max, cache->entries, weight);
-    if(cache->size[max] < size)
-    {
-      free(cache->data[max]);
-      cache->data[max] = (void *)dt_alloc_align(16, size);
-      cache->size[max] = size;
-    }
-    *data = cache->data[max];
-    cache->hash[max] = hash;
-    cache->used[max] = weight;
-    cache->misses++;
-    return 1;
+    _cache_set_hash(cache, k, -1);
+    k = _cache_get_line(cache, size);
+  }
+  else if(k >= 0) _cache_set_hash(cache, k, -1);
+  else k = _cache_get_line(cache, size);
+  // printf("[pixelpipe_cache_get] hash not found, returning slot %d/%d age %d\n", k, cache->entries, weight);
+
+  if(cache->size[k] < size)
+  {
+    free(cache->data[k]);
+    cache->memory -= cache->size[k];
+    cache->data[k] = (void *)dt_alloc_align(16, size);
+    cache->size[k] = size;
+    cache->memory += size;
   }
-  else return 0;
+  *data = cache->data[k];
+  _cache_set_hash(cache, k, hash);
+  cache->used[k] = cache->tick - weight;
+  cache->cost[k] = 0.0f;
+  cache->last = k;
+  cache->misses++;
+  _cache_shrink(cache, k);
+  if(cache->pinned_mutex) dt_pthread_mutex_unlock(cache->pinned_mutex);
+  return 1;
 }
 
 void dt_dev_pixelpipe_cache_flush(dt_dev_pixelpipe_cache_t *cache)
 {
+  g_hash_table_remove_all(cache->lookup);
   for(int k=0; k<cache->entries; k++)
   {
     cache->hash[k] = -1;
     cache->used[k] = 0;
+    cache->cost[k] = 0.0f;
+  }
+  cache->last = -1;
+}
+
+void dt_dev_pixelpipe_cache_trim(dt_dev_pixelpipe_cache_t *cache, const size_t size)
+{
+  dt_dev_pixelpipe_cache_flush(cache);
+  for(int k=0; k<cache->entries; k++)
+  {
+    if(!cache->data[k] || cache->size[k] <= size) continue;
+    // keep the old line if we can't get a smaller one, lines must not go missing.
+    void *data = (void *)dt_alloc_align(16, size);
+    if(!data) continue;
+    free(cache->data[k]);
+    cache->data[k] = data;
+    cache->memory -= cache->size[k] - size;
+    cache->size[k] = size;
   }
 }
 
@@ -186,9 +361,9 @@ void dt_dev_pixelpipe_cache_reweight(dt_dev_pixelpipe_cache_t *cache, void *data
 {
   for(int k=0; k<cache->entries; k++)
   {
-    if(cache->data[k] == data)
+    if(cache->data[k] && cache->data[k] == data)
     {
-      cache->used[k] = -cache->entries;
+      cache->used[k] = cache->tick + cache->entries;
     }
   }
 }
@@ -197,21 +372,60 @@ void dt_dev_pixelpipe_cache_invalidate(dt_dev_pixelpipe_cache_t *cache, void *da
 {
   for(int k=0; k<cache->entries; k++)
   {
-    if(cache->data[k] == data)
+    if(cache->data[k] && cache->data[k] == data)
     {
-      cache->hash[k] = -1;
+      _cache_set_hash(cache, k, -1);
+    }
+  }
+}
+
+void dt_dev_pixelpipe_cache_set_cost(dt_dev_pixelpipe_cache_t *cache, void *data, const double cost)
+{
+  for(int k=0; k<cache->entries; k++)
+  {
+    if(cache->data[k] && cache->data[k] == data)
+    {
+      cache->cost[k] = cost;
     }
   }
 }
 
+void dt_dev_pixelpipe_cache_account(dt_dev_pixelpipe_cache_t *cache, const char *module, const int hit, const size_t size, const double time)
+{
+  dt_dev_pixelpipe_cache_stats_t *stats = (dt_dev_pixelpipe_cache_stats_t *)g_hash_table_lookup(cache->stats, module);
+  if(!stats)
+  {
+    stats = (dt_dev_pixelpipe_cache_stats_t *)calloc(1, sizeof(dt_dev_pixelpipe_cache_stats_t));
+    g_hash_table_insert(cache->stats, g_strdup(module), stats);
+  }
+  stats->queries++;
+  stats->bytes += size;
+  if(!hit)
+  {
+    stats->misses++;
+    stats->time += time;
+  }
+}
+
+static void _cache_print_stats(gpointer key, gpointer value, gpointer user_data)
+{
+  const dt_dev_pixelpipe_cache_stats_t *stats = (const dt_dev_pixelpipe_cache_stats_t *)value;
+  printf("pixelpipe cache module %-20s queries %6"PRIu64" misses %6"PRIu64" hit rate %.3f, %.2f MB, %.3f secs recomputing\n",
+         (const char *)key, stats->queries, stats->misses,
+         stats->queries ? (stats->queries - stats->misses)/(float)stats->queries : 0.0f,
+         stats->bytes/(1024.0*1024.0), stats->time);
+}
+
 void dt_dev_pixelpipe_cache_print(dt_dev_pixelpipe_cache_t *cache)
 {
   for(int k=0; k<cache->entries; k++)
   {
     printf("pixelpipe cacheline %d ", k);
-    printf("used %d by %"PRIu64"", cache->used[k], cache->hash[k]);
+    printf("age %"PRId64" by %"PRIu64" size %zu cost %.3f", cache->tick - cache->used[k], cache->hash[k], cache->size[k], cache->cost[k]);
     printf("\n");
   }
+  printf("cache memory %.2f/%.2f MB\n", cache->memory/(1024.0*1024.0), cache->max_memory/(1024.0*1024.0));
+  g_hash_table_foreach(cache->stats, _cache_print_stats, NULL);
   printf("cache hit rate so far: %.3f\n", (cache->queries - cache->misses)/(float)cache->queries);
 }
 
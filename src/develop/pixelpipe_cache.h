@@ -18,26 +18,56 @@
 #ifndef DT_PIXELPIPE_CACHE_H
 #define DT_PIXELPIPE_CACHE_H
 
+#include "common/dtpthread.h"
 #include <inttypes.h>
+#include <glib.h>
+
+/** hard upper limit of cache lines, if the cache is sized by a memory budget. */
+#define DT_DEV_PIXELPIPE_CACHE_MAX_ENTRIES 64
+
 /**
  * implements a simple pixel cache suitable for caching float images
  * corresponding to history items and zoom/pan settings in the develop module.
- * it is optimized for very few entries (~5), so most operations are O(N).
+ * cache lines are found by their hash in O(1). the cache either holds a fixed
+ * number of lines (export, thumbnails) or grows up to a memory budget (darkroom).
+ * eviction prefers old lines, weighted by the time it took to compute them.
  */
 struct dt_dev_pixelpipe_t;
+
+/** per module statistics, as reported by dt_dev_pixelpipe_cache_print(). */
+typedef struct dt_dev_pixelpipe_cache_stats_t
+{
+  uint64_t queries;
+  uint64_t misses;
+  uint64_t bytes;  // size of the output buffers requested by this module
+  double   time;   // accumulated time spent recomputing this module
+}
+dt_dev_pixelpipe_cache_stats_t;
+
 typedef struct dt_dev_pixelpipe_cache_t
 {
-  int32_t  entries;
+  int32_t  entries;      // number of cache line slots in use
+  int32_t  min_entries;  // lines which are never freed when shrinking to the memory budget
+  int32_t  max_entries;  // number of slots allocated
+  size_t   memory;       // bytes currently allocated for cache lines
+  size_t   max_memory;   // memory budget, 0 means a fixed number of lines
   void    **data;
   size_t   *size;
   uint64_t *hash;
-  int32_t  *used;
+  int64_t  *used;        // tick of last use
+  float    *cost;        // time in seconds it took to compute the line
 #ifdef HAVE_OPENCL
   void    **gpu_mem;
 #endif
+  GHashTable *lookup;    // hash -> line index + 1
+  int32_t  last;         // line handed out last, it is the input of the module currently processed
+  void    **pinned;      // if set, the line *pinned points into is never freed or reused (the pipe's backbuf)
+  dt_pthread_mutex_t *pinned_mutex; // protects *pinned
+  int64_t  tick;
   // profiling:
   uint64_t queries;
   uint64_t misses;
+  GHashTable *stats;     // module op -> dt_dev_pixelpipe_cache_stats_t
 }
 dt_dev_pixelpipe_cache_t;
 
@@ -47,6 +77,12 @@ dt_dev_pixelpipe_cache_t;
 int dt_dev_pixelpipe_cache_init(dt_dev_pixelpipe_cache_t *cache, int entries, int size);
 void dt_dev_pixelpipe_cache_cleanup(dt_dev_pixelpipe_cache_t *cache);
 
+/** lets the cache grow beyond its initial number of lines, up to the given number of bytes. */
+void dt_dev_pixelpipe_cache_set_memory(dt_dev_pixelpipe_cache_t *cache, size_t max_memory);
+
+/** never free or hand out the line *buf points into, *buf is read under mutex. used for buffers other threads display. */
+void dt_dev_pixelpipe_cache_pin(dt_dev_pixelpipe_cache_t *cache, void **buf, dt_pthread_mutex_t *mutex);
+
 struct dt_iop_roi_t;
 /** creates a hopefully unique hash from the complete module stack up to the module-th. */
 uint64_t dt_dev_pixelpipe_cache_hash(int imgid, const struct dt_iop_roi_t *roi, struct dt_dev_pixelpipe_t *pipe, int module);
@@ -64,13 +100,22 @@ int dt_dev_pixelpipe_cache_available(dt_dev_pixelpipe_cache_t *cache, const uint
 /** invalidates all cachelines. */
 void dt_dev_pixelpipe_cache_flush(dt_dev_pixelpipe_cache_t *cache);
 
+/** invalidates all cachelines and shrinks the ones larger than size down to it. */
+void dt_dev_pixelpipe_cache_trim(dt_dev_pixelpipe_cache_t *cache, const size_t size);
+
 /** makes this buffer very important after it has been pulled from the cache. */
 void dt_dev_pixelpipe_cache_reweight(dt_dev_pixelpipe_cache_t *cache, void *data);
 
 /** mark the given cache line pointer as invalid. */
 void dt_dev_pixelpipe_cache_invalidate(dt_dev_pixelpipe_cache_t *cache, void *data);
 
-/** print out cache lines/hashes (debug). */
+/** remember how long it took to compute the given buffer (in seconds), expensive lines are kept longer. */
+void dt_dev_pixelpipe_cache_set_cost(dt_dev_pixelpipe_cache_t *cache, void *data, const double cost);
+
+/** count a hit or a miss of the output buffer of the given module, for the statistics. */
+void dt_dev_pixelpipe_cache_account(dt_dev_pixelpipe_cache_t *cache, const char *module, const int hit, const size_t size, const double time);
+
+/** print out cache lines/hashes and per module statistics (debug). */
 void dt_dev_pixelpipe_cache_print(dt_dev_pixelpipe_cache_t *cache);
 
 #endif
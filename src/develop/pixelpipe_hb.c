@@ -19,6 +19,7 @@
 #include "develop/pixelpipe.h"
 #include "develop/blend.h"
 #include "develop/tiling.h"
+#include "develop/pixelpipe_trace.h"
 #include "gui/gtk.h"
 #include "control/control.h"
 #include "control/signal.h"
@@ -83,6 +84,10 @@ int dt_dev_pixelpipe_init_preview(dt_dev_pixelpipe_t *pipe)
 {
   int res = dt_dev_pixelpipe_init_cached(pipe, 4*sizeof(float)*darktable.thumbnail_width*darktable.thumbnail_height, 5);
   pipe->type = DT_DEV_PIXELPIPE_PREVIEW;
+  // interactive pipes may keep more intermediate buffers around, as long as they fit the budget:
+  if(res) dt_dev_pixelpipe_cache_set_memory(&(pipe->cache), MAX(0, dt_conf_get_int64("pixelpipe_cache_memory")));
+  // the navigation and the center view draw the backbuf while we process:
+  if(res) dt_dev_pixelpipe_cache_pin(&(pipe->cache), (void **)&pipe->backbuf, &pipe->backbuf_mutex);
   return res;
 }
 
@@ -90,6 +95,9 @@ int dt_dev_pixelpipe_init(dt_dev_pixelpipe_t *pipe)
 {
   int res = dt_dev_pixelpipe_init_cached(pipe, 4*sizeof(float)*darktable.thumbnail_width*darktable.thumbnail_height, 5);
   pipe->type = DT_DEV_PIXELPIPE_FULL;
+  // interactive pipes may keep more intermediate buffers around, as long as they fit the budget:
+  if(res) dt_dev_pixelpipe_cache_set_memory(&(pipe->cache), MAX(0, dt_conf_get_int64("pixelpipe_cache_memory")));
+  if(res) dt_dev_pixelpipe_cache_pin(&(pipe->cache), (void **)&pipe->backbuf, &pipe->backbuf_mutex);
   return res;
 }
 
@@ -105,6 +113,7 @@ int dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe, int32_t size, int32_t
     return 0;
   pipe->cache_obsolete = 0;
   pipe->backbuf = NULL;
+  memset(&pipe->backbuf_roi, 0, sizeof(pipe->backbuf_roi));
   pipe->processing = 0;
   pipe->shutdown = 0;
   pipe->opencl_error = 0;
@@ -185,6 +194,7 @@ void dt_dev_pixelpipe_create_nodes(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev)
       piece->data = NULL;
       piece->hash = 0;
       piece->process_cl_ready = 0;
+      piece->roi_invariant = 0;
       dt_iop_init_pipe(piece->module, pipe,piece);
       pipe->nodes = g_list_append(pipe->nodes, piece);
     }
@@ -648,6 +658,140 @@ pixelpipe_picker_cl(int devid, dt_iop_module_t *module, cl_mem img, const dt_iop
 #endif
 
 
+// records one step of the pipe for --trace:
+static void
+_trace_event(const dt_dev_pixelpipe_t *pipe, const char *name, const dt_times_t *start,
+             const dt_dev_pixelpipe_trace_path_t path, const int tiling,
+             const dt_iop_roi_t *roi_in, const dt_iop_roi_t *roi_out, const size_t bytes, const size_t memory)
+{
+  dt_times_t end;
+  dt_get_times(&end);
+  dt_dev_pixelpipe_trace_event_t ev = { .pipe = _pipe_type_to_str(pipe->type) };
+  g_strlcpy(ev.name, name, sizeof(ev.name));
+  ev.imgid = pipe->image.id;
+  ev.path = path;
+  ev.tiling = tiling;
+  ev.start = start->clock;
+  ev.duration = end.clock - start->clock;
+  ev.cpu = end.user - start->user;
+  ev.bytes = bytes;
+  ev.memory = memory;
+  ev.in_width = roi_in->width;
+  ev.in_height = roi_in->height;
+  ev.out_width = roi_out->width;
+  ev.out_height = roi_out->height;
+  ev.scale = roi_out->scale;
+  dt_dev_pixelpipe_trace_add(&ev);
+}
+
+// runs of point-to-point modules (see IOP_FLAGS_POINT_TO_POINT) are processed together, in stripes
+// of rows small enough that the intermediate buffers stay in the caches. this is the cache budget
+// per thread for the two stripe buffers:
+#define DT_PIXELPIPE_FUSE_CACHE (256*1024)
+
+static inline int
+_skip_piece(const dt_develop_t *dev, dt_iop_module_t *module, const dt_dev_pixelpipe_iop_t *piece)
+{
+  return !piece->enabled || (dev->gui_module && dev->gui_module->operation_tags_filter() & module->operation_tags());
+}
+
+static int
+_fusable(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece)
+{
+  if(!(module->flags() & IOP_FLAGS_POINT_TO_POINT)) return 0;
+  if(module->output_bpp(module, pipe, piece) != 4*sizeof(float)) return 0;
+  // the focussed module needs its input cached, picks colours and displays masks:
+  if(module == dev->gui_module) return 0;
+  if(dev->gui_attached && pipe == dev->preview_pipe && module->request_histogram) return 0;
+  // masks may need more than the pixel itself:
+  const dt_develop_blend_params_t *d = (const dt_develop_blend_params_t *)piece->blendop_data;
+  if(d && (d->mask_mode & DEVELOP_MASK_ENABLED)) return 0;
+  return 1;
+}
+
+// finds the fusable modules right below this one. returns how many modules the run has (1 means no fusion),
+// and moves modules, pieces and pos to its first module. needs the busy_mutex.
+static int
+_pixelpipe_fuse_run(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, const dt_iop_roi_t *roi,
+                    GList **modules, GList **pieces, int *pos)
+{
+#ifdef HAVE_OPENCL
+  // the opencl path keeps buffers on the device, and it's fast enough there:
+  if(dt_opencl_is_inited() && pipe->opencl_enabled && pipe->devid >= 0) return 1;
+#endif
+  // nan checking wants to see every single output:
+  if(darktable.unmuted & DT_DEBUG_NAN) return 1;
+  if(!_fusable(pipe, dev, (dt_iop_module_t *)(*modules)->data, (dt_dev_pixelpipe_iop_t *)(*pieces)->data)) return 1;
+
+  int count = 1;
+  GList *m = g_list_previous(*modules), *p = g_list_previous(*pieces);
+  for(int k = *pos - 1; m; m = g_list_previous(m), p = g_list_previous(p), k--)
+  {
+    dt_iop_module_t *module = (dt_iop_module_t *)m->data;
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)p->data;
+    // disabled modules don't break the run:
+    if(_skip_piece(dev, module, piece)) continue;
+    if(!_fusable(pipe, dev, module, piece)) break;
+    // nothing to gain below a buffer we still have:
+    if(dt_dev_pixelpipe_cache_available(&(pipe->cache), dt_dev_pixelpipe_cache_hash(pipe->image.id, roi, pipe, k))) break;
+    *modules = m;
+    *pieces = p;
+    *pos = k;
+    count++;
+  }
+  // the first module of the run needs rgb input, m is the module it gets it from:
+  if(count > 1 && get_output_bpp(m ? (dt_iop_module_t *)m->data : NULL, pipe, p ? (dt_dev_pixelpipe_iop_t *)p->data : NULL, dev) != 4*sizeof(float))
+    return 1;
+  return count;
+}
+
+// processes count modules, starting at modules, in stripes. all of them are point-to-point, so roi is
+// the same for all. needs the busy_mutex, returns non-zero if cancelled or out of memory.
+static int
+_pixelpipe_process_fused(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, const float *input, float *output,
+                         const dt_iop_roi_t *roi, GList *modules, GList *pieces, const int count)
+{
+  const size_t row = (size_t)4*roi->width;
+  // two stripe buffers per thread in the cache, but give every thread a row at least:
+  const int threads = dt_get_num_threads();
+  const int rows = CLAMP((int)(DT_PIXELPIPE_FUSE_CACHE*(size_t)threads/(2*sizeof(float)*row)), MIN(threads, roi->height), roi->height);
+  float *stripe[2] = { dt_alloc_align(64, sizeof(float)*row*rows), dt_alloc_align(64, sizeof(float)*row*rows) };
+  if(!stripe[0] || !stripe[1])
+  {
+    free(stripe[0]);
+    free(stripe[1]);
+    return 1;
+  }
+  dt_print(DT_DEBUG_DEV, "[dev_pixelpipe] fusing %d modules from `%s' in stripes of %d rows [%s]\n",
+           count, ((dt_iop_module_t *)modules->data)->op, rows, _pipe_type_to_str(pipe->type));
+
+  float processed_maximum[3];
+  for(int k=0; k<3; k++) processed_maximum[k] = pipe->processed_maximum[k];
+  for(int y=0; y<roi->height; y+=rows)
+  {
+    const dt_iop_roi_t roi_stripe = { roi->x, roi->y + y, roi->width, MIN(rows, roi->height - y), roi->scale };
+    // like tiling, every stripe starts off the same maximum:
+    for(int k=0; k<3; k++) pipe->processed_maximum[k] = processed_maximum[k];
+    const float *in = input + y*row;
+    GList *m = modules, *p = pieces;
+    for(int n=0; n<count; m = g_list_next(m), p = g_list_next(p))
+    {
+      dt_iop_module_t *module = (dt_iop_module_t *)m->data;
+      dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)p->data;
+      if(_skip_piece(dev, module, piece)) continue;
+      // the last one writes straight to the output:
+      float *out = (++n == count) ? output + y*row : stripe[n&1];
+      module->process(module, piece, (void *)in, out, &roi_stripe, &roi_stripe);
+      for(int k=0; k<3; k++) piece->processed_maximum[k] = pipe->processed_maximum[k];
+      in = out;
+    }
+    if(dt_iop_cancelled((dt_dev_pixelpipe_iop_t *)pieces->data)) break;
+  }
+  free(stripe[0]);
+  free(stripe[1]);
+  return dt_iop_cancelled((dt_dev_pixelpipe_iop_t *)pieces->data);
+}
+
 // recursive helper for process:
 static int
 dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void **output, void **cl_mem_output, int *out_bpp,
@@ -689,6 +833,13 @@ dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void *
     if(piece) for(int k=0; k<3; k++) pipe->processed_maximum[k] = piece->processed_maximum[k];
     else      for(int k=0; k<3; k++) pipe->processed_maximum[k] = 1.0f;
     (void) dt_dev_pixelpipe_cache_get(&(pipe->cache), hash, bufsize, output);
+    if(module) dt_dev_pixelpipe_cache_account(&(pipe->cache), module->op, 1, bufsize, 0.0);
+    if(module && dt_dev_pixelpipe_trace_active)
+    {
+      dt_times_t now;
+      dt_get_times(&now);
+      _trace_event(pipe, module->op, &now, DT_DEV_PIXELPIPE_TRACE_CACHE, 0, roi_out, roi_out, bufsize, 0);
+    }
     dt_pthread_mutex_unlock(&pipe->busy_mutex);
     if(!modules) return 0;
     // go to post-collect directly:
@@ -726,7 +877,7 @@ dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void *
       }
       else if(dt_dev_pixelpipe_cache_get(&(pipe->cache), hash, bufsize, output))
       {
-        memset(*output, 0, pipe->backbuf_size);
+        memset(*output, 0, bufsize);
         if(roi_in.scale == 1.0f)
         {
           // fast branch for 1:1 pixel copies.
@@ -774,6 +925,12 @@ dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void *
       }
     }
     dt_show_times(&start, "[dev_pixelpipe]", "initing base buffer [%s]", _pipe_type_to_str(pipe->type));
+    if(dt_dev_pixelpipe_trace_active)
+    {
+      const dt_iop_roi_t roi_full = { 0, 0, pipe->iwidth, pipe->iheight, 1.0f };
+      _trace_event(pipe, "input", &start, DT_DEV_PIXELPIPE_TRACE_CPU, 0, &roi_full, roi_out, bufsize, bufsize);
+    }
+    if(*output != pipe->input) dt_dev_pixelpipe_cache_set_cost(&(pipe->cache), *output, dt_get_wtime() - start.clock);
     dt_pthread_mutex_unlock(&pipe->busy_mutex);
   }
   else
@@ -788,11 +945,15 @@ dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void *
       return 1;
     }
     module->modify_roi_in(module, piece, roi_out, &roi_in);
+    // can we run a few point-to-point modules below in one go? then we start below the first of them.
+    GList *fused_modules = modules, *fused_pieces = pieces;
+    int fused_pos = pos;
+    const int fused = _pixelpipe_fuse_run(pipe, dev, roi_out, &fused_modules, &fused_pieces, &fused_pos);
     dt_pthread_mutex_unlock(&pipe->busy_mutex);
 
     // recurse to get actual data of input buffer
     int in_bpp;
-    if(dt_dev_pixelpipe_process_rec(pipe, dev, &input, &cl_mem_input, &in_bpp, &roi_in, g_list_previous(modules), g_list_previous(pieces), pos-1)) return 1;
+    if(dt_dev_pixelpipe_process_rec(pipe, dev, &input, &cl_mem_input, &in_bpp, &roi_in, g_list_previous(fused_modules), g_list_previous(fused_pieces), fused_pos-1)) return 1;
     piece = (dt_dev_pixelpipe_iop_t *)pieces->data;
 
     // reserve new cache line: output
@@ -882,12 +1043,27 @@ dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void *
 
     assert(tiling.factor > 0.0f);
 
+    // for the trace: which path was taken, and did opencl tile? whether the cpu tiled is only worked out when tracing.
+    dt_dev_pixelpipe_trace_path_t trace_path = DT_DEV_PIXELPIPE_TRACE_CPU;
+    int trace_tiling_cl = 0;
+
     if(pipe->shutdown)
     {
       dt_pthread_mutex_unlock(&pipe->busy_mutex);
       return 1;
     }
 
+    if(fused > 1)
+    {
+      if(_pixelpipe_process_fused(pipe, dev, (float *)input, (float *)*output, roi_out, fused_modules, fused_pieces, fused))
+      {
+        dt_dev_pixelpipe_cache_invalidate(&(pipe->cache), *output);
+        dt_pthread_mutex_unlock(&pipe->busy_mutex);
+        return 1;
+      }
+      goto post_process_fused;
+    }
+
 #ifdef HAVE_OPENCL
     /* do we have opencl at all? did user tell us to use it? did we get a resource? */
     if (dt_opencl_is_inited() && pipe->opencl_enabled && pipe->devid >= 0)
@@ -1035,6 +1211,7 @@ dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void *
         else if(module->flags() & IOP_FLAGS_ALLOW_TILING)
         {
           /* image is too big for direct opencl processing -> try to process image via tiling */
+          trace_tiling_cl = 1;
 
           // fprintf(stderr, "[opencl_pixelpipe 3] module '%s' tiling with process_tiling_cl\n", module->op);
 
@@ -1152,6 +1329,7 @@ dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void *
         if (success_opencl)
         {
           /* Nice, everything went fine */
+          trace_path = DT_DEV_PIXELPIPE_TRACE_OPENCL;
 
           /* this is reasonable on slow GPUs only, where it's more expensive to reprocess the whole pixelpipe than
              regularly copying device buffers back to host. This would slow down fast GPUs considerably. */
@@ -1532,8 +1710,32 @@ dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void *
     dt_develop_blend_process(module, piece, input, *output, &roi_in, roi_out);
 #endif
 
+post_process_fused:
+    // the module may have stopped half way through, don't let the restarted pipe find that in the cache:
+    if(dt_iop_cancelled(piece))
+    {
+      dt_dev_pixelpipe_cache_invalidate(&(pipe->cache), *output);
+      dt_pthread_mutex_unlock(&pipe->busy_mutex);
+      return 1;
+    }
     dt_show_times(&start, "[dev_pixelpipe]", "processing `%s' [%s]", module->name(),
                   _pipe_type_to_str(pipe->type));
+    if(dt_dev_pixelpipe_trace_active)
+    {
+      // the cpu paths all tile on this condition:
+      const int trace_tiling_cpu = fused == 1 && (module->flags() & IOP_FLAGS_ALLOW_TILING) &&
+                                   !dt_tiling_piece_fits_host_memory(max(roi_in.width, roi_out->width), max(roi_in.height, roi_out->height),
+                                                                     max(in_bpp, bpp), tiling.factor, tiling.overhead);
+      const int trace_tiling = trace_path == DT_DEV_PIXELPIPE_TRACE_OPENCL ? trace_tiling_cl : trace_tiling_cpu;
+      // what the module asked for in its tiling callback, for the untiled image:
+      const size_t memory = tiling.factor * max(roi_in.width, roi_out->width) * max(roi_in.height, roi_out->height)
+                            * max(in_bpp, bpp) + tiling.overhead;
+      _trace_event(pipe, module->op, &start, trace_path, trace_tiling, &roi_in, roi_out, bufsize, memory);
+    }
+    // remember the recompute cost of this line for eviction, and keep statistics:
+    const double cost = dt_get_wtime() - start.clock;
+    dt_dev_pixelpipe_cache_set_cost(&(pipe->cache), *output, cost);
+    dt_dev_pixelpipe_cache_account(&(pipe->cache), module->op, 0, bufsize, cost);
     // in case we get this buffer from the cache, also get the processed max:
     for(int k=0; k<3; k++) piece->processed_maximum[k] = pipe->processed_maximum[k];
     dt_pthread_mutex_unlock(&pipe->busy_mutex);
@@ -2100,6 +2302,9 @@ int dt_dev_pixelpipe_process(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, int x,
 
   if(pipe->devid >= 0) dt_opencl_events_reset(pipe->devid);
 
+  dt_times_t start;
+  dt_get_times(&start);
+
   dt_iop_roi_t roi = (dt_iop_roi_t)
   {
     x, y, width, height, scale
@@ -2164,6 +2369,13 @@ restart:
     goto restart;  // try again (this time without opencl)
   }
 
+  if(dt_dev_pixelpipe_trace_active)
+  {
+    const dt_iop_roi_t roi_in = { 0, 0, pipe->iwidth, pipe->iheight, 1.0f };
+    _trace_event(pipe, err ? "aborted" : _pipe_type_to_str(pipe->type), &start, DT_DEV_PIXELPIPE_TRACE_PIPE,
+                 0, &roi_in, &roi, (size_t)4*width*height, pipe->cache.memory);
+  }
+
   // release resources:
   if(pipe->devid >= 0)
   {
@@ -2180,6 +2392,7 @@ restart:
   // terminate
   dt_pthread_mutex_lock(&pipe->backbuf_mutex);
   pipe->backbuf_hash = dt_dev_pixelpipe_cache_hash(pipe->image.id, &roi, pipe, 0);
+  pipe->backbuf_roi = roi;
   pipe->backbuf = buf;
   pipe->backbuf_width  = width;
   pipe->backbuf_height = height;
@@ -2231,6 +2444,31 @@ void dt_dev_pixelpipe_get_dimensions(dt_dev_pixelpipe_t *pipe, struct dt_develop
   dt_pthread_mutex_unlock(&pipe->busy_mutex);
 }
 
+int dt_dev_pixelpipe_tiling_overlap(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev, const dt_iop_roi_t *roi)
+{
+  float overlap = 0.0f;
+  dt_iop_roi_t roi_out = *roi;
+  GList *modules = g_list_last(dev->iop);
+  GList *pieces = g_list_last(pipe->nodes);
+  while(modules && pieces)
+  {
+    dt_iop_module_t *module = (dt_iop_module_t *)modules->data;
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)pieces->data;
+    if(piece->enabled)
+    {
+      dt_iop_roi_t roi_in = roi_out;
+      module->modify_roi_in(module, piece, &roi_out, &roi_in);
+      dt_develop_tiling_t tiling = { 0 };
+      module->tiling_callback(module, piece, &roi_in, &roi_out, &tiling);
+      if(roi_in.scale > 0.0f) overlap += tiling.overlap * roi->scale / roi_in.scale;
+      roi_out = roi_in;
+    }
+    modules = g_list_previous(modules);
+    pieces = g_list_previous(pieces);
+  }
+  return ceilf(overlap);
+}
+
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
 // kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-space on;
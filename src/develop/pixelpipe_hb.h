@@ -55,6 +55,7 @@ typedef struct dt_dev_pixelpipe_iop_t
   int colors;                      // how many colors per pixel
   dt_iop_roi_t buf_in, buf_out;    // theoretical full buffer regions of interest, as passed through modify_roi_out
   int process_cl_ready;            // set this to 0 in commit_params to temporarily disable the use of process_cl
+  int roi_invariant;               // IOP_FLAGS_ROI_INVARIANT, set this to 0 in commit_params if the params break it
   float processed_maximum[3];      // sensor saturation after this iop, used internally for caching
 }
 dt_dev_pixelpipe_iop_t;
@@ -111,6 +112,7 @@ typedef struct dt_dev_pixelpipe_t
   int backbuf_size;
   int backbuf_width, backbuf_height;
   uint64_t backbuf_hash;
+  dt_iop_roi_t backbuf_roi; // region of the image the backbuf shows
   dt_pthread_mutex_t backbuf_mutex, busy_mutex;
   // working?
   int processing;
@@ -153,6 +155,9 @@ void dt_dev_pixelpipe_set_input(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *d
 
 // returns the dimensions of the full image after processing.
 void dt_dev_pixelpipe_get_dimensions(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev, int width_in, int height_in, int *width, int *height);
+// returns the context all enabled modules together need around any part of roi, in output pixels: what they
+// ask for as tiling overlap, walking the regions of interest back from the output like the pipe does.
+int dt_dev_pixelpipe_tiling_overlap(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev, const dt_iop_roi_t *roi);
 
 // destroys all allocated data.
 void dt_dev_pixelpipe_cleanup(dt_dev_pixelpipe_t *pipe);
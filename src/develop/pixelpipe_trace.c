@@ -0,0 +1,189 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2014 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/darktable.h"
+#include "common/dtpthread.h"
+#include "develop/pixelpipe_trace.h"
+
+#include <glib.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+// don't let a long session eat up all memory, ~30MB of events are plenty:
+#define DT_PIXELPIPE_TRACE_MAX_EVENTS (1<<18)
+
+int dt_dev_pixelpipe_trace_active = 0;
+
+static struct
+{
+  dt_pthread_mutex_t lock;
+  GArray *events;
+  uint64_t dropped;
+  double start;
+  char *filename;
+}
+_trace = { .events = NULL };
+
+typedef struct dt_dev_pixelpipe_trace_summary_t
+{
+  const char *name;
+  uint64_t runs, hits, opencl, tiled;
+  double time, max_time, cpu;
+  uint64_t bytes, max_memory;
+}
+dt_dev_pixelpipe_trace_summary_t;
+
+static const char *_path_to_str(const dt_dev_pixelpipe_trace_path_t path)
+{
+  switch(path)
+  {
+    case DT_DEV_PIXELPIPE_TRACE_CACHE:
+      return "cache";
+    case DT_DEV_PIXELPIPE_TRACE_CPU:
+      return "cpu";
+    case DT_DEV_PIXELPIPE_TRACE_OPENCL:
+      return "opencl";
+    default:
+      return "pipe";
+  }
+}
+
+void dt_dev_pixelpipe_trace_init(const char *filename)
+{
+  dt_pthread_mutex_init(&_trace.lock, NULL);
+  _trace.events = g_array_new(FALSE, FALSE, sizeof(dt_dev_pixelpipe_trace_event_t));
+  _trace.dropped = 0;
+  _trace.start = dt_get_wtime();
+  _trace.filename = g_strdup(filename);
+  dt_dev_pixelpipe_trace_active = 1;
+}
+
+void dt_dev_pixelpipe_trace_cleanup()
+{
+  if(!_trace.events) return;
+  if(dt_dev_pixelpipe_trace_write(_trace.filename))
+    fprintf(stderr, "[pixelpipe_trace] could not write trace to `%s'\n", _trace.filename);
+  dt_dev_pixelpipe_trace_active = 0;
+  g_array_free(_trace.events, TRUE);
+  _trace.events = NULL;
+  g_free(_trace.filename);
+  dt_pthread_mutex_destroy(&_trace.lock);
+}
+
+void dt_dev_pixelpipe_trace_add(dt_dev_pixelpipe_trace_event_t *event)
+{
+  if(!dt_dev_pixelpipe_trace_active) return;
+  event->thread = (uint64_t)pthread_self();
+  dt_pthread_mutex_lock(&_trace.lock);
+  if(_trace.events->len < DT_PIXELPIPE_TRACE_MAX_EVENTS)
+    g_array_append_val(_trace.events, *event);
+  else
+    _trace.dropped++;
+  dt_pthread_mutex_unlock(&_trace.lock);
+}
+
+static gint _sort_by_time(gconstpointer a, gconstpointer b)
+{
+  const dt_dev_pixelpipe_trace_summary_t *sa = *(const dt_dev_pixelpipe_trace_summary_t **)a;
+  const dt_dev_pixelpipe_trace_summary_t *sb = *(const dt_dev_pixelpipe_trace_summary_t **)b;
+  return sa->time < sb->time ? 1 : (sa->time > sb->time ? -1 : 0);
+}
+
+int dt_dev_pixelpipe_trace_write(const char *filename)
+{
+  if(!_trace.events || !filename) return 1;
+  FILE *f = fopen(filename, "wb");
+  if(!f) return 1;
+
+  dt_pthread_mutex_lock(&_trace.lock);
+  const dt_dev_pixelpipe_trace_event_t *events = (const dt_dev_pixelpipe_trace_event_t *)_trace.events->data;
+  const int num = _trace.events->len;
+
+  // chrome wants small thread ids, and the summary is kept per module:
+  GHashTable *threads = g_hash_table_new_full(g_int64_hash, g_int64_equal, g_free, NULL);
+  GHashTable *modules = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, g_free);
+  GPtrArray *summary = g_ptr_array_new();
+
+  fprintf(f, "{\"traceEvents\":[\n");
+  for(int k=0; k<num; k++)
+  {
+    const dt_dev_pixelpipe_trace_event_t *ev = events + k;
+    int tid = GPOINTER_TO_INT(g_hash_table_lookup(threads, &ev->thread));
+    if(!tid)
+    {
+      tid = g_hash_table_size(threads) + 1;
+      g_hash_table_insert(threads, g_memdup(&ev->thread, sizeof(uint64_t)), GINT_TO_POINTER(tid));
+    }
+    // complete events, times in microseconds:
+    fprintf(f, "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.1f,\"dur\":%.1f,"
+            "\"args\":{\"pipe\":\"%s\",\"imgid\":%d,\"path\":\"%s\",\"tiling\":%d,\"cpu_ms\":%.3f,"
+            "\"bytes\":%"PRIu64",\"memory\":%"PRIu64",\"roi_in\":[%d,%d],\"roi_out\":[%d,%d],\"scale\":%g}}",
+            k ? ",\n" : "", ev->name, ev->path == DT_DEV_PIXELPIPE_TRACE_PIPE ? "pipe" : "module", tid,
+            (ev->start - _trace.start)*1e6, ev->duration*1e6,
+            ev->pipe, ev->imgid, _path_to_str(ev->path), ev->tiling, ev->cpu*1e3,
+            ev->bytes, ev->memory, ev->in_width, ev->in_height, ev->out_width, ev->out_height, ev->scale);
+
+    if(ev->path == DT_DEV_PIXELPIPE_TRACE_PIPE) continue;
+    dt_dev_pixelpipe_trace_summary_t *s = (dt_dev_pixelpipe_trace_summary_t *)g_hash_table_lookup(modules, ev->name);
+    if(!s)
+    {
+      s = (dt_dev_pixelpipe_trace_summary_t *)g_malloc0(sizeof(dt_dev_pixelpipe_trace_summary_t));
+      s->name = ev->name;
+      g_hash_table_insert(modules, (gpointer)ev->name, s);
+      g_ptr_array_add(summary, s);
+    }
+    if(ev->path == DT_DEV_PIXELPIPE_TRACE_CACHE)
+    {
+      s->hits++;
+      continue;
+    }
+    s->runs++;
+    if(ev->path == DT_DEV_PIXELPIPE_TRACE_OPENCL) s->opencl++;
+    if(ev->tiling) s->tiled++;
+    s->time += ev->duration;
+    s->max_time = MAX(s->max_time, ev->duration);
+    s->cpu += ev->cpu;
+    s->bytes += ev->bytes;
+    s->max_memory = MAX(s->max_memory, ev->memory);
+  }
+  fprintf(f, "\n],\n\"displayTimeUnit\":\"ms\",\n\"otherData\":{\"dropped_events\":\"%"PRIu64"\"},\n", _trace.dropped);
+
+  // the modules that took longest come first:
+  g_ptr_array_sort(summary, _sort_by_time);
+  fprintf(f, "\"modules\":[\n");
+  for(int k=0; k<summary->len; k++)
+  {
+    const dt_dev_pixelpipe_trace_summary_t *s = (const dt_dev_pixelpipe_trace_summary_t *)g_ptr_array_index(summary, k);
+    fprintf(f, "%s{\"name\":\"%s\",\"runs\":%"PRIu64",\"cache_hits\":%"PRIu64",\"opencl\":%"PRIu64",\"tiled\":%"PRIu64","
+            "\"total_ms\":%.3f,\"max_ms\":%.3f,\"cpu_ms\":%.3f,\"bytes\":%"PRIu64",\"max_memory\":%"PRIu64"}",
+            k ? ",\n" : "", s->name, s->runs, s->hits, s->opencl, s->tiled,
+            s->time*1e3, s->max_time*1e3, s->cpu*1e3, s->bytes, s->max_memory);
+  }
+  fprintf(f, "\n]}\n");
+  dt_pthread_mutex_unlock(&_trace.lock);
+
+  g_ptr_array_free(summary, TRUE);
+  g_hash_table_destroy(modules);
+  g_hash_table_destroy(threads);
+  return fclose(f) != 0;
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-space on;
@@ -0,0 +1,77 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2014 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DT_DEVELOP_PIXELPIPE_TRACE_H
+#define DT_DEVELOP_PIXELPIPE_TRACE_H
+
+#include <inttypes.h>
+#include <stddef.h>
+
+/**
+ * records what every pixelpipe run spent its time on, module by module:
+ * wall and cpu time, whether the cpu or the opencl path ran, tiling, buffer
+ * sizes and cache hits. switched on with --trace <file> (also for
+ * darktable-cli, after --core), and written on shutdown in chrome's trace
+ * event format, which chrome://tracing or perfetto display as a timeline.
+ * the file also contains a summary per module.
+ */
+
+typedef enum dt_dev_pixelpipe_trace_path_t
+{
+  DT_DEV_PIXELPIPE_TRACE_CACHE = 0,   // output was found in the pixelpipe cache
+  DT_DEV_PIXELPIPE_TRACE_CPU = 1,
+  DT_DEV_PIXELPIPE_TRACE_OPENCL = 2,
+  DT_DEV_PIXELPIPE_TRACE_PIPE = 3     // a whole pipe run
+}
+dt_dev_pixelpipe_trace_path_t;
+
+typedef struct dt_dev_pixelpipe_trace_event_t
+{
+  char name[32];          // module op, or the pipe type for whole runs
+  const char *pipe;       // pipe type
+  int32_t imgid;
+  dt_dev_pixelpipe_trace_path_t path;
+  int32_t tiling;
+  double start;           // wall clock, as returned by dt_get_wtime()
+  double duration;        // wall time in seconds
+  double cpu;             // process user time spent meanwhile, in seconds
+  uint64_t bytes;         // size of the output buffer
+  uint64_t memory;        // estimated peak memory of the module, buffers included
+  int32_t in_width, in_height;
+  int32_t out_width, out_height;
+  float scale;
+  uint64_t thread;        // filled in by dt_dev_pixelpipe_trace_add()
+}
+dt_dev_pixelpipe_trace_event_t;
+
+/** non-zero while recording, check this before filling in events. */
+extern int dt_dev_pixelpipe_trace_active;
+
+/** starts recording, the trace will go to filename. */
+void dt_dev_pixelpipe_trace_init(const char *filename);
+/** writes the trace (if recording) and frees everything. */
+void dt_dev_pixelpipe_trace_cleanup();
+/** records one event. thread safe. */
+void dt_dev_pixelpipe_trace_add(dt_dev_pixelpipe_trace_event_t *event);
+/** writes all events recorded so far, returns non-zero on failure. */
+int dt_dev_pixelpipe_trace_write(const char *filename);
+
+#endif
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-space on;
@@ -722,6 +722,9 @@ _default_process_tiling_ptp (struct dt_iop_module_t *self, struct dt_dev_pixelpi
   for(int tx=0; tx<tiles_x; tx++)
     for(int ty=0; ty<tiles_y; ty++)
     {
+      /* the pipe will start over anyways, and won't keep our output */
+      if(dt_iop_cancelled(piece)) continue;
+
       piece->pipe->tiling = 1;
 
       size_t wd = tx * tile_wd + width > roi_in->width  ? roi_in->width - tx * tile_wd : width;
@@ -953,6 +956,9 @@ _default_process_tiling_roi (struct dt_iop_module_t *self, struct dt_dev_pixelpi
   for(int tx=0; tx<tiles_x; tx++)
     for(int ty=0; ty<tiles_y; ty++)
     {
+      /* the pipe will start over anyways, and won't keep our output */
+      if(dt_iop_cancelled(piece)) continue;
+
       piece->pipe->tiling = 1;
 
       /* the output dimensions of the good part of this specific tile */
@@ -1292,6 +1298,9 @@ _default_process_tiling_cl_ptp (struct dt_iop_module_t *self, struct dt_dev_pixe
   for(int tx=0; tx<tiles_x; tx++)
     for(int ty=0; ty<tiles_y; ty++)
     {
+      /* the pipe will start over anyways, and won't keep our output */
+      if(dt_iop_cancelled(piece)) continue;
+
       piece->pipe->tiling = 1;
 
       size_t wd = tx * tile_wd + width > roi_in->width  ? roi_in->width - tx * tile_wd : width;
@@ -1617,6 +1626,9 @@ _default_process_tiling_cl_roi (struct dt_iop_module_t *self, struct dt_dev_pixe
   for(int tx=0; tx<tiles_x; tx++)
     for(int ty=0; ty<tiles_y; ty++)
     {
+      /* the pipe will start over anyways, and won't keep our output */
+      if(dt_iop_cancelled(piece)) continue;
+
       piece->pipe->tiling = 1;
 
       /* the output dimensions of the good part of this specific tile */
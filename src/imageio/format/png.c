@@ -31,9 +31,21 @@
 #include <stdio.h>
 #include <png.h>
 #include <inttypes.h>
+#include <stddef.h>
 #include <zlib.h>
 
-DT_MODULE(1)
+DT_MODULE(2)
+
+// rows converted and handed to libpng at once:
+#define DT_PNG_ROWS 64
+
+typedef enum dt_imageio_png_compression_t
+{
+  DT_PNG_COMPRESSION_NONE = 0,
+  DT_PNG_COMPRESSION_FAST = 1,
+  DT_PNG_COMPRESSION_BEST = 2    // the only choice up to version 1
+}
+dt_imageio_png_compression_t;
 
 typedef struct dt_imageio_png_t
 {
@@ -41,6 +53,8 @@ typedef struct dt_imageio_png_t
   int width, height;
   char style[128];
   int bpp;
+  int compression;    // dt_imageio_png_compression_t
+  int predictor;      // adaptive row filters, off writes unfiltered rows
   FILE *f;
   png_structp png_ptr;
   png_infop info_ptr;
@@ -50,6 +64,8 @@ dt_imageio_png_t;
 typedef struct dt_imageio_png_gui_t
 {
   GtkToggleButton *b8, *b16;
+  GtkComboBox *compression;
+  GtkToggleButton *predictor;
 }
 dt_imageio_png_gui_t;
 
@@ -149,21 +165,30 @@ write_image (dt_imageio_module_data_t *p_tmp, const char *filename, const void *
     return 1;
   }
 
+  // rows are converted into this, it has to survive the longjmp to be freed:
+  png_bytep volatile rowdata = NULL;
+
   if (setjmp(png_jmpbuf(png_ptr)))
   {
+    free(rowdata);
     fclose(f);
-    png_destroy_write_struct(&png_ptr, NULL);
+    png_destroy_write_struct(&png_ptr, &info_ptr);
     return 1;
   }
 
   png_init_io(png_ptr, f);
 
-  png_set_compression_level(png_ptr, Z_BEST_COMPRESSION);
+  const int level = p->compression == DT_PNG_COMPRESSION_NONE ? Z_NO_COMPRESSION :
+                    (p->compression == DT_PNG_COMPRESSION_FAST ? Z_BEST_SPEED : Z_BEST_COMPRESSION);
+  png_set_compression_level(png_ptr, level);
   png_set_compression_mem_level(png_ptr, 8);
   png_set_compression_strategy(png_ptr, Z_DEFAULT_STRATEGY);
   png_set_compression_window_bits(png_ptr, 15);
   png_set_compression_method(png_ptr, 8);
-  png_set_compression_buffer_size(png_ptr, 8192);
+  png_set_compression_buffer_size(png_ptr, 1<<16);
+  // filtering only pays off if there is compression after it:
+  png_set_filter(png_ptr, PNG_FILTER_TYPE_BASE,
+                 (p->predictor && p->compression != DT_PNG_COMPRESSION_NONE) ? PNG_ALL_FILTERS : PNG_FILTER_NONE);
 
   png_set_IHDR(png_ptr, info_ptr, width, height,
                p->bpp, PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE,
@@ -171,31 +196,61 @@ write_image (dt_imageio_module_data_t *p_tmp, const char *filename, const void *
 
   png_write_info(png_ptr, info_ptr);
 
-  // png_bytep row_pointer = (png_bytep) in;
-  png_byte row[6*width];
-  // unsigned long rowbytes = png_get_rowbytes(png_ptr, info_ptr);
+  // convert a bunch of rows at a time, and hand them to libpng together:
+  const size_t rowsize = (size_t)3*width*(p->bpp > 8 ? 2 : 1);
+  rowdata = (png_bytep)malloc(rowsize*DT_PNG_ROWS);
+  png_bytep rows[DT_PNG_ROWS];
+  if (!rowdata)
+  {
+    fclose(f);
+    png_destroy_write_struct(&png_ptr, &info_ptr);
+    return 1;
+  }
+  for(int k=0; k<DT_PNG_ROWS; k++) rows[k] = rowdata + rowsize*k;
 
-  if(p->bpp > 8)
+  double convert_time = 0.0, compress_time = 0.0;
+  for (int y0 = 0; y0 < height; y0 += DT_PNG_ROWS)
   {
-    for (int y = 0; y < height; y++)
+    const int num = MIN(DT_PNG_ROWS, height - y0);
+    double start = dt_get_wtime();
+    if(p->bpp > 8)
     {
-      for(int x=0; x<width; x++) for(int k=0; k<3; k++)
-        {
-          uint16_t pix = ((uint16_t *)in)[4*width*y + 4*x + k];
-          uint16_t swapped = (0xff00 & (pix<<8)) | (pix>>8);
-          ((uint16_t *)row)[3*x+k] = swapped;
-        }
-      png_write_row(png_ptr, row);
+#ifdef _OPENMP
+      #pragma omp parallel for default(none) shared(in, rows, y0) schedule(static)
+#endif
+      for (int y = 0; y < num; y++)
+      {
+        const uint16_t *in16 = (const uint16_t *)in + (size_t)4*width*(y0 + y);
+        uint16_t *row = (uint16_t *)rows[y];
+        for(int x=0; x<width; x++) for(int k=0; k<3; k++)
+          {
+            uint16_t pix = in16[4*x + k];
+            uint16_t swapped = (0xff00 & (pix<<8)) | (pix>>8);
+            row[3*x+k] = swapped;
+          }
+      }
     }
-  }
-  else
-  {
-    for (int y = 0; y < height; y++)
+    else
     {
-      for(int x=0; x<width; x++) for(int k=0; k<3; k++) row[3*x+k] = in[4*width*y + 4*x + k];
-      png_write_row(png_ptr, row);
+#ifdef _OPENMP
+      #pragma omp parallel for default(none) shared(in, rows, y0) schedule(static)
+#endif
+      for (int y = 0; y < num; y++)
+      {
+        const uint8_t *in8 = in + (size_t)4*width*(y0 + y);
+        png_bytep row = rows[y];
+        for(int x=0; x<width; x++) for(int k=0; k<3; k++) row[3*x+k] = in8[4*x + k];
+      }
     }
+    convert_time += dt_get_wtime() - start;
+    start = dt_get_wtime();
+    png_write_rows(png_ptr, rows, num);
+    compress_time += dt_get_wtime() - start;
   }
+  free(rowdata);
+  rowdata = NULL;
+  dt_print(DT_DEBUG_PERF, "[png] %s: converting took %.3f secs, compressing and writing %.3f secs\n",
+           filename, convert_time, compress_time);
 
   PNGwriteRawProfile(png_ptr, info_ptr, "exif", exif, exif_len);
 
@@ -333,7 +388,7 @@ int read_image (dt_imageio_module_data_t *p_tmp, uint8_t *out)
 size_t
 params_size(dt_imageio_module_format_t *self)
 {
-  return sizeof(dt_imageio_module_data_t) + sizeof(int);
+  return offsetof(dt_imageio_png_t, f);
 }
 
 void*
@@ -344,6 +399,8 @@ get_params(dt_imageio_module_format_t *self)
   d->bpp = dt_conf_get_int("plugins/imageio/format/png/bpp");
   if(d->bpp < 12) d->bpp = 8;
   else            d->bpp = 16;
+  d->compression = CLAMP(dt_conf_get_int("plugins/imageio/format/png/compression"), DT_PNG_COMPRESSION_NONE, DT_PNG_COMPRESSION_BEST);
+  d->predictor = dt_conf_get_bool("plugins/imageio/format/png/predictor");
   return d;
 }
 
@@ -356,12 +413,17 @@ free_params(dt_imageio_module_format_t *self, dt_imageio_module_data_t *params)
 int
 set_params(dt_imageio_module_format_t *self, const void *params, const int size)
 {
-  if(size != self->params_size(self)) return 1;
+  // version 1 params end before the compression settings, those are kept as they are:
+  const int old = (size == offsetof(dt_imageio_png_t, compression));
+  if(size != self->params_size(self) && !old) return 1;
   dt_imageio_png_t *d = (dt_imageio_png_t *)params;
   dt_imageio_png_gui_t *g = (dt_imageio_png_gui_t *)self->gui_data;
   if(d->bpp < 12) gtk_toggle_button_set_active(g->b8, TRUE);
   else            gtk_toggle_button_set_active(g->b16, TRUE);
   dt_conf_set_int("plugins/imageio/format/png/bpp", d->bpp);
+  if(old) return 0;
+  gtk_combo_box_set_active(g->compression, d->compression);
+  gtk_toggle_button_set_active(g->predictor, d->predictor);
   return 0;
 }
 
@@ -401,32 +463,70 @@ radiobutton_changed (GtkRadioButton *radiobutton, gpointer user_data)
     dt_conf_set_int("plugins/imageio/format/png/bpp", bpp);
 }
 
+static void
+compression_changed (GtkComboBox *widget, gpointer user_data)
+{
+  dt_conf_set_int("plugins/imageio/format/png/compression", gtk_combo_box_get_active(widget));
+}
+
+static void
+predictor_toggled (GtkToggleButton *button, gpointer user_data)
+{
+  dt_conf_set_bool("plugins/imageio/format/png/predictor", gtk_toggle_button_get_active(button));
+}
+
 void init(dt_imageio_module_format_t *self)
 {
 #ifdef USE_LUA
   luaA_struct(darktable.lua_state,dt_imageio_png_t);
   dt_lua_register_module_member(darktable.lua_state,self,dt_imageio_png_t,bpp,int);
+  dt_lua_register_module_member(darktable.lua_state,self,dt_imageio_png_t,compression,int);
+  dt_lua_register_module_member(darktable.lua_state,self,dt_imageio_png_t,predictor,int);
 #endif
 }
 void cleanup(dt_imageio_module_format_t *self) {}
 
-// TODO: some quality/compression stuff?
 void gui_init (dt_imageio_module_format_t *self)
 {
   dt_imageio_png_gui_t *gui = (dt_imageio_png_gui_t *)malloc(sizeof(dt_imageio_png_gui_t));
   self->gui_data = (void *)gui;
   int bpp = dt_conf_get_int("plugins/imageio/format/png/bpp");
-  self->widget = gtk_hbox_new(TRUE, 5);
+  self->widget = gtk_vbox_new(TRUE, 5);
+  GtkWidget *hbox = gtk_hbox_new(TRUE, 5);
+  gtk_box_pack_start(GTK_BOX(self->widget), hbox, TRUE, TRUE, 0);
   GtkWidget *radiobutton = gtk_radio_button_new_with_label(NULL, _("8-bit"));
   gui->b8 = GTK_TOGGLE_BUTTON(radiobutton);
-  gtk_box_pack_start(GTK_BOX(self->widget), radiobutton, TRUE, TRUE, 0);
+  gtk_box_pack_start(GTK_BOX(hbox), radiobutton, TRUE, TRUE, 0);
   g_signal_connect(G_OBJECT(radiobutton), "toggled", G_CALLBACK(radiobutton_changed), (gpointer)8);
   if(bpp < 12) gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(radiobutton), TRUE);
   radiobutton = gtk_radio_button_new_with_label_from_widget(GTK_RADIO_BUTTON(radiobutton), _("16-bit"));
   gui->b16 = GTK_TOGGLE_BUTTON(radiobutton);
-  gtk_box_pack_start(GTK_BOX(self->widget), radiobutton, TRUE, TRUE, 0);
+  gtk_box_pack_start(GTK_BOX(hbox), radiobutton, TRUE, TRUE, 0);
   g_signal_connect(G_OBJECT(radiobutton), "toggled", G_CALLBACK(radiobutton_changed), (gpointer)16);
   if(bpp >= 12) gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(radiobutton), TRUE);
+
+  hbox = gtk_hbox_new(FALSE, 5);
+  gtk_box_pack_start(GTK_BOX(self->widget), hbox, TRUE, TRUE, 0);
+  GtkWidget *label = gtk_label_new(_("compression"));
+  gtk_misc_set_alignment(GTK_MISC(label), 0.0, 0.5);
+  gtk_box_pack_start(GTK_BOX(hbox), label, TRUE, TRUE, 0);
+  GtkWidget *combo = gtk_combo_box_new_text();
+  gui->compression = GTK_COMBO_BOX(combo);
+  // same order as dt_imageio_png_compression_t:
+  gtk_combo_box_append_text(GTK_COMBO_BOX(combo), _("uncompressed"));
+  gtk_combo_box_append_text(GTK_COMBO_BOX(combo), _("fast"));
+  gtk_combo_box_append_text(GTK_COMBO_BOX(combo), _("best"));
+  gtk_combo_box_set_active(GTK_COMBO_BOX(combo),
+                           CLAMP(dt_conf_get_int("plugins/imageio/format/png/compression"), DT_PNG_COMPRESSION_NONE, DT_PNG_COMPRESSION_BEST));
+  gtk_box_pack_start(GTK_BOX(hbox), combo, TRUE, TRUE, 0);
+  g_signal_connect(G_OBJECT(combo), "changed", G_CALLBACK(compression_changed), NULL);
+
+  GtkWidget *button = gtk_check_button_new_with_label(_("row filters"));
+  gui->predictor = GTK_TOGGLE_BUTTON(button);
+  g_object_set(G_OBJECT(button), "tooltip-text", _("predict pixels from their neighbours before compressing, smaller but slower"), (char *)NULL);
+  gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(button), dt_conf_get_bool("plugins/imageio/format/png/predictor"));
+  gtk_box_pack_start(GTK_BOX(self->widget), button, TRUE, TRUE, 0);
+  g_signal_connect(G_OBJECT(button), "toggled", G_CALLBACK(predictor_toggled), NULL);
 }
 
 void gui_cleanup (dt_imageio_module_format_t *self)
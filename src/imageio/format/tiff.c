@@ -19,7 +19,9 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <inttypes.h>
+#include <stddef.h>
 #include <tiffio.h>
+#include <zlib.h>
 #include "common/darktable.h"
 #include "common/imageio_module.h"
 #include "common/imageio.h"
@@ -29,7 +31,16 @@
 #include "common/imageio_format.h"
 #define DT_TIFFIO_STRIPE 64
 
-DT_MODULE(1)
+DT_MODULE(2)
+
+typedef enum dt_imageio_tiff_compression_t
+{
+  DT_TIFF_COMPRESSION_NONE = 0,
+  DT_TIFF_COMPRESSION_DEFLATE_FAST = 1,
+  DT_TIFF_COMPRESSION_LZW = 2,
+  DT_TIFF_COMPRESSION_DEFLATE = 3    // best, the only choice up to version 1
+}
+dt_imageio_tiff_compression_t;
 
 typedef struct dt_imageio_tiff_t
 {
@@ -37,24 +48,129 @@ typedef struct dt_imageio_tiff_t
   int width, height;
   char style[128];
   int bpp;
+  int compression;      // dt_imageio_tiff_compression_t
+  int predictor;        // horizontal differencing before compression
+  // state while writing, not part of the params:
   TIFF *handle;
+  uint8_t *profile;
+  uint8_t *stripdata;   // a batch of strips of 3 channel rows, waiting to be encoded
+  int rows;             // rows currently in stripdata
+  int strips;           // strips per batch, deflate compresses them in parallel
+  uint32_t stripe;      // index of the next strip
+  uint8_t *zdata;       // deflated strips of the batch, one compressBound() each
+  char *filename;
+  double convert_time, compress_time, write_time;
 }
 dt_imageio_tiff_t;
 
+// the parameters of version 1. they were stored up to the TIFF handle, including the padding before it.
+typedef struct dt_imageio_tiff_v1_t
+{
+  int max_width, max_height;
+  int width, height;
+  char style[128];
+  int bpp;
+  TIFF *handle;
+}
+dt_imageio_tiff_v1_t;
+
 typedef struct dt_imageio_tiff_gui_t
 {
   GtkToggleButton *b8, *b16;
+  GtkComboBox *compression;
+  GtkToggleButton *predictor;
 }
 dt_imageio_tiff_gui_t;
 
+static size_t _strip_size(const dt_imageio_tiff_t *d, const int rows)
+{
+  return (size_t)d->width*3*(d->bpp/8)*rows;
+}
 
-int write_image (dt_imageio_module_data_t *d_tmp, const char *filename, const void *in_void, void *exif, int exif_len, int imgid)
+static int _deflate(const dt_imageio_tiff_t *d)
+{
+  return d->compression == DT_TIFF_COMPRESSION_DEFLATE || d->compression == DT_TIFF_COMPRESSION_DEFLATE_FAST;
+}
+
+// what libtiff does for us in TIFFWriteEncodedStrip(), for strips we deflate ourselves:
+static void _prepare_strip(const dt_imageio_tiff_t *d, uint8_t *strip, const int rows)
+{
+  const int width = d->width;
+  if(d->bpp == 16)
+  {
+    for(int y=0; y<rows; y++)
+    {
+      uint16_t *row = (uint16_t *)strip + (size_t)3*width*y;
+      if(d->predictor)
+        for(int x=3*width-1; x>=3; x--) row[x] -= row[x-3];
+      if(TIFFIsByteSwapped(d->handle)) TIFFSwabArrayOfShort(row, 3*width);
+    }
+  }
+  else if(d->predictor)
+  {
+    for(int y=0; y<rows; y++)
+    {
+      uint8_t *row = strip + (size_t)3*width*y;
+      for(int x=3*width-1; x>=3; x--) row[x] -= row[x-3];
+    }
+  }
+}
+
+// encodes and writes the rows waiting in stripdata. the strips of a batch are deflated in
+// parallel, but written in order:
+static int _write_strips(dt_imageio_tiff_t *d)
+{
+  if(!d->rows) return 0;
+  const int rows = d->rows;
+  const int strips = (rows + DT_TIFFIO_STRIPE - 1)/DT_TIFFIO_STRIPE;
+  const size_t stripsize = _strip_size(d, DT_TIFFIO_STRIPE);
+  d->rows = 0;
+
+  if(!_deflate(d))
+  {
+    double start = dt_get_wtime();
+    for(int s=0; s<strips; s++)
+    {
+      const int h = MIN(DT_TIFFIO_STRIPE, rows - s*DT_TIFFIO_STRIPE);
+      if(TIFFWriteEncodedStrip(d->handle, d->stripe++, d->stripdata + s*stripsize, _strip_size(d, h)) < 0) return 1;
+    }
+    d->write_time += dt_get_wtime() - start;
+    return 0;
+  }
+
+  const uLong bound = compressBound(stripsize);
+  const int level = d->compression == DT_TIFF_COMPRESSION_DEFLATE_FAST ? Z_BEST_SPEED : Z_BEST_COMPRESSION;
+  uLongf zsize[strips];
+  int err = 0;
+  double start = dt_get_wtime();
+#ifdef _OPENMP
+  #pragma omp parallel for default(none) shared(d, zsize, err) schedule(dynamic)
+#endif
+  for(int s=0; s<strips; s++)
+  {
+    const int h = MIN(DT_TIFFIO_STRIPE, rows - s*DT_TIFFIO_STRIPE);
+    uint8_t *strip = d->stripdata + s*stripsize;
+    _prepare_strip(d, strip, h);
+    zsize[s] = bound;
+    if(compress2(d->zdata + s*bound, zsize + s, strip, _strip_size(d, h), level) != Z_OK) err = 1;
+  }
+  d->compress_time += dt_get_wtime() - start;
+  if(err) return 1;
+
+  start = dt_get_wtime();
+  for(int s=0; s<strips; s++)
+    if(TIFFWriteRawStrip(d->handle, d->stripe++, d->zdata + s*bound, zsize[s]) < 0) return 1;
+  d->write_time += dt_get_wtime() - start;
+  return 0;
+}
+
+
+int write_image_begin(dt_imageio_module_data_t *d_tmp, const char *filename, int imgid)
 {
   dt_imageio_tiff_t *d=(dt_imageio_tiff_t*)d_tmp;
   // Fetch colorprofile into buffer if wanted
-  uint8_t *profile = NULL;
   uint32_t profile_len = 0;
-  int rc = 0;
+  d->profile = NULL;
 
   if(imgid > 0)
   {
@@ -62,104 +178,141 @@ int write_image (dt_imageio_module_data_t *d_tmp, const char *filename, const vo
     cmsSaveProfileToMem(out_profile, 0, &profile_len);
     if (profile_len > 0)
     {
-      profile=malloc(profile_len);
-      cmsSaveProfileToMem(out_profile, profile, &profile_len);
+      d->profile=malloc(profile_len);
+      cmsSaveProfileToMem(out_profile, d->profile, &profile_len);
     }
     dt_colorspaces_cleanup_profile(out_profile);
   }
 
   // Create tiff image
   TIFF *tif=TIFFOpen(filename,"wb");
+  if(!tif)
+  {
+    free(d->profile);
+    d->profile = NULL;
+    return 1;
+  }
   if(d->bpp == 8) TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 8);
   else            TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 16);
-  TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_DEFLATE);
+  if(d->compression == DT_TIFF_COMPRESSION_NONE) TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_NONE);
+  else if(d->compression == DT_TIFF_COMPRESSION_LZW) TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_LZW);
+  else TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_DEFLATE);
   TIFFSetField(tif, TIFFTAG_FILLORDER, FILLORDER_MSB2LSB);
-  if(profile!=NULL)
-    TIFFSetField(tif, TIFFTAG_ICCPROFILE, profile_len, profile);
+  if(d->profile!=NULL)
+    TIFFSetField(tif, TIFFTAG_ICCPROFILE, profile_len, d->profile);
   TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, d->width);
   TIFFSetField(tif, TIFFTAG_IMAGELENGTH, d->height);
   TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
   TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
-  TIFFSetField(tif, TIFFTAG_PREDICTOR, 1);		// Reference www.awaresystems.be/imaging/tiff/tifftags/predictor.html
+  // Reference www.awaresystems.be/imaging/tiff/tifftags/predictor.html
+  TIFFSetField(tif, TIFFTAG_PREDICTOR, (d->predictor && d->compression != DT_TIFF_COMPRESSION_NONE) ? 2 : 1);
   TIFFSetField(tif, TIFFTAG_RESOLUTIONUNIT, RESUNIT_INCH);
   TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, DT_TIFFIO_STRIPE);
   TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 3);
   TIFFSetField(tif, TIFFTAG_XRESOLUTION, 300.0);
   TIFFSetField(tif, TIFFTAG_YRESOLUTION, 300.0);
-  TIFFSetField(tif, TIFFTAG_ZIPQUALITY, 9);
+  if(_deflate(d))
+    TIFFSetField(tif, TIFFTAG_ZIPQUALITY, d->compression == DT_TIFF_COMPRESSION_DEFLATE_FAST ? 1 : 9);
+  if(d->compression == DT_TIFF_COMPRESSION_NONE) d->predictor = 0;
+
+  d->handle = tif;
+  d->strips = _deflate(d) ? dt_get_num_threads() : 1;
+  d->stripdata = (uint8_t *)malloc(_strip_size(d, DT_TIFFIO_STRIPE)*d->strips);
+  d->zdata = _deflate(d) ? (uint8_t *)malloc(compressBound(_strip_size(d, DT_TIFFIO_STRIPE))*d->strips) : NULL;
+  d->rows = 0;
+  d->stripe = 0;
+  d->filename = g_strdup(filename);
+  d->convert_time = d->compress_time = d->write_time = 0.0;
+  if(!d->stripdata || (_deflate(d) && !d->zdata))
+  {
+    TIFFClose(tif);
+    d->handle = NULL;
+    free(d->stripdata);
+    free(d->zdata);
+    d->stripdata = d->zdata = NULL;
+    free(d->profile);
+    d->profile = NULL;
+    g_free(d->filename);
+    d->filename = NULL;
+    return 1;
+  }
+  return 0;
+}
 
-  const uint8_t  *in8 =(const uint8_t  *)in_void;
-  const uint16_t *in16=(const uint16_t *)in_void;
-  if(d->bpp == 16)
+int write_image_rows(dt_imageio_module_data_t *d_tmp, const void *in_void, int rows)
+{
+  dt_imageio_tiff_t *d=(dt_imageio_tiff_t*)d_tmp;
+  const size_t rowsize = _strip_size(d, 1);
+  double start = dt_get_wtime();
+  for(int y=0; y<rows; y++)
   {
-    uint32_t rowsize=(d->width*3)*sizeof(uint16_t);
-    uint32_t stripesize=rowsize*DT_TIFFIO_STRIPE;
-    uint16_t *rowdata = (uint16_t *)malloc(stripesize);
-    uint16_t *wdata = rowdata;
-    uint32_t stripe=0;
-    // uint32_t insize=((d->width*d->height)*3)*sizeof(uint16_t);
-    // while(stripedata<(in8+insize)-(stripesize)) {
-    // TIFFWriteEncodedStrip(tif,stripe++,stripedata,stripesize);
-    // stripedata+=stripesize;
-    // }
-    for (int y = 0; y < d->height; y++)
+    // drop the 4th channel:
+    if(d->bpp == 16)
     {
+      const uint16_t *in16 = (const uint16_t *)in_void + (size_t)4*d->width*y;
+      uint16_t *wdata = (uint16_t *)(d->stripdata + rowsize*d->rows);
       for(int x=0; x<d->width; x++)
-        for(int k=0; k<3; k++)
-        {
-          (wdata)[0] = in16[4*d->width*y + 4*x + k];
-          wdata++;
-        }
-      if((wdata-stripesize/sizeof(uint16_t))==rowdata)
-      {
-        TIFFWriteEncodedStrip(tif,stripe++,rowdata,rowsize*DT_TIFFIO_STRIPE);
-        wdata=rowdata;
-      }
+        for(int k=0; k<3; k++) *(wdata++) = in16[4*x + k];
     }
-    if((wdata-stripesize/sizeof(uint16_t))!=rowdata)
-      TIFFWriteEncodedStrip(tif,stripe,rowdata,(wdata-rowdata)*sizeof(uint16_t));
-    TIFFClose(tif);
-    free(rowdata);
-  }
-  else
-  {
-    uint32_t rowsize=(d->width*3)*sizeof(uint8_t);
-    uint32_t stripesize=rowsize*DT_TIFFIO_STRIPE;
-    uint8_t *rowdata = (uint8_t *)malloc(stripesize);
-    uint8_t *wdata = rowdata;
-    uint32_t stripe=0;
-
-    for (int y = 0; y < d->height; y++)
+    else
     {
+      const uint8_t *in8 = (const uint8_t *)in_void + (size_t)4*d->width*y;
+      uint8_t *wdata = d->stripdata + rowsize*d->rows;
       for(int x=0; x<d->width; x++)
-        for(int k=0; k<3; k++)
-        {
-          (wdata)[0] = in8[4*d->width*y + 4*x + k];
-          wdata++;
-        }
-      if((wdata-stripesize)==rowdata)
-      {
-        TIFFWriteEncodedStrip(tif,stripe++,rowdata,rowsize*DT_TIFFIO_STRIPE);
-        wdata=rowdata;
-      }
+        for(int k=0; k<3; k++) *(wdata++) = in8[4*x + k];
+    }
+    if(++d->rows == DT_TIFFIO_STRIPE*d->strips)
+    {
+      d->convert_time += dt_get_wtime() - start;
+      if(_write_strips(d)) return 1;
+      start = dt_get_wtime();
     }
-    if((wdata-stripesize)!=rowdata)
-      TIFFWriteEncodedStrip(tif,stripe,rowdata,wdata-rowdata);
-    TIFFClose(tif);
-    free(rowdata);
   }
+  d->convert_time += dt_get_wtime() - start;
+  return 0;
+}
 
-  if(exif)
-    rc = dt_exif_write_blob(exif,exif_len,filename);
-
-  free(profile);
-
+int write_image_end(dt_imageio_module_data_t *d_tmp, void *exif, int exif_len)
+{
+  dt_imageio_tiff_t *d=(dt_imageio_tiff_t*)d_tmp;
+  int rc = 1; // no exif to write is no error
+
+  // last, partial batch. clean up either way:
+  const int err = _write_strips(d);
+  double start = dt_get_wtime();
+  TIFFClose(d->handle);
+  d->write_time += dt_get_wtime() - start;
+  d->handle = NULL;
+  free(d->stripdata);
+  free(d->zdata);
+  d->stripdata = d->zdata = NULL;
+  dt_print(DT_DEBUG_PERF, "[tiff] %s: converting took %.3f secs, compressing %.3f secs, writing %.3f secs\n",
+           d->filename, d->convert_time, d->compress_time, d->write_time);
+
+  if(exif && !err)
+    rc = dt_exif_write_blob(exif,exif_len,d->filename);
+
+  free(d->profile);
+  d->profile = NULL;
+  g_free(d->filename);
+  d->filename = NULL;
+
+  if(err) return 1;
   /*
    * Until we get symbolic error status codes, if rc is 1, return 0.
    */
   return ((rc == 1) ? 0 : 1);
 }
 
+int write_image (dt_imageio_module_data_t *d_tmp, const char *filename, const void *in_void, void *exif, int exif_len, int imgid)
+{
+  if(write_image_begin(d_tmp, filename, imgid)) return 1;
+  // always end the image, it frees what begin allocated:
+  const int err = write_image_rows(d_tmp, in_void, d_tmp->height);
+  const int res = write_image_end(d_tmp, exif, exif_len);
+  return err ? 1 : res;
+}
+
 #if 0
 int dt_imageio_tiff_read_header(const char *filename, dt_imageio_tiff_t *tiff)
 {
@@ -182,7 +335,7 @@ int dt_imageio_tiff_read(dt_imageio_tiff_t *tiff, uint8_t *out)
 size_t
 params_size(dt_imageio_module_format_t *self)
 {
-  return sizeof(dt_imageio_tiff_t) - sizeof(TIFF*);
+  return offsetof(dt_imageio_tiff_t, handle);
 }
 
 void*
@@ -193,6 +346,8 @@ get_params(dt_imageio_module_format_t *self)
   d->bpp = dt_conf_get_int("plugins/imageio/format/tiff/bpp");
   if(d->bpp < 12) d->bpp = 8;
   else            d->bpp = 16;
+  d->compression = CLAMP(dt_conf_get_int("plugins/imageio/format/tiff/compression"), DT_TIFF_COMPRESSION_NONE, DT_TIFF_COMPRESSION_DEFLATE);
+  d->predictor = dt_conf_get_bool("plugins/imageio/format/tiff/predictor");
   return d;
 }
 
@@ -205,12 +360,17 @@ free_params(dt_imageio_module_format_t *self, dt_imageio_module_data_t *params)
 int
 set_params(dt_imageio_module_format_t *self, const void *params, const int size)
 {
-  if(size != self->params_size(self)) return 1;
+  const int old = (size == offsetof(dt_imageio_tiff_v1_t, handle));
+  if(size != self->params_size(self) && !old) return 1;
   dt_imageio_tiff_t *d = (dt_imageio_tiff_t *)params;
   dt_imageio_tiff_gui_t *g = (dt_imageio_tiff_gui_t *)self->gui_data;
   if(d->bpp < 12) gtk_toggle_button_set_active(g->b8, TRUE);
   else            gtk_toggle_button_set_active(g->b16, TRUE);
   dt_conf_set_int("plugins/imageio/format/tiff/bpp", d->bpp);
+  // version 1 params end before the compression settings, those are kept as they are:
+  if(old) return 0;
+  gtk_combo_box_set_active(g->compression, d->compression);
+  gtk_toggle_button_set_active(g->predictor, d->predictor);
   return 0;
 }
 
@@ -250,31 +410,70 @@ radiobutton_changed (GtkRadioButton *radiobutton, gpointer user_data)
     dt_conf_set_int("plugins/imageio/format/tiff/bpp", bpp);
 }
 
+static void
+compression_changed (GtkComboBox *widget, gpointer user_data)
+{
+  dt_conf_set_int("plugins/imageio/format/tiff/compression", gtk_combo_box_get_active(widget));
+}
+
+static void
+predictor_toggled (GtkToggleButton *button, gpointer user_data)
+{
+  dt_conf_set_bool("plugins/imageio/format/tiff/predictor", gtk_toggle_button_get_active(button));
+}
+
 void init(dt_imageio_module_format_t *self)
 {
 #ifdef USE_LUA
   dt_lua_register_module_member(darktable.lua_state,self,dt_imageio_tiff_t,bpp,int);
+  dt_lua_register_module_member(darktable.lua_state,self,dt_imageio_tiff_t,compression,int);
+  dt_lua_register_module_member(darktable.lua_state,self,dt_imageio_tiff_t,predictor,int);
 #endif
 }
 void cleanup(dt_imageio_module_format_t *self) {}
 
-// TODO: some quality/compression stuff?
 void gui_init (dt_imageio_module_format_t *self)
 {
   dt_imageio_tiff_gui_t *gui = (dt_imageio_tiff_gui_t *)malloc(sizeof(dt_imageio_tiff_gui_t));
   self->gui_data = (void *)gui;
   int bpp = dt_conf_get_int("plugins/imageio/format/tiff/bpp");
-  self->widget = gtk_hbox_new(TRUE, 5);
+  self->widget = gtk_vbox_new(TRUE, 5);
+  GtkWidget *hbox = gtk_hbox_new(TRUE, 5);
+  gtk_box_pack_start(GTK_BOX(self->widget), hbox, TRUE, TRUE, 0);
   GtkWidget *radiobutton = gtk_radio_button_new_with_label(NULL, _("8-bit"));
   gui->b8 = GTK_TOGGLE_BUTTON(radiobutton);
-  gtk_box_pack_start(GTK_BOX(self->widget), radiobutton, TRUE, TRUE, 0);
+  gtk_box_pack_start(GTK_BOX(hbox), radiobutton, TRUE, TRUE, 0);
   g_signal_connect(G_OBJECT(radiobutton), "toggled", G_CALLBACK(radiobutton_changed), (gpointer)8);
   if(bpp < 12) gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(radiobutton), TRUE);
   radiobutton = gtk_radio_button_new_with_label_from_widget(GTK_RADIO_BUTTON(radiobutton), _("16-bit"));
   gui->b16 = GTK_TOGGLE_BUTTON(radiobutton);
-  gtk_box_pack_start(GTK_BOX(self->widget), radiobutton, TRUE, TRUE, 0);
+  gtk_box_pack_start(GTK_BOX(hbox), radiobutton, TRUE, TRUE, 0);
   g_signal_connect(G_OBJECT(radiobutton), "toggled", G_CALLBACK(radiobutton_changed), (gpointer)16);
   if(bpp >= 12) gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(radiobutton), TRUE);
+
+  hbox = gtk_hbox_new(FALSE, 5);
+  gtk_box_pack_start(GTK_BOX(self->widget), hbox, TRUE, TRUE, 0);
+  GtkWidget *label = gtk_label_new(_("compression"));
+  gtk_misc_set_alignment(GTK_MISC(label), 0.0, 0.5);
+  gtk_box_pack_start(GTK_BOX(hbox), label, TRUE, TRUE, 0);
+  GtkWidget *combo = gtk_combo_box_new_text();
+  gui->compression = GTK_COMBO_BOX(combo);
+  // same order as dt_imageio_tiff_compression_t:
+  gtk_combo_box_append_text(GTK_COMBO_BOX(combo), _("uncompressed"));
+  gtk_combo_box_append_text(GTK_COMBO_BOX(combo), _("deflate, fast"));
+  gtk_combo_box_append_text(GTK_COMBO_BOX(combo), _("LZW"));
+  gtk_combo_box_append_text(GTK_COMBO_BOX(combo), _("deflate, best"));
+  gtk_combo_box_set_active(GTK_COMBO_BOX(combo),
+                           CLAMP(dt_conf_get_int("plugins/imageio/format/tiff/compression"), DT_TIFF_COMPRESSION_NONE, DT_TIFF_COMPRESSION_DEFLATE));
+  gtk_box_pack_start(GTK_BOX(hbox), combo, TRUE, TRUE, 0);
+  g_signal_connect(G_OBJECT(combo), "changed", G_CALLBACK(compression_changed), NULL);
+
+  GtkWidget *button = gtk_check_button_new_with_label(_("horizontal predictor"));
+  gui->predictor = GTK_TOGGLE_BUTTON(button);
+  g_object_set(G_OBJECT(button), "tooltip-text", _("store differences to the left neighbour, smaller files for photographs"), (char *)NULL);
+  gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(button), dt_conf_get_bool("plugins/imageio/format/tiff/predictor"));
+  gtk_box_pack_start(GTK_BOX(self->widget), button, TRUE, TRUE, 0);
+  g_signal_connect(G_OBJECT(button), "toggled", G_CALLBACK(predictor_toggled), NULL);
 }
 
 void gui_cleanup (dt_imageio_module_format_t *self)
@@ -483,6 +483,8 @@ process (struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece, voi
 
   for(int scale=0; scale<max_scale; scale++)
   {
+    // the pipe starts over anyways, nothing to keep:
+    if(dt_iop_cancelled(piece)) goto error;
     eaw_decompose (buf2, buf1, detail[scale], scale, sharp[scale], width, height);
     if(scale == 0) buf1 = (float *)o;  // now switch to (float *)o for buffer ping-pong between buf1 and buf2
     float *buf3 = buf2;
@@ -492,6 +494,7 @@ process (struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece, voi
 
   for(int scale=max_scale-1; scale>=0; scale--)
   {
+    if(dt_iop_cancelled(piece)) goto error;
     eaw_synthesize (buf2, buf1, detail[scale], thrs[scale], boost[scale], width, height);
     float *buf3 = buf2;
     buf2 = buf1;
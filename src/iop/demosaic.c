@@ -116,7 +116,7 @@ groups ()
 int
 flags ()
 {
-  return IOP_FLAGS_ALLOW_TILING | IOP_FLAGS_ONE_INSTANCE;
+  return IOP_FLAGS_ALLOW_TILING | IOP_FLAGS_ONE_INSTANCE | IOP_FLAGS_ROI_INVARIANT;
 }
 
 void init_key_accels(dt_iop_module_so_t *self)
@@ -1132,7 +1132,10 @@ void tiling_callback  (struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop
 
   tiling->maxbuf = 1.0f;
   tiling->overhead = 0;
-  tiling->overlap = 5; // take care of border handling
+  // take care of border handling: ppg reads 4 pixels away, its pre-median 2 more, local green
+  // equilibration another 2 before that and every smoothing pass one after:
+  tiling->overlap = 6 + data->color_smoothing;
+  if(data->green_eq == DT_IOP_GREEN_EQ_LOCAL || data->green_eq == DT_IOP_GREEN_EQ_BOTH) tiling->overlap += 2;
   tiling->xalign = 2; // Bayer pattern
   tiling->yalign = 2; // Bayer pattern
   return;
@@ -1216,6 +1219,11 @@ void commit_params (struct dt_iop_module_t *self, dt_iop_params_t *params, dt_de
   // OpenCL can not (yet) green-equilibrate over full image.
   if(d->green_eq == DT_IOP_GREEN_EQ_FULL || d->green_eq == DT_IOP_GREEN_EQ_BOTH)
     piece->process_cl_ready = 0;
+
+  // the full green equilibration averages over the whole roi, and amaze isn't covered by the overlap:
+  if(d->green_eq == DT_IOP_GREEN_EQ_FULL || d->green_eq == DT_IOP_GREEN_EQ_BOTH ||
+     (d->demosaicing_method == DT_IOP_DEMOSAIC_AMAZE && !(pipe->type == DT_DEV_PIXELPIPE_FULL && get_quality() < 2)))
+    piece->roi_invariant = 0;
 }
 
 void init_pipe     (struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
@@ -579,6 +579,8 @@ void process_wavelets(
 
   for(int scale=0; scale<max_scale; scale++)
   {
+    // the pipe starts over anyways, nothing to keep:
+    if(dt_iop_cancelled(piece)) goto cleanup;
     const float sigma = 1.0f;
     const float varf = sqrtf(2.0f + 2.0f * 4.0f*4.0f + 6.0f*6.0f)/16.0f; // about 0.5
     const float sigma_band = powf(varf, scale) *sigma;
@@ -612,6 +614,7 @@ void process_wavelets(
   // now do everything backwards, so the result will end up in *ovoid
   for(int scale=max_scale-1; scale>=0; scale--)
   {
+    if(dt_iop_cancelled(piece)) goto cleanup;
 #if 1
     // variance stabilizing transform maps sigma to unity.
     const float sigma = 1.0f;
@@ -659,6 +662,7 @@ void process_wavelets(
 
   backtransform((float *)ovoid, width, height, aa, bb);
 
+cleanup:
   for(int k=0; k<max_scale; k++)
     free(buf[k]);
   free(tmp);
@@ -724,11 +728,13 @@ void process_nlmeans(
       // don't construct summed area tables but use sliding window! (applies to cpu version res < 1k only, or else we will add up errors)
       // do this in parallel with a little threading overhead. could parallelize the outer loops with a bit more memory
 #ifdef _OPENMP
-      #  pragma omp parallel for schedule(static) default(none) firstprivate(inited_slide) shared(kj, ki, roi_out, roi_in, in, ovoid, Sa)
+      #  pragma omp parallel for schedule(static) default(none) firstprivate(inited_slide) shared(kj, ki, roi_out, roi_in, in, ovoid, Sa, piece)
 #endif
       for(int j=0; j<roi_out->height; j++)
       {
         if(j+kj < 0 || j+kj >= roi_out->height) continue;
+        // skip the remaining work if the pipe will start over anyways:
+        if(dt_iop_cancelled(piece)) continue;
         float *S = Sa + dt_get_thread_num() * roi_out->width;
         const float *ins = in + 4*(roi_in->width *(j+kj) + ki);
         float *out = ((float *)ovoid) + 4*roi_out->width*j;
@@ -25,6 +25,7 @@
 #include <xmmintrin.h>
 #include "develop/develop.h"
 #include "develop/imageop.h"
+#include "develop/tiling.h"
 #include "control/control.h"
 #include "gui/accelerators.h"
 #include "gui/gtk.h"
@@ -81,7 +82,7 @@ groups ()
 int
 flags ()
 {
-  return IOP_FLAGS_ALLOW_TILING | IOP_FLAGS_ONE_INSTANCE;
+  return IOP_FLAGS_ALLOW_TILING | IOP_FLAGS_ONE_INSTANCE | IOP_FLAGS_ROI_INVARIANT;
 }
 
 int
@@ -152,6 +153,18 @@ output_bpp(dt_iop_module_t *module, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_i
   else return 4*sizeof(float);
 }
 
+void tiling_callback  (struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece, const dt_iop_roi_t *roi_in, const dt_iop_roi_t *roi_out, struct dt_develop_tiling_t *tiling)
+{
+  dt_iop_highlights_data_t *d = (dt_iop_highlights_data_t *)piece->data;
+
+  tiling->factor = 2.0f;  // in + out
+  tiling->maxbuf = 1.0f;
+  tiling->overhead = 0;
+  tiling->overlap = d->mode == DT_IOP_HIGHLIGHTS_LCH ? 1 : 0; // lch looks at the 3x3 neighbourhood
+  tiling->xalign = 1;
+  tiling->yalign = 1;
+  return;
+}
 
 void process(
     struct dt_iop_module_t *self,
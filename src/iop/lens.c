@@ -136,6 +136,149 @@ _lens_sanitize(const char *orig_lens)
 }
 
 
+// the distorted coordinates are smooth, so process() interpolates them from a
+// coarse grid as long as that stays this close (in pixels) to the exact values:
+#define DT_IOP_LENS_MAP_TOLERANCE 0.05f
+#define DT_IOP_LENS_MAP_MAX_STEP 32
+#define DT_IOP_LENS_MAP_MIN_STEP 8
+
+// returns the modifier for the current params and image size, only creating a new one if needed.
+// process() and process_cl() run under the pipe's busy mutex, as does commit_params().
+static lfModifier *_get_modifier(dt_iop_lensfun_data_t *d, const float orig_w, const float orig_h)
+{
+  if(d->modifier && d->modifier_w == orig_w && d->modifier_h == orig_h) return d->modifier;
+
+  if(d->modifier) lf_modifier_destroy(d->modifier);
+  d->map_valid = 0;
+
+  dt_pthread_mutex_lock(&darktable.plugin_threadsafe);
+  d->modifier = lf_modifier_new(d->lens, d->crop, orig_w, orig_h);
+
+  d->modflags = lf_modifier_initialize(
+                  d->modifier, d->lens, LF_PF_F32,
+                  d->focal, d->aperture,
+                  d->distance, d->scale,
+                  d->target_geom, d->modify_flags, d->inverse);
+  dt_pthread_mutex_unlock(&darktable.plugin_threadsafe);
+  d->modifier_w = orig_w;
+  d->modifier_h = orig_h;
+  return d->modifier;
+}
+
+static void _free_modifier(dt_iop_lensfun_data_t *d)
+{
+  if(d->modifier) lf_modifier_destroy(d->modifier);
+  d->modifier = NULL;
+  free(d->map);
+  d->map = NULL;
+  d->map_valid = 0;
+}
+
+static inline void _map_lerp(const float *m0, const float *m1, const int step,
+                             const int x, const float fy, float *pi)
+{
+  const int i = x/step;
+  const float fx = (x - i*step)/(float)step;
+  const float *a = m0 + 6*i, *b = a + 6, *c = m1 + 6*i, *e = c + 6;
+  for(int k=0; k<6; k++)
+  {
+    const float top = a[k] + fx*(b[k] - a[k]);
+    const float bottom = c[k] + fx*(e[k] - c[k]);
+    pi[k] = top + fy*(bottom - top);
+  }
+}
+
+// samples the distorted coordinates of roi_out on a grid of the coarsest step that
+// stays within DT_IOP_LENS_MAP_TOLERANCE in the cell centres. kept until the roi or the modifier change.
+static void _build_map(dt_iop_lensfun_data_t *d, lfModifier *modifier, const dt_iop_roi_t *roi_out)
+{
+  if(d->map_valid && d->map_roi.x == roi_out->x && d->map_roi.y == roi_out->y
+     && d->map_roi.width == roi_out->width && d->map_roi.height == roi_out->height
+     && d->map_roi.scale == roi_out->scale)
+    return;
+
+  free(d->map);
+  d->map = NULL;
+  d->map_step = 0;
+  d->map_roi = *roi_out;
+  d->map_valid = 1;
+
+  // small buffers are cheaper to do exactly
+  if(roi_out->width < 4*DT_IOP_LENS_MAP_MIN_STEP || roi_out->height < 4*DT_IOP_LENS_MAP_MIN_STEP) return;
+
+  for(int step = DT_IOP_LENS_MAP_MAX_STEP; step >= DT_IOP_LENS_MAP_MIN_STEP; step /= 2)
+  {
+    // one more node than needed to cover the last pixel, so lerping never reads past the grid
+    const int nx = (roi_out->width-1)/step + 2;
+    const int ny = (roi_out->height-1)/step + 2;
+    float *map = (float *)dt_alloc_align(16, (size_t)6*nx*ny*sizeof(float));
+    float *err = (float *)malloc(sizeof(float)*ny);
+    if(!map || !err)
+    {
+      free(map);
+      free(err);
+      return;
+    }
+
+#ifdef _OPENMP
+    #pragma omp parallel for default(none) shared(map, modifier, roi_out, step) schedule(static)
+#endif
+    for(int j=0; j<ny; j++)
+      for(int i=0; i<nx; i++)
+        lf_modifier_apply_subpixel_geometry_distortion(
+          modifier, roi_out->x + i*step, roi_out->y + j*step, 1, 1, map + (size_t)6*(j*nx + i));
+
+#ifdef _OPENMP
+    #pragma omp parallel for default(none) shared(map, err, modifier, roi_out, step) schedule(static)
+#endif
+    for(int j=0; j<ny-1; j++)
+    {
+      const float *m0 = map + (size_t)6*j*nx, *m1 = m0 + 6*nx;
+      float exact[6], approx[6];
+      err[j] = 0.0f;
+      for(int i=0; i<nx-1; i++)
+      {
+        lf_modifier_apply_subpixel_geometry_distortion(
+          modifier, roi_out->x + i*step + step/2, roi_out->y + j*step + step/2, 1, 1, exact);
+        _map_lerp(m0, m1, step, i*step + step/2, 0.5f, approx);
+        for(int k=0; k<6; k++) err[j] = fmaxf(err[j], fabsf(exact[k] - approx[k]));
+      }
+    }
+    float max_err = 0.0f;
+    for(int j=0; j<ny-1; j++) max_err = fmaxf(max_err, err[j]);
+    free(err);
+
+    if(max_err <= DT_IOP_LENS_MAP_TOLERANCE)
+    {
+      d->map = map;
+      d->map_step = step;
+      d->map_nx = nx;
+      d->map_ny = ny;
+      dt_print(DT_DEBUG_PERF, "[lens] coordinate grid %dx%d, step %d, max error %.3f px\n", nx, ny, step, max_err);
+      return;
+    }
+    free(map);
+  }
+  dt_print(DT_DEBUG_PERF, "[lens] distortion too strong for the coordinate grid, computing all pixels\n");
+}
+
+// fills pi with the 6 distorted coordinates (r, g, b) of each pixel in row y of roi_out
+static inline void _map_row(const dt_iop_lensfun_data_t *d, lfModifier *modifier,
+                            const dt_iop_roi_t *roi_out, const int y, float *pi)
+{
+  const int step = d->map_step;
+  if(!step)
+  {
+    lf_modifier_apply_subpixel_geometry_distortion(modifier, roi_out->x, roi_out->y+y, roi_out->width, 1, pi);
+    return;
+  }
+  const int j = y/step;
+  const float fy = (y - j*step)/(float)step;
+  const float *m0 = d->map + (size_t)6*j*d->map_nx, *m1 = m0 + 6*d->map_nx;
+  for(int x = 0; x < roi_out->width; x++, pi+=6)
+    _map_lerp(m0, m1, step, x, fy, pi);
+}
+
 void
 process (struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, void *ivoid, void *ovoid, const dt_iop_roi_t *roi_in, const dt_iop_roi_t *roi_out)
 {
@@ -158,15 +301,10 @@ process (struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, void *ivoi
 
   const float orig_w = roi_in->scale*piece->iwidth,
               orig_h = roi_in->scale*piece->iheight;
-  dt_pthread_mutex_lock(&darktable.plugin_threadsafe);
-  lfModifier *modifier = lf_modifier_new(d->lens, d->crop, orig_w, orig_h);
-
-  int modflags = lf_modifier_initialize(
-                   modifier, d->lens, LF_PF_F32,
-                   d->focal, d->aperture,
-                   d->distance, d->scale,
-                   d->target_geom, d->modify_flags, d->inverse);
-  dt_pthread_mutex_unlock(&darktable.plugin_threadsafe);
+  lfModifier *modifier = _get_modifier(d, orig_w, orig_h);
+  const int modflags = d->modflags;
+  // without tca all channels share their coordinates, and all four can be interpolated at once:
+  const int same_coords = !(modflags & LF_MODIFY_TCA) && ch == 4;
 
   if(d->inverse)
   {
@@ -184,6 +322,7 @@ process (struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, void *ivoi
       }
 
       const struct  dt_interpolation* interpolation = dt_interpolation_new(DT_INTERPOLATION_USERPREF);
+      _build_map(d, modifier, roi_out);
 
 #ifdef _OPENMP
       #pragma omp parallel for default(none) shared(roi_out, roi_in, in, d, ovoid, modifier, interpolation) schedule(static)
@@ -191,12 +330,17 @@ process (struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, void *ivoi
       for (int y = 0; y < roi_out->height; y++)
       {
         float *pi = (float *)(((char *)d->tmpbuf2) + req2*dt_get_thread_num());
-        lf_modifier_apply_subpixel_geometry_distortion (
-          modifier, roi_out->x, roi_out->y+y, roi_out->width, 1, pi);
+        _map_row(d, modifier, roi_out, y, pi);
         // reverse transform the global coords from lf to our buffer
         float *buf = ((float *)ovoid) + y*roi_out->width*ch;
         for (int x = 0; x < roi_out->width; x++,buf+=ch,pi+=6)
         {
+          if(same_coords)
+          {
+            dt_interpolation_compute_pixel4c(interpolation, in, buf, pi[2] - roi_in->x, pi[3] - roi_in->y,
+                                             roi_in->width, roi_in->height, ch_width);
+            continue;
+          }
           for(int c=0; c<3; c++)
           {
             const float pi0 = pi[c*2] - roi_in->x;
@@ -279,6 +423,7 @@ process (struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, void *ivoi
       }
 
       const struct dt_interpolation* interpolation = dt_interpolation_new(DT_INTERPOLATION_USERPREF);
+      _build_map(d, modifier, roi_out);
 
 #ifdef _OPENMP
       #pragma omp parallel for default(none) shared(roi_in, roi_out, d, ovoid, modifier, interpolation) schedule(static)
@@ -286,12 +431,18 @@ process (struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, void *ivoi
       for (int y = 0; y < roi_out->height; y++)
       {
         float *pi = (float *)(((char *)d->tmpbuf2) + dt_get_thread_num()*req2);
-        lf_modifier_apply_subpixel_geometry_distortion (
-          modifier, roi_out->x, roi_out->y+y, roi_out->width, 1, pi);
+        _map_row(d, modifier, roi_out, y, pi);
         // reverse transform the global coords from lf to our buffer
         float *out = ((float *)ovoid) + y*roi_out->width*ch;
         for (int x = 0; x < roi_out->width; x++,pi+=6)
         {
+          if(same_coords)
+          {
+            dt_interpolation_compute_pixel4c(interpolation, d->tmpbuf, out, pi[2] - roi_in->x, pi[3] - roi_in->y,
+                                             roi_in->width, roi_in->height, ch_width);
+            out += ch;
+            continue;
+          }
           for(int c=0; c<3; c++)
           {
             const float pi0 = pi[c*2] - roi_in->x;
@@ -321,7 +472,6 @@ process (struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, void *ivoi
         memcpy(out+ch*y*roi_out->width, input+ch*y*roi_out->width, ch*sizeof(float)*roi_out->width);
     }
   }
-  lf_modifier_destroy(modifier);
 
   if(g != NULL && self->dev->gui_attached && piece->pipe->type == DT_DEV_PIXELPIPE_PREVIEW)
   {
@@ -408,15 +558,8 @@ process_cl (struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_mem
   if(dev_tmpbuf == NULL) goto error;
 
 
-  dt_pthread_mutex_lock(&darktable.plugin_threadsafe);
-  modifier = lf_modifier_new(d->lens, d->crop, orig_w, orig_h);
-
-  int modflags = lf_modifier_initialize(
-                   modifier, d->lens, LF_PF_F32,
-                   d->focal, d->aperture,
-                   d->distance, d->scale,
-                   d->target_geom, d->modify_flags, d->inverse);
-  dt_pthread_mutex_unlock(&darktable.plugin_threadsafe);
+  modifier = _get_modifier(d, orig_w, orig_h);
+  const int modflags = d->modflags;
 
   if(d->inverse)
   {
@@ -424,14 +567,14 @@ process_cl (struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_mem
     if(modflags & (LF_MODIFY_TCA | LF_MODIFY_DISTORTION |
                    LF_MODIFY_GEOMETRY | LF_MODIFY_SCALE))
     {
+      _build_map(d, modifier, roi_out);
 #ifdef _OPENMP
       #pragma omp parallel for default(none) shared(roi_out, roi_in, tmpbuf, d, modifier) schedule(static)
 #endif
       for (int y = 0; y < roi_out->height; y++)
       {
         float *pi = tmpbuf + y * tmpbufwidth;
-        lf_modifier_apply_subpixel_geometry_distortion (
-          modifier, roi_out->x, roi_out->y+y, roi_out->width, 1, pi);
+        _map_row(d, modifier, roi_out, y, pi);
       }
 
       /* _blocking_ memory transfer: host tmpbuf buffer -> opencl dev_tmpbuf */
@@ -533,14 +676,14 @@ process_cl (struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_mem
     if(modflags & (LF_MODIFY_TCA | LF_MODIFY_DISTORTION |
                    LF_MODIFY_GEOMETRY | LF_MODIFY_SCALE))
     {
+      _build_map(d, modifier, roi_out);
 #ifdef _OPENMP
       #pragma omp parallel for default(none) shared(roi_out, roi_in, tmpbuf, d, modifier) schedule(static)
 #endif
       for (int y = 0; y < roi_out->height; y++)
       {
         float *pi = tmpbuf + y * tmpbufwidth;
-        lf_modifier_apply_subpixel_geometry_distortion (
-          modifier, roi_out->x, roi_out->y+y, roi_out->width, 1, pi);
+        _map_row(d, modifier, roi_out, y, pi);
       }
 
       /* _blocking_ memory transfer: host tmpbuf buffer -> opencl dev_tmpbuf */
@@ -575,14 +718,12 @@ process_cl (struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_mem
   dt_opencl_release_mem_object(dev_tmpbuf);
   dt_opencl_release_mem_object(dev_tmp);
   if (tmpbuf != NULL) free(tmpbuf);
-  if (modifier != NULL) lf_modifier_destroy(modifier);
   return TRUE;
 
 error:
   if (dev_tmp != NULL) dt_opencl_release_mem_object(dev_tmp);
   if (dev_tmpbuf != NULL) dt_opencl_release_mem_object(dev_tmpbuf);
   if (tmpbuf != NULL) free(tmpbuf);
-  if (modifier != NULL) lf_modifier_destroy(modifier);
   dt_print(DT_DEBUG_OPENCL, "[opencl_lens] couldn't enqueue kernel! %d\n", err);
   return FALSE;
 }
@@ -736,6 +877,8 @@ void commit_params (struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pi
   const lfCamera *camera = NULL;
   const lfCamera **cam = NULL;
 
+  // the modifier and the coordinates depend on everything below
+  _free_modifier(d);
   lf_lens_destroy(d->lens);
   d->lens = lf_lens_new();
 
@@ -801,6 +944,9 @@ void init_pipe (struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_p
   d->tmpbuf2 = NULL;
   d->tmpbuf_len = 0;
   d->tmpbuf = NULL;
+  d->modifier = NULL;
+  d->map = NULL;
+  d->map_valid = 0;
   d->lens = lf_lens_new();
   self->commit_params(self, self->default_params, pipe, piece);
 #endif
@@ -812,6 +958,7 @@ void cleanup_pipe (struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_de
 #error "lensfun needs to be ported to GEGL!"
 #else
   dt_iop_lensfun_data_t *d = (dt_iop_lensfun_data_t *)piece->data;
+  _free_modifier(d);
   lf_lens_destroy(d->lens);
   free(d->tmpbuf);
   free(d->tmpbuf2);
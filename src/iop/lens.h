@@ -108,6 +108,17 @@ typedef struct dt_iop_lensfun_data_t
   float aperture;
   float distance;
   lfLensType target_geom;
+  // kept between runs of process() and process_cl(), dropped in commit_params():
+  lfModifier *modifier;
+  float modifier_w, modifier_h;
+  int modflags;
+  // distorted coordinates (6 floats per node) on a coarse grid over map_roi,
+  // map_step == 0 means the grid wasn't precise enough and rows are computed exactly.
+  float *map;
+  int map_valid;
+  int map_step;
+  int map_nx, map_ny;
+  dt_iop_roi_t map_roi;
 }
 dt_iop_lensfun_data_t;
 
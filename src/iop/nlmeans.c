@@ -409,11 +409,13 @@ void process (struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, void
       // don't construct summed area tables but use sliding window! (applies to cpu version res < 1k only, or else we will add up errors)
       // do this in parallel with a little threading overhead. could parallelize the outer loops with a bit more memory
 #ifdef _OPENMP
-      #  pragma omp parallel for schedule(static) default(none) firstprivate(inited_slide) shared(kj, ki, roi_out, roi_in, ivoid, ovoid, Sa)
+      #  pragma omp parallel for schedule(static) default(none) firstprivate(inited_slide) shared(kj, ki, roi_out, roi_in, ivoid, ovoid, Sa, piece)
 #endif
       for(int j=0; j<roi_out->height; j++)
       {
         if(j+kj < 0 || j+kj >= roi_out->height) continue;
+        // skip the remaining work if the pipe will start over anyways:
+        if(dt_iop_cancelled(piece)) continue;
         float *S = Sa + dt_get_thread_num() * roi_out->width;
         const float *ins = ((float *)ivoid) + 4*(roi_in->width *(j+kj) + ki);
         float *out = ((float *)ovoid) + 4*roi_out->width*j;
@@ -88,7 +88,7 @@ groups ()
 int
 flags ()
 {
-  return IOP_FLAGS_ALLOW_TILING | IOP_FLAGS_ONE_INSTANCE;
+  return IOP_FLAGS_ALLOW_TILING | IOP_FLAGS_ONE_INSTANCE | IOP_FLAGS_ROI_INVARIANT;
 }
 
 void init_key_accels(dt_iop_module_so_t *self)
@@ -252,7 +252,7 @@ void process (struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, void
       const float *in = ((float *)ivoid) + j*roi_out->width;
       float *out = ((float*)ovoid) + j*roi_out->width;
       for(int i=0; i<roi_out->width; i++,out++,in++)
-        *out = *in * d->coeffs[FC(j+roi_out->x, i+roi_out->y, filters)];
+        *out = *in * d->coeffs[FC(j+roi_out->y, i+roi_out->x, filters)];
     }
   }
   else
@@ -724,9 +724,6 @@ static gboolean _lib_filmstrip_expose_callback(GtkWidget *widget, GdkEventExpose
 
   const int col_start = max_cols/2 - strip->offset;
   const int empty_edge = (width - (max_cols * wd))/2;
-  int step_res = SQLITE_ROW;
-
-  sqlite3_stmt *stmt = NULL;
 
   /* mouse over image position in filmstrip */
   pointerx -= empty_edge;
@@ -738,11 +735,6 @@ static gboolean _lib_filmstrip_expose_callback(GtkWidget *widget, GdkEventExpose
   /* get the count of current collection */
   strip->collection_count = dt_collection_get_count (darktable.collection);
 
-  /* get the collection query */
-  const gchar *query=dt_collection_get_query (darktable.collection);
-  if(!query)
-    return FALSE;
-
   if(offset < 0)
     strip->offset = offset = 0;
   if(offset > strip->collection_count-1)
@@ -750,10 +742,9 @@ static gboolean _lib_filmstrip_expose_callback(GtkWidget *widget, GdkEventExpose
 
   // dt_view_set_scrollbar(self, offset, count, max_cols, 0, 1, 1);
 
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1, &stmt, NULL);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, offset - max_cols/2);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, max_cols);
-
+  int ids[max_cols];
+  const int ids_num = dt_collection_get_ids(darktable.collection, offset - max_cols/2, max_cols, ids);
+  int current = 0;
 
   cairo_save(cr);
   cairo_translate(cr, empty_edge, 0.0f);
@@ -765,14 +756,9 @@ static gboolean _lib_filmstrip_expose_callback(GtkWidget *widget, GdkEventExpose
       continue;
     }
 
-    if(step_res != SQLITE_DONE)
+    if(current < ids_num)
     {
-      step_res = sqlite3_step(stmt);
-    }
-
-    if(step_res == SQLITE_ROW)
-    {
-      int id = sqlite3_column_int(stmt, 0);
+      int id = ids[current++];
       // set mouse over id
       if(seli == col)
       {
@@ -786,16 +772,10 @@ static gboolean _lib_filmstrip_expose_callback(GtkWidget *widget, GdkEventExpose
       dt_view_image_expose(&(strip->image_over), id, cr, wd, ht, max_cols, img_pointerx, img_pointery, FALSE);
       cairo_restore(cr);
     }
-    else if (step_res == SQLITE_DONE)
-    {
-      /* do nothing, just add some empty thumb frames */
-    }
-    else goto failure;
+    /* else just add some empty thumb frames */
     cairo_translate(cr, wd, 0.0f);
   }
-failure:
   cairo_restore(cr);
-  sqlite3_finalize(stmt);
 
   if(darktable.gui->center_tooltip == 1) // set in this round
   {
@@ -124,6 +124,61 @@ int main(int argc, char *arg[])
     dt_cache_cleanup(&cache2);
   }
 
+  {
+    // hits only mark entries, make sure garbage collection still keeps the ones in use:
+    dt_cache_t cache3;
+    dt_cache_init(&cache3, 64, 1, 64, 20);
+    dt_cache_set_allocate_callback(&cache3, alloc_dummy, NULL);
+    for(int k=1; k<1000; k++)
+    {
+      dt_cache_read_get(&cache3, 0);
+      dt_cache_read_release(&cache3, 0);
+      dt_cache_read_get(&cache3, k);
+      dt_cache_read_release(&cache3, k);
+      assert(dt_cache_contains(&cache3, 0));
+    }
+    assert(dt_cache_size(&cache3) == lru_check_consistency(&cache3));
+    assert(dt_cache_size(&cache3) <= 20);
+    fprintf(stderr, "[passed] frequently used entry survives garbage collection, have %d entries left.\n",
+            dt_cache_size(&cache3));
+    dt_cache_cleanup(&cache3);
+  }
+
+#ifdef _OPENMP
+  {
+    // benchmark: mostly hits on a hot set, some misses all over the place which allocate and collect garbage.
+    int num_ops = 2000000; // not const, so all gcc versions agree it needs to be listed as shared
+    for(int threads=1; threads<=64; threads*=2)
+    {
+      dt_cache_t cache4;
+      dt_cache_init(&cache4, 1<<16, 64, 64, 50000);
+      dt_cache_set_allocate_callback(&cache4, alloc_dummy, NULL);
+      const double start = omp_get_wtime();
+#  pragma omp parallel default(none) shared(cache4, num_ops) num_threads(threads)
+      {
+        uint32_t seed = omp_get_thread_num() + 1;
+#  pragma omp for schedule(static)
+        for(int k=0; k<num_ops; k++)
+        {
+          // xorshift, rand_r() isn't c99:
+          seed ^= seed << 13;
+          seed ^= seed >> 17;
+          seed ^= seed << 5;
+          const int r = seed & 0x7fffffff;
+          const uint32_t key = (r & 15) ? (r >> 4) % 8192 : (r >> 4) % 1000000;
+          if(dt_cache_read_get(&cache4, key))
+            dt_cache_read_release(&cache4, key);
+        }
+      }
+      const double end = omp_get_wtime();
+      assert(dt_cache_size(&cache4) == lru_check_consistency(&cache4));
+      fprintf(stderr, "[bench] %2d threads: %.2f Mops/s, %d entries\n", threads, num_ops/(end - start)*1e-6,
+              dt_cache_size(&cache4));
+      dt_cache_cleanup(&cache4);
+    }
+  }
+#endif
+
   exit(0);
 }
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
@@ -0,0 +1,143 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2014 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// unit test and benchmark for the dxt1 thumbnail codec, compared against libsquish.
+#include "common/image_compression.h"
+#include "common/image_compression.c"
+#include "external/squish/csquish.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+#include <sys/time.h>
+
+static double
+get_time()
+{
+  struct timeval time;
+  gettimeofday(&time, NULL);
+  return time.tv_sec + time.tv_usec*1e-6;
+}
+
+// something thumbnail-like: smooth gradients, a few hard edges and some noise.
+static void
+fill_image(uint8_t *buf, const int wd, const int ht)
+{
+  srand(42);
+  for(int j=0; j<ht; j++) for(int i=0; i<wd; i++)
+    {
+      uint8_t *p = buf + 4*(j*wd + i);
+      const float x = i/(float)wd, y = j/(float)ht;
+      float c[3] = { 255.0f*x, 255.0f*y, 127.5f + 127.5f*sinf(20.0f*x*y) };
+      if(((i/37) ^ (j/53)) & 1) c[0] = 255.0f - c[0];
+      for(int k=0; k<3; k++) p[k] = CLAMP((int)(c[k] + (rand() % 17) - 8), 0, 255);
+      p[3] = 255;
+    }
+}
+
+static double
+psnr(const uint8_t *a, const uint8_t *b, const int wd, const int ht)
+{
+  double err = 0.0;
+  for(int k=0; k<wd*ht; k++) for(int c=0; c<3; c++)
+    {
+      const double d = a[4*k+c] - (double)b[4*k+c];
+      err += d*d;
+    }
+  err /= 3.0*wd*ht;
+  return err > 0.0 ? 10.0*log10(255.0*255.0/err) : INFINITY;
+}
+
+int main(int argc __attribute__((unused)), char *arg[] __attribute__((unused)))
+{
+  const int wd = 1024, ht = 768, runs = 20;
+  const size_t blocks_size = 8*((wd+3)/4)*((ht+3)/4);
+  uint8_t *in = malloc(4*wd*ht), *out = malloc(4*wd*ht), *ref = malloc(4*wd*ht);
+  uint8_t *blocks = malloc(blocks_size), *squish_blocks = malloc(blocks_size);
+  fill_image(in, wd, ht);
+
+  // decoding has to match squish bit by bit, in both four and three colour mode:
+  for(size_t k=0; k<blocks_size; k++) blocks[k] = rand();
+  dt_image_dxt1_uncompress_8(blocks, out, wd, ht);
+  squish_decompress_image(ref, wd, ht, blocks, squish_dxt1);
+  assert(!memcmp(out, ref, 4*wd*ht));
+  fprintf(stderr, "[dxt] decoding of random blocks is identical to squish\n");
+
+  // odd sizes must not write outside the image, and agree with the full blocks:
+  {
+    const int w2 = 13, h2 = 7;
+    uint8_t small[4*16*8], full[4*16*8];
+    memset(small, 0xab, sizeof(small));
+    dt_image_dxt1_uncompress_8(blocks, small, w2, h2);
+    dt_image_dxt1_uncompress_8(blocks, full, 16, 8);
+    for(int j=0; j<h2; j++) assert(!memcmp(small + 4*w2*j, full + 4*16*j, 4*w2));
+    for(size_t k=4*w2*h2; k<sizeof(small); k++) assert(small[k] == 0xab);
+  }
+
+  // quality, compared to squish range fit and cluster fit:
+  for(int refine=0; refine<=2; refine+=2)
+  {
+    dt_image_dxt1_compress_8(in, blocks, wd, ht, refine);
+    dt_image_dxt1_uncompress_8(blocks, out, wd, ht);
+    squish_decompress_image(ref, wd, ht, blocks, squish_dxt1);
+    assert(!memcmp(out, ref, 4*wd*ht));
+    fprintf(stderr, "[dxt] refine %d: psnr %.2f dB\n", refine, psnr(in, out, wd, ht));
+  }
+  const int squish_flags[2] = { squish_dxt1 | squish_colour_range_fit, squish_dxt1 | squish_colour_cluster_fit };
+  const char *squish_names[2] = { "range fit", "cluster fit" };
+  for(int f=0; f<2; f++)
+  {
+    squish_compress_image(in, wd, ht, squish_blocks, squish_flags[f]);
+    squish_decompress_image(ref, wd, ht, squish_blocks, squish_dxt1);
+    fprintf(stderr, "[dxt] squish %s: psnr %.2f dB\n", squish_names[f], psnr(in, ref, wd, ht));
+  }
+
+  // throughput:
+  const double mpix = wd*(double)ht*runs*1e-6;
+  double start = get_time();
+  for(int r=0; r<runs; r++) dt_image_dxt1_uncompress_8(blocks, out, wd, ht);
+  fprintf(stderr, "[dxt] decode: %.1f MPix/s\n", mpix/(get_time() - start));
+  start = get_time();
+  for(int r=0; r<runs; r++) squish_decompress_image(ref, wd, ht, blocks, squish_dxt1);
+  fprintf(stderr, "[dxt] squish decode: %.1f MPix/s\n", mpix/(get_time() - start));
+  for(int refine=0; refine<=2; refine+=2)
+  {
+    start = get_time();
+    for(int r=0; r<runs; r++) dt_image_dxt1_compress_8(in, blocks, wd, ht, refine);
+    fprintf(stderr, "[dxt] encode, refine %d: %.1f MPix/s\n", refine, mpix/(get_time() - start));
+  }
+  for(int f=0; f<2; f++)
+  {
+    start = get_time();
+    for(int r=0; r<runs; r++) squish_compress_image(in, wd, ht, squish_blocks, squish_flags[f]);
+    fprintf(stderr, "[dxt] squish encode, %s: %.1f MPix/s\n", squish_names[f], mpix/(get_time() - start));
+  }
+
+  free(in);
+  free(out);
+  free(ref);
+  free(blocks);
+  free(squish_blocks);
+  exit(0);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-space on;
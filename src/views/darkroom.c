@@ -503,6 +503,23 @@ static void dt_dev_cleanup_module_accels(dt_iop_module_t *module)
   dt_accel_cleanup_locals_iop(module);
 }
 
+// develop the images left and right of the current one in the filmstrip in advance,
+// or at least start loading the next one if that is switched off.
+static void
+_dev_prefetch_neighbours(dt_develop_t *dev)
+{
+  if(dt_conf_get_int64("darkroom_prefetch_memory") <= 0)
+  {
+    dt_view_filmstrip_prefetch();
+    return;
+  }
+  int next = -1, prev = -1;
+  const int offset = dt_collection_image_offset(dev->image_storage.id);
+  if(dt_collection_get_ids(darktable.collection, offset+1, 1, &next) != 1) next = -1;
+  if(offset <= 0 || dt_collection_get_ids(darktable.collection, offset-1, 1, &prev) != 1) prev = -1;
+  dt_dev_prefetch(dev, next, prev);
+}
+
 static void
 dt_dev_change_image(dt_develop_t *dev, const uint32_t imgid)
 {
@@ -693,8 +710,8 @@ dt_dev_change_image(dt_develop_t *dev, const uint32_t imgid)
   // Signal develop initialize
   dt_control_signal_raise(darktable.signals, DT_SIGNAL_DEVELOP_IMAGE_CHANGED);
 
-  // prefetch next few from first selected image on.
-  dt_view_filmstrip_prefetch();
+  // prefetch the neighbours of the new image.
+  _dev_prefetch_neighbours(dev);
 
   // release pixel pipe mutices
   dt_pthread_mutex_unlock(&dev->preview_pipe_mutex);
@@ -737,17 +754,11 @@ dt_dev_jump_image(dt_develop_t *dev, int diff)
 
     offset = dt_collection_image_offset (orig_imgid);
 
-    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), qin, -1, &stmt, NULL);
-    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, offset + diff);
-    DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, 1);
-    if(sqlite3_step(stmt) == SQLITE_ROW)
+    if(dt_collection_get_ids(darktable.collection, offset + diff, 1, &imgid) == 1)
     {
-      imgid = sqlite3_column_int(stmt, 0);
-
       if (orig_imgid == imgid)
       {
         //nothing to do
-        sqlite3_finalize(stmt);
         return;
       }
 
@@ -758,7 +769,6 @@ dt_dev_jump_image(dt_develop_t *dev, int diff)
       }
 
     }
-    sqlite3_finalize(stmt);
   }
 }
 
@@ -1259,8 +1269,8 @@ void enter(dt_view_t *self)
                             G_CALLBACK(_view_darkroom_filmstrip_activate_callback),
                             self);
 
-  // prefetch next few from first selected image on.
-  dt_view_filmstrip_prefetch();
+  // prefetch the neighbours of the current image.
+  _dev_prefetch_neighbours(dev);
 }
 
 void leave(dt_view_t *self)
@@ -1302,6 +1312,9 @@ void leave(dt_view_t *self)
     dt_image_synch_xmp(dev->image_storage.id);
   }
 
+  // nothing to prepare anymore:
+  dt_dev_prefetch(dev, -1, -1);
+
   // clear gui.
   dev->gui_leaving = 1;
   dt_pthread_mutex_lock(&dev->history_mutex);
@@ -88,6 +88,10 @@ typedef struct dt_library_t
   int full_preview;
   int32_t full_preview_id;
   gboolean offset_changed;
+  // scrolling speed, to prefetch thumbnails ahead of the user:
+  int32_t prefetch_offset;    // offset at the last prefetch round
+  double prefetch_time;       // and when that was
+  float velocity;             // images per second, smoothed, negative when scrolling up
   GdkColor star_color;
   int images_in_row;
 
@@ -98,8 +102,6 @@ typedef struct dt_library_t
   /* prepared and reusable statements */
   struct
   {
-    /* main query statment, should be update on listener signal of collection */
-    sqlite3_stmt *main_query;
     /* select imgid from selected_images */
     sqlite3_stmt *select_imgid_in_selection;
     /* delete from selected_images where imgid != ?1 */
@@ -160,6 +162,41 @@ void switch_layout_to(dt_library_t *lib, int new_layout)
   }
 }
 
+/* queue thumbnails which are likely to be needed next: ahead in scrolling direction, more
+   the faster the user scrolls, and the current page as it would look zoomed out one step. */
+static void _prefetch_thumbnails(dt_library_t *lib, const int32_t offset, const int page,
+                                 const dt_mipmap_size_t mip, const int page_out, const dt_mipmap_size_t mip_out)
+{
+  const double now = dt_get_wtime();
+  const double dt = now - lib->prefetch_time;
+  // a pause starts over:
+  if(lib->prefetch_offset < 0 || dt > 1.0) lib->velocity = 0.0f;
+  else if(dt > 0.0) lib->velocity = 0.5f*lib->velocity + 0.5f*(offset - lib->prefetch_offset)/dt;
+  lib->prefetch_offset = offset;
+  lib->prefetch_time = now;
+
+  // half a page when resting, up to one second of scrolling ahead:
+  const int ahead = CLAMP((int)fabsf(lib->velocity), page/2 + 1, 4*page);
+  const int first = lib->velocity < 0.0f ? MAX(0, offset - ahead) : offset + page;
+  const int count = lib->velocity < 0.0f ? offset - first : ahead;
+
+  dt_mipmap_cache_prefetch_begin(darktable.mipmap_cache);
+  if(count > 0)
+  {
+    int imgids[count];
+    const int num = dt_collection_get_ids(darktable.collection, first, count, imgids);
+    // closest to what's on screen first:
+    for(int k=0; k<num; k++)
+      dt_mipmap_cache_prefetch(darktable.mipmap_cache, imgids[lib->velocity < 0.0f ? num-1-k : k], mip);
+  }
+  if(mip_out != mip && page_out > 0)
+  {
+    int imgids[page_out];
+    const int num = dt_collection_get_ids(darktable.collection, offset, page_out, imgids);
+    for(int k=0; k<num; k++) dt_mipmap_cache_prefetch(darktable.mipmap_cache, imgids[k], mip_out);
+  }
+}
+
 static void move_view(dt_library_t *lib, direction dir)
 {
   const int iir = dt_conf_get_int("plugins/lighttable/images_in_row");
@@ -255,21 +292,6 @@ void zoom_around_image(dt_library_t *lib, double pointerx, double pointery, int
 
 static void _view_lighttable_collection_listener_callback(gpointer instance, gpointer user_data)
 {
-  dt_view_t *self = (dt_view_t *)user_data;
-  dt_library_t *lib = (dt_library_t *)self->data;
-
-  /* check if we can get a query from collection */
-  const gchar *query=dt_collection_get_query (darktable.collection);
-  if(!query)
-    return;
-
-  /* if we have a statment lets clean it */
-  if(lib->statements.main_query)
-    sqlite3_finalize(lib->statements.main_query);
-
-  /* prepare a new main query statement for collection */
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1, &lib->statements.main_query, NULL);
-
   dt_control_queue_redraw_center();
 }
 
@@ -327,6 +349,7 @@ void init(dt_view_t *self)
   lib->full_preview = 0;
   lib->full_preview_id = -1;
   lib->last_mouse_over_id = -1;
+  lib->prefetch_offset = -1;
 
   GtkStyle *style = gtk_rc_get_style_by_paths(gtk_settings_get_default(), "dt-stars", NULL, GTK_TYPE_NONE);
 
@@ -334,14 +357,12 @@ void init(dt_view_t *self)
   lib->star_color.blue = (255/ 65535) * style->fg[GTK_STATE_NORMAL].blue;
   lib->star_color.green = (255/ 65535) * style->fg[GTK_STATE_NORMAL].green;
 
-  /* setup collection listener and initialize main_query statement */
+  /* setup collection listener */
   dt_control_signal_connect(darktable.signals,
                             DT_SIGNAL_COLLECTION_CHANGED,
                             G_CALLBACK(_view_lighttable_collection_listener_callback),
                             (gpointer) self);
 
-  _view_lighttable_collection_listener_callback(NULL,self);
-
   /* initialize reusable sql statements */
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "delete from selected_images where imgid != ?1", -1, &lib->statements.delete_except_arg, NULL);
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "select id from images where group_id = ?1 and id != ?2", -1, &lib->statements.is_grouped, NULL); //TODO: only check in displayed images?
@@ -458,8 +479,8 @@ expose_filemanager (dt_view_t *self, cairo_t *cr, int32_t width, int32_t height,
     return;
   }
 
-  /* do we have a main query collection statement */
-  if(!lib->statements.main_query)
+  /* do we have a collection query to draw */
+  if(!dt_collection_get_query(darktable.collection))
     return;
 
   /* safety check added to be able to work with zoom slider. The
@@ -480,14 +501,6 @@ expose_filemanager (dt_view_t *self, cairo_t *cr, int32_t width, int32_t height,
   /* update scroll borders */
   dt_view_set_scrollbar(self, 0, 1, 1, offset, lib->collection_count, max_rows*iir);
 
-  /* let's reset and reuse the main_query statement */
-  DT_DEBUG_SQLITE3_CLEAR_BINDINGS(lib->statements.main_query);
-  DT_DEBUG_SQLITE3_RESET(lib->statements.main_query);
-
-  /* setup offset and row for the main query */
-  DT_DEBUG_SQLITE3_BIND_INT(lib->statements.main_query, 1, offset);
-  DT_DEBUG_SQLITE3_BIND_INT(lib->statements.main_query, 2, max_rows*iir);
-
   if(mouse_over_id != -1)
   {
     const dt_image_t *mouse_over_image = dt_image_cache_read_get(darktable.image_cache, mouse_over_id);
@@ -504,17 +517,8 @@ expose_filemanager (dt_view_t *self, cairo_t *cr, int32_t width, int32_t height,
   // prefetch the ids so that we can peek into the future to see if there are adjacent images in the same group.
   int *query_ids = (int*)calloc(max_rows*max_cols, sizeof(int));
   if(!query_ids) goto after_drawing;
-  for(int row = 0; row < max_rows; row++)
-  {
-    for(int col = 0; col < max_cols; col++)
-    {
-      if(sqlite3_step(lib->statements.main_query) == SQLITE_ROW)
-        query_ids[row*iir+col] = sqlite3_column_int(lib->statements.main_query, 0);
-      else goto end_query_cache;
-    }
-  }
+  dt_collection_get_ids(darktable.collection, offset, max_rows*iir, query_ids);
 
-end_query_cache:
   mouse_over_id = -1;
   cairo_save(cr);
   int current_image =0;
@@ -711,38 +715,19 @@ escape_border_loop:
   cairo_restore(cr);
 after_drawing:
   /* check if offset was changed and we need to prefetch thumbs */
-  if (offset_changed)
+  if (offset_changed || offset != lib->prefetch_offset)
   {
-    int32_t imgids_num = 0;
-    const int prefetchrows = .5*max_rows+1;
-    int32_t imgids[prefetchrows*iir];
-    /* clear and reset main query */
-    DT_DEBUG_SQLITE3_CLEAR_BINDINGS(lib->statements.main_query);
-    DT_DEBUG_SQLITE3_RESET(lib->statements.main_query);
-
-    /* setup offest and row for prefetch */
-    DT_DEBUG_SQLITE3_BIND_INT(lib->statements.main_query, 1, offset + max_rows*iir);
-    DT_DEBUG_SQLITE3_BIND_INT(lib->statements.main_query, 2, prefetchrows*iir);
-
-    // prefetch jobs in inverse order: supersede previous jobs: most important last
-    while(sqlite3_step(lib->statements.main_query) == SQLITE_ROW && imgids_num < prefetchrows*iir)
-      imgids[imgids_num++] = sqlite3_column_int(lib->statements.main_query, 0);
-
-    float imgwd = iir == 1 ? 0.97 : 0.8;
-    dt_mipmap_size_t mip = dt_mipmap_cache_get_matching_size(
-                             darktable.mipmap_cache,
-                             imgwd*wd, imgwd*(iir==1?height:ht));
-    while(imgids_num > 0)
-    {
-      imgids_num --;
-      dt_mipmap_buffer_t buf;
-      dt_mipmap_cache_read_get(
-        darktable.mipmap_cache,
-        &buf,
-        imgids[imgids_num],
-        mip,
-        DT_MIPMAP_PREFETCH);
-    }
+    lib->offset_changed = FALSE;
+    const float imgwd = iir == 1 ? 0.97 : 0.8;
+    const dt_mipmap_size_t mip = dt_mipmap_cache_get_matching_size(
+                                   darktable.mipmap_cache,
+                                   imgwd*wd, imgwd*(iir==1?height:ht));
+    // one more image per row, for zooming out:
+    const float wd_out = width/(float)(iir+1);
+    const int max_rows_out = 1 + (int)(height/wd_out + .5);
+    const dt_mipmap_size_t mip_out = dt_mipmap_cache_get_matching_size(
+                                       darktable.mipmap_cache, 0.8f*wd_out, 0.8f*wd_out);
+    _prefetch_thumbnails(lib, offset, max_rows*iir, mip, max_rows_out*(iir+1), mip_out);
   }
 
   if(query_ids)
@@ -809,7 +794,7 @@ expose_zoomable (dt_view_t *self, cairo_t *cr, int32_t width, int32_t height, in
     zoom_y = lib->select_offset_y - /* (zoom == 1 ? 2. : 1.)*/pointery;
   }
 
-  if(!lib->statements.main_query)
+  if(!dt_collection_get_query(darktable.collection))
     return;
 
   if     (track == 0);
@@ -951,17 +936,13 @@ expose_zoomable (dt_view_t *self, cairo_t *cr, int32_t width, int32_t height, in
       continue;
     }
 
-    /* clear and reset main query */
-    DT_DEBUG_SQLITE3_CLEAR_BINDINGS(lib->statements.main_query);
-    DT_DEBUG_SQLITE3_RESET(lib->statements.main_query);
-
-    DT_DEBUG_SQLITE3_BIND_INT(lib->statements.main_query, 1, offset);
-    DT_DEBUG_SQLITE3_BIND_INT(lib->statements.main_query, 2, max_cols);
+    int row_ids[max_cols];
+    const int row_ids_num = dt_collection_get_ids(darktable.collection, offset, max_cols, row_ids);
     for(int col = 0; col < max_cols; col++)
     {
-      if(sqlite3_step(lib->statements.main_query) == SQLITE_ROW)
+      if(col < row_ids_num)
       {
-        id = sqlite3_column_int(lib->statements.main_query, 0);
+        id = row_ids[col];
 
         // set mouse over id
         if((zoom == 1 && mouse_over_id < 0) || ((!pan || track) && seli == col && selj == row))
@@ -1047,7 +1028,7 @@ void expose_full_preview(dt_view_t *self, cairo_t *cr, int32_t width, int32_t he
     {
       /* We need to augment the current main query a bit to fetch the
        * row we need. */
-      const char *main_query = sqlite3_sql(lib->statements.main_query);
+      const char *main_query = dt_collection_get_query(darktable.collection);
       stmt_string = g_strdup_printf(
                       "select images.id as id from (%s) as s1 %s",
                       main_query, filter_criteria);
@@ -1250,21 +1250,13 @@ void dt_view_filmstrip_scroll_relative(const int diff, int offset)
   if(qin)
   {
     int imgid = -1;
-    sqlite3_stmt *stmt;
-
-    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), qin, -1, &stmt, NULL);
-    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, offset + diff);
-    DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, 1);
-    if(sqlite3_step(stmt) == SQLITE_ROW)
+    if(dt_collection_get_ids(darktable.collection, offset + diff, 1, &imgid) == 1)
     {
-      imgid = sqlite3_column_int(stmt, 0);
-
       if (!darktable.develop->image_loading)
       {
         dt_view_filmstrip_scroll_to_image(darktable.view_manager, imgid, TRUE);
       }
     }
-    sqlite3_finalize(stmt);
   }
 
 }
@@ -1323,18 +1315,13 @@ void dt_view_filmstrip_prefetch()
     offset = dt_collection_image_offset(imgid);
   }
 
-  sqlite3_stmt *stmt;
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), qin, -1, &stmt, NULL);
   // only get one more image:
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, offset+1);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, offset+2);
-  if(sqlite3_step(stmt) == SQLITE_ROW)
+  int prefetchid = -1;
+  if(dt_collection_get_ids(darktable.collection, offset+1, 1, &prefetchid) == 1)
   {
-    const uint32_t prefetchid = sqlite3_column_int(stmt, 0);
     // dt_control_log("prefetching image %u", prefetchid);
     dt_mipmap_cache_read_get(darktable.mipmap_cache, NULL, prefetchid, DT_MIPMAP_FULL, DT_MIPMAP_PREFETCH);
   }
-  sqlite3_finalize(stmt);
 }
 
 void dt_view_manager_view_toolbox_add(dt_view_manager_t *vm,GtkWidget *tool)